@@ -44,3 +44,38 @@ concurrent_queue<std::string, std::mutex> queue;
 std::string str;
 queue.wait_pull(str);
 //@ [wait_pull]
+
+//@ [pull_with]
+concurrent_queue<std::string, std::mutex> queue;
+...
+queue.pull_with([](std::string &str) {
+    std::cout << str;
+});
+//@ [pull_with]
+
+//@ [pull_all]
+concurrent_queue<std::string, std::mutex> queue;
+...
+for(std::string &str : queue.pull_all())
+    std::cout << str;
+//@ [pull_all]
+
+//@ [for_each]
+concurrent_queue<std::string, std::mutex> queue;
+...
+queue.for_each([](const std::string &str) {
+    std::cout << str;
+});
+//@ [for_each]
+
+//@ [try_push_until]
+concurrent_queue<std::string, spinlock> queue;
+...
+auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+if(!queue.try_push_until(deadline, "request"))
+    std::cerr << "missed the deadline or closed";
+...
+std::string str;
+if(queue.try_pull_until(deadline, str))
+    std::cout << str;
+//@ [try_push_until]
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "../concurrent-utils/concurrent-queue.h"
+#include "../concurrent-utils/concurrent-stack.h"
+#include "scenario.h"
+
+using namespace concurrent_utils;
+
+namespace {
+
+/**
+ * @brief Command line selection of the scenario matrix
+ *
+ * Every option takes a comma separated list, e.g.
+ * @code
+ * concurrent-utils-bench --producers=1,4 --consumers=1,4 \
+ *     --locks=spinlock --payloads=string64 --ops=500000
+ * @endcode
+ * An empty list of names selects everything.
+ */
+struct options : bench::selection
+{
+    std::vector<unsigned> producers { 1, 2, 4 };
+    std::vector<unsigned> consumers { 1, 2, 4 };
+    std::vector<std::string> payloads;
+    std::size_t operations = 1000000;
+    std::size_t sample_every = 64;
+};
+
+std::vector<unsigned> split_numbers(const char *list)
+{
+    std::vector<unsigned> ret;
+    for(auto &s : bench::split(list)) {
+        const unsigned n = std::strtoul(s.c_str(), nullptr, 10);
+        if(n) ret.push_back(n);
+    }
+    return ret;
+}
+
+bool parse(int argc, char **argv, options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i], *value = std::strchr(arg, '=');
+        const std::string key(arg, value ? value - arg : std::strlen(arg));
+        if(value) ++value;
+
+        if(key == "--help" || !value) return false;
+        else if(key == "--producers") opts.producers = split_numbers(value);
+        else if(key == "--consumers") opts.consumers = split_numbers(value);
+        else if(key == "--queues") opts.queues = bench::split(value);
+        else if(key == "--locks") opts.locks = bench::split(value);
+        else if(key == "--payloads") opts.payloads = bench::split(value);
+        else if(key == "--ops") opts.operations = std::strtoull(value, nullptr, 10);
+        else if(key == "--sample") opts.sample_every = std::strtoull(value, nullptr, 10);
+        else return false;
+    }
+    return !opts.producers.empty() && !opts.consumers.empty()
+        && opts.operations && opts.sample_every;
+}
+
+void usage(const char *self)
+{
+    std::fprintf(stderr,
+        "usage: %s [--producers=1,2,4] [--consumers=1,2,4] [--queues=...]\n"
+        "       [--locks=mutex,spinlock,profiled,none] [--payloads=size_t,string64,bytes256]\n"
+        "       [--ops=1000000] [--sample=64]\n", self);
+}
+
+void print_header()
+{
+    std::printf("%-18s %-9s %-9s %4s %4s %14s %10s %10s %10s %12s\n",
+                "queue", "lock", "payload", "P", "C", "ops/sec",
+                "mean(ns)", "p50(ns)", "p99(ns)", "max(ns)");
+}
+
+void print_row(const char *queue, const char *lock, const char *payload,
+               const bench::cell &c, const bench::result &r)
+{
+    std::printf("%-18s %-9s %-9s %4u %4u %14.0f %10.0f %10.0f %10.0f %12.0f\n",
+                queue, lock, payload, c.producers, c.consumers, r.ops_per_sec,
+                r.lat_mean_ns, r.lat_p50_ns, r.lat_p99_ns, r.lat_max_ns);
+    if(r.pulled != c.operations / c.producers * c.producers)
+        std::printf("  ^ lost items: pulled %zu\n", r.pulled);
+    std::fflush(stdout);
+}
+
+/**
+ * @brief Runs all payloads and producer/consumer shapes
+ * for a queue implementation with a fixed lock
+ */
+struct run_matrix
+{
+    const options &opts;
+
+  template <typename Kind>
+    void operator()(Kind kind, const char *queue_name, const char *lock_name) const
+    {
+        run_shapes<std::size_t>(kind, queue_name, lock_name, "size_t");
+        run_shapes<std::string>(kind, queue_name, lock_name, "string64");
+        run_shapes<bench::bytes256>(kind, queue_name, lock_name, "bytes256");
+    }
+
+  template <typename Payload, typename Kind>
+    void run_shapes(Kind, const char *queue_name, const char *lock_name,
+                    const char *payload_name) const
+    {
+        if(!bench::selected(opts.payloads, payload_name))
+            return;
+
+        for(auto producers : opts.producers)
+            for(auto consumers : opts.consumers)
+            {
+                const bench::cell c { producers, consumers,
+                                      opts.operations, opts.sample_every };
+                typename Kind::template type<bench::message<Payload>> queue;
+                const auto r = bench::run_cell<Payload>(queue, c);
+                print_row(queue_name, lock_name, payload_name, c, r);
+            }
+    }
+};
+
+template <typename Tp, typename Lock>
+    using metered_queue = concurrent_queue<Tp, Lock, std::allocator<Tp>, queue_metrics>;
+
+template <typename Tp, typename>
+    using lock_free_stack = concurrent_stack<Tp>;
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+    if(!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    print_header();
+    const run_matrix run { opts };
+    bench::sweep<bench::locked_queue>(opts, "concurrent_queue", run);
+    bench::sweep<metered_queue>(opts, "metered_queue", run);
+    bench::sweep<bench::spinning_queue>(opts, "spinning_queue", run);
+    bench::sweep_lock_free<lock_free_stack>(opts, "concurrent_stack", run);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent-utils/reclamation.h"
+#include "scenario.h"
+
+using namespace concurrent_utils;
+
+namespace {
+
+/**
+ * @brief Command line selection of the reclamation benchmark
+ *
+ * @code
+ * concurrent-utils-bench-reclamation --threads=1,4 --writes=1,50 \
+ *     --schemes=hazard,epoch --ops=2000000
+ * @endcode
+ */
+struct options
+{
+    std::vector<unsigned> threads { 1, 2, 4 };
+    std::vector<unsigned> writes { 1, 10, 50 };
+    std::vector<std::string> schemes;
+    std::size_t operations = 2000000;
+    std::size_t slots = 64;
+};
+
+std::vector<unsigned> split_numbers(const char *list)
+{
+    std::vector<unsigned> ret;
+    for(auto &s : bench::split(list))
+        ret.push_back(std::strtoul(s.c_str(), nullptr, 10));
+    return ret;
+}
+
+bool parse(int argc, char **argv, options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i], *value = std::strchr(arg, '=');
+        const std::string key(arg, value ? value - arg : std::strlen(arg));
+        if(value) ++value;
+
+        if(key == "--help" || !value) return false;
+        else if(key == "--threads") opts.threads = split_numbers(value);
+        else if(key == "--writes") opts.writes = split_numbers(value);
+        else if(key == "--schemes") opts.schemes = bench::split(value);
+        else if(key == "--ops") opts.operations = std::strtoull(value, nullptr, 10);
+        else if(key == "--slots") opts.slots = std::strtoull(value, nullptr, 10);
+        else return false;
+    }
+    return !opts.threads.empty() && !opts.writes.empty()
+        && opts.operations && opts.slots;
+}
+
+void usage(const char *self)
+{
+    std::fprintf(stderr,
+        "usage: %s [--threads=1,2,4] [--writes=1,10,50] [--schemes=leak,hazard,epoch]\n"
+        "       [--ops=2000000] [--slots=64]\n", self);
+}
+
+struct node : reclaimable
+{
+    std::size_t value;
+    explicit node(std::size_t v) : value(v) { }
+};
+
+// Never reclaims while running, the baseline of the other schemes
+struct leak_scheme
+{
+    struct domain
+    {
+        std::vector<std::vector<node*>> retired;
+        explicit domain(unsigned threads) : retired(threads) { }
+        ~domain() { for(auto &v : retired) for(auto *p : v) delete p; }
+    };
+
+  template <typename Func>
+    static std::size_t read(domain&, unsigned, const std::atomic<node*> &src, Func &&f)
+    { return f(src.load(std::memory_order_acquire)); }
+
+    static void retire(domain &d, unsigned idx, node *p)
+    { d.retired[idx].push_back(p); }
+};
+
+struct hazard_scheme
+{
+    struct domain : hazard_domain<>
+    { explicit domain(unsigned) { } };
+
+  template <typename Func>
+    static std::size_t read(domain &d, unsigned, const std::atomic<node*> &src, Func &&f)
+    {
+        hazard_pointer<hazard_domain<>> hp(d);
+        return f(hp.protect(src));
+    }
+
+    static void retire(domain &d, unsigned, node *p) { d.retire(p); }
+};
+
+struct epoch_scheme
+{
+    struct domain : epoch_domain<>
+    { explicit domain(unsigned) { } };
+
+  template <typename Func>
+    static std::size_t read(domain &d, unsigned, const std::atomic<node*> &src, Func &&f)
+    {
+        epoch_guard<epoch_domain<>> guard(d);
+        return f(src.load(std::memory_order_acquire));
+    }
+
+    static void retire(domain &d, unsigned, node *p) { d.retire(p); }
+};
+
+/**
+ * @brief Runs reads and replacements of random slots
+ *
+ * Every operation reads a node through the scheme, a share of
+ * @a writes percents also replaces the node and retires the old one.
+ * @return Mean time of an operation in nanoseconds, per thread.
+ */
+template <typename Scheme>
+double run(unsigned threads, unsigned writes, const options &opts)
+{
+    std::vector<std::atomic<node*>> slots(opts.slots);
+    for(std::size_t i = 0; i < slots.size(); ++i)
+        slots[i].store(new node(i));
+
+    const std::size_t per_thread = opts.operations / threads;
+    std::atomic<unsigned> started { 0 };
+    std::atomic<std::size_t> checksum { 0 };
+    std::vector<std::thread> workers;
+    double seconds = 0;
+    {
+        typename Scheme::domain domain(threads);
+        for(unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([&, t]() {
+                std::uint64_t rnd = 0x9e3779b97f4a7c15ull * (t + 1);
+                std::size_t sum = 0;
+                started.fetch_add(1);
+                while(started.load() < threads) std::this_thread::yield();
+
+                for(std::size_t i = 0; i < per_thread; ++i) {
+                    rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+                    auto &slot = slots[rnd % slots.size()];
+                    sum += Scheme::read(domain, t, slot,
+                        [](const node *p) { return p->value; });
+                    if(rnd % 100 < writes)
+                        Scheme::retire(domain, t, slot.exchange(
+                            new node(i), std::memory_order_acq_rel));
+                }
+                checksum += sum;
+            });
+
+        const auto start = std::chrono::steady_clock::now();
+        for(auto &w : workers)
+            w.join();
+        seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        for(auto &slot : slots)
+            delete slot.load();
+    }
+    return seconds * 1e9 / per_thread;
+}
+
+template <typename Scheme>
+void sweep(const options &opts, const char *name)
+{
+    if(!bench::selected(opts.schemes, name))
+        return;
+    for(auto threads : opts.threads)
+        for(auto writes : opts.writes) {
+            std::printf("%-8s %8u %8u%% %12.1f\n", name, threads, writes,
+                        run<Scheme>(threads, writes, opts));
+            std::fflush(stdout);
+        }
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+    if(!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%-8s %8s %9s %12s\n", "scheme", "threads", "writes", "ns/op");
+    sweep<leak_scheme>(opts, "leak");
+    sweep<hazard_scheme>(opts, "hazard");
+    sweep<epoch_scheme>(opts, "epoch");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent-utils/concurrent-queue.h"
+#include "../concurrent-utils/policy-queue.h"
+#include "../concurrent-utils/queue-trace.h"
+#include "replay.h"
+
+using namespace concurrent_utils;
+
+namespace {
+
+/**
+ * @brief Command line of the replay benchmark
+ *
+ * Replays a trace recorded by trace_recorder against every selected
+ * queue and lock, or synthesizes a bursty trace to try it out:
+ * @code
+ * concurrent-utils-bench-replay --synthesize=bursts.trace
+ * concurrent-utils-bench-replay --trace=bursts.trace --locks=mutex,spinlock
+ * @endcode
+ */
+struct options : bench::selection
+{
+    std::string trace, synthesize;
+    double speed = 1.0;
+    unsigned producers = 4, consumers = 2;
+    std::size_t bursts = 200;
+};
+
+bool parse(int argc, char **argv, options &opts)
+{
+    for(int i = 1; i < argc; ++i) {
+        const char *arg = argv[i], *value = std::strchr(arg, '=');
+        const std::string key(arg, value ? value - arg : std::strlen(arg));
+        if(value) ++value;
+
+        if(key == "--help" || !value) return false;
+        else if(key == "--trace") opts.trace = value;
+        else if(key == "--synthesize") opts.synthesize = value;
+        else if(key == "--queues") opts.queues = bench::split(value);
+        else if(key == "--locks") opts.locks = bench::split(value);
+        else if(key == "--speed") opts.speed = std::strtod(value, nullptr);
+        else if(key == "--producers") opts.producers = std::strtoul(value, nullptr, 10);
+        else if(key == "--consumers") opts.consumers = std::strtoul(value, nullptr, 10);
+        else if(key == "--bursts") opts.bursts = std::strtoull(value, nullptr, 10);
+        else return false;
+    }
+    return (opts.trace.empty() != opts.synthesize.empty()) && opts.speed > 0
+        && opts.producers && opts.consumers && opts.bursts;
+}
+
+void usage(const char *self)
+{
+    std::fprintf(stderr,
+        "usage: %s --trace=FILE [--queues=...] [--locks=mutex,spinlock,profiled,none]\n"
+        "       [--speed=1.0]\n"
+        "       %s --synthesize=FILE [--producers=4] [--consumers=2] [--bursts=200]\n",
+        self, self);
+}
+
+/**
+ * @brief Records a trace of producers pushing bursts of items
+ * of mixed sizes with random pauses in between
+ */
+void synthesize(const options &opts)
+{
+    traced_queue<concurrent_queue<std::string, std::mutex>> queue;
+    trace_recorder recorder;
+    queue.trace(&recorder);
+    recorder.start();
+
+    std::atomic_uint producers_left { opts.producers };
+    std::vector<std::thread> threads;
+    for(unsigned p = 0; p < opts.producers; ++p)
+        threads.emplace_back([&, p]() {
+            std::mt19937 rng(p);
+            std::uniform_int_distribution<unsigned> pause(0, 2000), burst(1, 64);
+            const std::size_t sizes[] = { 16, 16, 64, 64, 64, 512, 4096 };
+            std::uniform_int_distribution<std::size_t> size(0, std::size(sizes) - 1);
+            for(std::size_t b = 0; b < opts.bursts; ++b) {
+                std::this_thread::sleep_for(std::chrono::microseconds(pause(rng)));
+                for(unsigned n = burst(rng); n; --n)
+                    queue.push(sizes[size(rng)], 'x');
+            }
+            if(producers_left.fetch_sub(1) == 1)
+                queue.close();
+        });
+    for(unsigned c = 0; c < opts.consumers; ++c)
+        threads.emplace_back([&]() {
+            std::string item;
+            while(queue.wait_pull(item) || queue.pull(item))
+                ;
+        });
+    for(auto &t : threads)
+        t.join();
+
+    recorder.stop();
+    recorder.save(opts.synthesize);
+    std::printf("%zu events of %zu threads written to %s\n",
+                recorder.events().size(), recorder.threads(),
+                opts.synthesize.c_str());
+}
+
+void print_header()
+{
+    std::printf("%-18s %-9s %12s %10s %10s %10s %12s %10s %10s %12s\n",
+                "queue", "lock", "ops/sec", "mean(ns)", "p50(ns)", "p99(ns)",
+                "max(ns)", "lag50(ns)", "lag99(ns)", "lagmax(ns)");
+}
+
+void print_row(const char *queue, const char *lock, const bench::replay_result &r)
+{
+    std::printf("%-18s %-9s %12.0f %10.0f %10.0f %10.0f %12.0f %10.0f %10.0f %12.0f\n",
+                queue, lock, r.ops_per_sec, r.lat_mean_ns, r.lat_p50_ns,
+                r.lat_p99_ns, r.lat_max_ns, r.lag_p50_ns, r.lag_p99_ns, r.lag_max_ns);
+    if(r.pulled != r.pushed)
+        std::printf("  ^ lost items: pushed %zu, pulled %zu\n", r.pushed, r.pulled);
+    std::fflush(stdout);
+}
+
+template <typename Tp, typename>
+    using bounded_ring = make_queue<Tp, bounded<1024>>;
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+    if(!parse(argc, argv, opts)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if(!opts.synthesize.empty()) {
+            synthesize(opts);
+            return EXIT_SUCCESS;
+        }
+
+        const std::vector<trace_event> events = trace_recorder::load(opts.trace);
+        auto run = [&](auto kind, const char *queue_name, const char *lock_name) {
+            typename decltype(kind)::template type<bench::message<std::string>> queue;
+            print_row(queue_name, lock_name, bench::replay(queue, events, opts.speed));
+        };
+        print_header();
+        bench::sweep<bench::locked_queue>(opts, "concurrent_queue", run);
+        bench::sweep<bench::spinning_queue>(opts, "spinning_queue", run);
+        bench::sweep_lock_free<bounded_ring>(opts, "bounded_ring", run);
+    } catch(const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
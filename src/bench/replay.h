@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_BENCH_REPLAY_H
+#define CONCURRENT_UTILS_BENCH_REPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent-utils/queue-trace.h"
+#include "../concurrent-utils/wait-strategies.h"
+#include "scenario.h"
+
+namespace bench {
+
+/**
+ * @brief Measurements of a replayed trace
+ *
+ * Lag is how late operations were issued against the schedule
+ * of the trace, because of the queue blocking the thread or the
+ * thread falling behind.
+ */
+struct replay_result : result
+{
+    double lag_p50_ns = 0, lag_p99_ns = 0, lag_max_ns = 0;
+    std::size_t pushed = 0;
+};
+
+namespace details {
+
+    // Sleeps until shortly before @a target, then spins
+    inline void wait_until(clock_type::time_point target)
+    {
+        constexpr auto spin_window = std::chrono::microseconds(50);
+        if(target - clock_type::now() > 2 * spin_window)
+            std::this_thread::sleep_until(target - spin_window);
+        while(clock_type::now() < target)
+            concurrent_utils::details::cpu_relax();
+    }
+
+} // namespace details
+
+/**
+ * @brief Re-drives @a queue with the operations of a trace
+ *
+ * Every thread of the trace gets a thread of its own, which issues
+ * its operations at their recorded offsets divided by @a speed.
+ * Pushes carry strings of the recorded sizes, pulls wait for items.
+ * The queue is closed once all pushes are done, pulls failing after
+ * that are skipped, remaining items are drained at the end.
+ *
+ * @a Queue must provide push(stamp, payload), pull(value),
+ * wait_pull(value) and close() in the manner of concurrent_queue.
+ */
+template <typename Queue>
+replay_result replay(Queue &queue,
+                     const std::vector<concurrent_utils::trace_event> &events,
+                     double speed = 1.0)
+{
+    using concurrent_utils::trace_event;
+    using concurrent_utils::trace_op;
+
+    unsigned threads_count = 0;
+    for(auto &e : events)
+        threads_count = std::max(threads_count, unsigned(e.thread) + 1);
+
+    std::vector<std::vector<trace_event>> schedule(threads_count);
+    for(auto &e : events)
+        schedule[e.thread].push_back(e);
+
+    // threads stop counting as producers after their last push
+    std::vector<std::size_t> last_push(threads_count, 0);
+    unsigned producers = 0;
+    for(unsigned t = 0; t < threads_count; ++t)
+        for(std::size_t i = 0; i < schedule[t].size(); ++i)
+            if(schedule[t][i].op == trace_op::push) {
+                producers += !last_push[t];
+                last_push[t] = i + 1;
+            }
+
+    const unsigned total = threads_count + 1;
+    std::atomic_uint started { 0 }, producers_left { producers };
+    std::vector<std::vector<std::uint64_t>> samples(threads_count), lags(threads_count);
+    std::vector<std::size_t> pulled(threads_count, 0), pushed(threads_count, 0);
+    clock_type::time_point start;
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count);
+
+    auto worker = [&](unsigned idx) {
+        auto &my_samples = samples[idx];
+        auto &my_lags = lags[idx];
+        my_lags.reserve(schedule[idx].size());
+        message<std::string> m;
+        bool closed = false;
+        details::arrive_and_wait(started, total);
+
+        for(std::size_t i = 0; i < schedule[idx].size(); ++i) {
+            const trace_event &e = schedule[idx][i];
+            const auto target = start + std::chrono::nanoseconds(
+                static_cast<std::uint64_t>(e.time_ns / speed));
+            details::wait_until(target);
+            my_lags.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_type::now() - target).count());
+
+            if(e.op == trace_op::push) {
+                queue.push(clock_type::now(), std::string(e.size, 'x'));
+                ++pushed[idx];
+                if(i + 1 == last_push[idx]
+                        && producers_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    queue.close();
+            } else if(!closed) {
+                if(queue.wait_pull(m) || queue.pull(m)) {
+                    details::consume(m, my_samples);
+                    ++pulled[idx];
+                } else
+                    closed = true;
+            }
+        }
+    };
+
+    for(unsigned i = 0; i < threads_count; ++i)
+        threads.emplace_back(worker, i);
+    // all threads share the same start of the schedule
+    start = clock_type::now() + std::chrono::milliseconds(1);
+    details::arrive_and_wait(started, total);
+    for(auto &t : threads)
+        t.join();
+    if(!producers)
+        queue.close();
+
+    replay_result res;
+    std::vector<std::uint64_t> drained;
+    for(message<std::string> m; queue.pull(m); ++res.pulled)
+        details::consume(m, drained);
+    res.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    for(auto n : pulled) res.pulled += n;
+    for(auto n : pushed) res.pushed += n;
+    res.ops_per_sec = (res.pulled + res.pushed) / res.seconds;
+
+    for(auto &s : samples)
+        drained.insert(drained.end(), s.begin(), s.end());
+    details::summarize(drained, res);
+
+    std::vector<std::uint64_t> merged;
+    for(auto &l : lags)
+        merged.insert(merged.end(), l.begin(), l.end());
+    if(!merged.empty()) {
+        std::sort(merged.begin(), merged.end());
+        res.lag_p50_ns = merged[merged.size() / 2];
+        res.lag_p99_ns = merged[merged.size() * 99 / 100];
+        res.lag_max_ns = merged.back();
+    }
+    return res;
+}
+
+} // namespace bench
+
+#endif // CONCURRENT_UTILS_BENCH_REPLAY_H
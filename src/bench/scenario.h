@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_BENCH_SCENARIO_H
+#define CONCURRENT_UTILS_BENCH_SCENARIO_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../concurrent-utils/concurrent-queue.h"
+#include "../concurrent-utils/profiled-lock.h"
+
+namespace bench {
+
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief Item travelling through the queue under test
+ *
+ * Every sampled message carries the time point of its push,
+ * unsampled ones carry the clock's epoch.
+ */
+template <typename Payload>
+struct message
+{
+    clock_type::time_point stamp;
+    Payload payload;
+
+    message() = default;
+    message(clock_type::time_point astamp, Payload &&apayload)
+        : stamp(astamp), payload(std::move(apayload)) { }
+};
+
+/// 256 bytes of trivially copyable data
+using bytes256 = std::array<char, 256>;
+
+template <typename Payload> Payload make_payload(std::size_t);
+
+template <>
+inline std::size_t make_payload<std::size_t>(std::size_t i) { return i; }
+
+template <>
+inline std::string make_payload<std::string>(std::size_t i)
+{
+    // longer than any small-string buffer, forces a heap allocation
+    std::string s(64, 'x');
+    s[0] = static_cast<char>(i);
+    return s;
+}
+
+template <>
+inline bytes256 make_payload<bytes256>(std::size_t i)
+{
+    bytes256 b;
+    b.fill(static_cast<char>(i));
+    return b;
+}
+
+/**
+ * @brief Single cell of the scenario matrix
+ */
+struct cell
+{
+    unsigned producers, consumers;
+    std::size_t operations;
+    std::size_t sample_every;
+};
+
+/**
+ * @brief Measurements of a single cell
+ *
+ * Latency is measured from the push of a message
+ * until it has been pulled by a consumer.
+ */
+struct result
+{
+    double seconds = 0;
+    double ops_per_sec = 0;
+    double lat_mean_ns = 0, lat_p50_ns = 0, lat_p99_ns = 0, lat_max_ns = 0;
+    std::size_t pulled = 0;
+};
+
+namespace details {
+
+    // Spins until all participants have arrived
+    inline void arrive_and_wait(std::atomic_uint &counter, unsigned total)
+    {
+        counter.fetch_add(1, std::memory_order_acq_rel);
+        while(counter.load(std::memory_order_acquire) < total)
+            std::this_thread::yield();
+    }
+
+  template <typename Payload>
+    inline void consume(const message<Payload> &m,
+                        std::vector<std::uint64_t> &samples)
+    {
+        if(m.stamp == clock_type::time_point())
+            return;
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - m.stamp).count());
+    }
+
+    inline void summarize(std::vector<std::uint64_t> &samples, result &res)
+    {
+        if(samples.empty())
+            return;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for(auto s : samples) sum += s;
+        res.lat_mean_ns = sum / samples.size();
+        res.lat_p50_ns = samples[samples.size() / 2];
+        res.lat_p99_ns = samples[samples.size() * 99 / 100];
+        res.lat_max_ns = samples.back();
+    }
+
+} // namespace details
+
+/**
+ * @brief Runs producers and consumers over @a queue
+ *
+ * @a Queue must provide push(stamp, payload), pull(value),
+ * wait_pull(value) and close() in the manner of concurrent_queue.
+ * Producers split the operations evenly, the queue is closed
+ * as soon as all of them have finished, consumers drain
+ * the remaining items afterwards.
+ */
+template <typename Payload, typename Queue>
+result run_cell(Queue &queue, const cell &c)
+{
+    // the calling thread joins the start barrier last
+    const unsigned total = c.producers + c.consumers + 1;
+    const std::size_t per_producer = c.operations / c.producers;
+    std::atomic_uint started { 0 }, producers_left { c.producers };
+    std::vector<std::vector<std::uint64_t>> samples(c.consumers);
+    std::vector<std::size_t> pulled(c.consumers, 0);
+    std::vector<std::thread> threads;
+    threads.reserve(c.producers + c.consumers);
+
+    auto producer = [&](unsigned idx) {
+        details::arrive_and_wait(started, total);
+        const std::size_t first = idx * per_producer;
+        for(std::size_t i = first; i < first + per_producer; ++i) {
+            const auto stamp = (i % c.sample_every)
+                    ? clock_type::time_point() : clock_type::now();
+            queue.push(stamp, make_payload<Payload>(i));
+        }
+        if(producers_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            queue.close();
+    };
+
+    auto consumer = [&](unsigned idx) {
+        auto &my_samples = samples[idx];
+        my_samples.reserve(c.operations / c.sample_every / c.consumers + 1);
+        message<Payload> m;
+        std::size_t n = 0;
+        details::arrive_and_wait(started, total);
+        for(; queue.wait_pull(m); ++n)
+            details::consume(m, my_samples);
+        for(; queue.pull(m); ++n)
+            details::consume(m, my_samples);
+        pulled[idx] = n;
+    };
+
+    for(unsigned i = 0; i < c.consumers; ++i)
+        threads.emplace_back(consumer, i);
+    for(unsigned i = 0; i < c.producers; ++i)
+        threads.emplace_back(producer, i);
+    details::arrive_and_wait(started, total);
+    const auto start = clock_type::now();
+    for(auto &t : threads)
+        t.join();
+    const auto finish = clock_type::now();
+
+    result res;
+    res.seconds = std::chrono::duration<double>(finish - start).count();
+    for(auto n : pulled) res.pulled += n;
+    res.ops_per_sec = res.pulled / res.seconds;
+
+    std::vector<std::uint64_t> merged;
+    for(auto &s : samples)
+        merged.insert(merged.end(), s.begin(), s.end());
+    details::summarize(merged, res);
+    return res;
+}
+
+/**
+ * @brief Splits comma separated @a list of a command line option,
+ * skipping empty items
+ */
+inline std::vector<std::string> split(const char *list)
+{
+    std::vector<std::string> ret;
+    std::string item;
+    for(const char *p = list; ; ++p) {
+        if(*p == ',' || !*p) {
+            if(!item.empty()) ret.push_back(item);
+            item.clear();
+            if(!*p) break;
+        } else
+            item.push_back(*p);
+    }
+    return ret;
+}
+
+/// Returns true, if @a name is in @a names or they are empty
+inline bool selected(const std::vector<std::string> &names, const char *name)
+{
+    return names.empty()
+        || std::find(names.begin(), names.end(), name) != names.end();
+}
+
+/**
+ * @brief Names of queues and locks selected on the command line,
+ * empty lists select everything
+ */
+struct selection
+{
+    std::vector<std::string> queues, locks;
+};
+
+/**
+ * @brief Queue implementation with a fixed lock type
+ *
+ * Passed to functions run by sweep(), which make queues
+ * of their item types by `typename Kind::template type<Tp>`.
+ */
+template <template <typename, typename> class Queue, typename Lock>
+struct queue_kind
+{
+  template <typename Tp>
+    using type = Queue<Tp, Lock>;
+};
+
+/**
+ * @brief Calls @a run for a queue implementation with every
+ * selected lock
+ *
+ * @a Queue is any template over an item type and a lock type,
+ * @a run is called with its queue_kind, @a queue_name and the name
+ * of the lock, if @a queue_name is selected.
+ */
+template <template <typename, typename> class Queue, typename Run>
+void sweep(const selection &sel, const char *queue_name, Run &&run)
+{
+    if(!selected(sel.queues, queue_name))
+        return;
+
+    if(selected(sel.locks, "mutex"))
+        run(queue_kind<Queue, std::mutex>(), queue_name, "mutex");
+    if(selected(sel.locks, "spinlock"))
+        run(queue_kind<Queue, concurrent_utils::spinlock>(), queue_name, "spinlock");
+    if(selected(sel.locks, "profiled"))
+        run(queue_kind<Queue, concurrent_utils::profiled_lock<std::mutex>>(),
+            queue_name, "profiled");
+}
+
+/**
+ * @brief Calls @a run for a lock-free implementation, which
+ * ignores the lock type and is reported with lock "none"
+ */
+template <template <typename, typename> class Queue, typename Run>
+void sweep_lock_free(const selection &sel, const char *queue_name, Run &&run)
+{
+    if(selected(sel.queues, queue_name) && selected(sel.locks, "none"))
+        run(queue_kind<Queue, void>(), queue_name, "none");
+}
+
+/// concurrent_queue with default policies
+template <typename Tp, typename Lock>
+    using locked_queue = concurrent_utils::concurrent_queue<Tp, Lock>;
+
+/// concurrent_queue spinning before it parks waiting consumers
+template <typename Tp, typename Lock>
+    using spinning_queue = concurrent_utils::concurrent_queue<Tp, Lock,
+        std::allocator<Tp>, concurrent_utils::no_queue_metrics,
+        concurrent_utils::spin_park_wait<>>;
+
+} // namespace bench
+
+#endif // CONCURRENT_UTILS_BENCH_SCENARIO_H
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_ARENA_RESOURCE_H
+#define CONCURRENT_UTILS_ARENA_RESOURCE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Thread-safe monotonic memory resource
+ *
+ * Carves allocations from big chunks requested from the upstream
+ * resource. Allocation from the current chunk is a single CAS on
+ * its offset, the spinlock is taken only to install a new chunk.
+ * Deallocation does nothing, all memory is returned to upstream
+ * at once by release() or on destruction.
+ *
+ * Suits batch jobs creating many small objects of similar lifetime,
+ * e.g. nodes of concurrent_queue with std::pmr::polymorphic_allocator;
+ * pass concurrent_queue::node_size multiplied by the expected number
+ * of items as @a chunk_size to fit the whole batch in one chunk.
+ *
+ * Requests bigger than a quarter of the chunk size get chunks of
+ * their own and do not waste the rest of the current chunk.
+ */
+class arena_resource : public std::pmr::memory_resource
+{
+    struct chunk
+    {
+        chunk *prev;
+        std::size_t size; // bytes usable after header
+        std::atomic<std::size_t> used { 0 };
+
+        chunk(chunk *p, std::size_t s) noexcept : prev(p), size(s) { }
+
+        std::uintptr_t data() const noexcept
+        { return reinterpret_cast<std::uintptr_t>(this) + _header; }
+    };
+
+    static constexpr std::size_t _align = alignof(std::max_align_t);
+    static constexpr std::size_t _header =
+        (sizeof(chunk) + _align - 1) / _align * _align;
+
+    std::pmr::memory_resource *const _upstream;
+    const std::size_t _chunk_size;
+    std::atomic<chunk *> _current { nullptr };
+    chunk *_chunks = nullptr; // guarded by _lock
+    std::atomic<std::size_t> _reserved { 0 };
+    spinlock _lock;
+
+    // Returns aligned address of @a bytes in @a c, or zero if it is full
+    static void *_carve(chunk *c, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        const std::uintptr_t base = c->data();
+        std::size_t used = c->used.load(std::memory_order_relaxed);
+        std::size_t begin, end;
+        do {
+            begin = ((base + used + alignment - 1) & ~(alignment - 1)) - base;
+            end = begin + bytes;
+            if(end > c->size)
+                return nullptr;
+        } while(!c->used.compare_exchange_weak(used, end, std::memory_order_relaxed));
+        return reinterpret_cast<void *>(base + begin);
+    }
+
+    // Requests a chunk having room for @a bytes at any @a alignment
+    chunk *_new_chunk(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = bytes + (alignment > _align ? alignment : 0);
+        void *p = _upstream->allocate(_header + size, _align);
+        _reserved.fetch_add(_header + size, std::memory_order_relaxed);
+        return ::new(p) chunk(_chunks, size);
+    }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if(!bytes) bytes = 1;
+
+        if(bytes > _chunk_size / 4) {
+            std::lock_guard<spinlock> lk(_lock);
+            chunk *c = _chunks = _new_chunk(bytes, alignment);
+            return _carve(c, bytes, alignment);
+        }
+
+        for(;;) {
+            chunk *c = _current.load(std::memory_order_acquire);
+            if(c) {
+                if(void *p = _carve(c, bytes, alignment))
+                    return p;
+            }
+
+            std::lock_guard<spinlock> lk(_lock);
+            // another thread might have installed a chunk already
+            if(_current.load(std::memory_order_relaxed) == c) {
+                _chunks = _new_chunk(std::max(_chunk_size, bytes), alignment);
+                _current.store(_chunks, std::memory_order_release);
+            }
+        }
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override { }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    { return this == &other; }
+
+public:
+    /**
+     * @brief Creates the arena
+     * @param chunk_size Size in bytes of chunks requested from upstream.
+     * @param upstream Resource providing chunks.
+     */
+    explicit arena_resource(std::size_t chunk_size = 1 << 20,
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : _upstream(upstream), _chunk_size(chunk_size ? chunk_size : 1) { }
+
+    /**
+     * @brief Destroys the arena returning all chunks to upstream
+     */
+    ~arena_resource() { release(); }
+
+#ifndef DOXYGEN
+    arena_resource(const arena_resource&) = delete;
+    arena_resource &operator=(const arena_resource&) = delete;
+#endif
+
+    /**
+     * @brief Returns all chunks to upstream at once
+     * @note Must not be called concurrently with allocations, memory
+     * given out before becomes invalid.
+     */
+    void release() noexcept
+    {
+        std::lock_guard<spinlock> lk(_lock);
+        _current.store(nullptr, std::memory_order_relaxed);
+        while(_chunks) {
+            chunk *c = _chunks;
+            _chunks = c->prev;
+            const std::size_t size = _header + c->size;
+            c->~chunk();
+            _upstream->deallocate(c, size, _align);
+        }
+        _reserved.store(0, std::memory_order_relaxed);
+    }
+
+    /// Returns resource providing chunks
+    std::pmr::memory_resource *upstream_resource() const noexcept
+    { return _upstream; }
+
+    /// Returns size of regular chunks
+    std::size_t chunk_size() const noexcept { return _chunk_size; }
+
+    /// Returns bytes currently requested from upstream
+    std::size_t reserved() const noexcept
+    { return _reserved.load(std::memory_order_relaxed); }
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_ARENA_RESOURCE_H
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_BYTE_RING_H
+#define CONCURRENT_UTILS_BYTE_RING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Ring buffer of variable-length byte messages
+ *
+ * A producer reserves a contiguous span of the ring, writes the
+ * message right there and commits it; a consumer takes the span of
+ * the next message, reads it in place and releases it. Messages are
+ * framed by 16-byte headers, so passing one costs no allocation and
+ * no copy besides writing it.
+ *
+ * A message never wraps around: when it does not fit before the end
+ * of the ring, the rest of the ring is skipped by a padding frame.
+ * So messages may take up to a half of the capacity.
+ *
+ * Reservations are serialized by one lock and takes by another, and
+ * messages are taken in order of reservation: a message reserved but
+ * not committed yet holds back those after it. Space is reclaimed
+ * in order as well, when all messages before it have been released.
+ *
+ * @tparam Lock Lock type of producers and consumers.
+ * @tparam Alloc Allocator of the ring.
+ */
+template <typename Lock = spinlock, typename Alloc = std::allocator<char>>
+class byte_ring
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "byte_ring only works with lockable type");
+#endif
+
+    enum : std::size_t { _cache_line = 64 };
+
+    enum : std::uint32_t {
+        _reserved = 1,
+        _committed,
+        _taken,
+        _released,
+        _padding
+    };
+
+    struct _frame
+    {
+        std::uint32_t size;     // bytes of the message
+        std::uint32_t length;   // bytes of the frame with the header
+        std::atomic<std::uint32_t> state;
+
+        _frame(std::uint32_t s, std::uint32_t l, std::uint32_t st) noexcept
+            : size(s), length(l), state(st) { }
+    };
+
+    static constexpr std::size_t _header = 16;
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+    using _byte_alloc = typename _alloc_traits::template rebind_alloc<char>;
+    using _byte_traits = std::allocator_traits<_byte_alloc>;
+
+    _byte_alloc _alloc;
+    char *_buffer;
+    std::size_t _capacity;
+
+    alignas(_cache_line) Lock _push_lock;
+    std::atomic<std::uint64_t> _head { 0 };     // end of reserved frames
+
+    alignas(_cache_line) Lock _pull_lock;
+    std::atomic<std::uint64_t> _read { 0 };     // next frame to take
+
+    alignas(_cache_line) spinlock _release_lock;
+    std::atomic<std::uint64_t> _tail { 0 };     // first frame not released
+
+    alignas(_cache_line) std::atomic<bool> _closed { false };
+    std::atomic<unsigned> _waiters { 0 };
+    std::mutex _mutex;
+    std::condition_variable _cond;
+
+    _frame *_at(std::uint64_t pos) const noexcept
+    { return reinterpret_cast<_frame*>(_buffer + (pos & (_capacity - 1))); }
+
+    static std::size_t _length(std::size_t size) noexcept
+    { return (_header + size + _header - 1) / _header * _header; }
+
+    void _notify();
+
+  template <typename Try>
+    auto _wait(Try &&attempt) -> decltype(attempt());
+
+public:
+    /**
+     * @brief Span of the ring reserved for a message
+     */
+    class write_span
+    {
+        char *_data = nullptr;
+        std::size_t _size = 0;
+        _frame *_frame_ptr = nullptr;
+
+        friend class byte_ring;
+
+    public:
+        /// Returns the beginning of the span
+        char *data() const noexcept { return _data; }
+
+        /// Returns the size of the span in bytes
+        std::size_t size() const noexcept { return _size; }
+
+        /// Returns true, if the span is reserved
+        explicit operator bool() const noexcept { return _data; }
+    };
+
+    /**
+     * @brief Span of the ring holding a taken message
+     */
+    class read_span
+    {
+        const char *_data = nullptr;
+        std::size_t _size = 0;
+        _frame *_frame_ptr = nullptr;
+
+        friend class byte_ring;
+
+    public:
+        /// Returns the beginning of the message
+        const char *data() const noexcept { return _data; }
+
+        /// Returns the size of the message in bytes
+        std::size_t size() const noexcept { return _size; }
+
+        /// Returns true, if a message has been taken
+        explicit operator bool() const noexcept { return _data; }
+    };
+
+    using allocator_type = Alloc;
+    using size_type = std::size_t;
+
+    explicit byte_ring(size_type capacity, const Alloc &alloc = Alloc());
+    ~byte_ring();
+
+#ifndef DOXYGEN
+    byte_ring(const byte_ring&) = delete;
+    byte_ring &operator=(const byte_ring&) = delete;
+#endif
+
+    write_span try_reserve(size_type size);
+    write_span reserve(size_type size);
+    void commit(write_span &span);
+    void commit(write_span &span, size_type size);
+
+    read_span try_pull();
+    read_span wait_pull();
+    void release(read_span &span);
+
+    void close();
+
+    /// Returns true, if the ring is closed
+    bool closed() const noexcept
+    { return _closed.load(std::memory_order_acquire); }
+
+    /// Returns true, if there are no reserved messages left to take
+    bool empty() const noexcept
+    {
+        return _read.load(std::memory_order_acquire)
+            == _head.load(std::memory_order_acquire);
+    }
+
+    /// Returns the size of the ring in bytes
+    size_type capacity() const noexcept { return _capacity; }
+
+    /// Returns the biggest size of a message
+    size_type max_message() const noexcept { return _capacity / 2 - _header; }
+
+    /// Returns the allocator used by the ring
+    allocator_type get_allocator() const noexcept { return allocator_type(_alloc); }
+};
+
+/**
+ * @brief Creates the ring
+ * @param capacity Size of the ring in bytes, rounded up
+ * to a power of two of at least 64.
+ * @param alloc Allocator of the ring.
+ */
+  template <typename Lock, typename Alloc>
+    byte_ring<Lock, Alloc>::
+    byte_ring(size_type capacity, const Alloc &alloc)
+        : _alloc(alloc), _capacity(64)
+    {
+        while(_capacity < capacity)
+            _capacity <<= 1;
+        _buffer = std::addressof(*_byte_traits::allocate(_alloc, _capacity));
+    }
+
+/**
+ * @brief Frees the ring
+ * @note Spans given out before become invalid.
+ */
+  template <typename Lock, typename Alloc>
+    byte_ring<Lock, Alloc>::
+    ~byte_ring()
+    {
+        _byte_traits::deallocate(_alloc, _buffer, _capacity);
+    }
+
+/**
+ * @internal
+ * @brief Wakes threads waiting for messages or space
+ */
+  template <typename Lock, typename Alloc>
+    void
+    byte_ring<Lock, Alloc>::
+    _notify()
+    {
+        // pairs with the fence in _wait()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(_waiters.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lk(_mutex); }
+            _cond.notify_all();
+        }
+    }
+
+/**
+ * @internal
+ * @brief Repeats @a attempt until it succeeds or the ring is closed
+ * @return Result of the last attempt.
+ */
+  template <typename Lock, typename Alloc>
+      template <typename Try>
+    auto
+    byte_ring<Lock, Alloc>::
+    _wait(Try &&attempt) -> decltype(attempt())
+    {
+        auto result = attempt();
+        if(result || closed())
+            return result;
+
+        std::unique_lock<std::mutex> lk(_mutex);
+        _waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!(result = attempt()) && !_closed.load(std::memory_order_relaxed))
+            _cond.wait(lk);
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+/**
+ * @brief Reserves a span of @a size bytes for a message,
+ * if the ring has room for it
+ * @return The span or empty span, if the ring is full or closed.
+ * @throw std::length_error If @a size exceeds max_message().
+ */
+  template <typename Lock, typename Alloc>
+    auto
+    byte_ring<Lock, Alloc>::
+    try_reserve(size_type size) -> write_span
+    {
+        if(size > max_message())
+            throw std::length_error("byte_ring: message is too long");
+
+        const std::size_t length = _length(size);
+        std::lock_guard<Lock> lk(_push_lock);
+        if(closed())
+            return { };
+
+        std::uint64_t head = _head.load(std::memory_order_relaxed);
+        const std::size_t room = _capacity - (head & (_capacity - 1));
+        const std::size_t padding = length > room ? room : 0;
+        if(head + padding + length - _tail.load(std::memory_order_acquire) > _capacity)
+            return { };
+
+        if(padding) {
+            ::new(static_cast<void*>(_at(head))) _frame(0, padding, _padding);
+            head += padding;
+        }
+        _frame *f = ::new(static_cast<void*>(_at(head))) _frame(size, length, _reserved);
+        _head.store(head + length, std::memory_order_release);
+
+        write_span span;
+        span._data = reinterpret_cast<char*>(f) + _header;
+        span._size = size;
+        span._frame_ptr = f;
+        return span;
+    }
+
+/**
+ * @brief Reserves a span of @a size bytes for a message,
+ * waiting for room
+ * @return The span or empty span, if the ring is closed.
+ * @throw std::length_error If @a size exceeds max_message().
+ */
+  template <typename Lock, typename Alloc>
+    auto
+    byte_ring<Lock, Alloc>::
+    reserve(size_type size) -> write_span
+    {
+        return _wait([&]() { return try_reserve(size); });
+    }
+
+/**
+ * @brief Makes the message in @a span available to consumers
+ * @note The span is empty after that.
+ */
+  template <typename Lock, typename Alloc>
+    void
+    byte_ring<Lock, Alloc>::
+    commit(write_span &span)
+    {
+        span._frame_ptr->state.store(_committed, std::memory_order_release);
+        span = write_span();
+        _notify();
+    }
+
+/**
+ * @brief Makes first @a size bytes of @a span available
+ * to consumers as the message
+ * @note The rest of the span is wasted until the message
+ * is released.
+ */
+  template <typename Lock, typename Alloc>
+    void
+    byte_ring<Lock, Alloc>::
+    commit(write_span &span, size_type size)
+    {
+        if(size > span._size)
+            throw std::length_error("byte_ring: commit exceeds the reservation");
+        span._frame_ptr->size = static_cast<std::uint32_t>(size);
+        commit(span);
+    }
+
+/**
+ * @brief Takes the next message, if it has been committed
+ * @return The span of the message or empty span.
+ */
+  template <typename Lock, typename Alloc>
+    auto
+    byte_ring<Lock, Alloc>::
+    try_pull() -> read_span
+    {
+        std::lock_guard<Lock> lk(_pull_lock);
+        for(;;) {
+            const std::uint64_t read = _read.load(std::memory_order_relaxed);
+            if(read == _head.load(std::memory_order_acquire))
+                return { };
+
+            _frame *f = _at(read);
+            const std::uint32_t state = f->state.load(std::memory_order_acquire);
+            if(state == _padding) {
+                _read.store(read + f->length, std::memory_order_release);
+                continue;
+            }
+            if(state != _committed)
+                return { };
+
+            f->state.store(_taken, std::memory_order_relaxed);
+            _read.store(read + f->length, std::memory_order_release);
+
+            read_span span;
+            span._data = reinterpret_cast<const char*>(f) + _header;
+            span._size = f->size;
+            span._frame_ptr = f;
+            return span;
+        }
+    }
+
+/**
+ * @brief Takes the next message, waiting for it
+ * @return The span of the message or empty span,
+ * if the ring is closed and has no committed messages.
+ */
+  template <typename Lock, typename Alloc>
+    auto
+    byte_ring<Lock, Alloc>::
+    wait_pull() -> read_span
+    {
+        return _wait([this]() { return try_pull(); });
+    }
+
+/**
+ * @brief Gives the space of the message in @a span back
+ * to producers
+ * @note The span is empty after that.
+ */
+  template <typename Lock, typename Alloc>
+    void
+    byte_ring<Lock, Alloc>::
+    release(read_span &span)
+    {
+        span._frame_ptr->state.store(_released, std::memory_order_release);
+        span = read_span();
+
+        {
+            std::lock_guard<spinlock> lk(_release_lock);
+            std::uint64_t tail = _tail.load(std::memory_order_relaxed);
+            const std::uint64_t read = _read.load(std::memory_order_acquire);
+            while(tail < read) {
+                _frame *f = _at(tail);
+                const std::uint32_t state = f->state.load(std::memory_order_acquire);
+                if(state != _released && state != _padding)
+                    break;
+                tail += f->length;
+            }
+            _tail.store(tail, std::memory_order_release);
+        }
+        _notify();
+    }
+
+/**
+ * @brief Closes the ring and wakes all waiting threads
+ *
+ * Reservations fail after that, committed messages can
+ * still be taken.
+ */
+  template <typename Lock, typename Alloc>
+    void
+    byte_ring<Lock, Alloc>::
+    close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _closed.store(true, std::memory_order_release);
+        }
+        _cond.notify_all();
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_BYTE_RING_H
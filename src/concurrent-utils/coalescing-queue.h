@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_COALESCING_QUEUE_H
+#define CONCURRENT_UTILS_COALESCING_QUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "concurrent-queue.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Concurrent queue keeping only the latest value per key
+ *
+ * Pushing a key which is already pending replaces its value in place,
+ * so the key keeps its original position and the queue's depth is
+ * bounded by the number of distinct keys rather than by the rate
+ * of updates. Pulling a key makes it new again.
+ *
+ * Entries are stored in a slab of slots linked by indices in the
+ * queue's order, freed slots are reused. Keys are found through an
+ * open-addressing table of 32-bit slot indices with linear probing,
+ * which keeps lookups within one or two cache lines.
+ * Locking, closing and waiting are the same as in concurrent_queue.
+ *
+ * @tparam Key Type of keys.
+ * @tparam Tp Type of values.
+ * @tparam Lock Lock type.
+ * @tparam Hash Hash function of keys.
+ * @tparam KeyEqual Equality of keys.
+ * @tparam Alloc Allocator of key-value pairs.
+ * @tparam Metrics Metrics policy, see concurrent_queue.
+ * Coalesced pushes are not counted as pushes.
+ */
+template <typename Key, typename Tp, typename Lock,
+          typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<Key, Tp>>,
+          typename Metrics = no_queue_metrics>
+class coalescing_queue : protected details::queue_sync<Lock, Metrics>
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "coalescing_queue only works with lockable type");
+#endif
+
+    using _sync = details::queue_sync<Lock, Metrics>;
+
+    using _sync::_lock;
+    using _sync::_closed;
+    using _sync::_metrics;
+    using _sync::_acquire;
+
+public:
+    using key_type = Key;
+    using mapped_type = Tp;
+    using value_type = std::pair<Key, Tp>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Alloc;
+    using metrics_type = Metrics;
+
+private:
+    using _index_type = std::uint32_t;
+    static constexpr _index_type _npos = ~_index_type(0);
+
+    struct _slot
+    {
+        std::size_t hash;
+        _index_type next;
+        std::optional<value_type> item;
+    };
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+    using _slot_alloc_type = typename _alloc_traits::template rebind_alloc<_slot>;
+    using _index_alloc_type = typename _alloc_traits::template rebind_alloc<_index_type>;
+
+    std::vector<_slot, _slot_alloc_type> _slots;
+    std::vector<_index_type, _index_alloc_type> _table; // empty or power of two
+    _index_type _head = _npos, _tail = _npos, _free = _npos;
+    size_type _size = 0;
+    std::uint64_t _coalesced = 0;
+    Hash _hash;
+    KeyEqual _equal;
+
+    inline std::size_t _mask() const noexcept { return _table.size() - 1; }
+
+    // Returns position of @a key in the table, or of the empty cell to put it
+    std::size_t _find(const Key &key, std::size_t hash) const
+    {
+        std::size_t i = hash & _mask();
+        for(; _table[i] != _npos; i = (i + 1) & _mask()) {
+            const _slot &s = _slots[_table[i]];
+            if(s.hash == hash && _equal(s.item->first, key))
+                break;
+        }
+        return i;
+    }
+
+    // Grows the table to keep it at most half full
+    void _reserve_table(size_type n)
+    {
+        std::size_t cap = _table.empty() ? 16 : _table.size();
+        while(cap < n * 2)
+            cap *= 2;
+        if(cap == _table.size())
+            return;
+
+        decltype(_table) table(cap, _npos, _table.get_allocator()); // might throw
+        _table.swap(table);
+        for(_index_type p = _head; p != _npos; p = _slots[p].next) {
+            std::size_t i = _slots[p].hash & _mask();
+            while(_table[i] != _npos)
+                i = (i + 1) & _mask();
+            _table[i] = p;
+        }
+    }
+
+    // Removes cell @a i of the table shifting the following ones back
+    void _erase_cell(std::size_t i) noexcept
+    {
+        for(std::size_t j = i;;) {
+            j = (j + 1) & _mask();
+            if(_table[j] == _npos)
+                break;
+            const std::size_t k = _slots[_table[j]].hash & _mask();
+            // move back, unless the ideal cell lies cyclically in (i, j]
+            if(i <= j ? (k <= i || j < k) : (k <= i && j < k)) {
+                _table[i] = _table[j];
+                i = j;
+            }
+        }
+        _table[i] = _npos;
+    }
+
+    // Returns a free slot, reusing freed ones
+    _index_type _acquire_slot()
+    {
+        if(_free != _npos) {
+            const _index_type p = _free;
+            _free = _slots[p].next;
+            return p;
+        }
+        _slots.push_back(_slot { 0, _npos, std::nullopt }); // might throw
+        return _index_type(_slots.size() - 1);
+    }
+
+    inline void _release_slot(_index_type p) noexcept
+    {
+        _slots[p].item.reset();
+        _slots[p].next = _free;
+        _free = p;
+    }
+
+    // Moves the first entry to @a item
+    void _take(value_type &item)
+    {
+        const _index_type p = _head;
+        _slot &s = _slots[p];
+        item = std::move_if_noexcept(*s.item);
+
+        std::size_t i = s.hash & _mask();
+        while(_table[i] != p)
+            i = (i + 1) & _mask();
+        _erase_cell(i);
+
+        _head = s.next;
+        if(_head == _npos)
+            _tail = _npos;
+        _release_slot(p);
+        --_size;
+        _metrics.on_pull();
+    }
+
+  template <typename... Deadline>
+    bool _wait_pull(value_type &item, const Deadline &...deadline)
+    {
+        std::unique_lock<Lock> lk(_lock, _acquire());
+        if(_sync::_wait(lk, [this]() { return _head != _npos; }, deadline...))
+            return false; // if closed
+        if(_head == _npos)
+            return false;
+        _take(item);
+        return true;
+    }
+
+public:
+    /**
+     * @brief Creates empty queue
+     * @param hash Hash function of keys.
+     * @param equal Equality of keys.
+     * @param a Allocator of the queue's storage.
+     */
+    explicit coalescing_queue(const Hash &hash = Hash(),
+                              const KeyEqual &equal = KeyEqual(),
+                              const allocator_type &a = allocator_type())
+        : _slots(_slot_alloc_type(a)), _table(_index_alloc_type(a))
+        , _hash(hash), _equal(equal) { }
+
+    /// Closes the queue and frees pending entries
+    ~coalescing_queue() { close(); }
+
+#ifndef DOXYGEN
+    coalescing_queue(const coalescing_queue&) = delete;
+    coalescing_queue &operator=(const coalescing_queue&) = delete;
+#endif
+
+    /// Returns the allocator used by the queue
+    allocator_type get_allocator() const
+    { return allocator_type(_slots.get_allocator()); }
+
+    /// Returns true, if the queue has no pending keys
+    inline bool empty() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return !_size; }
+
+    /// Counts pending keys
+    inline size_type size() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _size; }
+
+    /// Counts pushes which replaced a pending value
+    inline std::uint64_t coalesced() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _coalesced; }
+
+    /// Reserves space for @a n distinct pending keys
+    void reserve(size_type n)
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        _slots.reserve(n);
+        _reserve_table(n);
+    }
+
+    /// Returns true, if queue closed
+    inline bool closed() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _closed; }
+
+    /// Closes the queue
+    inline void close() { _sync::_close(); }
+
+    /// Returns reference to a internal queue's lock
+    inline Lock &underlying_lock() const noexcept { return _lock; }
+
+    /// Returns snapshot of metrics collected by the Metrics policy
+    inline queue_stats stats() const noexcept { return _metrics.stats(); }
+
+    /**
+     * @brief Replaces the pending value of @a key, or puts @a key
+     * with @a value to end of the queue, if the queue is not closed
+     * @return true, if the queue is not closed.
+     * @note If an exception occurs, the queue is unchanged, unless
+     * assignment of the pending value fails.
+     */
+  template <typename K, typename V>
+    bool push(K &&key, V &&value)
+    {
+        const std::size_t hash = _hash(key);
+
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
+        }
+
+        _reserve_table(_size + 1); // might throw
+        const std::size_t i = _find(key, hash);
+        if(_table[i] != _npos) {
+            _slots[_table[i]].item->second = std::forward<V>(value);
+            ++_coalesced;
+            return true;
+        }
+
+        const _index_type p = _acquire_slot(); // might throw
+        try {
+            _slots[p].item.emplace(std::forward<K>(key), std::forward<V>(value));
+        } catch(...) {
+            _release_slot(p);
+            throw;
+        }
+        _slots[p].hash = hash;
+        _slots[p].next = _npos;
+        _table[i] = p;
+
+        if(_tail != _npos)
+            _slots[_tail].next = p;
+        else
+            _head = p;
+        _tail = p;
+        ++_size;
+
+        _metrics.on_push();
+        _sync::_notify();
+        return true;
+    }
+
+    /**
+     * @brief Takes the first pending key with its latest value
+     * and moves them to @a item, if the queue is not empty
+     * @return false, if the queue is already empty; true otherwise.
+     */
+    bool pull(value_type &item)
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_head == _npos)
+            return false;
+        _take(item);
+        return true;
+    }
+
+    /**
+     * @brief Waits for keys to appear in the queue, then takes
+     * the first one, if the queue is not closed
+     * @return false, if the queue is empty or closed, true otherwise.
+     */
+    bool wait_pull(value_type &item) { return _wait_pull(item); }
+
+    /**
+     * @brief Same as wait_pull(value_type &), but waits until @a atime
+     */
+  template <typename Clock, typename Duration>
+    bool wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
+                   value_type &item)
+    { return _wait_pull(item, atime); }
+
+    /**
+     * @brief Same as wait_pull(value_type &), but waits within @a rtime
+     */
+  template <typename Rep, typename Period>
+    bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+                   value_type &item)
+    { return _wait_pull(item, rtime); }
+
+}; // class coalescing_queue
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_COALESCING_QUEUE_H
@@ -0,0 +1,1091 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_CONCURRENT_HASH_MAP_H
+#define CONCURRENT_UTILS_CONCURRENT_HASH_MAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Hash map with lock striping
+ *
+ * Keys are spread over a fixed number of stripes, each guarded by
+ * its own lock, so threads working with keys of different stripes
+ * never wait for each other. Operations on two keys of different
+ * stripes take both locks through ordered_lock.
+ *
+ * The table is an open-addressing array of buckets of one cache
+ * line each, holding 1-byte tags of hashes and pointers to seven
+ * entries. A key is probed in its home bucket and then in the other
+ * buckets of a group of four, all belonging to the same stripe; a
+ * bucket records whether probing ever passed it, so a lookup usually
+ * reads a single cache line and never needs tombstones.
+ *
+ * When a stripe exceeds 75% of its share of the table or a group
+ * overflows, the table doubles. Installing the new table takes all
+ * the locks for a moment, but entries are moved group by group
+ * later: an operation first moves the old group of its key and helps
+ * with a couple of other groups of its stripe. The old table is
+ * freed as soon as the last group has been moved.
+ *
+ * Entries are allocated one by one and never move in memory,
+ * however references to them are not given out: values are
+ * accessed by copying or in callbacks invoked under the lock.
+ *
+ * Hashes are mixed before use, but at most 28 distinct keys may
+ * have equal hashes: no resize can separate them, so inserting
+ * one more throws std::length_error.
+ *
+ * @tparam Key Type of keys.
+ * @tparam Tp Type of values.
+ * @tparam Hash Hash function of keys.
+ * @tparam Lock Lock type of stripes.
+ * @tparam KeyEqual Equality of keys.
+ * @tparam Alloc Allocator of key-value pairs.
+ */
+template <typename Key, typename Tp, typename Hash = std::hash<Key>,
+          typename Lock = spinlock, typename KeyEqual = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Tp>>>
+class concurrent_hash_map
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "concurrent_hash_map only works with lockable type");
+#endif
+
+public:
+    using key_type = Key;
+    using mapped_type = Tp;
+    using value_type = std::pair<const Key, Tp>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Alloc;
+    using lock_type = Lock;
+
+private:
+    enum : std::size_t {
+        _cache_line = 64,
+        _slots = 7,        // entries per bucket
+        _group = 4,        // buckets probed for a key
+        _help = 2          // groups moved by an operation besides its own
+    };
+
+    struct _node
+    {
+        std::size_t hash;
+        value_type value;
+
+      template <typename... Args>
+        explicit _node(std::size_t h, Args &&...args)
+            : hash(h), value(std::forward<Args>(args)...) { }
+    };
+
+    struct alignas(_cache_line) _bucket
+    {
+        std::uint8_t tags[_slots];  // zero for free slots
+        std::uint8_t overflow;      // probing has passed this bucket
+        _node *nodes[_slots];
+    };
+
+    struct alignas(_cache_line) _stripe
+    {
+        Lock lock;
+        std::atomic<size_type> size { 0 };
+        size_type cursor = 0;       // next old group to move
+    };
+
+    struct _table
+    {
+        _bucket *buckets = nullptr;
+        size_type count = 0;
+    };
+
+    // Position of an entry in a table
+    struct _place
+    {
+        _bucket *bucket;
+        unsigned slot;
+
+        _node *&node() const noexcept { return bucket->nodes[slot]; }
+        explicit operator bool() const noexcept { return bucket; }
+    };
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+  template <typename Up>
+    using _rebind_traits = typename _alloc_traits::template rebind_traits<Up>;
+  template <typename Up>
+    using _rebind_alloc = typename _alloc_traits::template rebind_alloc<Up>;
+
+    Hash _hash;
+    KeyEqual _equal;
+    _rebind_alloc<_node> _alloc;
+
+    _stripe *_stripes = nullptr;
+    size_type _stripe_count;
+
+    _table _current, _old;
+    unsigned char *_moved = nullptr;        // flags of old groups
+    std::atomic<size_type> _pending { 0 };  // old groups left to move
+
+    static size_type _mix(size_type h) noexcept
+    {
+        // finalizer of MurmurHash3, spreads weak hashes like std::hash<int>
+        std::uint64_t x = h;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return static_cast<size_type>(x);
+    }
+
+    static std::uint8_t _tag(size_type h) noexcept
+    { return 0x80 | (h >> (std::numeric_limits<size_type>::digits - 7)); }
+
+    static size_type _group_of(const _table &t, size_type h) noexcept
+    { return (h & (t.count - 1)) / _group; }
+
+    // Bucket number @a i of the probe sequence of @a h
+    static _bucket &_probe(const _table &t, size_type h, size_type i) noexcept
+    {
+        const size_type home = h & (t.count - 1);
+        return t.buckets[(home & ~size_type(_group - 1)) | ((home + i) & (_group - 1))];
+    }
+
+    size_type _hash_of(const Key &key) const
+    { return _mix(_hash(key)); }
+
+    _stripe &_stripe_of(size_type h) const noexcept
+    { return _stripes[(h / _group) & (_stripe_count - 1)]; }
+
+    size_type _stripe_capacity() const noexcept
+    { return _current.count * _slots * 3 / 4 / _stripe_count; }
+
+    _place _locate(const _table &t, size_type h, const Key &key) const;
+    static _place _free_place(const _table &t, size_type h) noexcept;
+    static bool _inseparable(const _table &t, size_type h) noexcept;
+
+    _table _allocate(size_type count);
+    void _deallocate(_table &t) noexcept;
+    void _destroy_nodes(_table &t, const unsigned char *moved) noexcept;
+    void _destroy_node(_node *n) noexcept;
+
+    bool _move_group(size_type g) noexcept;
+    bool _prepare(_stripe &s, size_type h) noexcept;
+    const _table &_table_of(size_type h) const noexcept;
+
+    void _lock_all() const;
+    void _unlock_all() const noexcept;
+    void _grow_locked(size_type count);
+    void _finish_locked() noexcept;
+    void _grow(size_type seen);
+    void _cleanup();
+
+    // Calls _cleanup() on leaving the scope after the last old group
+    // has been moved, even if a callback throws; to be declared
+    // before the lock of a stripe
+    struct _cleanup_guard
+    {
+        concurrent_hash_map &map;
+        bool last = false;
+
+        ~_cleanup_guard() { if(last) map._cleanup(); }
+    };
+
+  template <typename Make, typename Update>
+    bool _upsert(const Key &key, Make &&make, Update &&update);
+
+public:
+    explicit concurrent_hash_map(size_type stripes = 64,
+                                 const Hash &hash = Hash(),
+                                 const KeyEqual &equal = KeyEqual(),
+                                 const Alloc &alloc = Alloc());
+
+    /// Creates empty map using allocator @a alloc
+    explicit concurrent_hash_map(const Alloc &alloc)
+        : concurrent_hash_map(64, Hash(), KeyEqual(), alloc) { }
+
+    ~concurrent_hash_map();
+
+#ifndef DOXYGEN
+    concurrent_hash_map(const concurrent_hash_map&) = delete;
+    concurrent_hash_map &operator=(const concurrent_hash_map&) = delete;
+#endif
+
+    /// Returns the allocator used by the map
+    allocator_type get_allocator() const noexcept
+    { return allocator_type(_alloc); }
+
+    /// Returns the hash function
+    hasher hash_function() const { return _hash; }
+
+    /// Returns the equality of keys
+    key_equal key_eq() const { return _equal; }
+
+    /// Returns the number of lock stripes
+    size_type stripes() const noexcept { return _stripe_count; }
+
+    size_type size() const noexcept;
+
+    /// Returns true, if the map has no entries
+    bool empty() const noexcept { return !size(); }
+
+    size_type bucket_count() const;
+
+    void reserve(size_type n);
+
+    void clear();
+
+  template <typename... Args>
+    bool emplace(const Key &key, Args &&...args);
+
+    /// Inserts a copy of @a value, if its key is absent
+    bool insert(const value_type &value)
+    { return emplace(value.first, value.second); }
+
+  template <typename M>
+    bool insert_or_assign(const Key &key, M &&obj);
+
+  template <typename Func, typename... Args>
+    bool upsert(const Key &key, Func &&f, Args &&...args);
+
+    bool find(const Key &key, Tp &val) const;
+
+    std::optional<Tp> find(const Key &key) const;
+
+    bool contains(const Key &key) const;
+
+  template <typename Func>
+    bool visit(const Key &key, Func &&f);
+
+  template <typename Func>
+    bool visit(const Key &key, Func &&f) const;
+
+  template <typename Func>
+    bool visit_pair(const Key &key1, const Key &key2, Func &&f);
+
+    bool erase(const Key &key);
+
+  template <typename Func>
+    void for_each(Func &&f) const;
+
+}; // class concurrent_hash_map
+
+/**
+ * @brief Creates empty map
+ * @param stripes Number of locks, rounded up to a power of two.
+ * @param hash Hash function of keys.
+ * @param equal Equality of keys.
+ * @param alloc Allocator of the map.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    concurrent_hash_map(size_type stripes, const Hash &hash,
+                        const KeyEqual &equal, const Alloc &alloc)
+        : _hash(hash), _equal(equal), _alloc(alloc), _stripe_count(1)
+    {
+        while(_stripe_count < stripes)
+            _stripe_count <<= 1;
+
+        _rebind_alloc<_stripe> stripe_alloc(_alloc);
+        _stripes = std::addressof(*_rebind_traits<_stripe>::allocate(
+                                      stripe_alloc, _stripe_count));
+        for(size_type i = 0; i < _stripe_count; ++i)
+            _rebind_traits<_stripe>::construct(stripe_alloc, _stripes + i);
+
+        try {
+            _current = _allocate(_group * _stripe_count);
+        } catch(...) {
+            _rebind_traits<_stripe>::deallocate(stripe_alloc, _stripes, _stripe_count);
+            throw;
+        }
+    }
+
+/**
+ * @brief Destroys all entries and frees memory
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    ~concurrent_hash_map()
+    {
+        _destroy_nodes(_old, _moved);
+        _destroy_nodes(_current, nullptr);
+        _finish_locked();
+        _deallocate(_current);
+
+        _rebind_alloc<_stripe> stripe_alloc(_alloc);
+        for(size_type i = 0; i < _stripe_count; ++i)
+            _rebind_traits<_stripe>::destroy(stripe_alloc, _stripes + i);
+        _rebind_traits<_stripe>::deallocate(stripe_alloc, _stripes, _stripe_count);
+    }
+
+/**
+ * @internal
+ * @brief Finds the entry of @a key in @a t
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _locate(const _table &t, size_type h, const Key &key) const -> _place
+    {
+        const std::uint8_t tag = _tag(h);
+        for(size_type i = 0; i < _group; ++i) {
+            _bucket &b = _probe(t, h, i);
+            for(unsigned s = 0; s < _slots; ++s)
+                if(b.tags[s] == tag && b.nodes[s]->hash == h
+                        && _equal(b.nodes[s]->value.first, key))
+                    return { &b, s };
+            if(!b.overflow)
+                break;
+        }
+        return { nullptr, 0 };
+    }
+
+/**
+ * @internal
+ * @brief Finds a free slot for @a h in @a t, marking buckets
+ * passed on the way
+ * @return The slot or none, if the group is full.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _free_place(const _table &t, size_type h) noexcept -> _place
+    {
+        for(size_type i = 0; i < _group; ++i) {
+            _bucket &b = _probe(t, h, i);
+            for(unsigned s = 0; s < _slots; ++s)
+                if(!b.tags[s])
+                    return { &b, s };
+            b.overflow = 1;
+        }
+        return { nullptr, 0 };
+    }
+
+/**
+ * @internal
+ * @brief Checks whether all slots of the group of @a h in @a t
+ * hold entries with hash @a h, so no resize can make room for it
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _inseparable(const _table &t, size_type h) noexcept
+    {
+        for(size_type i = 0; i < _group; ++i) {
+            const _bucket &b = _probe(t, h, i);
+            for(unsigned s = 0; s < _slots; ++s)
+                if(!b.tags[s] || b.nodes[s]->hash != h)
+                    return false;
+        }
+        return true;
+    }
+
+/**
+ * @internal
+ * @brief Allocates a table of @a count empty buckets
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _allocate(size_type count) -> _table
+    {
+        _rebind_alloc<_bucket> bucket_alloc(_alloc);
+        _table t;
+        t.buckets = std::addressof(*_rebind_traits<_bucket>::allocate(bucket_alloc, count));
+        t.count = count;
+        std::memset(static_cast<void*>(t.buckets), 0, count * sizeof(_bucket));
+        return t;
+    }
+
+/**
+ * @internal
+ * @brief Frees buckets of @a t, but not its entries
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _deallocate(_table &t) noexcept
+    {
+        if(!t.buckets)
+            return;
+        _rebind_alloc<_bucket> bucket_alloc(_alloc);
+        _rebind_traits<_bucket>::deallocate(bucket_alloc, t.buckets, t.count);
+        t = _table();
+    }
+
+/**
+ * @internal
+ * @brief Destroys @a n and frees its memory
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _destroy_node(_node *n) noexcept
+    {
+        _rebind_traits<_node>::destroy(_alloc, n);
+        _rebind_traits<_node>::deallocate(_alloc, n, 1);
+    }
+
+/**
+ * @internal
+ * @brief Destroys all entries of @a t and empties its buckets,
+ * skipping groups marked in @a moved, if given
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _destroy_nodes(_table &t, const unsigned char *moved) noexcept
+    {
+        for(size_type i = 0; i < t.count; ++i) {
+            if(moved && moved[i / _group])
+                continue;
+            _bucket &b = t.buckets[i];
+            for(unsigned s = 0; s < _slots; ++s)
+                if(b.tags[s]) _destroy_node(b.nodes[s]);
+            std::memset(static_cast<void*>(&b), 0, sizeof(_bucket));
+        }
+    }
+
+/**
+ * @internal
+ * @brief Moves entries of the old group @a g to the current table
+ *
+ * New groups receive entries of a single old group and are empty
+ * until it has been moved, so they always have room for them.
+ * @note Must be called under the lock of the group's stripe.
+ * @return true, if that was the last group left.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _move_group(size_type g) noexcept
+    {
+        if(_moved[g])
+            return false;
+
+        for(size_type i = g * _group; i < (g + 1) * _group; ++i) {
+            _bucket &b = _old.buckets[i];
+            for(unsigned s = 0; s < _slots; ++s)
+                if(b.tags[s]) {
+                    _node *n = b.nodes[s];
+                    const _place p = _free_place(_current, n->hash);
+                    p.bucket->tags[p.slot] = _tag(n->hash);
+                    p.node() = n;
+                }
+        }
+
+        _moved[g] = 1;
+        return _pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+/**
+ * @internal
+ * @brief Moves the old group of @a h and a few other groups
+ * of stripe @a s, if the table is being resized
+ * @note Must be called under the lock of @a s.
+ * @return true, if the last group left has been moved.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _prepare(_stripe &s, size_type h) noexcept
+    {
+        if(!_old.buckets)
+            return false;
+
+        bool last = _move_group(_group_of(_old, h));
+
+        // groups of a stripe are congruent to its index
+        const size_type groups = _old.count / _group;
+        const size_type first = &s - _stripes;
+        for(size_type n = 0; n < _help; ++n) {
+            const size_type g = first + s.cursor * _stripe_count;
+            if(g >= groups)
+                break;
+            last |= _move_group(g);
+            ++s.cursor;
+        }
+        return last;
+    }
+
+/**
+ * @internal
+ * @brief Returns the table holding entries with hash @a h
+ * @note Must be called under the lock of the stripe of @a h.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _table_of(size_type h) const noexcept -> const _table&
+    {
+        return _old.buckets && !_moved[_group_of(_old, h)] ? _old : _current;
+    }
+
+/**
+ * @internal
+ * @brief Acquires locks of all stripes in order of their indices
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _lock_all() const
+    {
+        size_type i = 0;
+        try {
+            for(; i < _stripe_count; ++i)
+                _stripes[i].lock.lock();
+        } catch(...) {
+            while(i--) _stripes[i].lock.unlock();
+            throw;
+        }
+    }
+
+/**
+ * @internal
+ * @brief Releases locks of all stripes
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _unlock_all() const noexcept
+    {
+        for(size_type i = _stripe_count; i--; )
+            _stripes[i].lock.unlock();
+    }
+
+/**
+ * @internal
+ * @brief Installs an empty table of @a count buckets, entries
+ * of the current one are to be moved later
+ * @note Must be called under all locks with no resize pending.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _grow_locked(size_type count)
+    {
+        const size_type groups = _current.count / _group;
+        _table t = _allocate(count);
+        _rebind_alloc<unsigned char> flag_alloc(_alloc);
+        try {
+            _moved = std::addressof(*_rebind_traits<unsigned char>::allocate(
+                                        flag_alloc, groups));
+        } catch(...) {
+            _deallocate(t);
+            throw;
+        }
+        std::memset(_moved, 0, groups);
+
+        _old = _current;
+        _current = t;
+        _pending.store(groups, std::memory_order_relaxed);
+        for(size_type i = 0; i < _stripe_count; ++i)
+            _stripes[i].cursor = 0;
+    }
+
+/**
+ * @internal
+ * @brief Moves all groups left and frees the old table
+ * @note Must be called under all locks.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _finish_locked() noexcept
+    {
+        if(!_old.buckets)
+            return;
+
+        const size_type groups = _old.count / _group;
+        for(size_type g = 0; g < groups; ++g)
+            _move_group(g);
+
+        _rebind_alloc<unsigned char> flag_alloc(_alloc);
+        _rebind_traits<unsigned char>::deallocate(flag_alloc, _moved, groups);
+        _moved = nullptr;
+        _deallocate(_old);
+    }
+
+/**
+ * @internal
+ * @brief Doubles the table, unless somebody has already
+ * resized it since it had @a seen buckets
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _grow(size_type seen)
+    {
+        _lock_all();
+        try {
+            if(_current.count == seen) {
+                _finish_locked();
+                _grow_locked(seen * 2);
+            }
+        } catch(...) {
+            _unlock_all();
+            throw;
+        }
+        _unlock_all();
+    }
+
+/**
+ * @internal
+ * @brief Frees the old table once all its groups have been moved
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _cleanup()
+    {
+        _lock_all();
+        if(!_pending.load(std::memory_order_acquire))
+            _finish_locked();
+        _unlock_all();
+    }
+
+/**
+ * @internal
+ * @brief Calls @a update for the value of @a key, if present,
+ * otherwise inserts the entry created by @a make
+ * @return true, if the entry has been inserted.
+ * @throw std::length_error If the group of @a key is full of
+ * entries with the same hash.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Make, typename Update>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    _upsert(const Key &key, Make &&make, Update &&update)
+    {
+        const size_type h = _hash_of(key);
+        _stripe &s = _stripe_of(h);
+
+        for(;;) {
+            size_type seen;
+            bool full = false, inserted = false;
+            {
+                _cleanup_guard cleanup { *this };
+                std::lock_guard<Lock> lk(s.lock);
+                cleanup.last = _prepare(s, h);
+                seen = _current.count;
+
+                if(_place p = _locate(_current, h, key))
+                    update(p.node()->value.second);
+                else if(s.size.load(std::memory_order_relaxed) >= _stripe_capacity())
+                    full = true;
+                else if(_place p = _free_place(_current, h)) {
+                    p.node() = make(h);
+                    p.bucket->tags[p.slot] = _tag(h);
+                    s.size.fetch_add(1, std::memory_order_relaxed);
+                    inserted = true;
+                } else if(_inseparable(_current, h))
+                    throw std::length_error(
+                        "concurrent_hash_map: too many keys with equal hashes");
+                else
+                    full = true;
+            }
+
+            if(!full)
+                return inserted;
+            _grow(seen);
+        }
+    }
+
+/**
+ * @brief Counts entries
+ * @note Stripes are counted one by one without locks,
+ * the result is exact only when the map is not modified.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    size() const noexcept -> size_type
+    {
+        size_type n = 0;
+        for(size_type i = 0; i < _stripe_count; ++i)
+            n += _stripes[i].size.load(std::memory_order_relaxed);
+        return n;
+    }
+
+/**
+ * @brief Returns the number of buckets of the current table
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    bucket_count() const -> size_type
+    {
+        std::lock_guard<Lock> lk(_stripes[0].lock);
+        return _current.count;
+    }
+
+/**
+ * @brief Resizes the table at once to hold @a n entries
+ * without further resizing
+ * @note Blocks all operations while entries are moved.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    reserve(size_type n)
+    {
+        _lock_all();
+        try {
+            _finish_locked();
+            size_type count = _current.count;
+            while(count * _slots * 3 / 4 < n)
+                count *= 2;
+            if(count != _current.count) {
+                _grow_locked(count);
+                _finish_locked();
+            }
+        } catch(...) {
+            _unlock_all();
+            throw;
+        }
+        _unlock_all();
+    }
+
+/**
+ * @brief Destroys all entries
+ * @note Keeps the size of the table.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    clear()
+    {
+        _lock_all();
+        _destroy_nodes(_old, _moved);
+        _destroy_nodes(_current, nullptr);
+        _finish_locked();
+        for(size_type i = 0; i < _stripe_count; ++i)
+            _stripes[i].size.store(0, std::memory_order_relaxed);
+        _unlock_all();
+    }
+
+/**
+ * @brief Inserts an entry of @a key and the value constructed
+ * from @a args, if @a key is absent
+ * @return true, if the entry has been inserted.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename... Args>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    emplace(const Key &key, Args &&...args)
+    {
+        return _upsert(key, [&](size_type h) {
+            _node *n = std::addressof(*_rebind_traits<_node>::allocate(_alloc, 1));
+            try {
+                _rebind_traits<_node>::construct(_alloc, n, h,
+                    std::piecewise_construct, std::forward_as_tuple(key),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+            } catch(...) {
+                _rebind_traits<_node>::deallocate(_alloc, n, 1);
+                throw;
+            }
+            return n;
+        }, [](Tp&) { });
+    }
+
+/**
+ * @brief Assigns @a obj to the value of @a key, inserting
+ * the entry, if @a key is absent
+ * @return true, if the entry has been inserted.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename M>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    insert_or_assign(const Key &key, M &&obj)
+    {
+        return upsert(key, [&](Tp &value) { value = std::forward<M>(obj); },
+                      std::forward<M>(obj));
+    }
+
+/**
+ * @brief Calls @a f for the value of @a key under the lock,
+ * if @a key is present, otherwise inserts an entry of @a key
+ * and the value constructed from @a args
+ * @return true, if the entry has been inserted.
+ * @note Only one of @a f and @a args is used, so both
+ * may forward the same object.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Func, typename... Args>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    upsert(const Key &key, Func &&f, Args &&...args)
+    {
+        return _upsert(key, [&](size_type h) {
+            _node *n = std::addressof(*_rebind_traits<_node>::allocate(_alloc, 1));
+            try {
+                _rebind_traits<_node>::construct(_alloc, n, h,
+                    std::piecewise_construct, std::forward_as_tuple(key),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+            } catch(...) {
+                _rebind_traits<_node>::deallocate(_alloc, n, 1);
+                throw;
+            }
+            return n;
+        }, f);
+    }
+
+/**
+ * @brief Copies the value of @a key to @a val, if present
+ * @return true, if @a key is present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    find(const Key &key, Tp &val) const
+    {
+        return visit(key, [&](const Tp &value) { val = value; });
+    }
+
+/**
+ * @brief Copies the value of @a key
+ * @return The value or empty optional, if @a key is absent.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    auto
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    find(const Key &key) const -> std::optional<Tp>
+    {
+        std::optional<Tp> ret;
+        visit(key, [&](const Tp &value) { ret.emplace(value); });
+        return ret;
+    }
+
+/**
+ * @brief Returns true, if @a key is present
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    contains(const Key &key) const
+    {
+        return visit(key, [](const Tp&) { });
+    }
+
+/**
+ * @brief Calls @a f for the value of @a key under the lock,
+ * if @a key is present
+ * @return true, if @a key is present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Func>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    visit(const Key &key, Func &&f)
+    {
+        const size_type h = _hash_of(key);
+        _stripe &s = _stripe_of(h);
+        _cleanup_guard cleanup { *this };
+        std::lock_guard<Lock> lk(s.lock);
+        cleanup.last = _prepare(s, h);
+        if(_place p = _locate(_current, h, key)) {
+            f(p.node()->value.second);
+            return true;
+        }
+        return false;
+    }
+
+/// @copydoc visit()
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Func>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    visit(const Key &key, Func &&f) const
+    {
+        const size_type h = _hash_of(key);
+        std::lock_guard<Lock> lk(_stripe_of(h).lock);
+        if(_place p = _locate(_table_of(h), h, key)) {
+            f(static_cast<const Tp&>(p.node()->value.second));
+            return true;
+        }
+        return false;
+    }
+
+/**
+ * @brief Calls @a f for values of @a key1 and @a key2 at once,
+ * if both are present
+ *
+ * Locks of different stripes are taken through ordered_lock,
+ * so concurrent calls never deadlock.
+ * @return true, if both keys are present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Func>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    visit_pair(const Key &key1, const Key &key2, Func &&f)
+    {
+        const size_type h1 = _hash_of(key1), h2 = _hash_of(key2);
+        _stripe &s1 = _stripe_of(h1), &s2 = _stripe_of(h2);
+        bool found = false;
+        _cleanup_guard cleanup { *this };
+
+        auto locked = [&]() {
+            cleanup.last = _prepare(s1, h1);
+            cleanup.last |= _prepare(s2, h2);
+            _place p1 = _locate(_current, h1, key1);
+            _place p2 = _locate(_current, h2, key2);
+            if(p1 && p2) {
+                f(p1.node()->value.second, p2.node()->value.second);
+                found = true;
+            }
+        };
+
+        if(&s1 == &s2) {
+            std::lock_guard<Lock> lk(s1.lock);
+            locked();
+        } else {
+            ordered_lock<Lock, Lock> lk(s1.lock, s2.lock);
+            locked();
+        }
+        return found;
+    }
+
+/**
+ * @brief Removes the entry of @a key
+ * @return true, if @a key was present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+    bool
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    erase(const Key &key)
+    {
+        const size_type h = _hash_of(key);
+        _stripe &s = _stripe_of(h);
+        _node *n = nullptr;
+        bool last;
+        {
+            std::lock_guard<Lock> lk(s.lock);
+            last = _prepare(s, h);
+            if(_place p = _locate(_current, h, key)) {
+                n = p.node();
+                p.bucket->tags[p.slot] = 0;
+                s.size.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        // the entry is destroyed outside of the lock
+        if(n)
+            _destroy_node(n);
+        if(last)
+            _cleanup();
+        return n != nullptr;
+    }
+
+/**
+ * @brief Calls @a f for every entry
+ *
+ * Takes locks of stripes one by one, so it neither blocks
+ * the whole map nor sees a consistent snapshot of it.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename KeyEqual, typename Alloc>
+      template <typename Func>
+    void
+    concurrent_hash_map<Key, Tp, Hash, Lock, KeyEqual, Alloc>::
+    for_each(Func &&f) const
+    {
+        auto visit_groups = [&](const _table &t, size_type stripe,
+                                const unsigned char *skip) {
+            for(size_type g = stripe; g < t.count / _group; g += _stripe_count) {
+                if(skip && skip[g])
+                    continue;
+                for(size_type i = g * _group; i < (g + 1) * _group; ++i)
+                    for(unsigned s = 0; s < _slots; ++s)
+                        if(t.buckets[i].tags[s])
+                            f(static_cast<const value_type&>(t.buckets[i].nodes[s]->value));
+            }
+        };
+
+        for(size_type i = 0; i < _stripe_count; ++i) {
+            std::lock_guard<Lock> lk(_stripes[i].lock);
+            if(_old.buckets)
+                visit_groups(_old, i, _moved);
+            visit_groups(_current, i, nullptr);
+        }
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_CONCURRENT_HASH_MAP_H
@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_CONCURRENT_LRU_CACHE_H
+#define CONCURRENT_UTILS_CONCURRENT_LRU_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Snapshot of the cache's statistics
+ */
+struct cache_stats
+{
+    std::uint64_t hits = 0;      ///< Lookups which found the key
+    std::uint64_t misses = 0;    ///< Lookups which did not find the key
+    std::uint64_t inserts = 0;   ///< Entries added to the cache
+    std::uint64_t evictions = 0; ///< Entries evicted to free space
+    std::uint64_t size = 0;      ///< Current number of entries
+    std::uint64_t weight = 0;    ///< Current total weight of entries
+
+    /// Returns the ratio of hits to all lookups
+    double hit_ratio() const noexcept
+    { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+/**
+ * @brief Weigher of concurrent_lru_cache counting entries
+ */
+struct unit_weigher
+{
+  template <typename Key, typename Tp>
+    std::size_t operator()(const Key&, const Tp&) const noexcept { return 1; }
+};
+
+/**
+ * @brief Sharded cache with approximate LRU eviction
+ *
+ * Keys are spread over shards, each with its own lock, hash table
+ * and share of the capacity. Entries of a shard form a ring swept
+ * by a clock hand: a hit only sets the entry's reference bit, and
+ * the hand evicts the first entry without the bit, clearing bits
+ * of entries it passes. So hits never relink lists under the lock,
+ * while recently used entries survive as in LRU.
+ *
+ * The capacity limits the total weight of entries: by default every
+ * entry weighs 1, so it is the number of entries. Statistics are
+ * relaxed atomics of each shard, summed by stats() without locks.
+ *
+ * @tparam Key Type of keys.
+ * @tparam Tp Type of values.
+ * @tparam Hash Hash function of keys.
+ * @tparam Lock Lock type of shards.
+ * @tparam Weigher Function object returning the weight of
+ * a key and a value.
+ * @tparam KeyEqual Equality of keys.
+ * @tparam Alloc Allocator of entries.
+ */
+template <typename Key, typename Tp, typename Hash = std::hash<Key>,
+          typename Lock = spinlock, typename Weigher = unit_weigher,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Tp>>>
+class concurrent_lru_cache
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "concurrent_lru_cache only works with lockable type");
+#endif
+
+    enum : std::size_t { _cache_line = 64 };
+
+    struct _entry
+    {
+        Tp value;
+        std::size_t weight = 0;
+        bool referenced = false;
+        const Key *key = nullptr;           // key of the map's node
+        _entry *prev = nullptr, *next = nullptr;  // clock ring
+
+      template <typename... Args>
+        explicit _entry(Args &&...args) : value(std::forward<Args>(args)...) { }
+    };
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+  template <typename Up>
+    using _rebind_alloc = typename _alloc_traits::template rebind_alloc<Up>;
+  template <typename Up>
+    using _rebind_traits = typename _alloc_traits::template rebind_traits<Up>;
+    using _map_type = std::unordered_map<Key, _entry, Hash, KeyEqual,
+        _rebind_alloc<std::pair<const Key, _entry>>>;
+    using _counter = std::atomic<std::uint64_t>;
+
+    struct alignas(_cache_line) _shard
+    {
+        Lock lock;
+        _map_type map;
+        _entry *hand = nullptr;
+        std::size_t capacity;
+
+        _counter hits { 0 }, misses { 0 }, inserts { 0 }, evictions { 0 };
+        _counter size { 0 }, weight { 0 };
+
+        _shard(std::size_t cap, const Hash &hash, const KeyEqual &equal,
+               const Alloc &alloc)
+            : map(0, hash, equal, alloc), capacity(cap) { }
+    };
+
+    Hash _hash;
+    Weigher _weigher;
+    _rebind_alloc<_shard> _alloc;
+    _shard *_shards = nullptr;
+    std::size_t _shard_count, _capacity;
+
+    _shard &_shard_of(const Key &key) const noexcept;
+
+    static void _link(_shard &s, _entry &e) noexcept;
+    static void _unlink(_shard &s, _entry &e) noexcept;
+    static void _add(std::atomic<std::uint64_t> &counter, std::uint64_t n) noexcept;
+    static void _sub(std::atomic<std::uint64_t> &counter, std::uint64_t n) noexcept;
+    bool _evict(_shard &s, std::size_t weight) noexcept;
+
+  template <typename... Args>
+    bool _emplace(_shard &s, const Key &key, Args &&...args);
+
+public:
+    using key_type = Key;
+    using mapped_type = Tp;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using weigher_type = Weigher;
+    using allocator_type = Alloc;
+    using lock_type = Lock;
+
+    explicit concurrent_lru_cache(size_type capacity, size_type shards = 16,
+                                  const Weigher &weigher = Weigher(),
+                                  const Hash &hash = Hash(),
+                                  const KeyEqual &equal = KeyEqual(),
+                                  const Alloc &alloc = Alloc());
+    ~concurrent_lru_cache();
+
+#ifndef DOXYGEN
+    concurrent_lru_cache(const concurrent_lru_cache&) = delete;
+    concurrent_lru_cache &operator=(const concurrent_lru_cache&) = delete;
+#endif
+
+    bool find(const Key &key, Tp &val);
+    std::optional<Tp> find(const Key &key);
+    bool contains(const Key &key) const;
+
+  template <typename... Args>
+    bool emplace(const Key &key, Args &&...args);
+
+  template <typename M>
+    bool insert_or_assign(const Key &key, M &&obj);
+
+    bool erase(const Key &key);
+    void clear();
+
+    size_type size() const noexcept;
+    size_type weight() const noexcept;
+
+    /// Returns true, if the cache has no entries
+    bool empty() const noexcept { return !size(); }
+
+    /// Returns the maximum total weight of entries
+    size_type capacity() const noexcept { return _capacity; }
+
+    /// Returns the number of shards
+    size_type shards() const noexcept { return _shard_count; }
+
+    cache_stats stats() const noexcept;
+};
+
+/**
+ * @brief Creates empty cache
+ * @param capacity Maximum total weight of entries, split evenly
+ * between shards.
+ * @param shards Number of shards, rounded up to a power of two.
+ * @param weigher Weigher of entries.
+ * @param hash Hash function of keys.
+ * @param equal Equality of keys.
+ * @param alloc Allocator of entries.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    concurrent_lru_cache(size_type capacity, size_type shards,
+                         const Weigher &weigher, const Hash &hash,
+                         const KeyEqual &equal, const Alloc &alloc)
+        : _hash(hash), _weigher(weigher), _alloc(alloc), _shard_count(1)
+    {
+        while(_shard_count < shards)
+            _shard_count <<= 1;
+        const size_type share = (capacity + _shard_count - 1) / _shard_count;
+        _capacity = share * _shard_count;
+
+        _shards = std::addressof(*_rebind_traits<_shard>::allocate(_alloc, _shard_count));
+        size_type i = 0;
+        try {
+            for(; i < _shard_count; ++i)
+                _rebind_traits<_shard>::construct(_alloc, _shards + i,
+                                                  share, hash, equal, alloc);
+        } catch(...) {
+            while(i--) _rebind_traits<_shard>::destroy(_alloc, _shards + i);
+            _rebind_traits<_shard>::deallocate(_alloc, _shards, _shard_count);
+            throw;
+        }
+    }
+
+/**
+ * @brief Destroys all entries
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    ~concurrent_lru_cache()
+    {
+        for(size_type i = 0; i < _shard_count; ++i)
+            _rebind_traits<_shard>::destroy(_alloc, _shards + i);
+        _rebind_traits<_shard>::deallocate(_alloc, _shards, _shard_count);
+    }
+
+/**
+ * @internal
+ * @brief Returns the shard of @a key
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    auto
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _shard_of(const Key &key) const noexcept -> _shard&
+    {
+        // high bits of the product, as maps of shards use low ones
+        const std::uint64_t h = std::uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ull;
+        return _shards[(h >> 32) & (_shard_count - 1)];
+    }
+
+/**
+ * @internal
+ * @brief Inserts @a e into the ring just behind the hand,
+ * so it is the last entry the hand reaches
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    void
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _link(_shard &s, _entry &e) noexcept
+    {
+        if(!s.hand) {
+            e.prev = e.next = s.hand = &e;
+            return;
+        }
+        e.next = s.hand;
+        e.prev = s.hand->prev;
+        e.prev->next = &e;
+        s.hand->prev = &e;
+    }
+
+/**
+ * @internal
+ * @brief Removes @a e from the ring, moving the hand past it
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    void
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _unlink(_shard &s, _entry &e) noexcept
+    {
+        if(e.next == &e) {
+            s.hand = nullptr;
+            return;
+        }
+        if(s.hand == &e)
+            s.hand = e.next;
+        e.prev->next = e.next;
+        e.next->prev = e.prev;
+    }
+
+/**
+ * @internal
+ * @brief Adds @a n to @a counter, which is modified only
+ * under the lock of its shard
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    void
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _add(std::atomic<std::uint64_t> &counter, std::uint64_t n) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+/// @copydoc _add()
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    void
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _sub(std::atomic<std::uint64_t> &counter, std::uint64_t n) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) - n,
+                      std::memory_order_relaxed);
+    }
+
+/**
+ * @internal
+ * @brief Evicts entries of @a s until @a weight more fits
+ * @note Must be called under the lock of @a s.
+ * @return false, if @a weight exceeds the capacity of the shard.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _evict(_shard &s, std::size_t weight) noexcept
+    {
+        if(weight > s.capacity)
+            return false;
+
+        while(s.weight.load(std::memory_order_relaxed) + weight > s.capacity) {
+            _entry &e = *s.hand;
+            if(e.referenced) {
+                // second chance
+                e.referenced = false;
+                s.hand = e.next;
+                continue;
+            }
+            _unlink(s, e);
+            _sub(s.weight, e.weight);
+            _sub(s.size, 1);
+            _add(s.evictions, 1);
+            s.map.erase(*e.key);
+        }
+        return true;
+    }
+
+/**
+ * @brief Copies the value of @a key to @a val and marks
+ * the entry as recently used
+ * @return true, if @a key is present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    find(const Key &key, Tp &val)
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        auto it = s.map.find(key);
+        if(it == s.map.end()) {
+            _add(s.misses, 1);
+            return false;
+        }
+        _add(s.hits, 1);
+        if(!it->second.referenced)
+            it->second.referenced = true;
+        val = it->second.value;
+        return true;
+    }
+
+/**
+ * @brief Copies the value of @a key and marks the entry
+ * as recently used
+ * @return The value or empty optional, if @a key is absent.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    auto
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    find(const Key &key) -> std::optional<Tp>
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        auto it = s.map.find(key);
+        if(it == s.map.end()) {
+            _add(s.misses, 1);
+            return std::nullopt;
+        }
+        _add(s.hits, 1);
+        if(!it->second.referenced)
+            it->second.referenced = true;
+        return it->second.value;
+    }
+
+/**
+ * @brief Returns true, if @a key is present
+ * @note Neither marks the entry nor counts the lookup.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    contains(const Key &key) const
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        return s.map.count(key);
+    }
+
+/**
+ * @internal
+ * @brief Inserts an entry of absent @a key to @a s
+ * @note Must be called under the lock of @a s.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+      template <typename... Args>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    _emplace(_shard &s, const Key &key, Args &&...args)
+    {
+        auto it = s.map.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(std::forward<Args>(args)...)).first;
+        _entry &e = it->second;
+        try {
+            e.weight = _weigher(it->first, static_cast<const Tp&>(e.value));
+        } catch(...) {
+            s.map.erase(it);
+            throw;
+        }
+        if(!_evict(s, e.weight)) {
+            s.map.erase(it);
+            return false;
+        }
+
+        e.key = &it->first;
+        _link(s, e);
+        _add(s.weight, e.weight);
+        _add(s.size, 1);
+        _add(s.inserts, 1);
+        return true;
+    }
+
+/**
+ * @brief Inserts an entry of @a key and the value constructed
+ * from @a args, if @a key is absent, evicting entries as needed
+ * @return true, if the entry has been inserted; false, if @a key
+ * is present or the entry weighs more than a shard may hold.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+      template <typename... Args>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    emplace(const Key &key, Args &&...args)
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        if(s.map.count(key))
+            return false;
+        return _emplace(s, key, std::forward<Args>(args)...);
+    }
+
+/**
+ * @brief Assigns @a obj to the value of @a key, inserting
+ * the entry, if @a key is absent
+ *
+ * An assigned entry is reweighed and marked as recently used.
+ * @return true, if the entry has been inserted or assigned; false,
+ * if it weighs more than a shard may hold, then @a key is removed.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+      template <typename M>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    insert_or_assign(const Key &key, M &&obj)
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        auto it = s.map.find(key);
+        if(it == s.map.end())
+            return _emplace(s, key, std::forward<M>(obj));
+
+        _entry &e = it->second;
+        e.value = std::forward<M>(obj);
+        const std::size_t weight = _weigher(it->first, static_cast<const Tp&>(e.value));
+
+        // the entry leaves the ring while others are evicted for it
+        _unlink(s, e);
+        _sub(s.weight, e.weight);
+        _sub(s.size, 1);
+        e.weight = weight;
+        e.referenced = true;
+        if(!_evict(s, e.weight)) {
+            s.map.erase(it);
+            return false;
+        }
+        _link(s, e);
+        _add(s.weight, e.weight);
+        _add(s.size, 1);
+        return true;
+    }
+
+/**
+ * @brief Removes the entry of @a key
+ * @return true, if @a key was present.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    bool
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    erase(const Key &key)
+    {
+        _shard &s = _shard_of(key);
+        std::lock_guard<Lock> lk(s.lock);
+        auto it = s.map.find(key);
+        if(it == s.map.end())
+            return false;
+
+        _unlink(s, it->second);
+        _sub(s.weight, it->second.weight);
+        _sub(s.size, 1);
+        s.map.erase(it);
+        return true;
+    }
+
+/**
+ * @brief Removes all entries
+ * @note Keeps the statistics.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    void
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    clear()
+    {
+        for(size_type i = 0; i < _shard_count; ++i) {
+            _shard &s = _shards[i];
+            std::lock_guard<Lock> lk(s.lock);
+            s.map.clear();
+            s.hand = nullptr;
+            s.weight.store(0, std::memory_order_relaxed);
+            s.size.store(0, std::memory_order_relaxed);
+        }
+    }
+
+/**
+ * @brief Counts entries without locks
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    auto
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    size() const noexcept -> size_type
+    {
+        size_type n = 0;
+        for(size_type i = 0; i < _shard_count; ++i)
+            n += _shards[i].size.load(std::memory_order_relaxed);
+        return n;
+    }
+
+/**
+ * @brief Sums weights of entries without locks
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    auto
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    weight() const noexcept -> size_type
+    {
+        size_type n = 0;
+        for(size_type i = 0; i < _shard_count; ++i)
+            n += _shards[i].weight.load(std::memory_order_relaxed);
+        return n;
+    }
+
+/**
+ * @return Sum of statistics of all shards
+ * @note Counters are read one by one without locks, so the
+ * snapshot is not consistent with respect to concurrent operations.
+ */
+  template <typename Key, typename Tp, typename Hash, typename Lock,
+            typename Weigher, typename KeyEqual, typename Alloc>
+    cache_stats
+    concurrent_lru_cache<Key, Tp, Hash, Lock, Weigher, KeyEqual, Alloc>::
+    stats() const noexcept
+    {
+        const auto r = std::memory_order_relaxed;
+        cache_stats st;
+        for(size_type i = 0; i < _shard_count; ++i) {
+            const _shard &s = _shards[i];
+            st.hits += s.hits.load(r);
+            st.misses += s.misses.load(r);
+            st.inserts += s.inserts.load(r);
+            st.evictions += s.evictions.load(r);
+            st.size += s.size.load(r);
+            st.weight += s.weight.load(r);
+        }
+        return st;
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_CONCURRENT_LRU_CACHE_H
@@ -28,11 +28,16 @@
 #ifndef CONCURRENT_UTILS_CONCURRENT_QUEUE_H
 #define CONCURRENT_UTILS_CONCURRENT_QUEUE_H
 
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <type_traits>
+#include <utility>
 #include <condition_variable>
 
 #include "locks.h"
+#include "queue-metrics.h"
+#include "wait-strategies.h"
 
 namespace concurrent_utils {
 
@@ -52,8 +57,9 @@ namespace details {
         };
 
         // Rebind to node's allocator type
-        typedef typename Alloc::template rebind<node>::other
+        typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node>
             node_alloc_type;
+        typedef std::allocator_traits<node_alloc_type> node_alloc_traits;
 
         // Queue's root structure.
         // Derived from node's allocator to use EBO.
@@ -81,16 +87,23 @@ namespace details {
 
         void operator()(node *ptr)
         {
-            using traits = std::allocator_traits<node_alloc_type>;
             node_alloc_type &alloc = _get_node_allocator();
-            traits::destroy(alloc, ptr);
-            traits::deallocate(alloc, ptr, 1);
+            node_alloc_traits::destroy(alloc, ptr);
+            node_alloc_traits::deallocate(alloc, ptr, 1);
         }
 
         using scoped_node_ptr = std::unique_ptr<node, basic_forward_queue<Tp, Alloc> &>;
 
         queue_impl _impl;
 
+        // Swap either exchanges allocators or moves items between them
+        static constexpr bool _nothrow_swap =
+            node_alloc_traits::propagate_on_container_swap::value
+            || node_alloc_traits::is_always_equal::value;
+
+        basic_forward_queue() = default;
+        explicit basic_forward_queue(const node_alloc_type &a) : _impl(a) { }
+
         // Returns node's allocator reference
         inline node_alloc_type &_get_node_allocator() noexcept
         { return *static_cast<node_alloc_type*>(&_impl); }
@@ -102,18 +115,213 @@ namespace details {
       template <typename... Args>
         scoped_node_ptr _create_node(Args&&...);
 
+        // Returns true, if nodes of @a other may be freed by own allocator
+        inline bool _same_allocator(const basic_forward_queue &other) const noexcept
+        {
+            return node_alloc_traits::is_always_equal::value
+                || _get_node_allocator() == other._get_node_allocator();
+        }
+
+        // Exchanges nodes with @a other, and allocators too if Propagate
+      template <bool Propagate>
+        inline void _exchange(basic_forward_queue &other) noexcept
+        {
+            if constexpr(Propagate) {
+                using std::swap;
+                swap(_get_node_allocator(), other._get_node_allocator());
+            }
+            _impl.swap(other._impl);
+        }
+
+        void _swap(basic_forward_queue &other) noexcept(_nothrow_swap);
+
         inline void  _hook(node*) noexcept;
+        inline void  _splice(basic_forward_queue &other) noexcept;
         inline scoped_node_ptr _unhook_next() noexcept;
+        void _relocate_from(basic_forward_queue &other);
         void _clear();
         inline bool _empty() const noexcept { return !_impl.last; }
+        std::size_t _count() const noexcept;
 
     }; // struct basic_forward_queue
 
+    // Counts pushes and closes for spinning consumers
+  template <bool Spins>
+    struct queue_events
+    {
+        std::atomic<unsigned> _events { 0 };
+
+        inline void _signal() noexcept
+        { _events.fetch_add(1, std::memory_order_release); }
+    };
+
+  template <>
+    struct queue_events<false>
+    {
+        inline void _signal() noexcept { }
+    };
+
+  template <typename Lock, typename Metrics, typename Wait = park_wait>
+    struct queue_sync : queue_events<Wait::spins>
+    {
+        using cond_type = typename std::conditional<
+            std::is_same<Lock, std::mutex>::value,
+            std::condition_variable, std::condition_variable_any>::type;
+
+        mutable Lock _lock;
+        cond_type _cond;
+        bool _closed = false;
+        mutable Metrics _metrics;
+
+        // Acquires the lock through the metrics policy,
+        // to be passed to std::lock_guard or std::unique_lock
+        inline std::adopt_lock_t _acquire() const
+        { _metrics.acquire(_lock); return std::adopt_lock; }
+
+        // Tries to acquire the lock through the metrics policy until
+        // atime; on success the lock is to be adopted by the caller
+      template <typename Clock, typename Duration>
+        inline bool _try_acquire(const std::chrono::time_point<Clock, Duration> &atime) const
+        { return _metrics.try_acquire_until(_lock, atime); }
+
+      template <typename Ready, typename Expired, typename Park>
+        void _spin_wait(std::unique_lock<Lock> &lk, Ready ready,
+                        Expired expired, Park park);
+
+      template <typename Ready>
+        bool _wait(std::unique_lock<Lock> &lk, Ready ready);
+
+      template <typename Ready, typename Clock, typename Duration>
+        bool _wait(std::unique_lock<Lock> &lk, Ready ready,
+            const std::chrono::time_point<Clock, Duration> &atime);
+
+      template <typename Ready, typename Rep, typename Period>
+        bool _wait(std::unique_lock<Lock> &lk, Ready ready,
+            const std::chrono::duration<Rep, Period> &rtime);
+
+        // Wakes a consumer according to the wait strategy
+        inline void _notify()
+        {
+            this->_signal();
+            if(Wait::parks)
+                _cond.notify_one();
+        }
+
+        void _close();
+
+    }; // struct queue_sync
+
 } // namespace details
 
 
-template <typename Tp, typename Lock, typename Alloc = std::allocator<Tp>>
+/**
+ * @brief Items detached from a queue at once
+ *
+ * Owns the detached nodes and frees all of them in the destructor,
+ * that is outside of the queue's lock. Swap and move assignment
+ * follow allocator's propagate_on_container_swap, as the queue does.
+ *
+ * @sa concurrent_queue::pull_all()
+ */
+template <typename Tp, typename Alloc = std::allocator<Tp>>
+class queue_batch : protected details::basic_forward_queue<Tp, Alloc>
+{
+    using _base = details::basic_forward_queue<Tp, Alloc>;
+
+  template <typename Up, typename Node>
+    class _iterator
+    {
+        Node *_node = nullptr;
+
+      template <typename, typename>
+        friend class _iterator;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename std::remove_const<Up>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Up *;
+        using reference = Up &;
+
+        _iterator() = default;
+        explicit _iterator(Node *node) noexcept : _node(node) { }
+
+        // Allows conversion from iterator to const_iterator
+      template <typename Up2, typename Node2>
+        _iterator(const _iterator<Up2, Node2> &other) noexcept
+            : _node(other._node) { }
+
+        reference operator*() const noexcept { return _node->t; }
+        pointer operator->() const noexcept { return std::addressof(_node->t); }
+
+        _iterator &operator++() noexcept
+        { _node = _node->next; return *this; }
+
+        _iterator operator++(int) noexcept
+        { _iterator ret = *this; ++*this; return ret; }
+
+        bool operator==(const _iterator &other) const noexcept
+        { return _node == other._node; }
+
+        bool operator!=(const _iterator &other) const noexcept
+        { return _node != other._node; }
+    };
+
+public:
+    using allocator_type = Alloc;
+    using value_type = Tp;
+    using size_type = std::size_t;
+    using iterator = _iterator<Tp, typename _base::node>;
+    using const_iterator = _iterator<const Tp, const typename _base::node>;
+
+    queue_batch() = default;
+
+    /// Creates empty batch using allocator @a a
+    explicit queue_batch(const allocator_type &a)
+        : _base(typename _base::node_alloc_type(a)) { }
+
+    /// Frees all items
+    ~queue_batch() { _base::_clear(); }
+
+    /// Moves items from \a other to self
+    queue_batch(queue_batch &&other) noexcept
+        : _base(other._get_node_allocator()) { _base::_impl.swap(other._impl); }
+
+    /// Frees own items and moves items from \a other to self
+    queue_batch &operator=(queue_batch &&other) noexcept(_base::_nothrow_swap)
+    { queue_batch(std::move(other)).swap(*this); return *this; }
+
+    /// Exchanges items with \a other
+    void swap(queue_batch &other) noexcept(_base::_nothrow_swap)
+    { _base::_swap(other); }
+
+    /// Returns the allocator used by the batch
+    allocator_type get_allocator() const noexcept
+    { return allocator_type(_base::_get_node_allocator()); }
+
+    /// Returns true, if the batch has no items
+    bool empty() const noexcept { return _base::_empty(); }
+
+    /// Counts items of the batch
+    size_type size() const noexcept { return _base::_count(); }
+
+    iterator begin() noexcept { return iterator(_base::_impl.next); }
+    iterator end() noexcept { return iterator(); }
+    const_iterator begin() const noexcept { return const_iterator(_base::_impl.next); }
+    const_iterator end() const noexcept { return const_iterator(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+  template <typename Tpa, typename Locka, typename Alloca, typename Metricsa, typename Waita>
+    friend class concurrent_queue;
+
+}; // class queue_batch
+
+
+template <typename Tp, typename Lock, typename Alloc = std::allocator<Tp>,
+          typename Metrics = no_queue_metrics, typename Wait = park_wait>
 class concurrent_queue : protected details::basic_forward_queue<Tp, Alloc>
+                       , protected details::queue_sync<Lock, Metrics, Wait>
 {
 #ifndef DOXYGEN
     static_assert(std::is_copy_constructible<Tp>::value
@@ -125,24 +333,73 @@ class concurrent_queue : protected details::basic_forward_queue<Tp, Alloc>
 #endif
 
     using _base = details::basic_forward_queue<Tp, Alloc>;
-    using _cond_type = typename std::conditional<
-        std::is_same<Lock, std::mutex>::value,
-        std::condition_variable, std::condition_variable_any>::type;
+    using _sync = details::queue_sync<Lock, Metrics, Wait>;
 
-    mutable Lock _lock;
-    _cond_type _cond;
-    bool _closed = false;
+    using _sync::_lock;
+    using _sync::_closed;
+    using _sync::_metrics;
+    using _sync::_acquire;
+    using _sync::_try_acquire;
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+
+    // Whether copy assignment from a queue with Alloc2 replaces the allocator
+  template <typename Alloc2>
+    static constexpr bool _propagates_copy()
+    {
+        return std::is_same<Alloc, Alloc2>::value
+            && _alloc_traits::propagate_on_container_copy_assignment::value;
+    }
+
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    Alloc _copy_allocator(
+        concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other) const noexcept
+    {
+        if constexpr(_propagates_copy<Alloc2>())
+            return other.get_allocator();
+        else
+            return get_allocator();
+    }
+
+    // Synchronizes the depth counter after bulk operations
+    inline void _recount() noexcept
+    { if(Metrics::enabled) _metrics.set_depth(_base::_count()); }
+
+    using _node = typename _base::node;
+
+    // Position of a for_each() walk, kept on the walker's stack
+    // and linked into the queue's list of walks, guarded by the lock
+    struct _walk
+    {
+        const _node *next, *last; // next item to visit, or null
+        _walk *link;
+    };
+
+    mutable _walk *_walks = nullptr;
+
+    void _skip(const _node *p) const noexcept;
+    void _end_walks() const noexcept;
+    void _leave(_walk &w) const noexcept;
+    typename _base::scoped_node_ptr _unhook() noexcept;
+
+  template <typename Visit>
+    void _visit(Visit &&visit) const;
+
+    // Acquires own and other's lock through the metrics
+    // policies in address order, to be adopted by ordered_lock
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    std::adopt_lock_t _acquire(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&) const;
 
     // To allow construction and assignment from any incompatible types
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    void _assign(concurrent_queue<Tp2, Lock2, Alloc2> const&);
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    void _assign(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&);
 
-  template <typename Lock2>
-    void _append(concurrent_queue<Tp, Lock2, Alloc> &&);
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    void _append(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&);
 
     // We can append queues with any compatible types
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    void _append(concurrent_queue<Tp2, Lock2, Alloc2> const&);
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    void _append(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&);
 
     bool _wait(std::unique_lock<Lock> &lk);
 
@@ -154,16 +411,32 @@ class concurrent_queue : protected details::basic_forward_queue<Tp, Alloc>
     bool _wait(std::unique_lock<Lock> &lk,
         const std::chrono::duration<Rep, Period> &rtime);
 
+    typename _base::scoped_node_ptr _take();
+
+  template <typename... Deadline>
+    typename _base::scoped_node_ptr _wait_take(const Deadline &...);
+
+  template <typename Clock, typename Duration>
+    typename _base::scoped_node_ptr
+    _try_wait_take(const std::chrono::time_point<Clock, Duration> &atime);
+
 public:
     using allocator_type = Alloc;
     using value_type = Tp;
     using size_type = std::size_t;
+    using metrics_type = Metrics;
+    using wait_strategy = Wait;
+    using batch_type = queue_batch<Tp, Alloc>;
+
+    /// Size of the memory block allocated for each item
+    static constexpr std::size_t node_size = sizeof(typename _base::node);
 
     /// Returns the allocator used by the queue
     allocator_type get_allocator() const noexcept
     { return allocator_type(_base::_get_node_allocator()); }
 
     concurrent_queue() noexcept;
+    explicit concurrent_queue(const allocator_type &a) noexcept;
     ~concurrent_queue();
 
     concurrent_queue(concurrent_queue const&);
@@ -172,69 +445,71 @@ public:
     // To allow construction and assignment from any compatible types
 
     /// @copydoc concurrent_queue(const concurrent_queue &other)
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2> const&);
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&);
 
     /// @copydoc concurrent_queue::operator=(const concurrent_queue &other)
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue &operator=(concurrent_queue<Tp2, Lock2, Alloc2> const&);
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue &operator=(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&);
 
     /// @brief Appends contents of @a other to itself by moving items
-  template <typename Lock2>
-    concurrent_queue &append(concurrent_queue<Tp, Lock2, Alloc> &&other);
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    concurrent_queue &append(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&other);
 
     /// @copydoc append
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue &append(concurrent_queue<Tp2, Lock2, Alloc2> const&);
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue &append(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const&);
 
-    /// Moves content from \a other to self
+    /// Moves content and allocator from \a other to self
     concurrent_queue(concurrent_queue &&other) noexcept
-        : concurrent_queue() { swap(other); }
+        : concurrent_queue(other.get_allocator()) { swap(other); }
 
     /// Clears content and moves it from \a other to self
-    concurrent_queue &operator=(concurrent_queue &&other) noexcept
+    concurrent_queue &operator=(concurrent_queue &&other) noexcept(_base::_nothrow_swap)
     { concurrent_queue(std::move(other)).swap(*this); return *this; }
 
     /// @copydoc concurrent_queue(concurrent_queue &&other)
-  template <typename Lock2>
-    concurrent_queue(concurrent_queue<Tp, Lock2, Alloc> &&other) noexcept
-        : concurrent_queue() { swap(other); }
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    concurrent_queue(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&other) noexcept
+        : concurrent_queue(other.get_allocator()) { swap(other); }
 
     /// @copydoc operator=(concurrent_queue &&other)
-  template <typename Lock2>
-    concurrent_queue &operator=(concurrent_queue<Tp, Lock2, Alloc> &&other) noexcept
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    concurrent_queue &operator=(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&other)
+        noexcept(_base::_nothrow_swap)
     { concurrent_queue(std::move(other)).swap(*this); return *this; }
 
 #ifndef DOXYGEN
     // Moving from another types is prohibited
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2> &&) = delete;
-  template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue &operator=(concurrent_queue<Tp2, Lock2, Alloc2> &&) = delete;
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> &&) = delete;
+  template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue &operator=(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> &&) = delete;
 #endif
 
     /// Returns true, if queue's size equals zero
     inline bool empty() const
-    { std::lock_guard<Lock> lk(_lock); return _base::_empty(); }
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _base::_empty(); }
 
     /// Returns true, if queue closed
     inline bool closed() const
-    { std::lock_guard<Lock> lk(_lock); return _closed; }
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _closed; }
 
-    /// Clears queue's contents
-    inline void clear() noexcept
-    { concurrent_queue<Tp, Lock, Alloc>().swap(*this); }
+    void clear() noexcept;
 
     void close();
 
     /// Returns reference to a internal queue's lock
     inline Lock &underlying_lock() const noexcept { return _lock; }
 
-  template <typename Lock2>
-    void swap(concurrent_queue<Tp, Lock2, Alloc> &) noexcept;
+    /// Returns snapshot of metrics collected by the Metrics policy
+    inline queue_stats stats() const noexcept { return _metrics.stats(); }
 
-  template <typename Lock2>
-    void swap_unsafe(concurrent_queue<Tp, Lock2, Alloc> &) noexcept;
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    void swap(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &) noexcept(_base::_nothrow_swap);
+
+  template <typename Lock2, typename Metrics2, typename Wait2>
+    void swap_unsafe(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &) noexcept(_base::_nothrow_swap);
 
   template <typename... Args>
     bool push(Args &&...args);
@@ -251,12 +526,58 @@ public:
     bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
                    value_type &val);
 
+  template <typename Clock, typename Duration, typename... Args>
+    bool try_push_until(const std::chrono::time_point<Clock, Duration> &atime,
+                        Args &&...args);
+
+  template <typename Rep, typename Period, typename... Args>
+    bool try_push_for(const std::chrono::duration<Rep, Period> &rtime,
+                      Args &&...args);
+
+  template <typename Clock, typename Duration>
+    bool try_pull_until(const std::chrono::time_point<Clock, Duration> &atime,
+                        value_type &val);
+
+  template <typename Rep, typename Period>
+    bool try_pull_for(const std::chrono::duration<Rep, Period> &rtime,
+                      value_type &val);
+
   template <typename... Args>
     bool push_unsafe(Args &&...args);
 
     bool pull_unsafe(value_type &val);
 
-  template <typename Tpa, typename Locka, typename Alloca>
+  template <typename Func>
+    bool pull_with(Func &&f);
+
+    batch_type pull_all();
+
+  template <typename Func>
+    void for_each(Func &&f) const;
+
+    batch_type snapshot() const;
+
+    std::optional<value_type> try_pull();
+
+    std::optional<value_type> wait_pull();
+
+  template <typename Clock, typename Duration>
+    std::optional<value_type>
+    wait_pull(const std::chrono::time_point<Clock, Duration> &atime);
+
+  template <typename Rep, typename Period>
+    std::optional<value_type>
+    wait_pull(const std::chrono::duration<Rep, Period> &rtime);
+
+  template <typename Clock, typename Duration>
+    std::optional<value_type>
+    try_pull_until(const std::chrono::time_point<Clock, Duration> &atime);
+
+  template <typename Rep, typename Period>
+    std::optional<value_type>
+    try_pull_for(const std::chrono::duration<Rep, Period> &rtime);
+
+  template <typename Tpa, typename Locka, typename Alloca, typename Metricsa, typename Waita>
     friend class concurrent_queue;
 
 }; // class concurrent_queue
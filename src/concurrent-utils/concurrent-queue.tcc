@@ -41,13 +41,15 @@ namespace concurrent_utils {
     details::basic_forward_queue<Tp, Alloc>::
     _create_node(Args &&...args) -> scoped_node_ptr
     {
-        using traits = std::allocator_traits<node_alloc_type>;
         node_alloc_type &alloc = _get_node_allocator();
-        auto guarded_ptr = std::__allocate_guarded(alloc);
-        traits::construct(alloc, guarded_ptr.get(), std::forward<Args>(args)...);
-        scoped_node_ptr node { guarded_ptr.get(), *this };
-        guarded_ptr = nullptr;
-        return node;
+        node *ptr = std::addressof(*node_alloc_traits::allocate(alloc, 1));
+        try {
+            node_alloc_traits::construct(alloc, ptr, std::forward<Args>(args)...);
+        } catch(...) {
+            node_alloc_traits::deallocate(alloc, ptr, 1);
+            throw;
+        }
+        return { ptr, *this };
     }
 
 /**
@@ -66,6 +68,94 @@ namespace concurrent_utils {
         _impl.last = p;
     }
 
+/**
+ * @internal
+ * @brief Exchanges contents with @a other
+ *
+ * Allocators are exchanged as well if they propagate on swap.
+ * Otherwise nodes are exchanged only if allocators are equal,
+ * else items are moved to nodes created by the other allocator.
+ * @note If an exception occurs while items are moved, both queues
+ * keep their items, but the items might be left moved-from.
+ */
+  template <typename Tp, typename Alloc>
+    void
+    details::basic_forward_queue<Tp, Alloc>::
+    _swap(basic_forward_queue &other) noexcept(_nothrow_swap)
+    {
+        if constexpr(node_alloc_traits::propagate_on_container_swap::value)
+            _exchange<true>(other);
+        else if constexpr(node_alloc_traits::is_always_equal::value)
+            _exchange<false>(other);
+        else if(_same_allocator(other))
+            _exchange<false>(other);
+        else {
+            basic_forward_queue mine(_get_node_allocator());
+            basic_forward_queue theirs(other._get_node_allocator());
+
+            // might throw
+            mine._relocate_from(other);
+            try {
+                theirs._relocate_from(*this);
+            } catch(...) {
+                mine._clear();
+                throw;
+            }
+
+            // old nodes are freed by temporaries with right allocators
+            _impl.swap(mine._impl);
+            other._impl.swap(theirs._impl);
+            mine._clear();
+            theirs._clear();
+        }
+    }
+
+/**
+ * @internal
+ * @brief Moves all nodes of @a other to end of the queue
+ * @note Nodes must be allocated by an equal allocator.
+ */
+  template <typename Tp, typename Alloc>
+    void
+    details::basic_forward_queue<Tp, Alloc>::
+    _splice(basic_forward_queue &other) noexcept
+    {
+        if(!other._impl.next)
+            return;
+        if(_impl.last)
+            _impl.last->next = other._impl.next;
+        else
+            _impl.next = other._impl.next;
+        _impl.last = other._impl.last;
+        other._impl.next = other._impl.last = nullptr;
+    }
+
+/**
+ * @internal
+ * @brief Puts items of @a other to end of the queue into nodes
+ * created by own allocator, moving items if it can not throw
+ * @note Nodes of @a other are left in place. If an exception
+ * occurs, saves the original queue's state.
+ */
+  template <typename Tp, typename Alloc>
+    void
+    details::basic_forward_queue<Tp, Alloc>::
+    _relocate_from(basic_forward_queue &other)
+    {
+        basic_forward_queue items(_get_node_allocator());
+
+        try {
+            for(node *p = other._impl.next; p; p = p->next)
+                items._hook(items._create_node(
+                    nullptr, std::move_if_noexcept(p->t)).release());
+        } catch(...) {
+            items._clear();
+            throw;
+        }
+
+        _splice(items);
+    }
+
 /**
  * @internal
  * @brief Takes the next node from the queue
@@ -97,46 +187,203 @@ namespace concurrent_utils {
         while(_unhook_next());
     }
 
+/**
+ * @internal
+ * @brief Counts nodes of the queue
+ * @note Without blocking.
+ */
+  template <typename Tp, typename Alloc>
+    std::size_t
+    details::basic_forward_queue<Tp, Alloc>::_count() const noexcept
+    {
+        std::size_t n = 0;
+        for(auto *p = _impl.next; p; p = p->next)
+            ++n;
+        return n;
+    }
+
+/**
+ * @internal
+ * @brief Releases the lock and spins until a push or close
+ * is signalled, repeating until @a ready returns true, the queue
+ * is closed or @a expired returns true
+ *
+ * If the strategy gives up spinning, parks the thread by @a park.
+ */
+  template <typename Lock, typename Metrics, typename Wait>
+      template <typename Ready, typename Expired, typename Park>
+    void
+    details::queue_sync<Lock, Metrics, Wait>::
+    _spin_wait(std::unique_lock<Lock> &lk, Ready ready, Expired expired, Park park)
+    {
+        while(!_closed && !ready() && !expired()) {
+            // pushes are signalled under the lock, so none is missed
+            const unsigned seen = this->_events.load(std::memory_order_relaxed);
+            lk.unlock();
+            const bool signalled = Wait::spin([&]() {
+                return this->_events.load(std::memory_order_acquire) != seen
+                    || expired();
+            });
+            lk.lock();
+
+            if constexpr(Wait::parks) {
+                if(!signalled && !_closed && !ready())
+                    park(lk);
+            }
+        }
+    }
+
+/**
+ * @internal
+ * @brief Waits until @a ready returns true or the queue is closed
+ * @return true, if the queue has been closed.
+ */
+  template <typename Lock, typename Metrics, typename Wait>
+      template <typename Ready>
+    bool
+    details::queue_sync<Lock, Metrics, Wait>::
+    _wait(std::unique_lock<Lock> &lk, Ready ready)
+    {
+        if(_closed || ready())
+            return _closed; // not blocked, so not a wait
+        const auto start = _metrics.now();
+        if constexpr(Wait::spins)
+            _spin_wait(lk, ready, []() { return false; },
+                [this](std::unique_lock<Lock> &l) { _cond.wait(l); });
+        else
+            _cond.wait(lk, [&]() { return _closed || ready(); });
+        _metrics.on_wait(start);
+        return _closed;
+    }
+
+/**
+ * @internal
+ * @brief Waits until @a ready returns true or the queue is closed,
+ * but not later than @a atime
+ * @return true, if the queue is closed.
+ */
+  template <typename Lock, typename Metrics, typename Wait>
+      template <typename Ready, typename Clock, typename Duration>
+    bool
+    details::queue_sync<Lock, Metrics, Wait>::
+    _wait(std::unique_lock<Lock> &lk, Ready ready,
+          const std::chrono::time_point<Clock, Duration> &atime)
+    {
+        if(_closed || ready())
+            return _closed; // not blocked, so not a wait
+        const auto start = _metrics.now();
+        if constexpr(Wait::spins)
+            _spin_wait(lk, ready, [&]() { return !(Clock::now() < atime); },
+                [&](std::unique_lock<Lock> &l) { _cond.wait_until(l, atime); });
+        else
+            _cond.wait_until(lk, atime, [&]() { return _closed || ready(); });
+        _metrics.on_wait(start);
+        return _closed;
+    }
+
+/**
+ * @internal
+ * @brief Waits until @a ready returns true or the queue is closed,
+ * but not longer than @a rtime
+ * @return true, if the queue is closed.
+ */
+  template <typename Lock, typename Metrics, typename Wait>
+      template <typename Ready, typename Rep, typename Period>
+    bool
+    details::queue_sync<Lock, Metrics, Wait>::
+    _wait(std::unique_lock<Lock> &lk, Ready ready,
+          const std::chrono::duration<Rep, Period> &rtime)
+    {
+        if constexpr(Wait::spins)
+            return _wait(lk, ready, std::chrono::steady_clock::now() + rtime);
+
+        if(_closed || ready())
+            return _closed;
+        const auto start = _metrics.now();
+        _cond.wait_for(lk, rtime, [&]() { return _closed || ready(); });
+        _metrics.on_wait(start);
+        return _closed;
+    }
+
+/**
+ * @internal
+ * @brief Closes the queue and wakes up all waiters
+ */
+  template <typename Lock, typename Metrics, typename Wait>
+    void
+    details::queue_sync<Lock, Metrics, Wait>::_close()
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        _closed = true;
+        this->_signal();
+        if(Wait::parks)
+            _cond.notify_all();
+    }
+
 /**
  * @internal
  * @brief Copies content of @a other to self
+ *
+ * Items are copied by a walk over @a other, so its producers and
+ * consumers are not blocked, and the queue is locked only to take
+ * the copies.
  * @note If an exception occurs during nodes are copying, saves
  * the original queue's state.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template<typename Tp2, typename Lock2, typename Alloc2>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template<typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
     void
-    concurrent_queue<Tp, Lock, Alloc>::
-    _assign(concurrent_queue<Tp2, Lock2, Alloc2> const &other)
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _assign(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other)
     {
         static_assert(std::is_constructible<Tp, Tp2>::value,
                 "template argument substituting Tp in the second"
            " queue object declaration must be constructible from"
                      " Tp in the first queue object declaration");
 
-        // temp's destructor should be executed after all unlocks
-        concurrent_queue<Tp, Lock, Alloc> temp;
+        // temp's destructor should be executed after the unlock
+        concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> temp(_copy_allocator(other));
 
-        // to protect deadlocks
-        ordered_lock<Lock, Lock2> locker { _lock, other._lock };
+        // other's producers and consumers are not blocked meanwhile
+        other._visit([&temp](Tp2 &t) {
+            temp._hook(temp._create_node(nullptr, std::move(t)).release()); // might throw
+        });
 
-        for(auto *other_node_ptr = other._impl.next;
-            other_node_ptr;
-            other_node_ptr = other_node_ptr->next)
-        {
-            // might throw
-            typename _base::scoped_node_ptr
-                node_ptr = temp._create_node(nullptr, std::ref(other_node_ptr->t));
-            temp._hook(node_ptr.release());
-        }
+        std::lock_guard<Lock> lk(_lock, _acquire());
 
-        // we can unlock other now
-        std::unique_lock<Lock> locker2 { _lock, std::adopt_lock };
-        locker.release();
-        other._lock.unlock();
+        // swap contents with the temp object, taking
+        // its allocator if it propagates on copy assignment
+        if constexpr(_propagates_copy<Alloc2>()) {
+            _base::template _exchange<true>(temp);
+            _end_walks();
+            _recount();
+        } else
+            swap_unsafe(temp);
+    }
 
-        // swap contents with the temp object
-        swap_unsafe(temp);
+/**
+ * @internal
+ * @brief Acquires own lock and the lock of @a other in order of
+ * their addresses, so lock waits on both are seen by the metrics
+ * @return std::adopt_lock to pass to ordered_lock.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    std::adopt_lock_t
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _acquire(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other) const
+    {
+        if(static_cast<const void *>(&_lock)
+           < static_cast<const void *>(&other._lock)) {
+            std::unique_lock<Lock> lk(_lock, _acquire());
+            other._acquire();
+            lk.release();
+        } else {
+            std::unique_lock<Lock2> lk(other._lock, other._acquire());
+            _acquire();
+            lk.release();
+        }
+        return std::adopt_lock;
     }
 
 /**
@@ -144,32 +391,38 @@ namespace concurrent_utils {
  * @brief Appends contents of @a other to itself by moving
  * nodes using a simple exchange of pointers
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Lock2>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Lock2, typename Metrics2, typename Wait2>
     void
-    concurrent_queue<Tp, Lock, Alloc>::
-    _append(concurrent_queue<Tp, Lock2, Alloc> &&other)
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _append(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&other)
     {
         // to protect deadlocks
-        ordered_lock<Lock, Lock2> locker { _lock, other._lock };
-        if(this->_impl.last)
-            this->_impl.last->next = other._impl.next;
-        else
-            this->_impl.next = other._impl.next;
-        this->_impl.last = other._impl.last;
-        other._impl.next = other._impl.last = nullptr;
+        ordered_lock<Lock, Lock2> locker { _lock, other._lock, _acquire(other) };
+        if(_base::_same_allocator(other))
+            _base::_splice(other);
+        else {
+            // nodes of other can not be freed by own allocator
+            _base::_relocate_from(other); // might throw
+            other._clear();
+        }
+        other._end_walks();
+        _recount();
+        other._recount();
     }
 
 /**
  * @internal
  * @brief Appends contents of @a other to itself by copying nodes
+ *
+ * Items are copied by a walk over @a other, without blocking it.
  * @note The original queue is still in initial state.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template<typename Tp2, typename Lock2, typename Alloc2>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template<typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
     void
-    concurrent_queue<Tp, Lock, Alloc>::
-    _append(concurrent_queue<Tp2, Lock2, Alloc2> const &other)
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _append(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other)
     {
         static_assert(std::is_constructible<Tp, Tp2>::value,
                 "template argument substituting Tp in the second"
@@ -177,24 +430,13 @@ namespace concurrent_utils {
                     " Tp in the first queue object declaration");
 
         // temp's destructor should be executed after all unlocks
-        concurrent_queue<Tp, Lock, Alloc> temp;
+        concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> temp(get_allocator());
 
-        // to protect deadlocks
-        ordered_lock<Lock, Lock2> locker { _lock, other._lock };
+        // other's producers and consumers are not blocked meanwhile
+        other._visit([&temp](Tp2 &t) {
+            temp._hook(temp._create_node(nullptr, std::move(t)).release()); // might throw
+        });
 
-        for(auto *other_node_ptr = other._impl.next;
-            other_node_ptr;
-            other_node_ptr = other_node_ptr->next)
-        {
-            // might throw
-            typename _base::scoped_node_ptr
-                node_ptr = temp._create_node(nullptr, std::ref(other_node_ptr->t));
-            temp._hook(node_ptr.release());
-        }
-
-        locker.unlock();
-
-        // move contents from the temp object
         _append(std::move(temp));
     }
 
@@ -203,13 +445,12 @@ namespace concurrent_utils {
  * @brief Waits for items to appear in the queue
  * @return true, if the queue has been closed.
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     _wait(std::unique_lock<Lock> &lk)
     {
-        _cond.wait(lk, [this]() { return _closed || !_base::_empty(); });
-        return _closed;
+        return _sync::_wait(lk, [this]() { return !_base::_empty(); });
     }
 
 /**
@@ -217,16 +458,14 @@ namespace concurrent_utils {
  * @brief Waits for items to appear in the queue until @a atime
  * @return true, if the queue is closed.
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template<typename Clock, typename Duration>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     _wait(std::unique_lock<Lock> &lk,
           const std::chrono::time_point<Clock, Duration> &atime)
     {
-        _cond.wait_until(lk, atime, [this]() {
-            return _closed || !_base::_empty(); });
-        return _closed;
+        return _sync::_wait(lk, [this]() { return !_base::_empty(); }, atime);
     }
 
 /**
@@ -234,32 +473,211 @@ namespace concurrent_utils {
  * @brief Waits for items to appear in the queue within @a rtime
  * @return true, if the queue is closed.
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template <typename Rep, typename Period>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     _wait(std::unique_lock<Lock> &lk,
           const std::chrono::duration<Rep, Period> &rtime)
     {
-        _cond.wait_for(lk, rtime, [this]() {
-            return _closed || !_base::_empty(); });
-        return _closed;
+        return _sync::_wait(lk, [this]() { return !_base::_empty(); }, rtime);
+    }
+
+/**
+ * @internal
+ * @brief Takes the next node from the queue under the lock
+ * @return Address of taken node, or null if the queue is empty.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _take() -> typename _base::scoped_node_ptr
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        typename _base::scoped_node_ptr node = _unhook();
+        if(node) _metrics.on_pull();
+        return node;
+    }
+
+/**
+ * @internal
+ * @brief Waits for items to appear in the queue, optionally
+ * until @a deadline, then takes the next node under the lock
+ * @return Address of taken node, or null if the queue
+ * is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename... Deadline>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _wait_take(const Deadline &...deadline) -> typename _base::scoped_node_ptr
+    {
+        std::unique_lock<Lock> lk(_lock, _acquire());
+        if(_wait(lk, deadline...)) // if closed
+            return { nullptr, *this };
+        typename _base::scoped_node_ptr node = _unhook();
+        if(node) _metrics.on_pull();
+        return node;
+    }
+
+/**
+ * @internal
+ * @brief Acquires the lock and waits for items to appear in the
+ * queue, both until @a atime, then takes the next node
+ * @return Address of taken node, or null if the deadline has
+ * expired or the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Clock, typename Duration>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _try_wait_take(const std::chrono::time_point<Clock, Duration> &atime)
+        -> typename _base::scoped_node_ptr
+    {
+        if(!_try_acquire(atime))
+            return { nullptr, *this };
+        std::unique_lock<Lock> lk(_lock, std::adopt_lock);
+        if(_wait(lk, atime)) // if closed
+            return { nullptr, *this };
+        typename _base::scoped_node_ptr node = _unhook();
+        if(node) _metrics.on_pull();
+        return node;
+    }
+
+/**
+ * @internal
+ * @brief Moves walks, that are about to visit @a p, to the next item
+ * @note Without blocking. Must be called before @a p is unhooked.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _skip(const _node *p) const noexcept
+    {
+        for(_walk *w = _walks; w; w = w->link)
+            if(w->next == p)
+                w->next = p == w->last ? nullptr : p->next;
+    }
+
+/**
+ * @internal
+ * @brief Finishes all walks, used when all items leave the queue at once
+ * @note Without blocking.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::_end_walks() const noexcept
+    {
+        for(_walk *w = _walks; w; w = w->link)
+            w->next = nullptr;
+    }
+
+/**
+ * @internal
+ * @brief Unlinks the finished walk @a w from the queue
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _leave(_walk &w) const noexcept
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        _walk **link = &_walks;
+        while(*link != &w)
+            link = &(*link)->link;
+        *link = w.link;
+    }
+
+/**
+ * @internal
+ * @brief Takes the next node, walks that are about to visit it skip it
+ * @return Address of taken node, or null if the queue is empty.
+ * @note Without blocking.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _unhook() noexcept -> typename _base::scoped_node_ptr
+    {
+        if(_walks && _base::_impl.next)
+            _skip(_base::_impl.next);
+        return _base::_unhook_next();
+    }
+
+/**
+ * @internal
+ * @brief Walks over items that are in the queue at the moment
+ * of the call and invokes @a visit with a reference to a copy
+ * of each item that is still in the queue when reached
+ *
+ * Each item is copied under the lock, and @a visit is invoked
+ * without blocking. The walk is linked into the queue, so that
+ * consumers move it past the items they take, without copying.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Visit>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    _visit(Visit &&visit) const
+    {
+        _walk w { nullptr, nullptr, nullptr };
+
+        {
+            std::lock_guard<Lock> lk(_lock, _acquire());
+            if(_base::_empty())
+                return;
+            w = _walk { _base::_impl.next, _base::_impl.last, _walks };
+            _walks = &w;
+        }
+
+        // unlinks the walk however it finishes
+        struct leave_guard
+        {
+            const concurrent_queue &queue;
+            _walk &w;
+            ~leave_guard() { queue._leave(w); }
+        } guard { *this, w };
+
+        for(;;) {
+            std::optional<value_type> item;
+
+            {
+                std::lock_guard<Lock> lk(_lock, _acquire());
+                const _node *p = w.next;
+                if(!p)
+                    break;
+                item.emplace(p->t); // might throw
+                w.next = p == w.last ? nullptr : p->next;
+            }
+
+            visit(*item);
+        }
     }
 
 /**
  * Initializes all fields
  */
-  template <typename Tp, typename Lock, typename Alloc>
-    concurrent_queue<Tp, Lock, Alloc>::
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     concurrent_queue() noexcept
     {
     }
 
+/**
+ * Initializes all fields, items are allocated by @a a
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    concurrent_queue(const allocator_type &a) noexcept
+        : _base(typename _base::node_alloc_type(a))
+    {
+    }
+
 /**
  * Blocks and clears the queue
  */
-  template <typename Tp, typename Lock, typename Alloc>
-    concurrent_queue<Tp, Lock, Alloc>::
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     ~concurrent_queue()
     {
         close();
@@ -272,10 +690,11 @@ namespace concurrent_utils {
  * @note If an exception occurs during items are copying,
  * the queue is still empty.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-    concurrent_queue<Tp, Lock, Alloc>::
-    concurrent_queue(const concurrent_queue<Tp, Lock, Alloc> &other)
-        : concurrent_queue()
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    concurrent_queue(const concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> &other)
+        : concurrent_queue(_alloc_traits::select_on_container_copy_construction(
+              other.get_allocator()))
     {
         _assign(other);
     }
@@ -285,10 +704,10 @@ namespace concurrent_utils {
  * @note If an exception occurs during items are copying, saves
  * the original queue's state.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-    concurrent_queue<Tp, Lock, Alloc> &
-    concurrent_queue<Tp, Lock, Alloc>::
-    operator=(concurrent_queue<Tp, Lock, Alloc> const &other)
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> &
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    operator=(concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> const &other)
     {
         if(this != std::addressof(other))
             _assign(other);
@@ -298,10 +717,10 @@ namespace concurrent_utils {
 /**
  * @copydoc concurrent_queue(const concurrent_queue &other)
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue<Tp, Lock, Alloc>::
-    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2> const &other)
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    concurrent_queue(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other)
         : concurrent_queue()
     {
         _assign(other);
@@ -310,11 +729,11 @@ namespace concurrent_utils {
 /**
  * @copydoc concurrent_queue &concurrent_queue::operator=(const concurrent_queue &other)
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue<Tp, Lock, Alloc> &
-    concurrent_queue<Tp, Lock, Alloc>::
-    operator=(concurrent_queue<Tp2, Lock2, Alloc2> const &other)
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> &
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    operator=(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other)
     {
         _assign(other); return *this;
     }
@@ -322,11 +741,11 @@ namespace concurrent_utils {
 /**
  * @brief Appends contents of @a other to itself by moving items
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Lock2>
-    concurrent_queue<Tp, Lock, Alloc> &
-    concurrent_queue<Tp, Lock, Alloc>::
-    append(concurrent_queue<Tp, Lock2, Alloc> &&other)
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Lock2, typename Metrics2, typename Wait2>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> &
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    append(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &&other)
     {
         _append(std::move(other)); return *this;
     }
@@ -335,11 +754,11 @@ namespace concurrent_utils {
  * @brief Appends contents of @a other to itself by copying items
  * @note The original queue is still in initial state.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Tp2, typename Lock2, typename Alloc2>
-    concurrent_queue<Tp, Lock, Alloc> &
-    concurrent_queue<Tp, Lock, Alloc>::
-    append(concurrent_queue<Tp2, Lock2, Alloc2> const &other)
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Tp2, typename Lock2, typename Alloc2, typename Metrics2, typename Wait2>
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> &
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    append(concurrent_queue<Tp2, Lock2, Alloc2, Metrics2, Wait2> const &other)
     {
         _append(other); return *this;
     }
@@ -347,40 +766,60 @@ namespace concurrent_utils {
 /**
  * @brief Closes the queue
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
     void
-    concurrent_queue<Tp, Lock, Alloc>::close()
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::close()
     {
-        std::lock_guard<Lock> lk(_lock);
-        _closed = true;
-        _cond.notify_all();
+        _sync::_close();
+    }
+
+/**
+ * @brief Clears queue's contents
+ *
+ * The items are freed outside of the lock.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::clear() noexcept
+    {
+        concurrent_queue<Tp, Lock, Alloc, Metrics, Wait> temp(get_allocator());
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        swap_unsafe(temp);
     }
 
 /**
  * @brief Exchanges contents with @a other
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Lock2>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Lock2, typename Metrics2, typename Wait2>
     void
-    concurrent_queue<Tp, Lock, Alloc>::
-    swap(concurrent_queue<Tp, Lock2, Alloc> &other) noexcept
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    swap(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &other)
+        noexcept(_base::_nothrow_swap)
     {
         // to protect deadlocks
-        ordered_lock<Lock, Lock2> locker(_lock, other._lock);
+        ordered_lock<Lock, Lock2> locker(_lock, other._lock, _acquire(other));
         swap_unsafe(other);
     }
 
 /**
  * @brief Exchanges contents with @a other
- * @note Without blocking.
+ * @note Without blocking. If allocators neither propagate on swap
+ * nor compare equal, items are moved to nodes of other allocator.
+ * Walks over both queues finish.
  */
-  template <typename Tp, typename Lock, typename Alloc>
-      template <typename Lock2>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Lock2, typename Metrics2, typename Wait2>
     void
-    concurrent_queue<Tp, Lock, Alloc>::
-    swap_unsafe(concurrent_queue<Tp, Lock2, Alloc> &other) noexcept
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    swap_unsafe(concurrent_queue<Tp, Lock2, Alloc, Metrics2, Wait2> &other)
+        noexcept(_base::_nothrow_swap)
     {
-        _base::_impl.swap(other._base::_impl);
+        _base::_swap(other);
+        _end_walks();
+        other._end_walks();
+        _recount();
+        other._recount();
     }
 
 /**
@@ -389,10 +828,10 @@ namespace concurrent_utils {
  * @return true, if the queue is not closed.
  * @snippet concurrent-queue.cc push
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template<typename... Args>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     push(Args &&...args)
     {
         static_assert(std::is_constructible<value_type, Args...>::value,
@@ -402,10 +841,14 @@ namespace concurrent_utils {
         typename _base::scoped_node_ptr node
             = _base::_create_node(nullptr, std::forward<Args>(args)...);
 
-        std::lock_guard<Lock> lk(_lock);
-        if(_closed) return false;
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
+        }
         _base::_hook(node.release());
-        _cond.notify_one();
+        _metrics.on_push();
+        _sync::_notify();
         return true;
     }
 
@@ -415,17 +858,12 @@ namespace concurrent_utils {
  * @return false, if the queue is already empty; true otherwise.
  * @snippet concurrent-queue.cc pull
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     pull(value_type &val)
     {
-        typename _base::scoped_node_ptr node { nullptr, *this };
-
-        {
-            std::lock_guard<Lock> lk(_lock);
-            node = _base::_unhook_next();
-        }
+        typename _base::scoped_node_ptr node = _take();
 
         if(node) {
             val = std::move_if_noexcept(node->t);
@@ -442,18 +880,12 @@ namespace concurrent_utils {
  * @return false, if the queue is empty or closed, true otherwise.
  * @snippet concurrent-queue.cc wait_pull
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     wait_pull(value_type &val)
     {
-        typename _base::scoped_node_ptr node { nullptr, *this };
-
-        {
-            std::unique_lock<Lock> lk(_lock);
-            if(_wait(lk)) return false; // if closed
-            node = _base::_unhook_next();
-        }
+        typename _base::scoped_node_ptr node = _wait_take();
 
         if(node) {
             val = std::move_if_noexcept(node->t);
@@ -470,20 +902,14 @@ namespace concurrent_utils {
  * @return false, if the queue is empty or closed, true otherwise.
  * @snippet concurrent-queue.cc wait_pull
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template <typename Clock, typename Duration>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
               value_type &val)
     {
-        typename _base::scoped_node_ptr node { nullptr, *this };
-
-        {
-            std::unique_lock<Lock> lk(_lock);
-            if(_wait(lk, atime)) return false; // if closed
-            node = _base::_unhook_next();
-        }
+        typename _base::scoped_node_ptr node = _wait_take(atime);
 
         if(node) {
             val = std::move_if_noexcept(node->t);
@@ -500,20 +926,96 @@ namespace concurrent_utils {
  * @return false, if the queue is empty or closed, true otherwise.
  * @snippet concurrent-queue.cc wait_pull
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template <typename Rep, typename Period>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     wait_pull(const std::chrono::duration<Rep, Period> &rtime,
               value_type &val)
     {
-        typename _base::scoped_node_ptr node { nullptr, *this };
+        typename _base::scoped_node_ptr node = _wait_take(rtime);
 
-        {
-            std::unique_lock<Lock> lk(_lock);
-            if(_wait(lk, rtime)) return false; // if closed
-            node = _base::_unhook_next();
+        if(node) {
+            val = std::move_if_noexcept(node->t);
+            return true;
+        }
+
+        return false;
+    }
+
+/**
+ * @brief Creates an item from given arguments and puts it to the queue,
+ * if it is not closed and its lock is acquired until @a atime
+ *
+ * Timed acquisition of the lock is used if the lock provides one,
+ * see try_lock_until(Lockable&, const std::chrono::time_point&).
+ * @return false, if the deadline has expired or the queue is closed;
+ * true otherwise.
+ * @snippet concurrent-queue.cc try_push_until
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Clock, typename Duration, typename... Args>
+    bool
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_push_until(const std::chrono::time_point<Clock, Duration> &atime,
+                   Args &&...args)
+    {
+        static_assert(std::is_constructible<value_type, Args...>::value,
+                      "template argument substituting Tp"
+            " must be constructible from given arguments");
+
+        typename _base::scoped_node_ptr node
+            = _base::_create_node(nullptr, std::forward<Args>(args)...);
+
+        if(!_try_acquire(atime))
+            return false;
+        std::lock_guard<Lock> lk(_lock, std::adopt_lock);
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
         }
+        _base::_hook(node.release());
+        _metrics.on_push();
+        _sync::_notify();
+        return true;
+    }
+
+/**
+ * @brief Creates an item from given arguments and puts it to the queue,
+ * if it is not closed and its lock is acquired within @a rtime
+ * measured on steady_clock
+ * @return false, if the deadline has expired or the queue is closed;
+ * true otherwise.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Rep, typename Period, typename... Args>
+    bool
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_push_for(const std::chrono::duration<Rep, Period> &rtime,
+                 Args &&...args)
+    {
+        return try_push_until(std::chrono::steady_clock::now() + rtime,
+                              std::forward<Args>(args)...);
+    }
+
+/**
+ * @brief Acquires the lock and waits for items to appear in the queue,
+ * both until @a atime, then takes first item and forwards it by
+ * reference @a val, if the queue is not closed
+ *
+ * Unlike wait_pull(), bounds the lock acquisition as well.
+ * @return false, if the deadline has expired or the queue is empty
+ * or closed; true otherwise.
+ * @snippet concurrent-queue.cc try_push_until
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Clock, typename Duration>
+    bool
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_pull_until(const std::chrono::time_point<Clock, Duration> &atime,
+                   value_type &val)
+    {
+        typename _base::scoped_node_ptr node = _try_wait_take(atime);
 
         if(node) {
             val = std::move_if_noexcept(node->t);
@@ -523,26 +1025,47 @@ namespace concurrent_utils {
         return false;
     }
 
+/**
+ * @brief Acquires the lock and waits for items to appear in the queue,
+ * both within @a rtime measured on steady_clock, then takes first item
+ * and forwards it by reference @a val, if the queue is not closed
+ * @return false, if the deadline has expired or the queue is empty
+ * or closed; true otherwise.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Rep, typename Period>
+    bool
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_pull_for(const std::chrono::duration<Rep, Period> &rtime,
+                 value_type &val)
+    {
+        return try_pull_until(std::chrono::steady_clock::now() + rtime, val);
+    }
+
 /**
  * @brief Creates an item from given arguments and puts it to the queue
  * without blocking, if it is not closed
  * @return true, if the queue is not closed.
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
       template<typename... Args>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     push_unsafe(Args &&...args)
     {
         static_assert(std::is_constructible<value_type, Args...>::value,
                       "template argument substituting Tp"
             " must be constructible from given arguments");
 
-        if(_closed) return false;
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
+        }
         typename _base::scoped_node_ptr node
             = _base::_create_node(nullptr, std::forward<Args>(args)...);
         _base::_hook(node.release());
-        _cond.notify_one();
+        _metrics.on_push();
+        _sync::_notify();
         return true;
     }
 
@@ -551,12 +1074,13 @@ namespace concurrent_utils {
  * and forwards it by reference @a val if the queue is not empty
  * @return false, if the queue is already empty; true otherwise.
  */
-  template <typename Tp, typename Lock, typename Alloc>
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
     bool
-    concurrent_queue<Tp, Lock, Alloc>::
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
     pull_unsafe(value_type &val)
     {
-        typename _base::scoped_node_ptr node = _base::_unhook_next();
+        typename _base::scoped_node_ptr node = _unhook();
+        if(node) _metrics.on_pull();
 
         if(node) {
             val = std::move_if_noexcept(node->t);
@@ -566,4 +1090,206 @@ namespace concurrent_utils {
         return false;
     }
 
+/**
+ * @brief Takes the next item from the queue, if it is not empty,
+ * and invokes @a f with a reference to it before the item is destroyed
+ *
+ * Neither constructs nor assigns any value_type, so the item
+ * can be consumed in place. @a f is invoked without blocking.
+ * @return false, if the queue is already empty; true otherwise.
+ * @snippet concurrent-queue.cc pull_with
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Func>
+    bool
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    pull_with(Func &&f)
+    {
+        typename _base::scoped_node_ptr node = _take();
+
+        if(node) {
+            std::forward<Func>(f)(node->t);
+            return true;
+        }
+
+        return false;
+    }
+
+/**
+ * @brief Takes all items from the queue at once
+ *
+ * Detaches the whole list of items in constant time under
+ * a single lock acquisition. Items are freed with the returned
+ * batch, outside of the queue's lock.
+ * @return Batch of items, empty if the queue is already empty.
+ * @snippet concurrent-queue.cc pull_all
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    pull_all() -> batch_type
+    {
+        batch_type batch(get_allocator());
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        batch._impl.swap(_base::_impl);
+        _end_walks();
+        _metrics.on_drain();
+        return batch;
+    }
+
+/**
+ * @brief Invokes @a f with a const reference to a copy of each item
+ * that is in the queue at the moment of the call
+ *
+ * The queue is locked only to copy an item, and @a f is invoked
+ * without blocking, so producers and consumers continue to work
+ * meanwhile. Items pushed after the call are not visited, and items
+ * pulled before the walk reaches them are skipped. Consumers take
+ * items without copying, they only move the walk past them.
+ * @note Walks can nest and run concurrently; the queue must not be
+ * destroyed during a walk.
+ * @snippet concurrent-queue.cc for_each
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Func>
+    void
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    for_each(Func &&f) const
+    {
+        static_assert(std::is_copy_constructible<value_type>::value,
+                      "for_each requires copyable template argument");
+
+        _visit([&f](value_type &t) { f(std::as_const(t)); });
+    }
+
+/**
+ * @brief Copies items of the queue without blocking
+ * its producers and consumers
+ * @return Batch of copies in the queue's order, made as by for_each().
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    snapshot() const -> batch_type
+    {
+        batch_type batch(get_allocator());
+        _visit([&batch](value_type &t) {
+            batch._hook(batch._create_node(nullptr, std::move(t)).release()); // might throw
+        });
+        return batch;
+    }
+
+/**
+ * @brief Takes the next item from the queue, if it is not empty
+ * @return The item or empty optional, if the queue is already empty.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_pull() -> std::optional<value_type>
+    {
+        typename _base::scoped_node_ptr node = _take();
+
+        if(node)
+            return std::optional<value_type>(std::move_if_noexcept(node->t));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Waits for items to appear in the queue,
+ * then takes first item, if the queue is not closed
+ * @return The item or empty optional, if the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    wait_pull() -> std::optional<value_type>
+    {
+        typename _base::scoped_node_ptr node = _wait_take();
+
+        if(node)
+            return std::optional<value_type>(std::move_if_noexcept(node->t));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Waits for items to appear in the queue until @a atime,
+ * then takes first item, if the queue is not closed
+ * @return The item or empty optional, if the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Clock, typename Duration>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    wait_pull(const std::chrono::time_point<Clock, Duration> &atime)
+        -> std::optional<value_type>
+    {
+        typename _base::scoped_node_ptr node = _wait_take(atime);
+
+        if(node)
+            return std::optional<value_type>(std::move_if_noexcept(node->t));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Waits for items to appear in the queue within @a rtime,
+ * then takes first item, if the queue is not closed
+ * @return The item or empty optional, if the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Rep, typename Period>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    wait_pull(const std::chrono::duration<Rep, Period> &rtime)
+        -> std::optional<value_type>
+    {
+        typename _base::scoped_node_ptr node = _wait_take(rtime);
+
+        if(node)
+            return std::optional<value_type>(std::move_if_noexcept(node->t));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Acquires the lock and waits for items to appear in the queue,
+ * both until @a atime, then takes first item, if the queue is not closed
+ * @return The item or empty optional, if the deadline has expired
+ * or the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Clock, typename Duration>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_pull_until(const std::chrono::time_point<Clock, Duration> &atime)
+        -> std::optional<value_type>
+    {
+        typename _base::scoped_node_ptr node = _try_wait_take(atime);
+
+        if(node)
+            return std::optional<value_type>(std::move_if_noexcept(node->t));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Acquires the lock and waits for items to appear in the queue,
+ * both within @a rtime measured on steady_clock, then takes first item,
+ * if the queue is not closed
+ * @return The item or empty optional, if the deadline has expired
+ * or the queue is empty or closed.
+ */
+  template <typename Tp, typename Lock, typename Alloc, typename Metrics, typename Wait>
+      template <typename Rep, typename Period>
+    auto
+    concurrent_queue<Tp, Lock, Alloc, Metrics, Wait>::
+    try_pull_for(const std::chrono::duration<Rep, Period> &rtime)
+        -> std::optional<value_type>
+    {
+        return try_pull_until(std::chrono::steady_clock::now() + rtime);
+    }
+
 } // namespace concurrent_utils
@@ -0,0 +1,641 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_CONCURRENT_STACK_H
+#define CONCURRENT_UTILS_CONCURRENT_STACK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "wait-strategies.h"
+
+namespace concurrent_utils {
+
+namespace details {
+
+    /**
+     * @internal
+     * @brief Treiber stack of nodes linked by atomic @a next pointers
+     *
+     * The head keeps a counter of modifications in the upper bits
+     * unused by 64-bit addresses, so a node popped and pushed back
+     * between reading the head and replacing it does not corrupt
+     * the stack. Nodes must stay allocated while any thread might
+     * read them, which holds for nodes moving between stacks
+     * of the same owner and freed by it only on destruction.
+     */
+  template <typename Node>
+    class tagged_stack
+    {
+#ifndef DOXYGEN
+        static_assert(sizeof(void*) == sizeof(std::uint64_t),
+            "tagged_stack requires 64-bit addresses");
+#endif
+
+        enum : unsigned { _ptr_bits = 48 };
+        static constexpr std::uint64_t _ptr_mask = (std::uint64_t(1) << _ptr_bits) - 1;
+
+        std::atomic<std::uint64_t> _head { 0 };
+
+        static Node *_ptr(std::uint64_t head) noexcept
+        { return reinterpret_cast<Node*>(head & _ptr_mask); }
+
+        static std::uint64_t _next_head(std::uint64_t head, Node *p) noexcept
+        {
+            return reinterpret_cast<std::uintptr_t>(p)
+                | (((head >> _ptr_bits) + 1) << _ptr_bits);
+        }
+
+    public:
+        bool empty() const noexcept
+        { return !_ptr(_head.load(std::memory_order_acquire)); }
+
+        // Single attempt to push @a n, fails under contention
+        bool try_push(Node *n) noexcept
+        {
+            std::uint64_t head = _head.load(std::memory_order_relaxed);
+            n->next.store(_ptr(head), std::memory_order_relaxed);
+            return _head.compare_exchange_strong(head, _next_head(head, n),
+                std::memory_order_release, std::memory_order_relaxed);
+        }
+
+        void push(Node *n) noexcept
+        {
+            std::uint64_t head = _head.load(std::memory_order_relaxed);
+            do n->next.store(_ptr(head), std::memory_order_relaxed);
+            while(!_head.compare_exchange_weak(head, _next_head(head, n),
+                      std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // Single attempt to pop a node to @a n
+        // @return false, if failed under contention
+        bool try_pop(Node *&n) noexcept
+        {
+            std::uint64_t head = _head.load(std::memory_order_acquire);
+            n = _ptr(head);
+            if(!n)
+                return true;
+            Node *next = n->next.load(std::memory_order_relaxed);
+            return _head.compare_exchange_strong(head, _next_head(head, next),
+                std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        Node *pop() noexcept
+        {
+            Node *n;
+            while(!try_pop(n)) { }
+            return n;
+        }
+    };
+
+} // namespace details
+
+/**
+ * @brief Lock-free LIFO stack
+ *
+ * Treiber stack with protection against ABA and an elimination
+ * array: when the head is contended, a pushing thread offers its
+ * node in a random slot of the array for a short time, and popping
+ * threads take offered nodes from there, so matching pairs complete
+ * without touching the head at all.
+ *
+ * Nodes of pulled items are kept in an internal free list and
+ * reused by later pushes, all of them are freed by the destructor.
+ * Thus memory is bounded by the peak number of items, and pushes
+ * allocate only while the stack grows beyond it; reserve() grows
+ * it in advance.
+ *
+ * Pushing, pulling and closing are the same as in concurrent_queue;
+ * waiting consumers spin briefly and then block, pushes notify
+ * only when somebody is blocked.
+ *
+ * @tparam Tp Type of items.
+ * @tparam Alloc Allocator type.
+ * @note Requires 64-bit addresses with the upper 16 bits unused.
+ */
+template <typename Tp, typename Alloc = std::allocator<Tp>>
+class concurrent_stack
+{
+#ifndef DOXYGEN
+    static_assert(std::is_move_constructible<Tp>::value
+                  && std::is_move_assignable<Tp>::value,
+        "concurrent_stack requires movable template argument");
+#endif
+
+    enum : std::size_t {
+        _cache_line = 64,
+        _eliminators = 8,       // slots of the elimination array
+        _eliminate_spins = 128, // time the offer is kept
+        _wait_spins = 64        // attempts of a consumer before blocking
+    };
+
+    struct _node
+    {
+        std::atomic<_node*> next { nullptr };
+        alignas(Tp) unsigned char storage[sizeof(Tp)];
+
+        Tp *value() noexcept { return reinterpret_cast<Tp*>(storage); }
+    };
+
+    struct alignas(_cache_line) _slot
+    {
+        std::atomic<_node*> offer { nullptr };
+    };
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+    using _node_alloc_type = typename _alloc_traits::template rebind_alloc<_node>;
+    using _node_alloc_traits = std::allocator_traits<_node_alloc_type>;
+
+    alignas(_cache_line) details::tagged_stack<_node> _items;
+    alignas(_cache_line) details::tagged_stack<_node> _free;
+    _slot _exchanger[_eliminators];
+
+    alignas(_cache_line) std::atomic<bool> _closed { false };
+    std::atomic<unsigned> _waiters { 0 };
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    _node_alloc_type _alloc;
+
+    // Frees node's item and returns it to the free list
+    struct _node_deleter
+    {
+        concurrent_stack *owner;
+        void operator()(_node *n) const noexcept { owner->_recycle(n); }
+    };
+    using _node_ptr = std::unique_ptr<_node, _node_deleter>;
+
+    static std::size_t _random_slot() noexcept;
+
+    _node *_allocate();
+    void _recycle(_node *n) noexcept;
+
+  template <typename... Args>
+    _node_ptr _create(Args &&...args);
+
+    bool _eliminate_push(_node *n) noexcept;
+    _node *_eliminate_pop() noexcept;
+
+    void _push(_node *n) noexcept;
+    _node_ptr _pop() noexcept;
+
+  template <typename... Deadline>
+    _node_ptr _wait_pop(const Deadline &...deadline);
+
+public:
+    using value_type = Tp;
+    using size_type = std::size_t;
+    using allocator_type = Alloc;
+
+    concurrent_stack() = default;
+
+    /// Creates empty stack using allocator @a a
+    explicit concurrent_stack(const allocator_type &a) : _alloc(a) { }
+
+    ~concurrent_stack();
+
+#ifndef DOXYGEN
+    concurrent_stack(const concurrent_stack&) = delete;
+    concurrent_stack &operator=(const concurrent_stack&) = delete;
+#endif
+
+    /// Returns the allocator used by the stack
+    allocator_type get_allocator() const noexcept
+    { return allocator_type(_alloc); }
+
+    /// Returns true, if the stack has no items
+    inline bool empty() const noexcept { return _items.empty(); }
+
+    /// Returns true, if the stack closed
+    inline bool closed() const noexcept
+    { return _closed.load(std::memory_order_acquire); }
+
+    void close();
+
+    void reserve(size_type n);
+
+  template <typename... Args>
+    bool push(Args &&...args);
+
+    bool pull(value_type &val);
+
+    bool wait_pull(value_type &val);
+
+  template <typename Clock, typename Duration>
+    bool wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
+                   value_type &val);
+
+  template <typename Rep, typename Period>
+    bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+                   value_type &val);
+
+    std::optional<value_type> try_pull();
+
+    std::optional<value_type> wait_pull();
+
+}; // class concurrent_stack
+
+/**
+ * @brief Destroys remaining items and frees all nodes
+ */
+  template <typename Tp, typename Alloc>
+    concurrent_stack<Tp, Alloc>::
+    ~concurrent_stack()
+    {
+        while(_node *n = _items.pop())
+            _recycle(n);
+        while(_node *n = _free.pop()) {
+            _node_alloc_traits::destroy(_alloc, n);
+            _node_alloc_traits::deallocate(_alloc, n, 1);
+        }
+    }
+
+/**
+ * @internal
+ * @brief Picks a slot of the elimination array for the calling thread
+ */
+  template <typename Tp, typename Alloc>
+    std::size_t
+    concurrent_stack<Tp, Alloc>::
+    _random_slot() noexcept
+    {
+        static thread_local std::uint32_t x = static_cast<std::uint32_t>(
+            reinterpret_cast<std::uintptr_t>(&x) >> 4) | 1;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x % _eliminators;
+    }
+
+/**
+ * @internal
+ * @brief Takes a node from the free list or allocates a new one
+ */
+  template <typename Tp, typename Alloc>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    _allocate() -> _node*
+    {
+        if(_node *n = _free.pop())
+            return n;
+        _node *n = std::addressof(*_node_alloc_traits::allocate(_alloc, 1));
+        _node_alloc_traits::construct(_alloc, n);
+        return n;
+    }
+
+/**
+ * @internal
+ * @brief Destroys the item of @a n and puts it to the free list
+ */
+  template <typename Tp, typename Alloc>
+    void
+    concurrent_stack<Tp, Alloc>::
+    _recycle(_node *n) noexcept
+    {
+        Alloc alloc(_alloc);
+        _alloc_traits::destroy(alloc, n->value());
+        _free.push(n);
+    }
+
+/**
+ * @internal
+ * @brief Creates a node holding an item constructed from @a args
+ */
+  template <typename Tp, typename Alloc>
+      template <typename... Args>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    _create(Args &&...args) -> _node_ptr
+    {
+        _node *n = _allocate();
+        try {
+            Alloc alloc(_alloc);
+            _alloc_traits::construct(alloc, n->value(), std::forward<Args>(args)...);
+        } catch(...) {
+            _free.push(n);
+            throw;
+        }
+        return { n, _node_deleter { this } };
+    }
+
+/**
+ * @internal
+ * @brief Offers @a n in the elimination array for a while
+ * @return true, if a popping thread has taken it.
+ */
+  template <typename Tp, typename Alloc>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    _eliminate_push(_node *n) noexcept
+    {
+        std::atomic<_node*> &offer = _exchanger[_random_slot()].offer;
+        _node *expected = nullptr;
+        if(!offer.compare_exchange_strong(expected, n,
+                std::memory_order_release, std::memory_order_relaxed))
+            return false;
+
+        for(std::size_t i = 0; i < _eliminate_spins; ++i) {
+            if(offer.load(std::memory_order_relaxed) != n)
+                return true;
+            details::cpu_relax();
+        }
+
+        // withdrawal fails only if the node has just been taken
+        expected = n;
+        return !offer.compare_exchange_strong(expected, nullptr,
+            std::memory_order_relaxed, std::memory_order_relaxed);
+    }
+
+/**
+ * @internal
+ * @brief Takes a node offered in the elimination array, if any
+ */
+  template <typename Tp, typename Alloc>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    _eliminate_pop() noexcept -> _node*
+    {
+        std::atomic<_node*> &offer = _exchanger[_random_slot()].offer;
+        _node *n = offer.load(std::memory_order_relaxed);
+        if(n && offer.compare_exchange_strong(n, nullptr,
+                std::memory_order_acquire, std::memory_order_relaxed))
+            return n;
+        return nullptr;
+    }
+
+/**
+ * @internal
+ * @brief Puts @a n on top of the stack or hands it over to
+ * a popping thread, then wakes a blocked consumer, if any
+ */
+  template <typename Tp, typename Alloc>
+    void
+    concurrent_stack<Tp, Alloc>::
+    _push(_node *n) noexcept
+    {
+        while(!_items.try_push(n))
+            if(_eliminate_push(n))
+                return;
+
+        // pairs with the fence in _wait_pop()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(_waiters.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lk(_mutex); }
+            _cond.notify_one();
+        }
+    }
+
+/**
+ * @internal
+ * @brief Takes the top node or a node offered by a pushing thread
+ * @return The node, or null if the stack is empty.
+ */
+  template <typename Tp, typename Alloc>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    _pop() noexcept -> _node_ptr
+    {
+        _node *n;
+        while(!_items.try_pop(n))
+            if((n = _eliminate_pop()))
+                break;
+        return { n, _node_deleter { this } };
+    }
+
+/**
+ * @internal
+ * @brief Waits for items to appear in the stack, optionally
+ * until @a deadline, then takes the top node
+ * @return The node, or null if the stack is empty or closed.
+ */
+  template <typename Tp, typename Alloc>
+      template <typename... Deadline>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    _wait_pop(const Deadline &...deadline) -> _node_ptr
+    {
+        for(std::size_t i = 0; i < _wait_spins; ++i) {
+            if(closed())
+                return { nullptr, _node_deleter { this } };
+            if(_node_ptr n = _pop())
+                return n;
+            details::cpu_relax();
+        }
+
+        std::unique_lock<std::mutex> lk(_mutex);
+        _waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        _node_ptr n { nullptr, _node_deleter { this } };
+        bool expired = false;
+        while(!_closed.load(std::memory_order_relaxed) && !(n = _pop()) && !expired) {
+            if constexpr(sizeof...(Deadline) > 0)
+                expired = _cond.wait_until(lk, deadline...) == std::cv_status::timeout;
+            else
+                _cond.wait(lk);
+        }
+
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+        return n;
+    }
+
+/**
+ * @brief Closes the stack and wakes all waiting consumers
+ *
+ * Pushes fail after that, items pushed before can still be pulled.
+ */
+  template <typename Tp, typename Alloc>
+    void
+    concurrent_stack<Tp, Alloc>::
+    close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _closed.store(true, std::memory_order_release);
+        }
+        _cond.notify_all();
+    }
+
+/**
+ * @brief Allocates nodes for @a n more items in advance
+ */
+  template <typename Tp, typename Alloc>
+    void
+    concurrent_stack<Tp, Alloc>::
+    reserve(size_type n)
+    {
+        while(n--) {
+            _node *p = std::addressof(*_node_alloc_traits::allocate(_alloc, 1));
+            _node_alloc_traits::construct(_alloc, p);
+            _free.push(p);
+        }
+    }
+
+/**
+ * @brief Creates an item from given arguments and puts it
+ * on top of the stack, if it is not closed
+ * @return true, if the stack is not closed.
+ */
+  template <typename Tp, typename Alloc>
+      template <typename... Args>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    push(Args &&...args)
+    {
+        static_assert(std::is_constructible<value_type, Args...>::value,
+                      "template argument substituting Tp"
+            " must be constructible from given arguments");
+
+        if(closed())
+            return false;
+        _push(_create(std::forward<Args>(args)...).release());
+        return true;
+    }
+
+/**
+ * @brief Takes the top item and forwards it by reference @a val,
+ * if the stack is not empty
+ * @return false, if the stack is already empty; true otherwise.
+ */
+  template <typename Tp, typename Alloc>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    pull(value_type &val)
+    {
+        _node_ptr n = _pop();
+
+        if(n) {
+            val = std::move_if_noexcept(*n->value());
+            return true;
+        }
+
+        return false;
+    }
+
+/**
+ * @brief Waits for items to appear in the stack, then takes the top
+ * item and forwards it by reference @a val, if the stack is not closed
+ * @return false, if the stack is empty or closed, true otherwise.
+ */
+  template <typename Tp, typename Alloc>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    wait_pull(value_type &val)
+    {
+        _node_ptr n = _wait_pop();
+
+        if(n) {
+            val = std::move_if_noexcept(*n->value());
+            return true;
+        }
+
+        return false;
+    }
+
+/**
+ * @brief Waits for items to appear in the stack until @a atime,
+ * then takes the top item and forwards it by reference @a val,
+ * if the stack is not closed
+ * @return false, if the stack is empty or closed, true otherwise.
+ */
+  template <typename Tp, typename Alloc>
+      template <typename Clock, typename Duration>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
+              value_type &val)
+    {
+        _node_ptr n = _wait_pop(atime);
+
+        if(n) {
+            val = std::move_if_noexcept(*n->value());
+            return true;
+        }
+
+        return false;
+    }
+
+/**
+ * @brief Waits for items to appear in the stack within @a rtime,
+ * then takes the top item and forwards it by reference @a val,
+ * if the stack is not closed
+ * @return false, if the stack is empty or closed, true otherwise.
+ */
+  template <typename Tp, typename Alloc>
+      template <typename Rep, typename Period>
+    bool
+    concurrent_stack<Tp, Alloc>::
+    wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+              value_type &val)
+    {
+        return wait_pull(std::chrono::steady_clock::now() + rtime, val);
+    }
+
+/**
+ * @brief Takes the top item, if the stack is not empty
+ * @return The item or empty optional, if the stack is already empty.
+ */
+  template <typename Tp, typename Alloc>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    try_pull() -> std::optional<value_type>
+    {
+        _node_ptr n = _pop();
+
+        if(n)
+            return std::optional<value_type>(std::move_if_noexcept(*n->value()));
+
+        return std::nullopt;
+    }
+
+/**
+ * @brief Waits for items to appear in the stack,
+ * then takes the top item, if the stack is not closed
+ * @return The item or empty optional, if the stack is empty or closed.
+ */
+  template <typename Tp, typename Alloc>
+    auto
+    concurrent_stack<Tp, Alloc>::
+    wait_pull() -> std::optional<value_type>
+    {
+        _node_ptr n = _wait_pop();
+
+        if(n)
+            return std::optional<value_type>(std::move_if_noexcept(*n->value()));
+
+        return std::nullopt;
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_CONCURRENT_STACK_H
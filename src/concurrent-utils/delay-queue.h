@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_DELAY_QUEUE_H
+#define CONCURRENT_UTILS_DELAY_QUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "concurrent-queue.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Concurrent queue releasing items at scheduled time
+ *
+ * Items are kept in a binary heap ordered by due time, items due
+ * at the same time are pulled in order of pushing. Pushing and
+ * pulling take logarithmic time, the heap is stored contiguously
+ * and only grows, so millions of pending items need neither
+ * per-item allocations nor timer threads.
+ *
+ * Waiting consumers sleep until the earliest item is due, pushing
+ * an earlier item wakes one of them to reschedule. Locking, closing
+ * and waiting with deadlines are the same as in concurrent_queue.
+ *
+ * @tparam Tp Type of items.
+ * @tparam Lock Lock type.
+ * @tparam Clock Clock measuring due time.
+ * @tparam Alloc Allocator type.
+ * @tparam Metrics Metrics policy, see concurrent_queue.
+ */
+template <typename Tp, typename Lock, typename Clock = std::chrono::steady_clock,
+          typename Alloc = std::allocator<Tp>, typename Metrics = no_queue_metrics>
+class delay_queue : protected details::queue_sync<Lock, Metrics>
+{
+#ifndef DOXYGEN
+    static_assert(std::is_move_constructible<Tp>::value
+                  && std::is_move_assignable<Tp>::value,
+        "delay_queue requires movable template argument");
+
+    static_assert(is_lockable<Lock>::value,
+        "delay_queue only works with lockable type");
+#endif
+
+    using _sync = details::queue_sync<Lock, Metrics>;
+
+    using _sync::_lock;
+    using _sync::_closed;
+    using _sync::_cond;
+    using _sync::_metrics;
+    using _sync::_acquire;
+
+public:
+    using value_type = Tp;
+    using size_type = std::size_t;
+    using clock_type = Clock;
+    using time_point = typename Clock::time_point;
+    using duration = typename Clock::duration;
+    using allocator_type = Alloc;
+    using metrics_type = Metrics;
+
+private:
+    struct _entry
+    {
+        time_point due;
+        std::uint64_t seq;
+        Tp t;
+
+      template <typename... Args>
+        _entry(const time_point &adue, std::uint64_t aseq, Args &&...args)
+            : due(adue), seq(aseq), t(std::forward<Args>(args)...) { }
+    };
+
+    // Orders the heap by due time, then by order of pushing
+    struct _later
+    {
+        bool operator()(const _entry &a, const _entry &b) const noexcept
+        { return b.due < a.due || (!(a.due < b.due) && b.seq < a.seq); }
+    };
+
+    using _entry_alloc_type =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<_entry>;
+
+    std::vector<_entry, _entry_alloc_type> _heap;
+    std::uint64_t _seq = 0;
+
+    inline bool _due(const time_point &now) const noexcept
+    { return !_heap.empty() && !(now < _heap.front().due); }
+
+    // Moves the earliest item to @a val
+    void _take(value_type &val)
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), _later());
+        try {
+            val = std::move_if_noexcept(_heap.back().t);
+        } catch(...) {
+            std::push_heap(_heap.begin(), _heap.end(), _later());
+            throw;
+        }
+        _heap.pop_back();
+        _metrics.on_pull();
+
+        // let another consumer schedule the next item
+        if(!_heap.empty())
+            _cond.notify_one();
+    }
+
+  template <typename Clock2, typename Duration2>
+    static time_point _to_clock(const std::chrono::time_point<Clock2, Duration2> &atime)
+    {
+        if constexpr(std::is_same<Clock, Clock2>::value)
+            return std::chrono::time_point_cast<duration>(atime);
+        else
+            return Clock::now() + std::chrono::duration_cast<duration>(atime - Clock2::now());
+    }
+
+    bool _wait_pull(value_type &val, const time_point *limit);
+
+public:
+    delay_queue() = default;
+
+    /// Creates empty queue using allocator @a a
+    explicit delay_queue(const allocator_type &a) : _heap(_entry_alloc_type(a)) { }
+
+    /// Closes the queue and frees pending items
+    ~delay_queue() { close(); }
+
+#ifndef DOXYGEN
+    delay_queue(const delay_queue&) = delete;
+    delay_queue &operator=(const delay_queue&) = delete;
+#endif
+
+    /// Returns the allocator used by the queue
+    allocator_type get_allocator() const
+    { return allocator_type(_heap.get_allocator()); }
+
+    /// Returns true, if the queue has no pending items
+    inline bool empty() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _heap.empty(); }
+
+    /// Counts pending items, either due or not
+    inline size_type size() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _heap.size(); }
+
+    /// Reserves space for @a n pending items
+    inline void reserve(size_type n)
+    { std::lock_guard<Lock> lk(_lock, _acquire()); _heap.reserve(n); }
+
+    /// Returns true, if queue closed
+    inline bool closed() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _closed; }
+
+    /// Closes the queue
+    inline void close() { _sync::_close(); }
+
+    /// Returns reference to a internal queue's lock
+    inline Lock &underlying_lock() const noexcept { return _lock; }
+
+    /// Returns snapshot of metrics collected by the Metrics policy
+    inline queue_stats stats() const noexcept { return _metrics.stats(); }
+
+    /**
+     * @brief Returns due time of the earliest item
+     * @return The time or empty optional, if the queue is empty.
+     */
+    std::optional<time_point> next_due() const
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_heap.empty())
+            return std::nullopt;
+        return _heap.front().due;
+    }
+
+    /**
+     * @brief Creates an item from given arguments and schedules it
+     * to be pulled at @a due, if the queue is not closed
+     * @return true, if the queue is not closed.
+     */
+  template <typename... Args>
+    bool push_at(const time_point &due, Args &&...args)
+    {
+        static_assert(std::is_constructible<value_type, Args...>::value,
+                      "template argument substituting Tp"
+            " must be constructible from given arguments");
+
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
+        }
+        const std::uint64_t seq = _seq++;
+        _heap.emplace_back(due, seq, std::forward<Args>(args)...);
+        std::push_heap(_heap.begin(), _heap.end(), _later());
+        _metrics.on_push();
+
+        // waiters sleep until the former earliest item is due
+        if(_heap.front().seq == seq)
+            _cond.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Same as push_at(), but schedules the item
+     * to be pulled after @a delay from now
+     */
+  template <typename Rep, typename Period, typename... Args>
+    bool push_after(const std::chrono::duration<Rep, Period> &delay, Args &&...args)
+    {
+        return push_at(Clock::now() + std::chrono::duration_cast<duration>(delay),
+                       std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Takes the earliest item and moves it to @a val,
+     * if it is already due
+     * @return false, if no item is due yet; true otherwise.
+     */
+    bool pull(value_type &val)
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(!_due(Clock::now()))
+            return false;
+        _take(val);
+        return true;
+    }
+
+    /**
+     * @brief Waits until the earliest item is due, then moves it
+     * to @a val, if the queue is not closed
+     * @return false, if the queue is closed, true otherwise.
+     */
+    bool wait_pull(value_type &val) { return _wait_pull(val, nullptr); }
+
+    /**
+     * @brief Same as wait_pull(value_type &), but waits until @a atime
+     * @return false, if the queue is closed or no item is due
+     * until @a atime, true otherwise.
+     */
+  template <typename Clock2, typename Duration2>
+    bool wait_pull(const std::chrono::time_point<Clock2, Duration2> &atime,
+                   value_type &val)
+    {
+        const time_point limit = _to_clock(atime);
+        return _wait_pull(val, &limit);
+    }
+
+    /**
+     * @brief Same as wait_pull(value_type &), but waits within @a rtime
+     * @return false, if the queue is closed or no item is due
+     * within @a rtime, true otherwise.
+     */
+  template <typename Rep, typename Period>
+    bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+                   value_type &val)
+    {
+        const time_point limit = Clock::now()
+            + std::chrono::duration_cast<duration>(rtime);
+        return _wait_pull(val, &limit);
+    }
+
+}; // class delay_queue
+
+/**
+ * @internal
+ * @brief Waits until the earliest item is due or the queue is closed,
+ * but not later than @a limit, if given, then takes the item
+ *
+ * The wait is rescheduled whenever an earlier item is pushed.
+ * @return true, if an item was taken.
+ */
+  template <typename Tp, typename Lock, typename Clock, typename Alloc, typename Metrics>
+    bool
+    delay_queue<Tp, Lock, Clock, Alloc, Metrics>::
+    _wait_pull(value_type &val, const time_point *limit)
+    {
+        std::unique_lock<Lock> lk(_lock, _acquire());
+        if(_closed)
+            return false;
+
+        time_point now = Clock::now();
+        if(_due(now)) {
+            _take(val);
+            return true; // not blocked, so not a wait
+        }
+        if(limit && !(now < *limit))
+            return false;
+
+        const auto start = _metrics.now();
+        bool taken = false;
+
+        for(;;) {
+            if(_heap.empty()) {
+                if(limit)
+                    _cond.wait_until(lk, *limit);
+                else
+                    _cond.wait(lk);
+            } else {
+                const time_point due = _heap.front().due;
+                _cond.wait_until(lk, limit && *limit < due ? *limit : due);
+            }
+
+            if(_closed)
+                break;
+            now = Clock::now();
+            if(_due(now)) {
+                _take(val);
+                taken = true;
+                break;
+            }
+            if(limit && !(now < *limit))
+                break;
+        }
+
+        _metrics.on_wait(start);
+        return taken;
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_DELAY_QUEUE_H
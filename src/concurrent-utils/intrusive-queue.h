@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_INTRUSIVE_QUEUE_H
+#define CONCURRENT_UTILS_INTRUSIVE_QUEUE_H
+
+#include "concurrent-queue.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Concurrent queue linking user's objects through
+ * a pointer embedded into them
+ *
+ * The queue neither allocates nor copies anything: @a push links
+ * the object through its @a Next member, pulls unlink it. Objects
+ * are not owned by the queue and must outlive their stay in it.
+ * Locking, closing and waiting are the same as in concurrent_queue.
+ *
+ * @code
+ * struct message {
+ *     message *next;
+ *     ...
+ * };
+ *
+ * intrusive_concurrent_queue<message, &message::next, std::mutex> queue;
+ * @endcode
+ *
+ * @tparam Tp Type of queued objects.
+ * @tparam Next Pointer to the member of @a Tp used as a link.
+ * @tparam Lock Lock type.
+ * @tparam Metrics Metrics policy, see concurrent_queue.
+ */
+template <typename Tp, Tp *Tp::*Next, typename Lock,
+          typename Metrics = no_queue_metrics>
+class intrusive_concurrent_queue : protected details::queue_sync<Lock, Metrics>
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "intrusive_concurrent_queue only works with lockable type");
+#endif
+
+    using _sync = details::queue_sync<Lock, Metrics>;
+
+    using _sync::_lock;
+    using _sync::_closed;
+    using _sync::_metrics;
+    using _sync::_acquire;
+
+    Tp *_next = nullptr, *_last = nullptr;
+
+    // Puts the given object to end of the queue
+    inline void _hook(Tp *item) noexcept
+    {
+        item->*Next = nullptr;
+        if(_last)
+            _last->*Next = item;
+        else
+            _next = item;
+        _last = item;
+    }
+
+    // Takes the next object from the queue
+    inline Tp *_unhook_next() noexcept
+    {
+        Tp *item = _next;
+        if(!item)
+            return nullptr;
+        _next = item->*Next;
+        if(!_next)
+            _last = nullptr;
+        item->*Next = nullptr;
+        _metrics.on_pull();
+        return item;
+    }
+
+    inline bool _empty() const noexcept { return !_last; }
+
+  template <typename... Deadline>
+    bool _wait_pull(Tp *&item, const Deadline &...deadline)
+    {
+        std::unique_lock<Lock> lk(_lock, _acquire());
+        if(_sync::_wait(lk, [this]() { return !_empty(); }, deadline...))
+            return false; // if closed
+        pointer p = _unhook_next();
+        if(p) item = p;
+        return p;
+    }
+
+public:
+    using value_type = Tp;
+    using pointer = Tp *;
+    using metrics_type = Metrics;
+
+    intrusive_concurrent_queue() = default;
+
+    /// Closes the queue, objects still linked are left untouched
+    ~intrusive_concurrent_queue() { close(); }
+
+#ifndef DOXYGEN
+    intrusive_concurrent_queue(const intrusive_concurrent_queue&) = delete;
+    intrusive_concurrent_queue &operator=(const intrusive_concurrent_queue&) = delete;
+#endif
+
+    /// Returns true, if queue's size equals zero
+    inline bool empty() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _empty(); }
+
+    /// Returns true, if queue closed
+    inline bool closed() const
+    { std::lock_guard<Lock> lk(_lock, _acquire()); return _closed; }
+
+    /// Closes the queue
+    inline void close() { _sync::_close(); }
+
+    /// Returns reference to a internal queue's lock
+    inline Lock &underlying_lock() const noexcept { return _lock; }
+
+    /// Returns snapshot of metrics collected by the Metrics policy
+    inline queue_stats stats() const noexcept { return _metrics.stats(); }
+
+    /**
+     * @brief Links @a item to end of the queue, if it is not closed
+     * @return true, if the queue is not closed.
+     */
+    bool push(pointer item)
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        if(_closed) {
+            _metrics.on_closed_push();
+            return false;
+        }
+        _hook(item);
+        _metrics.on_push();
+        _sync::_notify();
+        return true;
+    }
+
+    /**
+     * @brief Unlinks the next object from the queue and stores
+     * its address to @a item, if the queue is not empty
+     * @return false, if the queue is already empty; true otherwise.
+     */
+    bool pull(pointer &item)
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        pointer p = _unhook_next();
+        if(p) item = p;
+        return p;
+    }
+
+    /**
+     * @brief Waits for objects to appear in the queue, then unlinks
+     * the first one and stores its address to @a item,
+     * if the queue is not closed
+     * @return false, if the queue is empty or closed, true otherwise.
+     */
+    bool wait_pull(pointer &item) { return _wait_pull(item); }
+
+    /**
+     * @brief Same as wait_pull(pointer &), but waits until @a atime
+     */
+  template <typename Clock, typename Duration>
+    bool wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
+                   pointer &item)
+    { return _wait_pull(item, atime); }
+
+    /**
+     * @brief Same as wait_pull(pointer &), but waits within @a rtime
+     */
+  template <typename Rep, typename Period>
+    bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+                   pointer &item)
+    { return _wait_pull(item, rtime); }
+
+    /**
+     * @brief Unlinks all objects from the queue at once
+     * @return First of detached objects, which are still chained
+     * through @a Next in the queue's order, or null if the queue
+     * is already empty.
+     */
+    pointer pull_all()
+    {
+        std::lock_guard<Lock> lk(_lock, _acquire());
+        pointer first = _next;
+        _next = _last = nullptr;
+        _metrics.on_drain();
+        return first;
+    }
+
+}; // class intrusive_concurrent_queue
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_INTRUSIVE_QUEUE_H
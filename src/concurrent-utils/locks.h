@@ -29,6 +29,7 @@
 #define CONCURRENT_UTILS_LOCKS_H
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <thread>
 
@@ -51,6 +52,66 @@ public:
     enum { value = check<Tp>(nullptr, nullptr) };
 };
 
+/**
+ * @internal
+ */
+template <typename Tp> class is_try_lockable
+{
+  template <typename Up>
+    static constexpr bool check(decltype(std::declval<Up>().try_lock())*)
+    { return is_lockable<Up>::value; }
+
+  template <typename>
+    static constexpr bool check(...) { return false; }
+
+public:
+    enum { value = check<Tp>(nullptr) };
+};
+
+/**
+ * @internal
+ */
+template <typename Tp> class is_timed_lockable
+{
+  template <typename Up>
+    static constexpr bool check(decltype(std::declval<Up>().try_lock_until(
+        std::declval<const std::chrono::steady_clock::time_point&>()))*)
+    { return is_try_lockable<Up>::value; }
+
+  template <typename>
+    static constexpr bool check(...) { return false; }
+
+public:
+    enum { value = check<Tp>(nullptr) };
+};
+
+/**
+ * @brief Tries to acquire @a l until @a atime
+ *
+ * Uses the lock's own try_lock_until() if it has one, otherwise
+ * polls try_lock() and yields between attempts. Locks without
+ * try_lock() can not be bounded and are acquired by lock().
+ * @return true, if lock was acquired
+ */
+template <typename Lockable, typename Clock, typename Duration>
+inline bool
+try_lock_until(Lockable &l, const std::chrono::time_point<Clock, Duration> &atime)
+{
+    if constexpr(is_timed_lockable<Lockable>::value)
+        return l.try_lock_until(atime);
+    else if constexpr(is_try_lockable<Lockable>::value) {
+        while(!l.try_lock()) {
+            if(Clock::now() >= atime)
+                return false;
+            std::this_thread::yield();
+        }
+        return true;
+    } else {
+        l.lock();
+        return true;
+    }
+}
+
 /**
  * @brief Spin-lock implementation
  */
@@ -123,6 +184,7 @@ public:
 
     /**
      * @brief Tries to acquire the lock until @a atime
+     * measured on its own clock
      * @return true, if lock was acquired
      */
   template <typename Clock, typename Duration>
@@ -130,7 +192,7 @@ public:
     try_lock_until(const std::chrono::time_point<Clock, Duration> &atime)
     {
         while(!try_lock()) {
-            if(std::chrono::system_clock::now() >= atime)
+            if(Clock::now() >= atime)
                 return false;
             _sleep();
         }
@@ -139,12 +201,13 @@ public:
 
     /**
      * @brief Tries to acquire the lock for @a rtime
+     * measured on steady_clock
      * @return true, if lock was acquired
      */
   template <typename Rep, typename Period>
     inline bool
     try_lock_for(const std::chrono::duration<Rep, Period> &rtime) {
-        return try_lock_until(std::chrono::system_clock::now() + rtime);
+        return try_lock_until(std::chrono::steady_clock::now() + rtime);
     }
 
     /**
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_MULTICAST_RING_H
+#define CONCURRENT_UTILS_MULTICAST_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace concurrent_utils {
+
+/**
+ * @brief Pre-allocated ring delivering every item to all consumers
+ *
+ * Producers claim sequences from a shared counter, fill the ring's
+ * slot in place and publish sequences in order. Each consumer has
+ * its own cursor and reads the slots without copying, so one item
+ * reaches any number of consumers with neither allocations nor
+ * copies. A consumer may depend on other consumers, then it sees
+ * only items they have already processed, e.g. business logic
+ * after journaling. Producers wait while the slowest consumer
+ * is a whole ring behind.
+ *
+ * Consumers process all available items in a batch and then advance
+ * their cursors once. Waiting threads spin, then yield, and then
+ * block, being woken only when somebody waits.
+ *
+ * @code
+ * multicast_ring<event> ring(1024);
+ * auto &journal = ring.add_consumer();
+ * auto &logic = ring.add_consumer({ &journal });
+ * @endcode
+ *
+ * @tparam Tp Type of items, must be default constructible.
+ * @tparam Alloc Allocator of the ring's slots.
+ */
+template <typename Tp, typename Alloc = std::allocator<Tp>>
+class multicast_ring
+{
+#ifndef DOXYGEN
+    static_assert(std::is_default_constructible<Tp>::value,
+        "multicast_ring requires default constructible template argument");
+#endif
+
+public:
+    using value_type = Tp;
+    using size_type = std::size_t;
+    using sequence_type = std::int64_t;
+    using allocator_type = Alloc;
+
+private:
+    using _sequence = std::atomic<sequence_type>;
+
+    enum : std::size_t { _cache_line = 64 };
+
+    // Sequences are padded to keep producers and consumers
+    // off each other's cache lines
+    struct alignas(_cache_line) _padded_sequence : _sequence
+    {
+        explicit _padded_sequence(sequence_type s) noexcept : _sequence(s) { }
+    };
+
+public:
+    /**
+     * @brief Consumer's cursor in the ring
+     *
+     * Created by multicast_ring::add_consumer(), each consumer
+     * must be used by one thread at a time.
+     */
+    class consumer
+    {
+        _padded_sequence _seq;
+        multicast_ring &_ring;
+        std::vector<const consumer *> _deps;
+
+        consumer(multicast_ring &ring, sequence_type seq,
+                 std::initializer_list<const consumer *> deps)
+            : _seq(seq), _ring(ring), _deps(deps) { }
+
+        // Returns the last sequence this consumer may process
+        sequence_type _available() const noexcept
+        {
+            sequence_type hi = _ring._published.load(std::memory_order_acquire);
+            for(const consumer *d : _deps)
+                hi = std::min(hi, d->_seq.load(std::memory_order_acquire));
+            return hi;
+        }
+
+        friend class multicast_ring;
+
+    public:
+#ifndef DOXYGEN
+        consumer(const consumer&) = delete;
+        consumer &operator=(const consumer&) = delete;
+#endif
+
+        /// Returns the last processed sequence
+        sequence_type sequence() const noexcept
+        { return _seq.load(std::memory_order_acquire); }
+
+        /**
+         * @brief Invokes @a f with a const reference to each
+         * available item without blocking, then advances the cursor
+         * @return Number of processed items.
+         */
+      template <typename Func>
+        size_type process(Func &&f)
+        {
+            const sequence_type next = _seq.load(std::memory_order_relaxed) + 1;
+            const sequence_type hi = _available();
+            if(hi < next)
+                return 0;
+
+            for(sequence_type s = next; s <= hi; ++s)
+                f(std::as_const(_ring._slot(s)));
+
+            _seq.store(hi, std::memory_order_release);
+            _ring._notify();
+            return size_type(hi - next + 1);
+        }
+
+        /**
+         * @brief Waits for items to become available, then
+         * processes all of them as process() does
+         * @return Number of processed items, zero if the ring is
+         * closed and all published items are processed.
+         */
+      template <typename Func>
+        size_type wait_process(Func &&f)
+        {
+            const sequence_type next = _seq.load(std::memory_order_relaxed) + 1;
+            _ring._wait([&]() {
+                return _available() >= next
+                    || (_ring._closed.load(std::memory_order_acquire)
+                        && _ring._published.load(std::memory_order_acquire) < next);
+            });
+            return process(std::forward<Func>(f));
+        }
+    };
+
+private:
+    std::vector<Tp, Alloc> _slots;
+    const size_type _mask;
+
+    _padded_sequence _claim { -1 };
+    _padded_sequence _published { -1 };
+    _padded_sequence _gating { -1 }; // cached minimum of consumers' sequences
+
+    std::vector<std::unique_ptr<consumer>> _consumers;
+    std::atomic_bool _closed { false };
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::atomic<unsigned> _waiters { 0 };
+
+    static size_type _round_capacity(size_type n) noexcept
+    {
+        size_type cap = 2;
+        while(cap < n)
+            cap *= 2;
+        return cap;
+    }
+
+    inline Tp &_slot(sequence_type s) noexcept { return _slots[size_type(s) & _mask]; }
+
+    // Recalculates the minimum of consumers' sequences
+    sequence_type _refresh_gating() noexcept
+    {
+        sequence_type lo = std::numeric_limits<sequence_type>::max();
+        for(const auto &c : _consumers)
+            lo = std::min(lo, c->_seq.load(std::memory_order_acquire));
+        _gating.store(lo, std::memory_order_release);
+        return lo;
+    }
+
+    // Spins, yields and at last blocks until @a ready returns true
+  template <typename Ready>
+    void _wait(Ready ready)
+    {
+        for(int i = 0; i < 128; ++i)
+            if(ready()) return;
+        for(int i = 0; i < 16; ++i) {
+            if(ready()) return;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lk(_mutex);
+        _waiters.fetch_add(1, std::memory_order_relaxed);
+        // pairs with the fence in _notify(), so either the waiter
+        // sees the new state or the notifier sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _cond.wait(lk, ready);
+        _waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Wakes blocked threads, if any
+    void _notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(_waiters.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lk(_mutex); }
+            _cond.notify_all();
+        }
+    }
+
+    // Makes @a seq visible to consumers after all previous ones
+    bool _publish(sequence_type seq)
+    {
+        _wait([&]() {
+            return _published.load(std::memory_order_acquire) == seq - 1
+                || _closed.load(std::memory_order_acquire);
+        });
+        if(_published.load(std::memory_order_acquire) != seq - 1)
+            return false; // closed, previous producer gave up
+        _published.store(seq, std::memory_order_release);
+        _notify();
+        return true;
+    }
+
+public:
+    /**
+     * @brief Creates the ring
+     * @param capacity Minimal number of slots, rounded up
+     * to a power of two.
+     * @param a Allocator of slots.
+     */
+    explicit multicast_ring(size_type capacity,
+                            const allocator_type &a = allocator_type())
+        : _slots(_round_capacity(capacity), a)
+        , _mask(_slots.size() - 1) { }
+
+#ifndef DOXYGEN
+    multicast_ring(const multicast_ring&) = delete;
+    multicast_ring &operator=(const multicast_ring&) = delete;
+#endif
+
+    /// Returns number of slots
+    size_type capacity() const noexcept { return _slots.size(); }
+
+    /// Returns the last published sequence
+    sequence_type published() const noexcept
+    { return _published.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Adds a consumer starting after the last published item
+     * @param deps Consumers which must process items first.
+     * @return Reference to the consumer, valid while the ring exists.
+     * @note Consumers must be added before producers start.
+     */
+    consumer &add_consumer(std::initializer_list<const consumer *> deps = { })
+    {
+        std::unique_ptr<consumer> c(new consumer(*this, published(), deps));
+        _consumers.push_back(std::move(c));
+        _refresh_gating();
+        return *_consumers.back();
+    }
+
+    /**
+     * @brief Closes the ring
+     *
+     * Producers stop publishing, consumers process items
+     * already published and then stop waiting.
+     */
+    void close()
+    {
+        _closed.store(true, std::memory_order_release);
+        _notify();
+    }
+
+    /// Returns true, if the ring is closed
+    bool closed() const noexcept { return _closed.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Claims the next slot, invokes @a f with a reference
+     * to it to fill the item in place, and publishes it
+     *
+     * Waits while the slowest consumer is a whole ring behind.
+     * @return false, if the ring is closed.
+     * @note The slot is published even if @a f throws,
+     * as later sequences can not be published without it.
+     */
+  template <typename Func>
+    bool publish_with(Func &&f)
+    {
+        if(closed())
+            return false;
+
+        const sequence_type seq = _claim.fetch_add(1, std::memory_order_relaxed) + 1;
+        const sequence_type wrap = seq - sequence_type(capacity());
+
+        // the cache passes on consumers' releases of their slots
+        if(wrap > _gating.load(std::memory_order_acquire)) {
+            _wait([&]() {
+                return wrap <= _refresh_gating() || closed();
+            });
+            if(wrap > _gating.load(std::memory_order_acquire))
+                return false; // closed
+        }
+
+        try {
+            std::forward<Func>(f)(_slot(seq));
+        } catch(...) {
+            _publish(seq);
+            throw;
+        }
+        return _publish(seq);
+    }
+
+    /**
+     * @brief Move-assigns an item created from given arguments
+     * to the next slot and publishes it
+     * @return false, if the ring is closed.
+     */
+  template <typename... Args>
+    bool push(Args &&...args)
+    {
+        return publish_with([&](Tp &slot) {
+            slot = Tp(std::forward<Args>(args)...);
+        });
+    }
+
+}; // class multicast_ring
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_MULTICAST_RING_H
@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_OBJECT_POOL_H
+#define CONCURRENT_UTILS_OBJECT_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "locks.h"
+#include "reclamation.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Default hooks of object_pool
+ *
+ * Creates objects by their default constructors and leaves
+ * released objects as they are.
+ */
+template <typename Tp>
+struct default_pool_hooks
+{
+    /// Constructs a new object at @a place
+    void construct(void *place) { ::new(place) Tp(); }
+
+    /// Prepares a released object for reuse
+    void reset(Tp&) noexcept { }
+};
+
+/**
+ * @brief Pool of reusable objects with per-thread caches
+ *
+ * Each thread keeps released objects in two magazines, arrays of
+ * pointers of a fixed size, so most acquisitions and releases touch
+ * only the thread's own cache. A thread exchanges whole magazines
+ * with the depot, shared by all threads and protected by a spinlock,
+ * only when both of its magazines are empty on acquisition or full
+ * on release. New objects are allocated when the depot has nothing
+ * to give, and released objects are destroyed when it is full.
+ *
+ * Caches of exited threads are kept and reused by new threads.
+ *
+ * @tparam Tp Type of objects.
+ * @tparam Hooks Type with member functions `construct(void*)`,
+ * creating an object in raw memory, and `reset(Tp&)`, called
+ * for every released object.
+ * @tparam Alloc Allocator of objects and caches.
+ */
+template <typename Tp, typename Hooks = default_pool_hooks<Tp>,
+          typename Alloc = std::allocator<Tp>>
+class object_pool
+{
+    enum : std::size_t { _cache_line = 64 };
+
+    using _alloc_traits = std::allocator_traits<Alloc>;
+  template <typename Up>
+    using _rebind_traits = typename _alloc_traits::template rebind_traits<Up>;
+  template <typename Up>
+    using _rebind_alloc = typename _alloc_traits::template rebind_alloc<Up>;
+    using _magazine_list = std::vector<Tp**, _rebind_alloc<Tp**>>;
+
+    struct alignas(_cache_line) _record : details::reclaim_record
+    {
+        Tp **loaded = nullptr, **previous = nullptr;
+        std::size_t loaded_count = 0, previous_count = 0;
+
+        explicit _record(const Alloc&) { }
+    };
+
+    struct _domain : details::reclaim_domain<_record, Alloc>
+    {
+        using _base = details::reclaim_domain<_record, Alloc>;
+        explicit _domain(const Alloc &alloc) : _base(alloc) { }
+        using _base::_local;
+        using _base::_first;
+        using _base::_next;
+    } _impl;
+
+    Hooks _hooks;
+    _rebind_alloc<Tp> _alloc;
+    std::size_t _magazine, _depot_size;
+
+    spinlock _lock;
+    _magazine_list _full, _empty;   // magazines of the depot
+
+    _record &_local();
+    Tp **_allocate_magazine();
+    void _deallocate_magazine(Tp **m) noexcept;
+    Tp *_create();
+    void _destroy(Tp *p) noexcept;
+    bool _deposit(_record &r);
+
+public:
+    using value_type = Tp;
+    using hooks_type = Hooks;
+    using allocator_type = Alloc;
+    using size_type = std::size_t;
+
+    explicit object_pool(size_type max_size = 1024, size_type magazine = 32,
+                         const Hooks &hooks = Hooks(), const Alloc &alloc = Alloc());
+
+    /// Creates pool using @a hooks
+    explicit object_pool(const Hooks &hooks, const Alloc &alloc = Alloc())
+        : object_pool(1024, 32, hooks, alloc) { }
+
+    ~object_pool();
+
+#ifndef DOXYGEN
+    object_pool(const object_pool&) = delete;
+    object_pool &operator=(const object_pool&) = delete;
+#endif
+
+    Tp *acquire();
+    void release(Tp *p);
+    void reserve(size_type n);
+
+    /// Returns the number of objects in a magazine
+    size_type magazine_size() const noexcept { return _magazine; }
+
+    /// Returns the number of idle objects the depot may hold
+    size_type max_size() const noexcept { return _depot_size * _magazine; }
+
+    /// Returns the allocator used by the pool
+    allocator_type get_allocator() const noexcept { return allocator_type(_alloc); }
+};
+
+/**
+ * @brief Creates empty pool
+ * @param max_size Number of idle objects the depot may hold,
+ * rounded down to whole magazines, but at least one magazine.
+ * @param magazine Number of objects in a magazine.
+ * @param hooks Hooks creating and resetting objects.
+ * @param alloc Allocator of objects and caches.
+ * @note Besides the depot, each thread caches up to twice
+ * @a magazine idle objects.
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    object_pool<Tp, Hooks, Alloc>::
+    object_pool(size_type max_size, size_type magazine,
+                const Hooks &hooks, const Alloc &alloc)
+        : _impl(alloc), _hooks(hooks), _alloc(alloc)
+        , _magazine(magazine ? magazine : 1)
+        , _depot_size(std::max<size_type>(max_size / _magazine, 1))
+        , _full(alloc), _empty(alloc)
+    {
+        // the depot never holds more magazines than that,
+        // so it never allocates under the lock
+        _full.reserve(_depot_size);
+        _empty.reserve(_depot_size);
+    }
+
+/**
+ * @brief Destroys all idle objects
+ * @note Objects still acquired must not be released anymore.
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    object_pool<Tp, Hooks, Alloc>::
+    ~object_pool()
+    {
+        for(_record *r = _impl._first(); r; r = _impl._next(r)) {
+            if(!r->loaded)
+                continue;
+            std::for_each(r->loaded, r->loaded + r->loaded_count,
+                          [this](Tp *p) { _destroy(p); });
+            std::for_each(r->previous, r->previous + r->previous_count,
+                          [this](Tp *p) { _destroy(p); });
+            _deallocate_magazine(r->loaded);
+            _deallocate_magazine(r->previous);
+        }
+        for(Tp **m : _full) {
+            std::for_each(m, m + _magazine, [this](Tp *p) { _destroy(p); });
+            _deallocate_magazine(m);
+        }
+        for(Tp **m : _empty)
+            _deallocate_magazine(m);
+    }
+
+/**
+ * @internal
+ * @brief Returns the cache of the calling thread
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    auto
+    object_pool<Tp, Hooks, Alloc>::
+    _local() -> _record&
+    {
+        _record &r = _impl._local();
+        if(!r.loaded) {
+            Tp **previous = _allocate_magazine();
+            try {
+                r.loaded = _allocate_magazine();
+            } catch(...) {
+                _deallocate_magazine(previous);
+                throw;
+            }
+            r.previous = previous;
+        }
+        return r;
+    }
+
+/**
+ * @internal
+ * @brief Allocates an array of pointers of a magazine's size
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    Tp **
+    object_pool<Tp, Hooks, Alloc>::
+    _allocate_magazine()
+    {
+        _rebind_alloc<Tp*> alloc(_alloc);
+        return std::addressof(*_rebind_traits<Tp*>::allocate(alloc, _magazine));
+    }
+
+/**
+ * @internal
+ * @brief Frees an array allocated by _allocate_magazine()
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    void
+    object_pool<Tp, Hooks, Alloc>::
+    _deallocate_magazine(Tp **m) noexcept
+    {
+        _rebind_alloc<Tp*> alloc(_alloc);
+        _rebind_traits<Tp*>::deallocate(alloc, m, _magazine);
+    }
+
+/**
+ * @internal
+ * @brief Allocates and constructs a new object by the hooks
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    Tp *
+    object_pool<Tp, Hooks, Alloc>::
+    _create()
+    {
+        Tp *p = std::addressof(*_rebind_traits<Tp>::allocate(_alloc, 1));
+        try {
+            _hooks.construct(static_cast<void*>(p));
+        } catch(...) {
+            _rebind_traits<Tp>::deallocate(_alloc, p, 1);
+            throw;
+        }
+        return p;
+    }
+
+/**
+ * @internal
+ * @brief Destroys @a p and frees its memory
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    void
+    object_pool<Tp, Hooks, Alloc>::
+    _destroy(Tp *p) noexcept
+    {
+        p->~Tp();
+        _rebind_traits<Tp>::deallocate(_alloc, p, 1);
+    }
+
+/**
+ * @internal
+ * @brief Gives the previous magazine of @a r, which is full as well
+ * as the loaded one, to the depot in exchange for an empty one
+ *
+ * If the depot has no empty magazine, a new one is allocated outside
+ * of the lock and the depot is checked again.
+ * @return false, if the depot is full.
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    bool
+    object_pool<Tp, Hooks, Alloc>::
+    _deposit(_record &r)
+    {
+        Tp **spare = nullptr;
+        bool deposited = false;
+        for(;;) {
+            std::unique_lock<spinlock> lk(_lock);
+            if(_full.size() >= _depot_size)
+                break;
+
+            Tp **empty = spare;
+            if(!_empty.empty()) {
+                empty = _empty.back();
+                _empty.pop_back();
+            } else if(!spare) {
+                lk.unlock();
+                spare = _allocate_magazine();
+                continue;
+            } else
+                spare = nullptr;
+
+            _full.push_back(r.previous);
+            r.previous = r.loaded;
+            r.loaded = empty;
+            r.loaded_count = 0;
+            deposited = true;
+            break;
+        }
+
+        // the depot got full or an empty magazine meanwhile
+        if(spare)
+            _deallocate_magazine(spare);
+        return deposited;
+    }
+
+/**
+ * @brief Takes an idle object or creates a new one
+ * @return Pointer to the object, to be given back by release().
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    Tp *
+    object_pool<Tp, Hooks, Alloc>::
+    acquire()
+    {
+        _record &r = _local();
+        if(!r.loaded_count) {
+            if(r.previous_count) {
+                std::swap(r.loaded, r.previous);
+                std::swap(r.loaded_count, r.previous_count);
+            } else {
+                {
+                    std::lock_guard<spinlock> lk(_lock);
+                    if(!_full.empty()) {
+                        // both magazines are empty, one goes to the depot
+                        _empty.push_back(r.previous);
+                        r.previous = r.loaded;
+                        r.loaded = _full.back();
+                        r.loaded_count = _magazine;
+                        _full.pop_back();
+                    }
+                }
+                // the depot has nothing, created outside of the lock
+                if(!r.loaded_count)
+                    return _create();
+            }
+        }
+        return r.loaded[--r.loaded_count];
+    }
+
+/**
+ * @brief Resets @a p by the hooks and gives it back to the pool
+ *
+ * Destroys @a p, if the depot is full.
+ * @param p Pointer obtained from acquire() of this pool.
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    void
+    object_pool<Tp, Hooks, Alloc>::
+    release(Tp *p)
+    {
+        _hooks.reset(*p);
+
+        _record &r = _local();
+        if(r.loaded_count == _magazine) {
+            if(r.previous_count < _magazine) {
+                std::swap(r.loaded, r.previous);
+                std::swap(r.loaded_count, r.previous_count);
+            } else if(!_deposit(r)) {
+                _destroy(p);
+                return;
+            }
+        }
+        r.loaded[r.loaded_count++] = p;
+    }
+
+/**
+ * @brief Creates objects for the depot in advance
+ * @param n Number of objects, rounded up to whole magazines
+ * and limited by max_size().
+ */
+  template <typename Tp, typename Hooks, typename Alloc>
+    void
+    object_pool<Tp, Hooks, Alloc>::
+    reserve(size_type n)
+    {
+        for(size_type created = 0; created < n; created += _magazine) {
+            Tp **m = nullptr;
+            {
+                std::lock_guard<spinlock> lk(_lock);
+                if(!_empty.empty()) {
+                    m = _empty.back();
+                    _empty.pop_back();
+                } else if(_full.size() >= _depot_size)
+                    return;
+            }
+
+            const bool reused = m;
+            if(!reused)
+                m = _allocate_magazine();
+            size_type count = 0;
+            try {
+                for(; count < _magazine; ++count)
+                    m[count] = _create();
+            } catch(...) {
+                std::for_each(m, m + count, [this](Tp *p) { _destroy(p); });
+                if(reused) {
+                    std::lock_guard<spinlock> lk(_lock);
+                    _empty.push_back(m);
+                } else
+                    _deallocate_magazine(m);
+                throw;
+            }
+
+            bool pushed;
+            {
+                std::lock_guard<spinlock> lk(_lock);
+                pushed = reused || _full.size() + _empty.size() < _depot_size;
+                if(pushed)
+                    _full.push_back(m);
+            }
+            if(!pushed) {
+                // other threads have filled the depot meanwhile
+                std::for_each(m, m + _magazine, [this](Tp *p) { _destroy(p); });
+                _deallocate_magazine(m);
+                return;
+            }
+        }
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_OBJECT_POOL_H
@@ -0,0 +1,828 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_PERSISTENT_QUEUE_H
+#define CONCURRENT_UTILS_PERSISTENT_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Options of persistent_queue
+ *
+ * With both sync options zero, written data reaches the disk
+ * whenever the OS writes the pages back, which survives a crash
+ * of the process, but not of the machine.
+ *
+ * Syncs are checked only by pushes and pulls, there is no timer:
+ * after the last push of a burst, records stay unsynced until
+ * the next push, a call of persistent_queue::sync() or closing
+ * the queue, which syncs if any sync option is set.
+ */
+struct persistent_queue_options
+{
+    /// Size of segment files in bytes, at most 4GB
+    std::size_t segment_size = std::size_t(64) << 20;
+
+    /// Number of pushes (pulls) after which they are synced, or zero
+    std::size_t sync_every = 0;
+
+    /// Time after which pushes (pulls) are synced by the next one, or zero
+    std::chrono::milliseconds sync_interval { 0 };
+
+    /// Number of consumed segment files kept for reuse
+    std::size_t spare_segments = 2;
+};
+
+/**
+ * @brief Queue of byte records persisted in memory-mapped files
+ *
+ * Records are appended to segment files of a directory, which are
+ * mapped to memory, so pushes write straight to the page cache and
+ * pulls hand out records right from the mapping. Each record has
+ * a header with its size, checksum and the number of its segment,
+ * aligned to 8 bytes. A segment ends with a marker or when the next
+ * record does not fit in it.
+ *
+ * The position of the consumer is kept in a small mapped file too.
+ * On open, the queue recovers: records are validated from the first
+ * segment on, and the first record with a wrong segment number or
+ * checksum, e.g. written partially before a crash, marks the end of
+ * the queue. Delivery is at-least-once: records pulled after the last
+ * sync of the position are pulled again after a crash.
+ *
+ * Consumed segment files are renamed to become spares, which are
+ * renamed back to new segments instead of creating new files.
+ *
+ * Pushes are serialized by one lock and pulls by another, so a
+ * producer and a consumer never wait for each other. Pulls never
+ * block: the queue may be polled or paired with a notification.
+ *
+ * @tparam Lock Lock type of producers and consumers.
+ * @note Only one queue object may use a directory at a time,
+ * opening a directory in use throws std::system_error.
+ * @throw std::system_error On failed file operations.
+ */
+template <typename Lock = spinlock>
+class persistent_queue
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "persistent_queue only works with lockable type");
+#endif
+
+    using _clock = std::chrono::steady_clock;
+
+    enum : std::uint32_t { _end_marker = 0xffffffff };
+
+    struct _header
+    {
+        std::uint32_t size;
+        std::uint32_t checksum;
+        std::uint64_t segment;
+    };
+
+    struct _position
+    {
+        std::uint64_t segment;
+        std::uint64_t offset;
+    };
+
+    struct _segment
+    {
+        std::uint64_t seq;
+        int fd;
+        char *base;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t _align = alignof(_header);
+
+    std::string _dir;
+    persistent_queue_options _options;
+
+    spinlock _segments_lock;
+    std::deque<_segment> _segments;     // from the consumer's to the producer's
+    std::vector<std::uint64_t> _spares; // numbers of spare files
+
+    // seq << 32 | offset of the end of published records
+    std::atomic<std::uint64_t> _published { 0 };
+
+    Lock _push_lock;
+    _segment _tail;
+    std::size_t _write_offset = 0, _synced_offset = 0, _unsynced_pushes = 0;
+    _clock::time_point _push_synced;
+
+    Lock _pull_lock;
+    _segment _head;
+    std::size_t _read_offset = 0, _unsynced_pulls = 0;
+    int _cursor_fd = -1;
+    _position *_cursor = nullptr;
+    _clock::time_point _pull_synced;
+
+    [[noreturn]] static void _throw_errno(const std::string &what)
+    { throw std::system_error(errno, std::generic_category(), what); }
+
+    static std::size_t _aligned(std::size_t n) noexcept
+    { return (n + _align - 1) / _align * _align; }
+
+    static std::uint32_t _checksum(const char *data, std::uint32_t size,
+                                   std::uint64_t seq) noexcept;
+
+    std::string _path(std::uint64_t seq, const char *ext) const;
+    _segment _open_segment(std::uint64_t seq, bool create);
+    void _close_segment(const _segment &s) noexcept;
+    void _retire_segment(const _segment &s);
+    void _open_cursor();
+    void _recover();
+    std::size_t _valid_end(const _segment &s, bool &ended) const noexcept;
+    bool _sync_due(std::size_t unsynced, _clock::time_point since) const noexcept;
+
+    void _publish() noexcept;
+    void _sync_pushes();
+    void _roll();
+    void _save_position() noexcept;
+    void _sync_pulls();
+    const _header *_front();
+    void _pop(const _header *h);
+
+public:
+    explicit persistent_queue(const std::string &dir,
+                              const persistent_queue_options &options = { });
+    ~persistent_queue();
+
+#ifndef DOXYGEN
+    persistent_queue(const persistent_queue&) = delete;
+    persistent_queue &operator=(const persistent_queue&) = delete;
+#endif
+
+  template <typename Writer>
+    void push_with(std::size_t size, Writer &&write);
+
+    /// Appends a record of @a size bytes copied from @a data
+    void push(const void *data, std::size_t size)
+    { push_with(size, [&](void *dst) { std::memcpy(dst, data, size); }); }
+
+  template <typename Tp>
+    void push(const Tp &item);
+
+  template <typename Func>
+    bool consume(Func &&f);
+
+  template <typename Tp>
+    bool pull(Tp &item);
+
+    bool empty();
+
+    void sync();
+
+    /// Returns the directory of the queue
+    const std::string &directory() const noexcept { return _dir; }
+
+    /// Returns the options of the queue
+    const persistent_queue_options &options() const noexcept { return _options; }
+};
+
+/**
+ * @brief Opens the queue in @a dir, creating the directory if needed,
+ * and recovers records left there
+ */
+  template <typename Lock>
+    persistent_queue<Lock>::
+    persistent_queue(const std::string &dir, const persistent_queue_options &options)
+        : _dir(dir), _options(options)
+    {
+        if(_options.segment_size > 0xffffffffu || _options.segment_size < 4096)
+            throw std::invalid_argument("persistent_queue: bad segment size");
+
+        if(::mkdir(_dir.c_str(), 0755) && errno != EEXIST)
+            _throw_errno("persistent_queue: mkdir " + _dir);
+
+        try {
+            _open_cursor();
+            _recover();
+        } catch(...) {
+            for(const _segment &s : _segments)
+                _close_segment(s);
+            if(_cursor) ::munmap(_cursor, sizeof(_position));
+            if(_cursor_fd >= 0) ::close(_cursor_fd);
+            throw;
+        }
+        _push_synced = _pull_synced = _clock::now();
+    }
+
+/**
+ * @brief Syncs the queue, if any sync option is set, and closes it
+ */
+  template <typename Lock>
+    persistent_queue<Lock>::
+    ~persistent_queue()
+    {
+        if(_options.sync_every || _options.sync_interval.count()) {
+            try { sync(); } catch(...) { }
+        }
+        for(const _segment &s : _segments)
+            _close_segment(s);
+        ::munmap(_cursor, sizeof(_position));
+        ::close(_cursor_fd);
+    }
+
+/**
+ * @internal
+ * @brief FNV-1a hash of a record
+ */
+  template <typename Lock>
+    std::uint32_t
+    persistent_queue<Lock>::
+    _checksum(const char *data, std::uint32_t size, std::uint64_t seq) noexcept
+    {
+        std::uint32_t h = 2166136261u;
+        auto feed = [&h](const void *p, std::size_t n) {
+            for(std::size_t i = 0; i < n; ++i)
+                h = (h ^ static_cast<const unsigned char*>(p)[i]) * 16777619u;
+        };
+        feed(&size, sizeof(size));
+        feed(&seq, sizeof(seq));
+        feed(data, size);
+        return h;
+    }
+
+/**
+ * @internal
+ * @brief Returns the path of a segment or spare file
+ */
+  template <typename Lock>
+    std::string
+    persistent_queue<Lock>::
+    _path(std::uint64_t seq, const char *ext) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.%s",
+                      static_cast<unsigned long long>(seq), ext);
+        return _dir + '/' + name;
+    }
+
+/**
+ * @internal
+ * @brief Maps segment @a seq, creating its file from a spare
+ * or anew, if @a create
+ */
+  template <typename Lock>
+    auto
+    persistent_queue<Lock>::
+    _open_segment(std::uint64_t seq, bool create) -> _segment
+    {
+        const std::string path = _path(seq, "seg");
+        if(create) {
+            std::uint64_t spare = 0;
+            bool reuse = false;
+            {
+                std::lock_guard<spinlock> lk(_segments_lock);
+                if(!_spares.empty()) {
+                    spare = _spares.back();
+                    _spares.pop_back();
+                    reuse = true;
+                }
+            }
+            if(reuse && ::rename(_path(spare, "spare").c_str(), path.c_str()))
+                _throw_errno("persistent_queue: rename to " + path);
+        }
+
+        _segment s { seq, ::open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644),
+                     nullptr, 0 };
+        if(s.fd < 0)
+            _throw_errno("persistent_queue: open " + path);
+
+        struct stat st;
+        if(::fstat(s.fd, &st)) {
+            ::close(s.fd);
+            _throw_errno("persistent_queue: stat " + path);
+        }
+        s.size = static_cast<std::size_t>(st.st_size);
+        if(create || s.size < sizeof(_header)) {
+            if(::ftruncate(s.fd, _options.segment_size)) {
+                ::close(s.fd);
+                _throw_errno("persistent_queue: truncate " + path);
+            }
+            s.size = _options.segment_size;
+        }
+
+        void *p = ::mmap(nullptr, s.size, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+        if(p == MAP_FAILED) {
+            ::close(s.fd);
+            _throw_errno("persistent_queue: mmap " + path);
+        }
+        s.base = static_cast<char*>(p);
+        return s;
+    }
+
+/**
+ * @internal
+ * @brief Unmaps @a s and closes its file
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _close_segment(const _segment &s) noexcept
+    {
+        ::munmap(s.base, s.size);
+        ::close(s.fd);
+    }
+
+/**
+ * @internal
+ * @brief Closes consumed @a s and turns its file into a spare
+ * or removes it
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _retire_segment(const _segment &s)
+    {
+        if(s.base)
+            _close_segment(s);
+        const std::string path = _path(s.seq, "seg");
+
+        // only the consumer adds spares, so the check holds after
+        // unlocking, and the producer does not wait for file operations
+        bool keep;
+        {
+            std::lock_guard<spinlock> lk(_segments_lock);
+            keep = _spares.size() < _options.spare_segments;
+        }
+        if(keep && !::rename(path.c_str(), _path(s.seq, "spare").c_str())) {
+            std::lock_guard<spinlock> lk(_segments_lock);
+            _spares.push_back(s.seq);
+        } else
+            ::unlink(path.c_str());
+    }
+
+/**
+ * @internal
+ * @brief Locks and maps the file with the consumer's position
+ *
+ * The lock is held while the file is open, so the directory can not
+ * be opened by another queue, in this or in another process.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _open_cursor()
+    {
+        const std::string path = _dir + "/cursor";
+        _cursor_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if(_cursor_fd < 0)
+            _throw_errno("persistent_queue: open " + path);
+        if(::flock(_cursor_fd, LOCK_EX | LOCK_NB))
+            _throw_errno("persistent_queue: lock " + path);
+        if(::ftruncate(_cursor_fd, sizeof(_position)))
+            _throw_errno("persistent_queue: truncate " + path);
+
+        void *p = ::mmap(nullptr, sizeof(_position), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, _cursor_fd, 0);
+        if(p == MAP_FAILED)
+            _throw_errno("persistent_queue: mmap " + path);
+        _cursor = static_cast<_position*>(p);
+    }
+
+/**
+ * @internal
+ * @brief Returns the end of valid records of @a s
+ * @param ended Set, if @a s ends with a marker or is full.
+ */
+  template <typename Lock>
+    std::size_t
+    persistent_queue<Lock>::
+    _valid_end(const _segment &s, bool &ended) const noexcept
+    {
+        std::size_t off = 0;
+        for(;;) {
+            if(off + sizeof(_header) > s.size) {
+                ended = true;
+                return off;
+            }
+            _header h;
+            std::memcpy(&h, s.base + off, sizeof(h));
+            ended = h.segment == s.seq && h.size == _end_marker;
+            if(ended || h.segment != s.seq || !h.size
+                    || h.size > s.size - off - sizeof(_header)
+                    || h.checksum != _checksum(s.base + off + sizeof(_header),
+                                               h.size, s.seq))
+                return off;
+            off += _aligned(sizeof(_header) + h.size);
+        }
+    }
+
+/**
+ * @internal
+ * @brief Maps segments left in the directory and finds positions
+ * of the producer and the consumer
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _recover()
+    {
+        std::vector<std::uint64_t> found;
+        if(DIR *d = ::opendir(_dir.c_str())) {
+            while(const dirent *e = ::readdir(d)) {
+                unsigned long long seq;
+                char ext[8];
+                if(std::sscanf(e->d_name, "%16llx.%7s", &seq, ext) != 2)
+                    continue;
+                if(!std::strcmp(ext, "seg"))
+                    found.push_back(seq);
+                else if(!std::strcmp(ext, "spare"))
+                    _spares.push_back(seq);
+            }
+            ::closedir(d);
+        } else
+            _throw_errno("persistent_queue: opendir " + _dir);
+        std::sort(found.begin(), found.end());
+
+        // segments before the consumer's are consumed already
+        _position pos = *_cursor;
+        auto first = std::lower_bound(found.begin(), found.end(), pos.segment);
+        for(auto it = found.begin(); it != first; ++it)
+            _retire_segment(_segment { *it, -1, nullptr, 0 });
+        found.erase(found.begin(), first);
+
+        if(found.empty() || found.front() != pos.segment) {
+            pos.segment = found.empty() ? std::max<std::uint64_t>(pos.segment, 1)
+                                        : found.front();
+            pos.offset = 0;
+        }
+
+        // valid records are contiguous, the rest is lost
+        std::size_t end = 0;
+        bool ended = true;
+        for(std::size_t i = 0; i < found.size(); ++i) {
+            if(!ended) {
+                for(std::size_t j = i; j < found.size(); ++j)
+                    _retire_segment(_segment { found[j], -1, nullptr, 0 });
+                break;
+            }
+            _segments.push_back(_open_segment(found[i], false));
+            end = _valid_end(_segments.back(), ended);
+            if(i + 1 < found.size() && found[i + 1] != found[i] + 1)
+                ended = false;
+        }
+
+        const bool fresh = _segments.empty() || ended;
+        if(_segments.empty())
+            _segments.push_back(_open_segment(pos.segment, true));
+        else if(ended) {
+            // crashed after the end of a segment
+            _segments.push_back(_open_segment(_segments.back().seq + 1, true));
+            end = 0;
+        }
+
+        _head = _segments.front();
+        _tail = _segments.back();
+        _write_offset = _synced_offset = end;
+        _read_offset = pos.segment == _tail.seq
+            ? std::min<std::size_t>(pos.offset, end) : pos.offset;
+        _save_position();
+
+        // intact records may follow the lost ones, so the segment is
+        // ended right after the valid records, and new records go to
+        // the next one instead of making the old ones valid again
+        if(fresh)
+            _publish();
+        else
+            _roll();
+    }
+
+/**
+ * @internal
+ * @brief Makes records written by the producer visible to consumers
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _publish() noexcept
+    {
+        _published.store(_tail.seq << 32 | _write_offset, std::memory_order_release);
+    }
+
+/**
+ * @internal
+ * @brief Returns true, if a sync is due by the options
+ */
+  template <typename Lock>
+    bool
+    persistent_queue<Lock>::
+    _sync_due(std::size_t unsynced, _clock::time_point since) const noexcept
+    {
+        return (_options.sync_every && unsynced >= _options.sync_every)
+            || (_options.sync_interval.count()
+                && _clock::now() - since >= _options.sync_interval);
+    }
+
+/**
+ * @internal
+ * @brief Flushes records written since the last sync to the disk
+ * @note Must be called under the push lock.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _sync_pushes()
+    {
+        const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        const std::size_t from = _synced_offset / page * page;
+        if(_write_offset > from
+                && ::msync(_tail.base + from, _write_offset - from, MS_SYNC))
+            _throw_errno("persistent_queue: msync");
+        _synced_offset = _write_offset;
+        _unsynced_pushes = 0;
+        _push_synced = _clock::now();
+    }
+
+/**
+ * @internal
+ * @brief Ends the producer's segment and starts the next one
+ * @note Must be called under the push lock.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _roll()
+    {
+        _segment next = _open_segment(_tail.seq + 1, true);
+
+        if(_write_offset + sizeof(_header) <= _tail.size) {
+            const _header marker { _end_marker, 0, _tail.seq };
+            std::memcpy(_tail.base + _write_offset, &marker, sizeof(marker));
+            _write_offset += sizeof(marker);
+        }
+        if(_options.sync_every || _options.sync_interval.count())
+            _sync_pushes();
+
+        {
+            std::lock_guard<spinlock> lk(_segments_lock);
+            _segments.push_back(next);
+        }
+        _tail = next;
+        _write_offset = _synced_offset = 0;
+        _publish();
+    }
+
+/**
+ * @brief Appends a record of @a size bytes written in place
+ * by @a write
+ *
+ * @a write is called with a pointer to @a size bytes of the mapping
+ * and must fill them, e.g. by serializing an object there.
+ * @throw std::length_error If the record does not fit in a segment.
+ */
+  template <typename Lock>
+      template <typename Writer>
+    void
+    persistent_queue<Lock>::
+    push_with(std::size_t size, Writer &&write)
+    {
+        const std::size_t total = _aligned(sizeof(_header) + size);
+        if(!size || total > _options.segment_size)
+            throw std::length_error("persistent_queue: bad record size");
+
+        std::lock_guard<Lock> lk(_push_lock);
+        if(_write_offset + total > _tail.size)
+            _roll();
+
+        char *p = _tail.base + _write_offset;
+        write(static_cast<void*>(p + sizeof(_header)));
+        const _header h { static_cast<std::uint32_t>(size),
+                          _checksum(p + sizeof(_header), size, _tail.seq), _tail.seq };
+        std::memcpy(p, &h, sizeof(h));
+        _write_offset += total;
+        _publish();
+
+        if(_sync_due(++_unsynced_pushes, _push_synced))
+            _sync_pushes();
+    }
+
+/**
+ * @brief Appends a copy of trivially copyable @a item
+ */
+  template <typename Lock>
+      template <typename Tp>
+    void
+    persistent_queue<Lock>::
+    push(const Tp &item)
+    {
+#ifndef DOXYGEN
+        static_assert(std::is_trivially_copyable<Tp>::value,
+            "persistent_queue stores only trivially copyable items");
+#endif
+        push(static_cast<const void*>(&item), sizeof(Tp));
+    }
+
+/**
+ * @internal
+ * @brief Stores the consumer's position in the cursor file
+ * @note Must be called under the pull lock.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _save_position() noexcept
+    {
+        _cursor->segment = _head.seq;
+        _cursor->offset = _read_offset;
+    }
+
+/**
+ * @internal
+ * @brief Flushes the consumer's position to the disk
+ * @note Must be called under the pull lock.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _sync_pulls()
+    {
+        if(::msync(_cursor, sizeof(_position), MS_SYNC))
+            _throw_errno("persistent_queue: msync");
+        _unsynced_pulls = 0;
+        _pull_synced = _clock::now();
+    }
+
+/**
+ * @internal
+ * @brief Returns the header of the first record, moving to the next
+ * segment when the current one has been consumed
+ * @return The header or nullptr, if the queue is empty.
+ * @note Must be called under the pull lock.
+ */
+  template <typename Lock>
+    auto
+    persistent_queue<Lock>::
+    _front() -> const _header*
+    {
+        for(;;) {
+            const std::uint64_t end = _published.load(std::memory_order_acquire);
+            if(_head.seq == end >> 32 && _read_offset >= (end & 0xffffffffu))
+                return nullptr;
+
+            // a previous segment has been completed by the producer
+            const _header *h = reinterpret_cast<const _header*>(_head.base + _read_offset);
+            if(_read_offset + sizeof(_header) <= _head.size && h->size != _end_marker)
+                return h;
+
+            _segment done = _head;
+            {
+                std::lock_guard<spinlock> lk(_segments_lock);
+                _segments.pop_front();
+                _head = _segments.front();
+            }
+            _read_offset = 0;
+            _save_position();
+            _retire_segment(done);
+        }
+    }
+
+/**
+ * @internal
+ * @brief Moves the consumer past the record of @a h
+ * @note Must be called under the pull lock.
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    _pop(const _header *h)
+    {
+        _read_offset += _aligned(sizeof(_header) + h->size);
+        _save_position();
+        if(_sync_due(++_unsynced_pulls, _pull_synced))
+            _sync_pulls();
+    }
+
+/**
+ * @brief Calls @a f for the first record and removes it
+ *
+ * @a f is called with a pointer to the record in the mapping and
+ * its size, the record is valid only during the call. If @a f
+ * throws, the record stays in the queue.
+ * @return false, if the queue is empty.
+ */
+  template <typename Lock>
+      template <typename Func>
+    bool
+    persistent_queue<Lock>::
+    consume(Func &&f)
+    {
+        std::lock_guard<Lock> lk(_pull_lock);
+        const _header *h = _front();
+        if(!h)
+            return false;
+        f(static_cast<const void*>(h + 1), std::size_t(h->size));
+        _pop(h);
+        return true;
+    }
+
+/**
+ * @brief Copies the first record to trivially copyable @a item
+ * and removes it
+ * @return false, if the queue is empty.
+ * @throw std::length_error If the record is not of size of @a item,
+ * then it stays in the queue.
+ */
+  template <typename Lock>
+      template <typename Tp>
+    bool
+    persistent_queue<Lock>::
+    pull(Tp &item)
+    {
+#ifndef DOXYGEN
+        static_assert(std::is_trivially_copyable<Tp>::value,
+            "persistent_queue stores only trivially copyable items");
+#endif
+        return consume([&item](const void *data, std::size_t size) {
+            if(size != sizeof(Tp))
+                throw std::length_error("persistent_queue: record size mismatch");
+            std::memcpy(static_cast<void*>(&item), data, sizeof(Tp));
+        });
+    }
+
+/**
+ * @brief Returns true, if there are no records to pull
+ * @note Takes the pull lock and may retire a consumed segment.
+ */
+  template <typename Lock>
+    bool
+    persistent_queue<Lock>::
+    empty()
+    {
+        std::lock_guard<Lock> lk(_pull_lock);
+        return !_front();
+    }
+
+/**
+ * @brief Flushes pushed records and the consumer's position
+ * to the disk
+ */
+  template <typename Lock>
+    void
+    persistent_queue<Lock>::
+    sync()
+    {
+        {
+            std::lock_guard<Lock> lk(_push_lock);
+            _sync_pushes();
+        }
+        std::lock_guard<Lock> lk(_pull_lock);
+        _sync_pulls();
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_PERSISTENT_QUEUE_H
@@ -0,0 +1,739 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_POLICY_QUEUE_H
+#define CONCURRENT_UTILS_POLICY_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "concurrent-queue.h"
+#include "locks.h"
+#include "wait-strategies.h"
+
+namespace concurrent_utils {
+
+/// Policies telling how many threads push to a queue
+namespace producers {
+    struct single { };
+    struct multi { };
+} // namespace producers
+
+/// Policies telling how many threads pull from a queue
+namespace consumers {
+    struct single { };
+    struct multi { };
+} // namespace consumers
+
+/// Policy of a queue holding at most @a Capacity items,
+/// rounded up to a power of two
+template <std::size_t Capacity>
+struct bounded { };
+
+/// Policy of a queue growing without limit
+struct unbounded { };
+
+/// Policies telling how waiting threads wait, see wait-strategies.h
+namespace wait {
+    using park = park_wait;
+    using spin = spin_wait;
+    using yield = yield_wait<>;
+    using spin_park = spin_park_wait<>;
+} // namespace wait
+
+/// Policy of a queue allocating its memory with @a Alloc
+template <typename Alloc>
+struct use_allocator { };
+
+namespace details {
+
+    constexpr std::size_t ceil_pow2(std::size_t n) noexcept
+    {
+        std::size_t p = 1;
+        while(p < n)
+            p <<= 1;
+        return p;
+    }
+
+    // Parks and wakes threads waiting on one side of a queue
+    // according to the wait strategy
+  template <typename Wait>
+    class policy_waiter
+    {
+        std::atomic<unsigned> _waiters { 0 };
+        std::mutex _mutex;
+        std::condition_variable _cond;
+
+    public:
+      template <typename Ready>
+        void wait(Ready ready)
+        {
+            if constexpr(bool(Wait::spins)) {
+                if(Wait::spin(ready))
+                    return;
+            }
+            if constexpr(bool(Wait::parks)) {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _waiters.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while(!ready())
+                    _cond.wait(lk);
+                _waiters.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        void notify()
+        {
+            if constexpr(bool(Wait::parks)) {
+                // pairs with the fence in wait()
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(_waiters.load(std::memory_order_relaxed)) {
+                    { std::lock_guard<std::mutex> lk(_mutex); }
+                    _cond.notify_all();
+                }
+            }
+        }
+    };
+
+    // Blocking and optional-returning operations shared by the engines
+    // of make_queue. Derived engines provide _try_emplace(), _try_pull(),
+    // _empty(), _full() and static bounded.
+  template <typename Derived, typename Tp, typename Wait>
+    class basic_policy_queue
+    {
+        Derived &_self() noexcept { return static_cast<Derived&>(*this); }
+        const Derived &_self() const noexcept
+        { return static_cast<const Derived&>(*this); }
+
+      template <typename... Args>
+        bool _push(bool block, Args &&...args)
+        {
+            for(;;) {
+                if(closed())
+                    return false;
+                if(_self()._try_emplace(std::forward<Args>(args)...))
+                    break;
+                if(!block)
+                    return false;
+                _writable.wait([this]() { return !_self()._full() || closed(); });
+            }
+            _readable.notify();
+            return true;
+        }
+
+    protected:
+        static_assert(Wait::spins || Wait::parks,
+            "wait strategy must spin or park");
+
+        enum : std::size_t { _cache_line = 64 };
+
+        alignas(_cache_line) std::atomic<bool> _closed { false };
+        policy_waiter<Wait> _readable;
+        policy_waiter<Wait> _writable;
+
+    public:
+        using value_type = Tp;
+        using size_type = std::size_t;
+        using wait_strategy = Wait;
+
+      template <typename... Args>
+        bool push(Args &&...args)
+        {
+            // a failed attempt must leave the arguments intact
+            if constexpr(std::is_nothrow_constructible<Tp, Args&&...>::value)
+                return _push(Derived::bounded, std::forward<Args>(args)...);
+            else
+                return _push(Derived::bounded, Tp(std::forward<Args>(args)...));
+        }
+
+      template <typename... Args>
+        bool try_push(Args &&...args)
+        {
+            if constexpr(std::is_nothrow_constructible<Tp, Args&&...>::value)
+                return _push(false, std::forward<Args>(args)...);
+            else
+                return _push(false, Tp(std::forward<Args>(args)...));
+        }
+
+        bool pull(value_type &val)
+        {
+            if(!_self()._try_pull(val))
+                return false;
+            if constexpr(Derived::bounded)
+                _writable.notify();
+            return true;
+        }
+
+        bool wait_pull(value_type &val)
+        {
+            for(;;) {
+                if(pull(val))
+                    return true;
+                if(closed())
+                    return pull(val);
+                _readable.wait([this]() { return !_self()._empty() || closed(); });
+            }
+        }
+
+        std::optional<value_type> try_pull()
+        {
+            std::optional<value_type> result;
+            value_type val;
+            if(pull(val))
+                result.emplace(std::move(val));
+            return result;
+        }
+
+        std::optional<value_type> wait_pull()
+        {
+            std::optional<value_type> result;
+            value_type val;
+            if(wait_pull(val))
+                result.emplace(std::move(val));
+            return result;
+        }
+
+        void close()
+        {
+            _closed.store(true, std::memory_order_release);
+            _readable.notify();
+            _writable.notify();
+        }
+
+        bool closed() const noexcept
+        { return _closed.load(std::memory_order_acquire); }
+
+        bool empty() const noexcept { return _self()._empty(); }
+    };
+
+    // Bounded queue of one producer and one consumer: a ring
+    // with an index per side, each caching the other one
+  template <typename Tp, std::size_t Capacity, typename Wait, typename Alloc>
+    class spsc_ring_queue
+        : public basic_policy_queue<spsc_ring_queue<Tp, Capacity, Wait, Alloc>, Tp, Wait>
+    {
+        static_assert(std::is_nothrow_move_constructible<Tp>::value
+                      && std::is_nothrow_move_assignable<Tp>::value,
+            "bounded queues require nothrow movable items");
+
+        using _base = basic_policy_queue<spsc_ring_queue, Tp, Wait>;
+
+        struct _slot { alignas(Tp) unsigned char data[sizeof(Tp)]; };
+
+        using _slot_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<_slot>;
+        using _slot_traits = std::allocator_traits<_slot_alloc>;
+
+        static constexpr std::size_t _capacity = ceil_pow2(Capacity);
+
+        _slot_alloc _alloc;
+        _slot *_slots;
+
+        alignas(_base::_cache_line) std::atomic<std::size_t> _tail { 0 };
+        std::size_t _head_cache = 0;    // producer's view of _head
+
+        alignas(_base::_cache_line) std::atomic<std::size_t> _head { 0 };
+        std::size_t _tail_cache = 0;    // consumer's view of _tail
+
+        Tp *_at(std::size_t pos) noexcept
+        { return std::launder(reinterpret_cast<Tp*>(_slots[pos & (_capacity - 1)].data)); }
+
+        friend _base;
+
+      template <typename... Args>
+        bool _try_emplace(Args &&...args)
+        {
+            const std::size_t tail = _tail.load(std::memory_order_relaxed);
+            if(tail - _head_cache == _capacity) {
+                _head_cache = _head.load(std::memory_order_acquire);
+                if(tail - _head_cache == _capacity)
+                    return false;
+            }
+            ::new(static_cast<void*>(_slots[tail & (_capacity - 1)].data))
+                Tp(std::forward<Args>(args)...);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool _try_pull(Tp &val)
+        {
+            const std::size_t head = _head.load(std::memory_order_relaxed);
+            if(head == _tail_cache) {
+                _tail_cache = _tail.load(std::memory_order_acquire);
+                if(head == _tail_cache)
+                    return false;
+            }
+            Tp *item = _at(head);
+            val = std::move(*item);
+            item->~Tp();
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool _empty() const noexcept
+        {
+            return _head.load(std::memory_order_acquire)
+                == _tail.load(std::memory_order_acquire);
+        }
+
+        bool _full() const noexcept
+        {
+            return _tail.load(std::memory_order_acquire)
+                - _head.load(std::memory_order_acquire) == _capacity;
+        }
+
+    public:
+        static constexpr bool bounded = true;
+
+        explicit spsc_ring_queue(const Alloc &alloc = Alloc())
+            : _alloc(alloc)
+            , _slots(std::addressof(*_slot_traits::allocate(_alloc, _capacity))) { }
+
+        ~spsc_ring_queue()
+        {
+            for(std::size_t pos = _head; pos != _tail; ++pos)
+                _at(pos)->~Tp();
+            _slot_traits::deallocate(_alloc, _slots, _capacity);
+        }
+
+        spsc_ring_queue(const spsc_ring_queue&) = delete;
+        spsc_ring_queue &operator=(const spsc_ring_queue&) = delete;
+
+        static constexpr std::size_t capacity() noexcept { return _capacity; }
+    };
+
+    // Bounded queue of many producers or consumers: a ring of cells
+    // with sequence numbers, single sides claim cells without CAS
+  template <typename Tp, std::size_t Capacity, bool MultiProducer,
+            bool MultiConsumer, typename Wait, typename Alloc>
+    class ring_queue
+        : public basic_policy_queue<ring_queue<Tp, Capacity, MultiProducer,
+                                               MultiConsumer, Wait, Alloc>, Tp, Wait>
+    {
+        static_assert(std::is_nothrow_move_constructible<Tp>::value
+                      && std::is_nothrow_move_assignable<Tp>::value,
+            "bounded queues require nothrow movable items");
+
+        using _base = basic_policy_queue<ring_queue, Tp, Wait>;
+
+        struct _cell
+        {
+            std::atomic<std::size_t> seq;
+            alignas(Tp) unsigned char data[sizeof(Tp)];
+        };
+
+        using _cell_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<_cell>;
+        using _cell_traits = std::allocator_traits<_cell_alloc>;
+
+        static constexpr std::size_t _capacity = ceil_pow2(Capacity);
+
+        _cell_alloc _alloc;
+        _cell *_cells;
+
+        alignas(_base::_cache_line) std::atomic<std::size_t> _tail { 0 };
+        alignas(_base::_cache_line) std::atomic<std::size_t> _head { 0 };
+
+        static Tp *_item(_cell &c) noexcept
+        { return std::launder(reinterpret_cast<Tp*>(c.data)); }
+
+        // Claims the cell at pos of the side whose cells are ready
+        // at sequence pos + offset, returns nullptr if there is none
+      template <bool Multi>
+        _cell *_claim(std::atomic<std::size_t> &side, std::size_t &pos,
+                      std::size_t offset) noexcept
+        {
+            pos = side.load(std::memory_order_relaxed);
+            for(;;) {
+                _cell &c = _cells[pos & (_capacity - 1)];
+                const auto diff = std::ptrdiff_t(
+                    c.seq.load(std::memory_order_acquire) - (pos + offset));
+                if(diff < 0)
+                    return nullptr;
+                if(diff > 0)
+                    pos = side.load(std::memory_order_relaxed);
+                else if(!Multi) {
+                    side.store(pos + 1, std::memory_order_relaxed);
+                    return &c;
+                }
+                else if(side.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed))
+                    return &c;
+            }
+        }
+
+        friend _base;
+
+      template <typename... Args>
+        bool _try_emplace(Args &&...args)
+        {
+            std::size_t pos;
+            _cell *c = _claim<MultiProducer>(_tail, pos, 0);
+            if(!c)
+                return false;
+            ::new(static_cast<void*>(c->data)) Tp(std::forward<Args>(args)...);
+            c->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool _try_pull(Tp &val)
+        {
+            std::size_t pos;
+            _cell *c = _claim<MultiConsumer>(_head, pos, 1);
+            if(!c)
+                return false;
+            Tp *item = _item(*c);
+            val = std::move(*item);
+            item->~Tp();
+            c->seq.store(pos + _capacity, std::memory_order_release);
+            return true;
+        }
+
+        bool _empty() const noexcept
+        {
+            const std::size_t pos = _head.load(std::memory_order_acquire);
+            return _cells[pos & (_capacity - 1)].seq.load(std::memory_order_acquire)
+                != pos + 1;
+        }
+
+        bool _full() const noexcept
+        {
+            const std::size_t pos = _tail.load(std::memory_order_acquire);
+            return std::ptrdiff_t(_cells[pos & (_capacity - 1)].seq.load(
+                std::memory_order_acquire) - pos) < 0;
+        }
+
+    public:
+        static constexpr bool bounded = true;
+
+        explicit ring_queue(const Alloc &alloc = Alloc())
+            : _alloc(alloc)
+            , _cells(std::addressof(*_cell_traits::allocate(_alloc, _capacity)))
+        {
+            for(std::size_t i = 0; i < _capacity; ++i)
+                ::new(static_cast<void*>(_cells + i)) _cell { { i }, { } };
+        }
+
+        ~ring_queue()
+        {
+            for(std::size_t pos = _head; pos != _tail; ++pos)
+                _item(_cells[pos & (_capacity - 1)])->~Tp();
+            for(std::size_t i = 0; i < _capacity; ++i)
+                _cells[i].~_cell();
+            _cell_traits::deallocate(_alloc, _cells, _capacity);
+        }
+
+        ring_queue(const ring_queue&) = delete;
+        ring_queue &operator=(const ring_queue&) = delete;
+
+        static constexpr std::size_t capacity() noexcept { return _capacity; }
+    };
+
+    // Unbounded queue of a single consumer: a list linked by producers
+    // with one exchange, the consumer keeps the last taken node as a stub
+  template <typename Tp, typename Wait, typename Alloc>
+    class mpsc_list_queue
+        : public basic_policy_queue<mpsc_list_queue<Tp, Wait, Alloc>, Tp, Wait>
+    {
+        using _base = basic_policy_queue<mpsc_list_queue, Tp, Wait>;
+
+        struct _node
+        {
+            std::atomic<_node*> next { nullptr };
+            alignas(Tp) unsigned char data[sizeof(Tp)];
+        };
+
+        using _node_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<_node>;
+        using _node_traits = std::allocator_traits<_node_alloc>;
+
+        _node_alloc _alloc;
+
+        alignas(_base::_cache_line) std::atomic<_node*> _tail;  // last pushed
+        alignas(_base::_cache_line) std::atomic<_node*> _head;  // stub
+
+        _node *_create()
+        {
+            _node *n = std::addressof(*_node_traits::allocate(_alloc, 1));
+            return ::new(static_cast<void*>(n)) _node;
+        }
+
+        void _destroy(_node *n) noexcept
+        {
+            n->~_node();
+            _node_traits::deallocate(_alloc, n, 1);
+        }
+
+        static Tp *_item(_node *n) noexcept
+        { return std::launder(reinterpret_cast<Tp*>(n->data)); }
+
+        friend _base;
+
+      template <typename... Args>
+        bool _try_emplace(Args &&...args)
+        {
+            _node *n = _create();
+            try {
+                ::new(static_cast<void*>(n->data)) Tp(std::forward<Args>(args)...);
+            } catch(...) {
+                _destroy(n);
+                throw;
+            }
+            _node *prev = _tail.exchange(n, std::memory_order_acq_rel);
+            prev->next.store(n, std::memory_order_release);
+            return true;
+        }
+
+        bool _try_pull(Tp &val)
+        {
+            _node *head = _head.load(std::memory_order_relaxed);
+            _node *next = head->next.load(std::memory_order_acquire);
+            if(!next)
+                return false;
+            Tp *item = _item(next);
+            val = std::move(*item);
+            item->~Tp();
+            _head.store(next, std::memory_order_release);
+            _destroy(head);
+            return true;
+        }
+
+        // A push between the exchange and the link reads as not empty
+        bool _empty() const noexcept
+        {
+            return _head.load(std::memory_order_acquire)
+                == _tail.load(std::memory_order_acquire);
+        }
+
+        bool _full() const noexcept { return false; }
+
+    public:
+        static constexpr bool bounded = false;
+
+        explicit mpsc_list_queue(const Alloc &alloc = Alloc())
+            : _alloc(alloc)
+        {
+            _node *stub = _create();
+            _tail.store(stub, std::memory_order_relaxed);
+            _head.store(stub, std::memory_order_relaxed);
+        }
+
+        ~mpsc_list_queue()
+        {
+            _node *head = _head.load(std::memory_order_relaxed);
+            while(_node *next = head->next.load(std::memory_order_relaxed)) {
+                _item(next)->~Tp();
+                _destroy(head);
+                head = next;
+            }
+            _destroy(head);
+        }
+
+        mpsc_list_queue(const mpsc_list_queue&) = delete;
+        mpsc_list_queue &operator=(const mpsc_list_queue&) = delete;
+
+        static constexpr std::size_t capacity() noexcept
+        { return std::numeric_limits<std::size_t>::max(); }
+    };
+
+    // Unbounded queue of many consumers: concurrent_queue under spinlock
+  template <typename Tp, typename Wait, typename Alloc>
+    class locked_queue
+        : private concurrent_queue<Tp, spinlock, Alloc, no_queue_metrics, Wait>
+    {
+        using _base = concurrent_queue<Tp, spinlock, Alloc, no_queue_metrics, Wait>;
+
+    public:
+        using typename _base::value_type;
+        using typename _base::size_type;
+        using typename _base::wait_strategy;
+
+        static constexpr bool bounded = false;
+
+        explicit locked_queue(const Alloc &alloc = Alloc()) : _base(alloc) { }
+
+        locked_queue(const locked_queue&) = delete;
+        locked_queue &operator=(const locked_queue&) = delete;
+
+        using _base::push;
+        using _base::pull;
+        using _base::try_pull;
+        using _base::close;
+        using _base::closed;
+        using _base::empty;
+
+        // Same as push(), the queue is never full
+      template <typename... Args>
+        bool try_push(Args &&...args)
+        { return _base::push(std::forward<Args>(args)...); }
+
+        // Unlike concurrent_queue, takes items left after close()
+        bool wait_pull(value_type &val)
+        { return _base::wait_pull(val) || _base::pull(val); }
+
+        std::optional<value_type> wait_pull()
+        {
+            std::optional<value_type> result = _base::wait_pull();
+            return result ? result : _base::try_pull();
+        }
+
+        static constexpr std::size_t capacity() noexcept
+        { return std::numeric_limits<std::size_t>::max(); }
+    };
+
+    // Settings collected from the policies of make_queue,
+    // Capacity of 0 stands for unbounded
+  template <bool MultiProducer, bool MultiConsumer, std::size_t Capacity,
+            typename Wait, typename Alloc>
+    struct queue_config { };
+
+  template <typename Config, typename Policy, typename = void>
+    struct apply_policy
+    {
+        static_assert(!std::is_same<Policy, Policy>::value, "unknown queue policy");
+    };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A>
+    struct apply_policy<queue_config<P, C, N, W, A>, producers::single>
+    { using type = queue_config<false, C, N, W, A>; };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A>
+    struct apply_policy<queue_config<P, C, N, W, A>, producers::multi>
+    { using type = queue_config<true, C, N, W, A>; };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A>
+    struct apply_policy<queue_config<P, C, N, W, A>, consumers::single>
+    { using type = queue_config<P, false, N, W, A>; };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A>
+    struct apply_policy<queue_config<P, C, N, W, A>, consumers::multi>
+    { using type = queue_config<P, true, N, W, A>; };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A, std::size_t Capacity>
+    struct apply_policy<queue_config<P, C, N, W, A>, bounded<Capacity>>
+    {
+        static_assert(Capacity > 0, "bounded queue needs a capacity");
+        using type = queue_config<P, C, Capacity, W, A>;
+    };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A>
+    struct apply_policy<queue_config<P, C, N, W, A>, unbounded>
+    { using type = queue_config<P, C, 0, W, A>; };
+
+  template <bool P, bool C, std::size_t N, typename W, typename A, typename Alloc>
+    struct apply_policy<queue_config<P, C, N, W, A>, use_allocator<Alloc>>
+    { using type = queue_config<P, C, N, W, Alloc>; };
+
+    // Any type with spins and parks is a wait strategy
+  template <bool P, bool C, std::size_t N, typename W, typename A, typename Wait>
+    struct apply_policy<queue_config<P, C, N, W, A>, Wait,
+                        std::void_t<decltype(Wait::spins), decltype(Wait::parks)>>
+    { using type = queue_config<P, C, N, Wait, A>; };
+
+  template <typename Config, typename... Policies>
+    struct fold_policies { using type = Config; };
+
+  template <typename Config, typename Policy, typename... Policies>
+    struct fold_policies<Config, Policy, Policies...>
+        : fold_policies<typename apply_policy<Config, Policy>::type, Policies...> { };
+
+  template <typename Tp, typename Config>
+    struct queue_engine;
+
+  template <typename Tp, bool MultiProducer, bool MultiConsumer, std::size_t Capacity,
+            typename Wait, typename Alloc>
+    struct queue_engine<Tp, queue_config<MultiProducer, MultiConsumer, Capacity, Wait, Alloc>>
+    {
+        using _alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Tp>;
+
+        using _unbounded = typename std::conditional<MultiConsumer,
+            locked_queue<Tp, Wait, _alloc>,
+            mpsc_list_queue<Tp, Wait, _alloc>>::type;
+
+        using _bounded = typename std::conditional<MultiProducer || MultiConsumer,
+            ring_queue<Tp, Capacity, MultiProducer, MultiConsumer, Wait, _alloc>,
+            spsc_ring_queue<Tp, Capacity, Wait, _alloc>>::type;
+
+        using type = typename std::conditional<Capacity == 0, _unbounded, _bounded>::type;
+    };
+
+} // namespace details
+
+/**
+ * @brief Queue type picked at compile time by what the user needs
+ *
+ * @a Policies are any of, in any order, later ones overriding
+ * earlier ones of the same kind:
+ * - producers::single or producers::multi (default),
+ * - consumers::single or consumers::multi (default),
+ * - bounded<Capacity> or unbounded (default),
+ * - a wait strategy, such as wait::park (default) or wait::spin,
+ * - use_allocator<Alloc>, std::allocator by default.
+ *
+ * The engines behind are:
+ * - bounded, single producer and consumer: a ring with plain indices;
+ * - other bounded: a ring of cells with sequence numbers, claimed
+ *   with CAS only by the sides having many threads;
+ * - unbounded, single consumer: a list linked by producers with
+ *   one atomic exchange per item;
+ * - unbounded, many consumers: concurrent_queue with spinlock.
+ *
+ * All of them have the same interface:
+ * - `bool push(args...)` constructs an item, waiting for room
+ *   in bounded queues, returns false if the queue is closed;
+ * - `bool try_push(args...)` never waits, returns false
+ *   if the queue is full or closed;
+ * - `bool pull(value_type&)` and `std::optional<value_type> try_pull()`
+ *   take an item, if there is one;
+ * - `bool wait_pull(value_type&)` and `std::optional<value_type> wait_pull()`
+ *   wait for an item, fail when the queue is closed and empty;
+ * - `close()`, `closed()` and `empty()`;
+ * - `static capacity()`, the maximum of size_t for unbounded queues.
+ *
+ * Items of bounded queues must be nothrow move constructible and
+ * assignable. Nothing is checked at run time: a queue of a single
+ * producer or consumer breaks, if more threads use that side.
+ *
+ * @code
+ * make_queue<event, producers::single, consumers::multi,
+ *            bounded<1024>, wait::park> events;
+ * @endcode
+ */
+template <typename Tp, typename... Policies>
+using make_queue = typename details::queue_engine<Tp,
+    typename details::fold_policies<
+        details::queue_config<true, true, 0, park_wait, std::allocator<Tp>>,
+        Policies...>::type>::type;
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_POLICY_QUEUE_H
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_PROFILED_LOCK_H
+#define CONCURRENT_UTILS_PROFILED_LOCK_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Logarithmic histogram of durations
+ *
+ * Bucket @a i counts durations in [2^i, 2^(i+1)) nanoseconds,
+ * bucket zero also counts zero durations and the last one
+ * counts everything longer.
+ */
+using lock_histogram = std::array<std::uint64_t, 32>;
+
+/**
+ * @brief Snapshot of profiled_lock's measurements
+ */
+struct lock_profile
+{
+    std::uint64_t acquisitions = 0; ///< Successful acquisitions
+    std::uint64_t contended = 0;    ///< Acquisitions found the lock busy
+
+    std::chrono::nanoseconds wait_time {};     ///< Total acquisition time
+    std::chrono::nanoseconds max_wait_time {}; ///< Longest acquisition
+    std::chrono::nanoseconds hold_time {};     ///< Total time of ownership
+    std::chrono::nanoseconds max_hold_time {}; ///< Longest ownership
+
+    lock_histogram wait_histogram {}; ///< Distribution of acquisition times
+    lock_histogram hold_histogram {}; ///< Distribution of ownership times
+};
+
+/**
+ * @brief Lock wrapper measuring acquisition and hold times
+ *
+ * Wraps any lockable type and still models it, so it can be used
+ * instead of the original lock anywhere, e.g. in concurrent_queue
+ * or ordered_lock. Results are aggregated per lock instance.
+ *
+ * An acquisition is counted as contended when the first try_lock()
+ * fails, so locks without try_lock() never report contention.
+ *
+ * All statistics are updated only by the lock's owner, thus they
+ * do not add cache traffic on their own, and can be read by
+ * profile() from any thread at any time.
+ *
+ * @tparam Lock Wrapped lockable type.
+ * @tparam Clock Clock used for measurements.
+ */
+template <typename Lock, typename Clock = std::chrono::steady_clock>
+class profiled_lock
+{
+#ifndef DOXYGEN
+    static_assert(is_lockable<Lock>::value,
+        "profiled_lock only works with lockable types");
+#endif
+
+    enum : std::size_t { _buckets = std::tuple_size<lock_histogram>::value };
+
+    using counter_type = std::atomic<std::uint64_t>;
+    using counters_type = std::array<counter_type, _buckets>;
+
+    Lock _lock;
+    typename Clock::time_point _acquired;
+
+    counter_type _acquisitions { 0 }, _contended { 0 };
+    counter_type _wait_ns { 0 }, _max_wait_ns { 0 };
+    counter_type _hold_ns { 0 }, _max_hold_ns { 0 };
+    counters_type _wait_hist, _hold_hist;
+
+    // Only the owner of the lock modifies counters, so
+    // there is no need for read-modify-write operations
+    static void _add(counter_type &c, std::uint64_t value) noexcept
+    { c.store(c.load(std::memory_order_relaxed) + value, std::memory_order_relaxed); }
+
+    static void _max(counter_type &c, std::uint64_t value) noexcept
+    { if(c.load(std::memory_order_relaxed) < value) c.store(value, std::memory_order_relaxed); }
+
+    static std::size_t _bucket(std::uint64_t ns) noexcept
+    {
+        std::size_t i = 0;
+        while(ns >>= 1) ++i;
+        return i < _buckets ? i : _buckets - 1;
+    }
+
+    static std::uint64_t _ns(typename Clock::duration d) noexcept
+    { return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); }
+
+    void _acquired_after(typename Clock::time_point start, bool contended) noexcept
+    {
+        _acquired = Clock::now();
+        const auto ns = _ns(_acquired - start);
+        _add(_acquisitions, 1);
+        if(contended) _add(_contended, 1);
+        _add(_wait_ns, ns);
+        _max(_max_wait_ns, ns);
+        _add(_wait_hist[_bucket(ns)], 1);
+    }
+
+  template <typename L = Lock>
+    typename std::enable_if<is_try_lockable<L>::value, bool>::type
+    _try_first() { return _lock.try_lock(); }
+
+  template <typename L = Lock>
+    typename std::enable_if<!is_try_lockable<L>::value, bool>::type
+    _try_first() { return false; }
+
+    static void _snapshot(const counters_type &from, lock_histogram &to) noexcept
+    {
+        for(std::size_t i = 0; i < _buckets; ++i)
+            to[i] = from[i].load(std::memory_order_relaxed);
+    }
+
+public:
+    using lock_type = Lock;
+    using clock_type = Clock;
+
+    /**
+     * @brief Creates the lock
+     * @param args Arguments passed to the wrapped lock's constructor.
+     */
+  template <typename... Args>
+    explicit profiled_lock(Args &&...args)
+        : _lock(std::forward<Args>(args)...) { reset(); }
+
+#ifndef DOXYGEN
+    profiled_lock(const profiled_lock&) = delete;
+    profiled_lock &operator=(const profiled_lock&) = delete;
+#endif
+
+    /**
+     * @brief Acquires the lock and measures the time spent
+     */
+    void lock()
+    {
+        const auto start = Clock::now();
+        const bool acquired = _try_first();
+        if(!acquired)
+            _lock.lock();
+        _acquired_after(start, !acquired && is_try_lockable<Lock>::value);
+    }
+
+    /**
+     * @brief Releases the lock and measures the time it was held
+     */
+    void unlock()
+    {
+        const auto ns = _ns(Clock::now() - _acquired);
+        _add(_hold_ns, ns);
+        _max(_max_hold_ns, ns);
+        _add(_hold_hist[_bucket(ns)], 1);
+        _lock.unlock();
+    }
+
+    /**
+     * @brief Tries to acquire the lock without blocking
+     * @return true, if lock was acquired
+     * @note Available only if the wrapped lock provides try_lock().
+     */
+  template <typename L = Lock>
+    typename std::enable_if<is_try_lockable<L>::value, bool>::type
+    try_lock()
+    {
+        const auto start = Clock::now();
+        if(!_lock.try_lock())
+            return false;
+        _acquired_after(start, false);
+        return true;
+    }
+
+    /**
+     * @return Snapshot of measurements
+     * @note Counters are read one by one, so the snapshot is not
+     * consistent with respect to concurrent acquisitions.
+     */
+    lock_profile profile() const noexcept
+    {
+        using std::chrono::nanoseconds;
+        const auto r = std::memory_order_relaxed;
+        lock_profile p;
+        p.acquisitions = _acquisitions.load(r);
+        p.contended = _contended.load(r);
+        p.wait_time = nanoseconds(_wait_ns.load(r));
+        p.max_wait_time = nanoseconds(_max_wait_ns.load(r));
+        p.hold_time = nanoseconds(_hold_ns.load(r));
+        p.max_hold_time = nanoseconds(_max_hold_ns.load(r));
+        _snapshot(_wait_hist, p.wait_histogram);
+        _snapshot(_hold_hist, p.hold_histogram);
+        return p;
+    }
+
+    /**
+     * @brief Resets all measurements
+     * @note Should be called only when the lock is not used.
+     */
+    void reset() noexcept
+    {
+        const auto r = std::memory_order_relaxed;
+        for(auto *c : { &_acquisitions, &_contended, &_wait_ns,
+                        &_max_wait_ns, &_hold_ns, &_max_hold_ns })
+            c->store(0, r);
+        for(std::size_t i = 0; i < _buckets; ++i) {
+            _wait_hist[i].store(0, r);
+            _hold_hist[i].store(0, r);
+        }
+    }
+
+    /// Returns reference to the wrapped lock
+    Lock &underlying_lock() noexcept { return _lock; }
+
+}; // class profiled_lock
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_PROFILED_LOCK_H
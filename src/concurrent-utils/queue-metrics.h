@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_QUEUE_METRICS_H
+#define CONCURRENT_UTILS_QUEUE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Snapshot of the queue's metrics
+ */
+struct queue_stats
+{
+    std::uint64_t pushes = 0;        ///< Items put to the queue
+    std::uint64_t pulls = 0;         ///< Items taken from the queue
+    std::uint64_t closed_pushes = 0; ///< Pushes rejected by the closed queue
+    std::uint64_t depth = 0;         ///< Current number of items
+    std::uint64_t peak_depth = 0;    ///< Highest number of items ever seen
+
+    std::uint64_t waits = 0;                 ///< Number of blocking waits
+    std::chrono::nanoseconds wait_time {};   ///< Total time blocked in waits
+    std::chrono::nanoseconds max_wait_time {}; ///< Longest single wait
+
+    std::chrono::nanoseconds lock_wait_time {};     ///< Total time to acquire the lock
+    std::chrono::nanoseconds max_lock_wait_time {}; ///< Longest lock acquisition
+};
+
+/**
+ * @brief Metrics policy which collects nothing
+ *
+ * Default policy of concurrent_queue. All hooks are empty
+ * inline functions, so the compiler removes them entirely.
+ */
+struct no_queue_metrics
+{
+    enum { enabled = false };
+
+    struct stamp_type { };
+
+    static stamp_type now() noexcept { return { }; }
+
+  template <typename Lock>
+    static void acquire(Lock &l) { l.lock(); }
+
+  template <typename Lock, typename Clock, typename Duration>
+    static bool try_acquire_until(Lock &l,
+        const std::chrono::time_point<Clock, Duration> &atime)
+    { return try_lock_until(l, atime); }
+
+    void on_push() noexcept { }
+    void on_closed_push() noexcept { }
+    void on_pull() noexcept { }
+    void on_drain() noexcept { }
+    void on_wait(stamp_type) noexcept { }
+    void set_depth(std::uint64_t) noexcept { }
+
+    queue_stats stats() const noexcept { return { }; }
+};
+
+/**
+ * @brief Metrics policy which collects queue_stats
+ *
+ * All counters are relaxed atomics, so stats() never takes
+ * the queue's lock and may be called from any thread.
+ * Waits and lock acquisitions are timed with steady_clock.
+ *
+ * @note Depth of the queue is recounted after swap, append and
+ * assignment, which makes those operations linear in the number
+ * of items.
+ */
+class queue_metrics
+{
+    using clock_type = std::chrono::steady_clock;
+    using counter_type = std::atomic<std::uint64_t>;
+
+    counter_type _pushes { 0 }, _pulls { 0 }, _closed_pushes { 0 };
+    counter_type _depth { 0 }, _peak_depth { 0 };
+    counter_type _waits { 0 }, _wait_ns { 0 }, _max_wait_ns { 0 };
+    counter_type _lock_wait_ns { 0 }, _max_lock_wait_ns { 0 };
+
+    static void _update_max(counter_type &max, std::uint64_t value) noexcept
+    {
+        auto cur = max.load(std::memory_order_relaxed);
+        while(cur < value && !max.compare_exchange_weak(
+                  cur, value, std::memory_order_relaxed));
+    }
+
+    static std::uint64_t _elapsed_ns(clock_type::time_point since) noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - since).count();
+    }
+
+public:
+    enum { enabled = true };
+
+    using stamp_type = clock_type::time_point;
+
+    static stamp_type now() noexcept { return clock_type::now(); }
+
+    /**
+     * @brief Acquires @a l and accounts the time spent for it
+     */
+  template <typename Lock>
+    void acquire(Lock &l)
+    {
+        const auto start = now();
+        l.lock();
+        const auto ns = _elapsed_ns(start);
+        _lock_wait_ns.fetch_add(ns, std::memory_order_relaxed);
+        _update_max(_max_lock_wait_ns, ns);
+    }
+
+    /**
+     * @brief Tries to acquire @a l until @a atime and accounts
+     * the time spent for it, whether or not it succeeded
+     * @return true, if lock was acquired
+     */
+  template <typename Lock, typename Clock, typename Duration>
+    bool try_acquire_until(Lock &l,
+        const std::chrono::time_point<Clock, Duration> &atime)
+    {
+        const auto start = now();
+        const bool acquired = try_lock_until(l, atime);
+        const auto ns = _elapsed_ns(start);
+        _lock_wait_ns.fetch_add(ns, std::memory_order_relaxed);
+        _update_max(_max_lock_wait_ns, ns);
+        return acquired;
+    }
+
+    void on_push() noexcept
+    {
+        _pushes.fetch_add(1, std::memory_order_relaxed);
+        _update_max(_peak_depth,
+            _depth.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void on_closed_push() noexcept
+    { _closed_pushes.fetch_add(1, std::memory_order_relaxed); }
+
+    void on_pull() noexcept
+    {
+        _pulls.fetch_add(1, std::memory_order_relaxed);
+        _depth.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Accounts taking all items at once
+     */
+    void on_drain() noexcept
+    {
+        _pulls.fetch_add(_depth.exchange(0, std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Accounts the wait started at @a start
+     */
+    void on_wait(stamp_type start) noexcept
+    {
+        const auto ns = _elapsed_ns(start);
+        _waits.fetch_add(1, std::memory_order_relaxed);
+        _wait_ns.fetch_add(ns, std::memory_order_relaxed);
+        _update_max(_max_wait_ns, ns);
+    }
+
+    void set_depth(std::uint64_t depth) noexcept
+    {
+        _depth.store(depth, std::memory_order_relaxed);
+        _update_max(_peak_depth, depth);
+    }
+
+    /**
+     * @return Snapshot of all counters
+     * @note Counters are read one by one, so the snapshot
+     * is not consistent with respect to concurrent operations.
+     */
+    queue_stats stats() const noexcept
+    {
+        using std::chrono::nanoseconds;
+        const auto r = std::memory_order_relaxed;
+        queue_stats s;
+        s.pushes = _pushes.load(r);
+        s.pulls = _pulls.load(r);
+        s.closed_pushes = _closed_pushes.load(r);
+        s.depth = _depth.load(r);
+        s.peak_depth = _peak_depth.load(r);
+        s.waits = _waits.load(r);
+        s.wait_time = nanoseconds(_wait_ns.load(r));
+        s.max_wait_time = nanoseconds(_max_wait_ns.load(r));
+        s.lock_wait_time = nanoseconds(_lock_wait_ns.load(r));
+        s.max_lock_wait_time = nanoseconds(_max_lock_wait_ns.load(r));
+        return s;
+    }
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_QUEUE_METRICS_H
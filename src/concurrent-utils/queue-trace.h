@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_QUEUE_TRACE_H
+#define CONCURRENT_UTILS_QUEUE_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "reclamation.h"
+
+namespace concurrent_utils {
+
+/// Kind of a traced queue operation
+enum class trace_op : std::uint8_t { push, pull };
+
+/**
+ * @brief Single traced operation, as stored in trace files
+ */
+struct trace_event
+{
+    std::uint64_t time_ns;  ///< Time since the start of recording
+    std::uint32_t size;     ///< Size of the item in bytes
+    std::uint16_t thread;   ///< Index of the thread in the trace
+    trace_op op;            ///< Operation
+    std::uint8_t reserved;
+};
+
+#ifndef DOXYGEN
+static_assert(sizeof(trace_event) == 16, "trace_event must be compact");
+#endif
+
+/**
+ * @brief Recorder of queue operations for replaying them later
+ *
+ * Threads append events to their own chunks of memory without any
+ * lock, so recording costs a clock read and a store per operation.
+ * Recording is off until start(), events are written to a file
+ * by save() and read back by load().
+ *
+ * A trace file is the header "CUTRACE1", the number of threads and
+ * the number of events as 64-bit integers, then the events sorted by
+ * time, all in the byte order of the machine.
+ */
+class trace_recorder
+{
+    using clock_type = std::chrono::steady_clock;
+
+    static constexpr std::size_t _chunk_events = 4096;
+    static constexpr char _magic[8] = { 'C', 'U', 'T', 'R', 'A', 'C', 'E', '1' };
+
+    struct _chunk
+    {
+        trace_event events[_chunk_events];
+        std::atomic<std::size_t> count { 0 };
+        std::atomic<_chunk*> next { nullptr };
+    };
+
+    // Chunks of a thread, appended by the owner only; the record
+    // of an exited thread is reused by a new one under a new index
+    struct _record : details::reclaim_record
+    {
+        std::uint64_t owner = 0;
+        std::uint16_t thread = 0;
+        std::atomic<_chunk*> first { nullptr };
+        _chunk *last = nullptr;
+
+        explicit _record(const std::allocator<char>&) { }
+
+        ~_record()
+        {
+            for(_chunk *c = first.load(std::memory_order_relaxed); c; ) {
+                _chunk *next = c->next.load(std::memory_order_relaxed);
+                delete c;
+                c = next;
+            }
+        }
+    };
+
+    struct _domain : details::reclaim_domain<_record, std::allocator<char>>
+    {
+        using _base = details::reclaim_domain<_record, std::allocator<char>>;
+        _domain() : _base(std::allocator<char>()) { }
+        using _base::_local;
+        using _base::_first;
+        using _base::_next;
+    } _impl;
+
+    std::atomic<bool> _recording { false };
+    std::atomic<std::uint16_t> _threads { 0 };
+    std::atomic<std::size_t> _dropped { 0 };
+    std::atomic<clock_type::rep> _epoch { 0 };
+
+    [[noreturn]] static void _throw_errno(const std::string &what)
+    { throw std::system_error(errno, std::generic_category(), what); }
+
+    // Nonzero number of the calling thread, never given to another one
+    static std::uint64_t _thread_serial() noexcept
+    {
+        static std::atomic<std::uint64_t> last { 0 };
+        static thread_local const std::uint64_t serial =
+            last.fetch_add(1, std::memory_order_relaxed) + 1;
+        return serial;
+    }
+
+    void _append(_record &r, const trace_event &e)
+    {
+        _chunk *c = r.last;
+        std::size_t n = c ? c->count.load(std::memory_order_relaxed) : _chunk_events;
+        if(n == _chunk_events) {
+            _chunk *fresh = new _chunk;
+            if(c)
+                c->next.store(fresh, std::memory_order_release);
+            else
+                r.first.store(fresh, std::memory_order_release);
+            r.last = c = fresh;
+            n = 0;
+        }
+        c->events[n] = e;
+        c->count.store(n + 1, std::memory_order_release);
+    }
+
+public:
+    trace_recorder() = default;
+
+#ifndef DOXYGEN
+    trace_recorder(const trace_recorder&) = delete;
+    trace_recorder &operator=(const trace_recorder&) = delete;
+#endif
+
+    /// Starts recording, times of events count from now
+    void start() noexcept
+    {
+        _epoch.store(clock_type::now().time_since_epoch().count(),
+                     std::memory_order_relaxed);
+        _recording.store(true, std::memory_order_release);
+    }
+
+    /// Stops recording, recorded events are kept
+    void stop() noexcept { _recording.store(false, std::memory_order_release); }
+
+    /// Returns true, if events are being recorded
+    bool recording() const noexcept
+    { return _recording.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Records @a op with an item of @a size bytes
+     * made by the calling thread, if recording
+     *
+     * If no memory for the thread's record or chunk is left,
+     * the event is dropped and counted by dropped().
+     */
+    void record(trace_op op, std::size_t size) noexcept
+    {
+        if(!recording())
+            return;
+        trace_event e;
+        const clock_type::time_point epoch(
+            clock_type::duration(_epoch.load(std::memory_order_relaxed)));
+        e.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - epoch).count();
+        e.size = static_cast<std::uint32_t>(std::min<std::size_t>(size, UINT32_MAX));
+        e.op = op;
+        e.reserved = 0;
+
+        try {
+            _record &r = _impl._local();
+            if(r.owner != _thread_serial()) {
+                r.owner = _thread_serial();
+                r.thread = _threads.fetch_add(1, std::memory_order_relaxed);
+            }
+            e.thread = r.thread;
+            _append(r, e);
+        } catch(...) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// Returns number of threads seen so far
+    std::size_t threads() const noexcept
+    { return _threads.load(std::memory_order_relaxed); }
+
+    /// Returns number of events dropped for lack of memory
+    std::size_t dropped() const noexcept
+    { return _dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Collects events recorded so far, sorted by time
+     * @note Events being recorded at the moment may be missed.
+     */
+    std::vector<trace_event> events() const
+    {
+        std::vector<trace_event> ret;
+        for(_record *r = _impl._first(); r; r = _impl._next(r))
+            for(_chunk *c = r->first.load(std::memory_order_acquire); c;
+                    c = c->next.load(std::memory_order_acquire))
+                ret.insert(ret.end(), c->events,
+                           c->events + c->count.load(std::memory_order_acquire));
+        std::stable_sort(ret.begin(), ret.end(),
+            [](const trace_event &a, const trace_event &b) {
+                return a.time_ns < b.time_ns;
+            });
+        return ret;
+    }
+
+    /**
+     * @brief Writes recorded events to the file at @a path
+     * @throw std::system_error On failed file operations.
+     */
+    void save(const std::string &path) const
+    {
+        const std::vector<trace_event> all = events();
+        const std::uint64_t header[2] = { threads(), all.size() };
+
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+            f(std::fopen(path.c_str(), "wb"), &std::fclose);
+        if(!f)
+            _throw_errno("trace_recorder: open " + path);
+        if(std::fwrite(_magic, sizeof(_magic), 1, f.get()) != 1
+                || std::fwrite(header, sizeof(header), 1, f.get()) != 1
+                || std::fwrite(all.data(), sizeof(trace_event), all.size(), f.get())
+                    != all.size()
+                || std::fflush(f.get()))
+            _throw_errno("trace_recorder: write " + path);
+    }
+
+    /**
+     * @brief Reads events of the trace file at @a path
+     * @throw std::system_error On failed file operations.
+     * @throw std::runtime_error If the file is not a trace
+     * or its size does not match the number of events.
+     */
+    static std::vector<trace_event> load(const std::string &path)
+    {
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)>
+            f(std::fopen(path.c_str(), "rb"), &std::fclose);
+        if(!f)
+            _throw_errno("trace_recorder: open " + path);
+
+        char magic[sizeof(_magic)];
+        std::uint64_t header[2];
+        if(std::fread(magic, sizeof(magic), 1, f.get()) != 1
+                || std::memcmp(magic, _magic, sizeof(magic))
+                || std::fread(header, sizeof(header), 1, f.get()) != 1)
+            throw std::runtime_error("trace_recorder: not a trace " + path);
+
+        // the header is checked against the file before allocating
+        const long start = std::ftell(f.get());
+        if(start < 0 || std::fseek(f.get(), 0, SEEK_END))
+            _throw_errno("trace_recorder: seek " + path);
+        const long end = std::ftell(f.get());
+        if(end < 0 || std::fseek(f.get(), start, SEEK_SET))
+            _throw_errno("trace_recorder: seek " + path);
+        const std::uint64_t bytes = static_cast<std::uint64_t>(end - start);
+        if(bytes % sizeof(trace_event) || header[1] != bytes / sizeof(trace_event))
+            throw std::runtime_error("trace_recorder: bad size of trace " + path);
+
+        std::vector<trace_event> ret(header[1]);
+        if(std::fread(ret.data(), sizeof(trace_event), ret.size(), f.get()) != ret.size())
+            throw std::runtime_error("trace_recorder: truncated trace " + path);
+        return ret;
+    }
+};
+
+/**
+ * @brief Default measure of traced items
+ *
+ * Takes size() of items having it, such as strings and
+ * containers, otherwise the size of the type.
+ */
+struct trace_sizeof
+{
+  template <typename Tp>
+    std::size_t operator()(const Tp &item) const noexcept
+    {
+        if constexpr(_has_size<Tp>(0))
+            return item.size();
+        else
+            return sizeof(Tp);
+    }
+
+private:
+  template <typename Tp>
+    static constexpr auto _has_size(int) -> decltype(std::declval<const Tp&>().size(), bool())
+    { return true; }
+
+  template <typename Tp>
+    static constexpr bool _has_size(...) { return false; }
+};
+
+/**
+ * @brief Queue recording its pushes and pulls to a trace_recorder
+ *
+ * Wraps push(), pull(), wait_pull() and try_pull() of @a Queue,
+ * any other operations are not traced. Without an attached
+ * recorder or while it is stopped, the wrappers cost a test
+ * of a pointer and a flag.
+ *
+ * @tparam Queue Queue type in the manner of concurrent_queue.
+ * @tparam Sizer Function object giving the size of an item.
+ */
+template <typename Queue, typename Sizer = trace_sizeof>
+class traced_queue : public Queue
+{
+    trace_recorder *_recorder = nullptr;
+    Sizer _sizer;
+
+    bool _tracing() const noexcept
+    { return _recorder && _recorder->recording(); }
+
+public:
+    using value_type = typename Queue::value_type;
+
+    using Queue::Queue;
+
+    /// Attaches @a recorder, nullptr detaches the current one
+    void trace(trace_recorder *recorder) noexcept { _recorder = recorder; }
+
+    /// Returns the attached recorder
+    trace_recorder *recorder() const noexcept { return _recorder; }
+
+    /// Pushes an item, recording its size
+  template <typename... Args>
+    bool push(Args &&...args)
+    {
+        if(!_tracing())
+            return Queue::push(std::forward<Args>(args)...);
+        value_type item(std::forward<Args>(args)...);
+        const std::size_t size = _sizer(item);
+        if(!Queue::push(std::move(item)))
+            return false;
+        _recorder->record(trace_op::push, size); // never throws
+        return true;
+    }
+
+    /// Pulls an item without waiting, recording its size
+    bool pull(value_type &val)
+    {
+        if(!Queue::pull(val))
+            return false;
+        if(_tracing())
+            _recorder->record(trace_op::pull, _sizer(val));
+        return true;
+    }
+
+    /// Waits for an item and pulls it, recording its size
+    bool wait_pull(value_type &val)
+    {
+        if(!Queue::wait_pull(val))
+            return false;
+        if(_tracing())
+            _recorder->record(trace_op::pull, _sizer(val));
+        return true;
+    }
+
+    /// Pulls an item without waiting, recording its size
+    std::optional<value_type> try_pull()
+    {
+        std::optional<value_type> ret = Queue::try_pull();
+        if(ret && _tracing())
+            _recorder->record(trace_op::pull, _sizer(*ret));
+        return ret;
+    }
+
+    /// Waits for an item and pulls it, recording its size
+    std::optional<value_type> wait_pull()
+    {
+        std::optional<value_type> ret = Queue::wait_pull();
+        if(ret && _tracing())
+            _recorder->record(trace_op::pull, _sizer(*ret));
+        return ret;
+    }
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_QUEUE_TRACE_H
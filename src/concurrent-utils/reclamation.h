@@ -0,0 +1,781 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_RECLAMATION_H
+#define CONCURRENT_UTILS_RECLAMATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace concurrent_utils {
+
+namespace details { struct retired_list; }
+
+/**
+ * @brief Base of objects retired to a reclamation domain
+ *
+ * Holds the links of the domain's retire lists, so retirement
+ * never allocates. Derive nodes of lock-free structures from it
+ * and pass them to hazard_domain::retire() or epoch_domain::retire()
+ * once they are unreachable for new readers.
+ */
+class reclaimable
+{
+    reclaimable *_next_retired = nullptr;
+    void (*_reclaim)(reclaimable*) = nullptr;
+    std::uint64_t _retire_epoch = 0;
+
+    friend struct details::retired_list;
+
+protected:
+    reclaimable() noexcept = default;
+    ~reclaimable() = default;
+
+    // the state of retirement is never copied
+    reclaimable(const reclaimable&) noexcept { }
+    reclaimable &operator=(const reclaimable&) noexcept { return *this; }
+};
+
+/**
+ * @brief Deleter destroying and deallocating objects with @a Alloc
+ *
+ * Rebinds @a Alloc to the object's type. Deleters are not stored
+ * by the domains, so @a Alloc must be default constructible and
+ * all its instances must be equal.
+ */
+template <typename Alloc>
+struct allocator_delete
+{
+  template <typename Tp>
+    void operator()(Tp *p) const
+    {
+        using traits = typename std::allocator_traits<Alloc>::template rebind_traits<Tp>;
+        typename traits::allocator_type alloc;
+        traits::destroy(alloc, p);
+        traits::deallocate(alloc, p, 1);
+    }
+};
+
+namespace details {
+
+    // Singly linked list of retired objects in order of retirement
+    struct retired_list
+    {
+        reclaimable *head = nullptr, *tail = nullptr;
+        std::size_t size = 0;
+
+      template <typename Tp, typename Deleter>
+        static void _reclaim_with(reclaimable *p)
+        { Deleter()(static_cast<Tp*>(p)); }
+
+      template <typename Tp, typename Deleter>
+        void push(Tp *p, std::uint64_t epoch = 0) noexcept
+        {
+            static_assert(std::is_base_of<reclaimable, Tp>::value,
+                "retired objects must derive from reclaimable");
+            static_assert(std::is_empty<Deleter>::value
+                          && std::is_default_constructible<Deleter>::value,
+                "deleters are not stored and must be stateless");
+
+            p->_reclaim = &_reclaim_with<Tp, Deleter>;
+            _push(p, epoch);
+        }
+
+        void _push(reclaimable *p, std::uint64_t epoch) noexcept
+        {
+            p->_retire_epoch = epoch;
+            p->_next_retired = nullptr;
+            if(tail)
+                tail->_next_retired = p;
+            else
+                head = p;
+            tail = p;
+            ++size;
+        }
+
+        void splice(retired_list &other) noexcept
+        {
+            if(!other.head)
+                return;
+            if(tail)
+                tail->_next_retired = other.head;
+            else
+                head = other.head;
+            tail = other.tail;
+            size += other.size;
+            other.head = other.tail = nullptr;
+            other.size = 0;
+        }
+
+        // Reclaims every object for which @a keep returns false
+      template <typename Keep>
+        std::size_t reclaim_if_not(Keep keep)
+        {
+            retired_list kept;
+            std::size_t reclaimed = 0;
+            while(reclaimable *p = head) {
+                head = p->_next_retired;
+                if(keep(static_cast<const void*>(p), p->_retire_epoch))
+                    kept._push(p, p->_retire_epoch);
+                else {
+                    p->_reclaim(p);
+                    ++reclaimed;
+                }
+            }
+            *this = kept;
+            return reclaimed;
+        }
+
+        void reclaim_all()
+        { reclaim_if_not([](const void*, std::uint64_t) { return false; }); }
+    };
+
+    // Per-thread state of a domain, owned by the domain and
+    // reused by other threads after its owner has exited
+    struct reclaim_record
+    {
+        std::atomic<bool> active { true };
+        reclaim_record *next = nullptr;
+        retired_list retired; // accessed by the owner only
+    };
+
+    // Ids of alive domains, exiting threads release
+    // records only of domains found here
+    struct reclaim_registry
+    {
+        std::mutex lock;
+        std::vector<std::uint64_t> alive;
+        std::uint64_t last_id = 0;
+
+        static reclaim_registry &instance()
+        { static reclaim_registry registry; return registry; }
+
+        bool contains(std::uint64_t id) const noexcept
+        { return std::find(alive.begin(), alive.end(), id) != alive.end(); }
+    };
+
+    // Records of the current thread in all domains it used
+    class reclaim_thread_cache
+    {
+        struct entry { std::uint64_t domain; reclaim_record *record; };
+        std::vector<entry> _entries;
+
+    public:
+        ~reclaim_thread_cache()
+        {
+            if(_entries.empty())
+                return;
+            auto &registry = reclaim_registry::instance();
+            std::lock_guard<std::mutex> lk(registry.lock);
+            for(auto &e : _entries)
+                if(registry.contains(e.domain))
+                    e.record->active.store(false, std::memory_order_release);
+        }
+
+        static reclaim_thread_cache &local()
+        { static thread_local reclaim_thread_cache cache; return cache; }
+
+        reclaim_record *find(std::uint64_t domain) const noexcept
+        {
+            for(auto &e : _entries)
+                if(e.domain == domain) return e.record;
+            return nullptr;
+        }
+
+        void add(std::uint64_t domain, reclaim_record *record)
+        {
+            auto &registry = reclaim_registry::instance();
+            std::lock_guard<std::mutex> lk(registry.lock);
+            _entries.erase(std::remove_if(_entries.begin(), _entries.end(),
+                [&](const entry &e) { return !registry.contains(e.domain); }),
+                _entries.end());
+            _entries.push_back({ domain, record });
+        }
+    };
+
+    // Registry of per-thread records, common to both domains
+  template <typename Record, typename Alloc>
+    class reclaim_domain
+    {
+        using _record_alloc_type = typename
+            std::allocator_traits<Alloc>::template rebind_alloc<Record>;
+        using _record_alloc_traits = std::allocator_traits<_record_alloc_type>;
+
+        std::atomic<reclaim_record*> _records { nullptr };
+        std::atomic<std::size_t> _record_count { 0 };
+        _record_alloc_type _alloc;
+        std::uint64_t _id;
+
+        Record *_acquire_record()
+        {
+            for(Record *r = _first(); r; r = _next(r)) {
+                bool expected = false;
+                if(!r->active.load(std::memory_order_relaxed)
+                        && r->active.compare_exchange_strong(
+                            expected, true, std::memory_order_acquire))
+                    return r;
+            }
+
+            Record *r = std::addressof(*_record_alloc_traits::allocate(_alloc, 1));
+            try {
+                _record_alloc_traits::construct(_alloc, r, Alloc(_alloc));
+            } catch(...) {
+                _record_alloc_traits::deallocate(_alloc, r, 1);
+                throw;
+            }
+            reclaim_record *head = _records.load(std::memory_order_relaxed);
+            do r->next = head;
+            while(!_records.compare_exchange_weak(head, r,
+                      std::memory_order_release, std::memory_order_relaxed));
+            _record_count.fetch_add(1, std::memory_order_relaxed);
+            return r;
+        }
+
+    protected:
+        explicit reclaim_domain(const Alloc &alloc) : _alloc(alloc)
+        {
+            auto &registry = reclaim_registry::instance();
+            std::lock_guard<std::mutex> lk(registry.lock);
+            registry.alive.push_back(_id = ++registry.last_id);
+        }
+
+        // Reclaims everything, no thread may use the domain anymore
+        ~reclaim_domain()
+        {
+            {
+                auto &registry = reclaim_registry::instance();
+                std::lock_guard<std::mutex> lk(registry.lock);
+                registry.alive.erase(std::find(registry.alive.begin(),
+                    registry.alive.end(), _id));
+            }
+            for(Record *r = _first(); r; ) {
+                Record *next = _next(r);
+                r->retired.reclaim_all();
+                _record_alloc_traits::destroy(_alloc, r);
+                _record_alloc_traits::deallocate(_alloc, r, 1);
+                r = next;
+            }
+        }
+
+        Record *_first() const noexcept
+        { return static_cast<Record*>(_records.load(std::memory_order_acquire)); }
+
+        static Record *_next(Record *r) noexcept
+        { return static_cast<Record*>(r->next); }
+
+        std::size_t _threads() const noexcept
+        { return _record_count.load(std::memory_order_relaxed); }
+
+        // Returns the record of the calling thread
+        Record &_local()
+        {
+            auto &cache = reclaim_thread_cache::local();
+            if(reclaim_record *r = cache.find(_id))
+                return *static_cast<Record*>(r);
+
+            Record *r = _acquire_record();
+            try {
+                cache.add(_id, r);
+            } catch(...) {
+                r->active.store(false, std::memory_order_release);
+                throw;
+            }
+            return *r;
+        }
+
+        // Takes over objects retired by exited threads
+        void _adopt_orphans(Record &mine) noexcept
+        {
+            for(Record *r = _first(); r; r = _next(r)) {
+                bool expected = false;
+                if(r != &mine && !r->active.load(std::memory_order_relaxed)
+                        && r->active.compare_exchange_strong(
+                            expected, true, std::memory_order_acquire)) {
+                    mine.retired.splice(r->retired);
+                    r->active.store(false, std::memory_order_release);
+                }
+            }
+        }
+
+    public:
+#ifndef DOXYGEN
+        reclaim_domain(const reclaim_domain&) = delete;
+        reclaim_domain &operator=(const reclaim_domain&) = delete;
+#endif
+    };
+
+} // namespace details
+
+template <typename Domain> class hazard_pointer;
+template <typename Domain> class epoch_guard;
+
+/**
+ * @brief Domain of hazard pointers
+ *
+ * A reader announces the object it is going to access in
+ * a hazard_pointer; a retired object is reclaimed only when no
+ * hazard pointer announces it. Memory held by retired objects
+ * is bounded regardless of stalled readers, at the cost of
+ * a full fence for every protected pointer.
+ *
+ * Each thread keeps its own retire list and scans the hazard
+ * pointers of all threads once the list reaches the batch size,
+ * or twice the number of hazard pointers, if that is greater.
+ * Lists left by exited threads are adopted by the next scan.
+ *
+ * @code
+ * hazard_domain<> domain;
+ * hazard_pointer hp(domain);
+ * node *top = hp.protect(head); // safe to dereference
+ * ...
+ * domain.retire(unlinked);
+ * @endcode
+ *
+ * @tparam Slots Maximum number of hazard pointers per thread.
+ * @tparam Alloc Allocator of the domain's per-thread records.
+ * @note The domain must outlive all its hazard pointers and
+ * be destroyed when no thread uses it; then it reclaims all
+ * retired objects.
+ */
+template <std::size_t Slots = 4, typename Alloc = std::allocator<char>>
+class hazard_domain
+{
+#ifndef DOXYGEN
+    static_assert(Slots > 0 && Slots <= 32,
+        "hazard_domain supports from 1 to 32 hazard pointers per thread");
+#endif
+
+    using _scratch_type = std::vector<const void*, typename
+        std::allocator_traits<Alloc>::template rebind_alloc<const void*>>;
+
+    enum : std::size_t { _cache_line = 64 };
+
+    struct alignas(_cache_line) _record : details::reclaim_record
+    {
+        std::atomic<const void*> hazards[Slots] { };
+        std::uint32_t used = 0;  // slots held by hazard pointers
+        _scratch_type scratch;   // hazards collected by scans
+
+        explicit _record(const Alloc &alloc) : scratch(alloc) { }
+    };
+
+    struct _domain : details::reclaim_domain<_record, Alloc>
+    {
+        using _base = details::reclaim_domain<_record, Alloc>;
+        explicit _domain(const Alloc &alloc) : _base(alloc) { }
+        using _base::_local;
+        using _base::_first;
+        using _base::_next;
+        using _base::_threads;
+        using _base::_adopt_orphans;
+    } _impl;
+
+    std::size_t _batch;
+
+    std::size_t _scan(_record &rec);
+
+    friend class hazard_pointer<hazard_domain>;
+
+public:
+    using allocator_type = Alloc;
+
+    /// Number of hazard pointers available to each thread
+    static constexpr std::size_t slots = Slots;
+
+    /**
+     * @brief Creates the domain
+     * @param batch Number of retired objects in a thread's list
+     * that triggers a scan.
+     * @param alloc Allocator of the domain's per-thread records.
+     */
+    explicit hazard_domain(std::size_t batch = 64, const Alloc &alloc = Alloc())
+        : _impl(alloc), _batch(batch ? batch : 1) { }
+
+  template <typename Tp, typename Deleter = std::default_delete<Tp>>
+    void retire(Tp *p, Deleter = Deleter());
+
+    std::size_t reclaim();
+
+    /// Returns the number of retired objects that triggers a scan
+    std::size_t batch() const noexcept { return _batch; }
+};
+
+/**
+ * @brief Retires @a p to be reclaimed by @a Deleter once no
+ * hazard pointer announces it
+ * @note @a p must already be unreachable for new readers.
+ */
+  template <std::size_t Slots, typename Alloc>
+      template <typename Tp, typename Deleter>
+    void
+    hazard_domain<Slots, Alloc>::
+    retire(Tp *p, Deleter)
+    {
+        _record &rec = _impl._local();
+        rec.retired.template push<Tp, Deleter>(p);
+        if(rec.retired.size >= std::max(_batch, 2 * Slots * _impl._threads()))
+            _scan(rec);
+    }
+
+/**
+ * @brief Reclaims objects retired by the calling thread
+ * and by exited threads, which are not announced
+ * @return Number of reclaimed objects.
+ */
+  template <std::size_t Slots, typename Alloc>
+    std::size_t
+    hazard_domain<Slots, Alloc>::
+    reclaim()
+    {
+        return _scan(_impl._local());
+    }
+
+/**
+ * @internal
+ * @brief Reclaims objects of @a rec not announced by any thread
+ * @return Number of reclaimed objects.
+ */
+  template <std::size_t Slots, typename Alloc>
+    std::size_t
+    hazard_domain<Slots, Alloc>::
+    _scan(_record &rec)
+    {
+        _impl._adopt_orphans(rec);
+
+        // pairs with the fence of hazard_pointer::protect()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto &hazards = rec.scratch;
+        hazards.clear();
+        for(_record *r = _impl._first(); r; r = _impl._next(r))
+            for(auto &h : r->hazards)
+                if(const void *p = h.load(std::memory_order_acquire))
+                    hazards.push_back(p);
+        std::sort(hazards.begin(), hazards.end());
+
+        return rec.retired.reclaim_if_not([&](const void *p, std::uint64_t) {
+            return std::binary_search(hazards.begin(), hazards.end(), p);
+        });
+    }
+
+/**
+ * @brief Single hazard pointer of the calling thread
+ *
+ * Announces an object, which then is not reclaimed by
+ * the domain until the announcement is reset. Must be used
+ * only by the thread that has created it.
+ */
+template <typename Domain>
+class hazard_pointer
+{
+    typename Domain::_record &_rec;
+    std::uint32_t _bit;
+    std::atomic<const void*> &_slot;
+
+    static std::uint32_t _claim(typename Domain::_record &rec)
+    {
+        std::size_t i = 0;
+        while(i < Domain::slots && (rec.used & (1u << i))) ++i;
+        if(i == Domain::slots)
+            throw std::length_error("hazard_pointer: all slots of the thread are used");
+        rec.used |= 1u << i;
+        return i;
+    }
+
+public:
+    /// Takes a free hazard pointer of @a domain
+    explicit hazard_pointer(Domain &domain)
+        : _rec(domain._impl._local()), _bit(_claim(_rec)),
+          _slot(_rec.hazards[_bit]) { }
+
+    /// Resets the announcement and frees the hazard pointer
+    ~hazard_pointer()
+    {
+        _slot.store(nullptr, std::memory_order_release);
+        _rec.used &= ~(1u << _bit);
+    }
+
+#ifndef DOXYGEN
+    hazard_pointer(const hazard_pointer&) = delete;
+    hazard_pointer &operator=(const hazard_pointer&) = delete;
+#endif
+
+    /**
+     * @brief Announces the object @a src points to
+     * @return Value of @a src, that is safe to dereference
+     * until the announcement is reset.
+     */
+  template <typename Tp>
+    Tp *protect(const std::atomic<Tp*> &src) noexcept
+    {
+        Tp *p = src.load(std::memory_order_relaxed);
+        while(!try_protect(p, src)) { }
+        return p;
+    }
+
+    /**
+     * @brief Announces @a p, if @a src still points to it
+     * @return true, if @a p is safe to dereference;
+     * otherwise @a p is updated from @a src.
+     */
+  template <typename Tp>
+    bool try_protect(Tp *&p, const std::atomic<Tp*> &src) noexcept
+    {
+        _slot.store(p, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        Tp *const actual = src.load(std::memory_order_acquire);
+        if(actual == p)
+            return true;
+        p = actual;
+        return false;
+    }
+
+    /// Announces @a p, which must be known to be not retired yet
+  template <typename Tp>
+    void reset(Tp *p) noexcept
+    {
+        _slot.store(p, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /// Resets the announcement
+    void reset() noexcept { _slot.store(nullptr, std::memory_order_release); }
+};
+
+/**
+ * @brief Domain of epoch-based reclamation
+ *
+ * Readers enter a critical section by creating an epoch_guard.
+ * An object retired in global epoch @a e is reclaimed once the
+ * epoch has advanced twice, i.e. no reader of @a e may remain.
+ * The epoch advances only when every thread inside a critical
+ * section has observed the current one. That is cheaper than
+ * hazard pointers for readers, which pay one fence per critical
+ * section instead of per object, but a stalled reader delays
+ * reclamation of everything.
+ *
+ * Each thread keeps its own retire list; once it reaches the
+ * batch size, the thread tries to advance the epoch and reclaims
+ * whatever has become safe. Lists left by exited threads are
+ * adopted at that time.
+ *
+ * @code
+ * epoch_domain<> domain;
+ * {
+ *     epoch_guard guard(domain);
+ *     node *top = head.load(); // safe to dereference
+ *     ...
+ * }
+ * domain.retire(unlinked);
+ * @endcode
+ *
+ * @tparam Alloc Allocator of the domain's per-thread records.
+ * @note The domain must outlive all its guards and be destroyed
+ * when no thread uses it; then it reclaims all retired objects.
+ */
+template <typename Alloc = std::allocator<char>>
+class epoch_domain
+{
+    enum : std::size_t { _cache_line = 64 };
+
+    struct alignas(_cache_line) _record : details::reclaim_record
+    {
+        std::atomic<std::uint64_t> epoch { 0 }; // zero outside of sections
+        unsigned nesting = 0;
+
+        explicit _record(const Alloc &) { }
+    };
+
+    struct _domain : details::reclaim_domain<_record, Alloc>
+    {
+        using _base = details::reclaim_domain<_record, Alloc>;
+        explicit _domain(const Alloc &alloc) : _base(alloc) { }
+        using _base::_local;
+        using _base::_first;
+        using _base::_next;
+        using _base::_adopt_orphans;
+    } _impl;
+
+    alignas(_cache_line) std::atomic<std::uint64_t> _epoch { 1 };
+    std::size_t _batch;
+
+    bool _try_advance() noexcept;
+    std::size_t _collect(_record &rec);
+
+    friend class epoch_guard<epoch_domain>;
+
+public:
+    using allocator_type = Alloc;
+
+    /**
+     * @brief Creates the domain
+     * @param batch Number of retired objects in a thread's list
+     * that triggers reclamation.
+     * @param alloc Allocator of the domain's per-thread records.
+     */
+    explicit epoch_domain(std::size_t batch = 64, const Alloc &alloc = Alloc())
+        : _impl(alloc), _batch(batch ? batch : 1) { }
+
+  template <typename Tp, typename Deleter = std::default_delete<Tp>>
+    void retire(Tp *p, Deleter = Deleter());
+
+    std::size_t reclaim();
+
+    /// Returns the current global epoch
+    std::uint64_t epoch() const noexcept
+    { return _epoch.load(std::memory_order_relaxed); }
+
+    /// Returns the number of retired objects that triggers reclamation
+    std::size_t batch() const noexcept { return _batch; }
+};
+
+/**
+ * @brief Retires @a p to be reclaimed by @a Deleter once
+ * no critical section may access it
+ * @note @a p must already be unreachable for new readers.
+ */
+  template <typename Alloc>
+      template <typename Tp, typename Deleter>
+    void
+    epoch_domain<Alloc>::
+    retire(Tp *p, Deleter)
+    {
+        _record &rec = _impl._local();
+
+        // the epoch is read after @a p has been unlinked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        rec.retired.template push<Tp, Deleter>(
+            p, _epoch.load(std::memory_order_relaxed));
+        if(rec.retired.size >= _batch)
+            _collect(rec);
+    }
+
+/**
+ * @brief Tries to advance the epoch and reclaims objects
+ * retired by the calling thread and by exited threads,
+ * which can not be accessed anymore
+ * @return Number of reclaimed objects.
+ * @note Objects are reclaimed only after the epoch has advanced
+ * twice, so it might be necessary to call this more than once.
+ */
+  template <typename Alloc>
+    std::size_t
+    epoch_domain<Alloc>::
+    reclaim()
+    {
+        return _collect(_impl._local());
+    }
+
+/**
+ * @internal
+ * @brief Advances the epoch, if all threads inside critical
+ * sections have observed the current one
+ * @return true, if the epoch has been advanced.
+ */
+  template <typename Alloc>
+    bool
+    epoch_domain<Alloc>::
+    _try_advance() noexcept
+    {
+        std::uint64_t e = _epoch.load(std::memory_order_relaxed);
+
+        // pairs with the fence of epoch_guard
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for(_record *r = _impl._first(); r; r = _impl._next(r)) {
+            const std::uint64_t local = r->epoch.load(std::memory_order_relaxed);
+            if(local && local != e)
+                return false;
+        }
+        return _epoch.compare_exchange_strong(e, e + 1,
+            std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+
+/**
+ * @internal
+ * @brief Reclaims objects of @a rec retired two epochs ago
+ * @return Number of reclaimed objects.
+ */
+  template <typename Alloc>
+    std::size_t
+    epoch_domain<Alloc>::
+    _collect(_record &rec)
+    {
+        _impl._adopt_orphans(rec);
+        _try_advance();
+
+        const std::uint64_t e = _epoch.load(std::memory_order_acquire);
+        return rec.retired.reclaim_if_not([e](const void*, std::uint64_t retired) {
+            return retired + 2 > e;
+        });
+    }
+
+/**
+ * @brief Critical section of the calling thread in an epoch_domain
+ *
+ * Objects reachable inside the section are not reclaimed until
+ * it ends. Sections may be nested. Must be used only by the thread
+ * that has created it.
+ */
+template <typename Domain>
+class epoch_guard
+{
+    typename Domain::_record &_rec;
+
+public:
+    /// Enters a critical section of @a domain
+    explicit epoch_guard(Domain &domain) : _rec(domain._impl._local())
+    {
+        if(_rec.nesting++)
+            return;
+        _rec.epoch.store(domain._epoch.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /// Leaves the critical section
+    ~epoch_guard()
+    {
+        if(!--_rec.nesting)
+            _rec.epoch.store(0, std::memory_order_release);
+    }
+
+#ifndef DOXYGEN
+    epoch_guard(const epoch_guard&) = delete;
+    epoch_guard &operator=(const epoch_guard&) = delete;
+#endif
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_RECLAMATION_H
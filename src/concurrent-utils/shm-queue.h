@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_SHM_QUEUE_H
+#define CONCURRENT_UTILS_SHM_QUEUE_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace concurrent_utils {
+
+/**
+ * @brief Producer and consumer modes of shm_queue
+ */
+enum class shm_mode
+{
+    spsc,   ///< One producer and one consumer, lock-free ring
+    mpmc    ///< Any number of both, list under a robust mutex
+};
+
+namespace details {
+
+    // Futex shared between processes
+    struct shm_futex
+    {
+        static void wait(std::atomic<std::uint32_t> &word, std::uint32_t seen,
+                         std::chrono::nanoseconds timeout) noexcept
+        {
+            const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+            timespec ts { static_cast<time_t>(s.count()),
+                          static_cast<long>((timeout - s).count()) };
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+                      FUTEX_WAIT, seen, &ts, nullptr, 0);
+        }
+
+        static void wake_all(std::atomic<std::uint32_t> &word) noexcept
+        {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+                      FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+    };
+
+} // namespace details
+
+/**
+ * @brief Bounded queue in shared memory for exchange between processes
+ *
+ * Lives in a POSIX shared memory object mapped by every process using
+ * the queue under the same name; the first one creates and formats it.
+ * The region has no pointers: items are kept in nodes addressed by
+ * their offsets from the start of the region, so it may be mapped at
+ * any address.
+ *
+ * In shm_mode::spsc nodes form a ring with producer and consumer
+ * indices, and both sides never lock. In shm_mode::mpmc nodes are
+ * linked by offsets into the queue and a free list, guarded by a
+ * process-shared robust mutex: if a process dies holding it, the next
+ * owner relinks the lists, losing at most the item being moved.
+ *
+ * Waits sleep on process-shared futexes. Processes register as
+ * producers or consumers on their first push or pull; a wait gives
+ * up, as on a closed queue, once all registered processes of the
+ * other side have exited or died.
+ *
+ * @tparam Tp Type of items, trivially copyable.
+ * @tparam Mode Producer and consumer mode.
+ * @throw std::system_error On failed system calls.
+ */
+template <typename Tp, shm_mode Mode = shm_mode::mpmc>
+class shm_queue
+{
+#ifndef DOXYGEN
+    static_assert(std::is_trivially_copyable<Tp>::value,
+        "shm_queue only works with trivially copyable type");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+        "shm_queue needs address-free 64-bit atomics");
+#endif
+
+    using _clock = std::chrono::steady_clock;
+
+    enum : std::size_t { _cache_line = 64, _max_peers = 64 };
+    enum : std::uint64_t { _magic = 0x636f6e6373686d71ull };  // "concshmq"
+    enum : std::uint32_t { _producer = 1, _consumer = 2 };
+
+    // Longest sleep between checks of peers
+    static constexpr std::chrono::milliseconds _poll { 100 };
+
+    struct _node
+    {
+        std::uint64_t next;     // offset of the next node, zero for none
+        std::uint32_t mark;     // used by repairs
+        Tp value;
+    };
+
+    struct _peer
+    {
+        std::atomic<std::int32_t> pid;
+        std::atomic<std::uint32_t> roles;
+    };
+
+    struct _control
+    {
+        std::uint64_t magic;
+        std::uint32_t mode;
+        std::atomic<std::uint32_t> ready;
+        std::uint64_t capacity, item_size, nodes;
+        std::atomic<std::uint32_t> closed;
+        std::atomic<std::uint32_t> roles_seen;
+
+        alignas(_cache_line) std::atomic<std::uint32_t> pushes;  // futex
+        std::atomic<std::uint32_t> pull_waiters;
+        alignas(_cache_line) std::atomic<std::uint32_t> pulls;   // futex
+        std::atomic<std::uint32_t> push_waiters;
+
+        // spsc
+        alignas(_cache_line) std::atomic<std::uint64_t> head;
+        alignas(_cache_line) std::atomic<std::uint64_t> tail;
+
+        // mpmc, guarded by the mutex
+        alignas(_cache_line) pthread_mutex_t mutex;
+        std::uint64_t first, last, free, size;
+
+        alignas(_cache_line) _peer peers[_max_peers];
+    };
+
+    static constexpr std::size_t _nodes_offset =
+        (sizeof(_control) + _cache_line - 1) / _cache_line * _cache_line;
+
+    std::string _name;
+    char *_base = nullptr;
+    std::size_t _size = 0;
+    _control *_ctl = nullptr;
+    std::size_t _slot = _max_peers;
+    std::atomic<std::uint32_t> _roles { 0 };  // registered by this object
+
+    [[noreturn]] static void _throw_errno(const std::string &what)
+    { throw std::system_error(errno, std::generic_category(), what); }
+
+    _node &_at(std::uint64_t offset) const noexcept
+    { return *reinterpret_cast<_node*>(_base + offset); }
+
+    std::uint64_t _offset(std::uint64_t i) const noexcept
+    { return _nodes_offset + i * sizeof(_node); }
+
+    static bool _alive(std::int32_t pid) noexcept;
+
+    void _map(bool create, std::size_t capacity);
+    void _format(std::size_t capacity);
+    void _join();
+    void _register(std::uint32_t role) noexcept;
+    bool _abandoned(std::uint32_t role) const noexcept;
+
+    void _lock();
+    void _unlock() noexcept;
+    void _repair() noexcept;
+
+    bool _try_push(const Tp &item);
+    bool _try_pull(Tp &item);
+    bool _wait(std::atomic<std::uint32_t> &word, std::atomic<std::uint32_t> &waiters,
+               std::uint32_t other, _clock::time_point deadline,
+               bool (shm_queue::*blocked)());
+    bool _full();
+
+public:
+    using value_type = Tp;
+    using size_type = std::size_t;
+
+    /// Mode of the queue
+    static constexpr shm_mode mode = Mode;
+
+    shm_queue(const std::string &name, size_type capacity);
+    explicit shm_queue(const std::string &name);
+    ~shm_queue();
+
+#ifndef DOXYGEN
+    shm_queue(const shm_queue&) = delete;
+    shm_queue &operator=(const shm_queue&) = delete;
+#endif
+
+    static bool unlink(const std::string &name) noexcept;
+
+  template <typename... Args>
+    bool push(Args &&...args);
+
+  template <typename... Args>
+    bool try_push(Args &&...args);
+
+    bool pull(value_type &val);
+
+    bool wait_pull(value_type &val);
+
+  template <typename Clock, typename Duration>
+    bool wait_pull(const std::chrono::time_point<Clock, Duration> &atime,
+                   value_type &val);
+
+  template <typename Rep, typename Period>
+    bool wait_pull(const std::chrono::duration<Rep, Period> &rtime,
+                   value_type &val);
+
+    void close() noexcept;
+
+    /// Returns true, if the queue is closed
+    bool closed() const noexcept
+    { return _ctl->closed.load(std::memory_order_acquire); }
+
+    size_type size();
+
+    /// Returns true, if the queue has no items
+    bool empty() { return !size(); }
+
+    /// Returns the maximum number of items
+    size_type capacity() const noexcept { return _ctl->capacity; }
+
+    /// Returns the name of the shared memory object
+    const std::string &name() const noexcept { return _name; }
+};
+
+/**
+ * @brief Opens the queue @a name or creates it for @a capacity items
+ * @note Throws std::invalid_argument, if an existing queue has another
+ * mode or type of items.
+ */
+  template <typename Tp, shm_mode Mode>
+    shm_queue<Tp, Mode>::
+    shm_queue(const std::string &name, size_type capacity)
+        : _name(name[0] == '/' ? name : '/' + name)
+    {
+        if(!capacity)
+            throw std::invalid_argument("shm_queue: zero capacity");
+        _map(true, capacity);
+    }
+
+/**
+ * @brief Opens the existing queue @a name
+ */
+  template <typename Tp, shm_mode Mode>
+    shm_queue<Tp, Mode>::
+    shm_queue(const std::string &name)
+        : _name(name[0] == '/' ? name : '/' + name)
+    {
+        _map(false, 0);
+    }
+
+/**
+ * @brief Unregisters the process from the queue and unmaps it
+ * @note The shared memory object stays until unlink().
+ */
+  template <typename Tp, shm_mode Mode>
+    shm_queue<Tp, Mode>::
+    ~shm_queue()
+    {
+        _ctl->peers[_slot].roles.store(0, std::memory_order_relaxed);
+        _ctl->peers[_slot].pid.store(0, std::memory_order_release);
+
+        // let waiters of the other side notice
+        details::shm_futex::wake_all(_ctl->pushes);
+        details::shm_futex::wake_all(_ctl->pulls);
+        ::munmap(_base, _size);
+    }
+
+/**
+ * @brief Removes the shared memory object @a name
+ *
+ * Processes having the queue mapped keep using it.
+ * @return false, if there was no such object.
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    unlink(const std::string &name) noexcept
+    {
+        return !::shm_unlink((name[0] == '/' ? name : '/' + name).c_str());
+    }
+
+/**
+ * @internal
+ * @brief Returns true, if process @a pid is running
+ *
+ * A zombie has already exited, though it exists until reaped.
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _alive(std::int32_t pid) noexcept
+    {
+        if(pid <= 0 || (::kill(pid, 0) && errno != EPERM))
+            return false;
+
+        char path[32], state = 0;
+        std::snprintf(path, sizeof(path), "/proc/%d/stat", int(pid));
+        if(FILE *f = std::fopen(path, "r")) {
+            // the state follows the name in parentheses
+            if(std::fscanf(f, "%*d (%*[^)]) %c", &state) != 1)
+                state = 0;
+            std::fclose(f);
+        }
+        return state != 'Z' && state != 'X';
+    }
+
+/**
+ * @internal
+ * @brief Maps the shared memory object, formatting it, if created
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _map(bool create, std::size_t capacity)
+    {
+        bool created = false;
+        int fd = -1;
+        if(create) {
+            fd = ::shm_open(_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            created = fd >= 0;
+            if(!created && errno != EEXIST)
+                _throw_errno("shm_queue: shm_open " + _name);
+        }
+        if(!created && (fd = ::shm_open(_name.c_str(), O_RDWR, 0)) < 0)
+            _throw_errno("shm_queue: shm_open " + _name);
+
+        if(created) {
+            _size = _offset(capacity);
+            if(::ftruncate(fd, _size)) {
+                ::close(fd);
+                ::shm_unlink(_name.c_str());
+                _throw_errno("shm_queue: truncate " + _name);
+            }
+        } else {
+            // the creator may not have sized it yet
+            struct stat st;
+            for(int i = 0; ; ++i) {
+                if(::fstat(fd, &st)) {
+                    ::close(fd);
+                    _throw_errno("shm_queue: stat " + _name);
+                }
+                if(st.st_size || i == 1000)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            _size = static_cast<std::size_t>(st.st_size);
+            if(_size < _nodes_offset) {
+                ::close(fd);
+                throw std::invalid_argument("shm_queue: " + _name + " is not a queue");
+            }
+        }
+
+        void *p = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(p == MAP_FAILED)
+            _throw_errno("shm_queue: mmap " + _name);
+        _base = static_cast<char*>(p);
+        _ctl = reinterpret_cast<_control*>(_base);
+
+        try {
+            if(created)
+                _format(capacity);
+            _join();
+        } catch(...) {
+            ::munmap(_base, _size);
+            if(created)
+                ::shm_unlink(_name.c_str());
+            throw;
+        }
+    }
+
+/**
+ * @internal
+ * @brief Initializes the control block and the nodes
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _format(std::size_t capacity)
+    {
+        // the region is zeroed by ftruncate
+        _ctl->magic = _magic;
+        _ctl->mode = static_cast<std::uint32_t>(Mode);
+        _ctl->capacity = capacity;
+        _ctl->item_size = sizeof(Tp);
+        _ctl->nodes = _nodes_offset;
+
+        pthread_mutexattr_t attr;
+        ::pthread_mutexattr_init(&attr);
+        ::pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        ::pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        errno = ::pthread_mutex_init(&_ctl->mutex, &attr);
+        ::pthread_mutexattr_destroy(&attr);
+        if(errno)
+            _throw_errno("shm_queue: pthread_mutex_init");
+
+        for(std::size_t i = 0; i < capacity; ++i)
+            _at(_offset(i)).next = i + 1 < capacity ? _offset(i + 1) : 0;
+        _ctl->free = _offset(0);
+
+        _ctl->ready.store(1, std::memory_order_release);
+    }
+
+/**
+ * @internal
+ * @brief Checks the format and takes a slot in the table of peers
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _join()
+    {
+        for(int i = 0; !_ctl->ready.load(std::memory_order_acquire); ++i) {
+            if(i == 1000)
+                throw std::runtime_error("shm_queue: " + _name + " is not formatted");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if(_ctl->magic != _magic || _ctl->mode != static_cast<std::uint32_t>(Mode)
+                || _ctl->item_size != sizeof(Tp) || _ctl->nodes != _nodes_offset
+                || _size < _offset(_ctl->capacity))
+            throw std::invalid_argument("shm_queue: " + _name + " has another format");
+
+        const std::int32_t self = static_cast<std::int32_t>(::getpid());
+        for(std::size_t i = 0; i < _max_peers; ++i) {
+            _peer &p = _ctl->peers[i];
+            std::int32_t pid = p.pid.load(std::memory_order_acquire);
+            if(pid && _alive(pid))
+                continue;
+            // free or left by a dead process
+            if(p.pid.compare_exchange_strong(pid, self, std::memory_order_acq_rel)) {
+                p.roles.store(0, std::memory_order_relaxed);
+                _slot = i;
+                return;
+            }
+        }
+        throw std::length_error("shm_queue: too many processes use " + _name);
+    }
+
+/**
+ * @internal
+ * @brief Marks the process as a producer or consumer
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _register(std::uint32_t role) noexcept
+    {
+        if(_roles.load(std::memory_order_relaxed) & role)
+            return;
+        _roles.fetch_or(role, std::memory_order_relaxed);
+        _ctl->peers[_slot].roles.fetch_or(role, std::memory_order_acq_rel);
+        _ctl->roles_seen.fetch_or(role, std::memory_order_acq_rel);
+    }
+
+/**
+ * @internal
+ * @brief Returns true, if processes of @a role have been
+ * registered, but none of them is alive anymore
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _abandoned(std::uint32_t role) const noexcept
+    {
+        if(!(_ctl->roles_seen.load(std::memory_order_acquire) & role))
+            return false;
+        for(const _peer &p : _ctl->peers) {
+            const std::int32_t pid = p.pid.load(std::memory_order_acquire);
+            if((p.roles.load(std::memory_order_relaxed) & role) && _alive(pid))
+                return false;
+        }
+        return true;
+    }
+
+/**
+ * @internal
+ * @brief Locks the robust mutex, repairing lists left by a dead owner
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _lock()
+    {
+        const int err = ::pthread_mutex_lock(&_ctl->mutex);
+        if(err == EOWNERDEAD) {
+            _repair();
+            ::pthread_mutex_consistent(&_ctl->mutex);
+        } else if(err) {
+            errno = err;
+            _throw_errno("shm_queue: pthread_mutex_lock");
+        }
+    }
+
+/**
+ * @internal
+ * @brief Unlocks the robust mutex
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _unlock() noexcept
+    {
+        ::pthread_mutex_unlock(&_ctl->mutex);
+    }
+
+/**
+ * @internal
+ * @brief Relinks the queue and the free list after a process
+ * has died in the middle of a push or pull
+ *
+ * Pushes link a node only after filling it and pulls unlink it
+ * before freeing it, so nodes reachable from the head form
+ * the queue and all other nodes are free.
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    _repair() noexcept
+    {
+        const std::uint64_t capacity = _ctl->capacity;
+        for(std::uint64_t i = 0; i < capacity; ++i)
+            _at(_offset(i)).mark = 0;
+
+        std::uint64_t size = 0, last = 0;
+        for(std::uint64_t n = _ctl->first; n && size < capacity; n = _at(n).next) {
+            _at(n).mark = 1;
+            last = n;
+            ++size;
+        }
+        if(last)
+            _at(last).next = 0;
+        else
+            _ctl->first = 0;
+        _ctl->last = last;
+        _ctl->size = size;
+
+        _ctl->free = 0;
+        for(std::uint64_t i = capacity; i--; )
+            if(!_at(_offset(i)).mark) {
+                _at(_offset(i)).next = _ctl->free;
+                _ctl->free = _offset(i);
+            }
+    }
+
+/**
+ * @internal
+ * @brief Puts a copy of @a item to the queue, if it has room
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _try_push(const Tp &item)
+    {
+        if constexpr(Mode == shm_mode::spsc) {
+            const std::uint64_t tail = _ctl->tail.load(std::memory_order_relaxed);
+            if(tail - _ctl->head.load(std::memory_order_acquire) == _ctl->capacity)
+                return false;
+            _at(_offset(tail % _ctl->capacity)).value = item;
+            _ctl->tail.store(tail + 1, std::memory_order_release);
+        } else {
+            _lock();
+            const std::uint64_t n = _ctl->free;
+            if(!n) {
+                _unlock();
+                return false;
+            }
+            _ctl->free = _at(n).next;
+            _at(n).value = item;
+            _at(n).next = 0;
+            if(_ctl->last)
+                _at(_ctl->last).next = n;
+            else
+                _ctl->first = n;
+            _ctl->last = n;
+            ++_ctl->size;
+            _unlock();
+        }
+
+        _ctl->pushes.fetch_add(1, std::memory_order_seq_cst);
+        if(_ctl->pull_waiters.load(std::memory_order_seq_cst))
+            details::shm_futex::wake_all(_ctl->pushes);
+        return true;
+    }
+
+/**
+ * @internal
+ * @brief Takes an item from the queue, if it has any
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _try_pull(Tp &item)
+    {
+        if constexpr(Mode == shm_mode::spsc) {
+            const std::uint64_t head = _ctl->head.load(std::memory_order_relaxed);
+            if(head == _ctl->tail.load(std::memory_order_acquire))
+                return false;
+            item = _at(_offset(head % _ctl->capacity)).value;
+            _ctl->head.store(head + 1, std::memory_order_release);
+        } else {
+            _lock();
+            const std::uint64_t n = _ctl->first;
+            if(!n) {
+                _unlock();
+                return false;
+            }
+            item = _at(n).value;
+            _ctl->first = _at(n).next;
+            if(!_ctl->first)
+                _ctl->last = 0;
+            --_ctl->size;
+            _at(n).next = _ctl->free;
+            _ctl->free = n;
+            _unlock();
+        }
+
+        _ctl->pulls.fetch_add(1, std::memory_order_seq_cst);
+        if(_ctl->push_waiters.load(std::memory_order_seq_cst))
+            details::shm_futex::wake_all(_ctl->pulls);
+        return true;
+    }
+
+/**
+ * @internal
+ * @brief Returns true, if the queue has no room
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _full()
+    {
+        return size() == _ctl->capacity;
+    }
+
+/**
+ * @internal
+ * @brief Sleeps on futex @a word while @a blocked returns true,
+ * unless the queue is closed or abandoned by processes of role
+ * @a other, or @a deadline passes
+ * @return false, if the wait has given up.
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    _wait(std::atomic<std::uint32_t> &word, std::atomic<std::uint32_t> &waiters,
+          std::uint32_t other, _clock::time_point deadline, bool (shm_queue::*blocked)())
+    {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool ok = true;
+        for(;;) {
+            const std::uint32_t seen = word.load(std::memory_order_seq_cst);
+            if(!(this->*blocked)())
+                break;
+            if(closed() || _abandoned(other)) {
+                ok = false;
+                break;
+            }
+            const auto now = _clock::now();
+            if(now >= deadline) {
+                ok = false;
+                break;
+            }
+            details::shm_futex::wait(word, seen, std::min<_clock::duration>(
+                deadline - now, _poll));
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return ok;
+    }
+
+/**
+ * @brief Puts an item constructed from @a args to the queue,
+ * waiting while the queue is full
+ * @return false, if the queue is closed or all consumers are gone.
+ */
+  template <typename Tp, shm_mode Mode>
+      template <typename... Args>
+    bool
+    shm_queue<Tp, Mode>::
+    push(Args &&...args)
+    {
+        _register(_producer);
+        const Tp item(std::forward<Args>(args)...);
+        for(;;) {
+            if(closed())
+                return false;
+            if(_try_push(item))
+                return true;
+            if(!_wait(_ctl->pulls, _ctl->push_waiters, _consumer,
+                      _clock::time_point::max(), &shm_queue::_full))
+                return false;
+        }
+    }
+
+/**
+ * @brief Puts an item constructed from @a args to the queue,
+ * if it is not full
+ * @return false, if the queue is full or closed.
+ */
+  template <typename Tp, shm_mode Mode>
+      template <typename... Args>
+    bool
+    shm_queue<Tp, Mode>::
+    try_push(Args &&...args)
+    {
+        _register(_producer);
+        return !closed() && _try_push(Tp(std::forward<Args>(args)...));
+    }
+
+/**
+ * @brief Takes an item from the queue, if it has any
+ * @return false, if the queue is empty.
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    pull(value_type &val)
+    {
+        _register(_consumer);
+        return _try_pull(val);
+    }
+
+/**
+ * @brief Takes an item from the queue, waiting for it
+ * @return false, if the queue is empty and closed,
+ * or all producers are gone.
+ */
+  template <typename Tp, shm_mode Mode>
+    bool
+    shm_queue<Tp, Mode>::
+    wait_pull(value_type &val)
+    {
+        return wait_pull(_clock::time_point::max(), val);
+    }
+
+/**
+ * @brief Takes an item from the queue, waiting for it until @a atime
+ * @return false, if the time has passed, or the queue is empty
+ * and closed, or all producers are gone.
+ */
+  template <typename Tp, shm_mode Mode>
+      template <typename Clock, typename Duration>
+    bool
+    shm_queue<Tp, Mode>::
+    wait_pull(const std::chrono::time_point<Clock, Duration> &atime, value_type &val)
+    {
+        _register(_consumer);
+        _clock::time_point deadline = _clock::time_point::max();
+        if(atime != std::chrono::time_point<Clock, Duration>::max()) {
+            const auto left = atime - Clock::now();
+            deadline = left > Duration::zero()
+                ? _clock::now() + std::chrono::ceil<_clock::duration>(left)
+                : _clock::now();
+        }
+
+        for(;;) {
+            if(_try_pull(val))
+                return true;
+            if(!_wait(_ctl->pushes, _ctl->pull_waiters, _producer, deadline,
+                      &shm_queue::empty))
+                return _try_pull(val);
+        }
+    }
+
+/**
+ * @brief Takes an item from the queue, waiting for it for @a rtime
+ * @copydetails wait_pull(const std::chrono::time_point<Clock, Duration>&, value_type&)
+ */
+  template <typename Tp, shm_mode Mode>
+      template <typename Rep, typename Period>
+    bool
+    shm_queue<Tp, Mode>::
+    wait_pull(const std::chrono::duration<Rep, Period> &rtime, value_type &val)
+    {
+        return wait_pull(_clock::now() + std::chrono::ceil<_clock::duration>(rtime), val);
+    }
+
+/**
+ * @brief Closes the queue for all processes
+ *
+ * Pushes fail since then, pulls take items left.
+ */
+  template <typename Tp, shm_mode Mode>
+    void
+    shm_queue<Tp, Mode>::
+    close() noexcept
+    {
+        _ctl->closed.store(1, std::memory_order_seq_cst);
+        _ctl->pushes.fetch_add(1, std::memory_order_seq_cst);
+        _ctl->pulls.fetch_add(1, std::memory_order_seq_cst);
+        details::shm_futex::wake_all(_ctl->pushes);
+        details::shm_futex::wake_all(_ctl->pulls);
+    }
+
+/**
+ * @brief Returns the number of items
+ */
+  template <typename Tp, shm_mode Mode>
+    auto
+    shm_queue<Tp, Mode>::
+    size() -> size_type
+    {
+        if constexpr(Mode == shm_mode::spsc) {
+            const std::uint64_t head = _ctl->head.load(std::memory_order_acquire);
+            return _ctl->tail.load(std::memory_order_acquire) - head;
+        } else {
+            _lock();
+            const size_type n = _ctl->size;
+            _unlock();
+            return n;
+        }
+    }
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_SHM_QUEUE_H
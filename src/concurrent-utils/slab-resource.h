@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_SLAB_RESOURCE_H
+#define CONCURRENT_UTILS_SLAB_RESOURCE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "locks.h"
+
+namespace concurrent_utils {
+
+/**
+ * @brief Thread-safe slab memory resource on huge pages
+ *
+ * Serves small blocks from slabs of 2MB mapped directly from the OS,
+ * each slab holding blocks of a single size class. A slab is mapped
+ * with MAP_HUGETLB, so it takes one TLB entry instead of 512; when no
+ * huge pages are reserved, it is mapped from regular pages aligned
+ * to 2MB and advised for transparent huge pages.
+ *
+ * Slabs are aligned to their size, so deallocation finds the slab of
+ * a block by masking its address. A slab left without blocks is
+ * unmapped at once, unless it is the last slab of its class.
+ *
+ * Meant for nodes of concurrent_queue and other node-based structures
+ * with std::pmr::polymorphic_allocator. Blocks over 1KB or aligned
+ * over 64 bytes are passed to the upstream resource.
+ *
+ * @note Each size class has its own spinlock, but all allocations of
+ * a class contend for it.
+ */
+class slab_resource : public std::pmr::memory_resource
+{
+public:
+    /// Size and alignment of slabs
+    static constexpr std::size_t slab_size = std::size_t(2) << 20;
+
+    /// Biggest block served from slabs
+    static constexpr std::size_t max_block = 1024;
+
+private:
+    static constexpr std::size_t _cache_line = 64;
+    static constexpr std::size_t _granule = 16;
+    static constexpr std::size_t _classes = max_block / _granule;
+
+    struct free_block { free_block *next; };
+
+    struct slab
+    {
+        slab *prev = nullptr, *next = nullptr;
+        free_block *free = nullptr;
+        std::size_t block;      // size of blocks
+        std::size_t capacity;   // blocks in the slab
+        std::size_t used = 0;   // blocks given out
+        std::size_t carved = 0; // blocks ever given out, the rest is untouched
+        bool huge;
+
+        slab(std::size_t b, bool h) noexcept
+            : block(b), capacity((slab_size - _header) / b), huge(h) { }
+
+        char *data() noexcept
+        { return reinterpret_cast<char*>(this) + _header; }
+    };
+
+    static constexpr std::size_t _header =
+        (sizeof(slab) + _cache_line - 1) / _cache_line * _cache_line;
+
+    struct alignas(_cache_line) size_class
+    {
+        spinlock lock;
+        slab *partial = nullptr;  // slabs with free blocks
+        slab *full = nullptr;     // slabs without free blocks
+        std::size_t slabs = 0;
+    };
+
+    std::pmr::memory_resource *const _upstream;
+    const bool _use_hugetlb;
+    size_class _sizes[_classes];
+    std::atomic<std::size_t> _slabs { 0 }, _huge_slabs { 0 };
+
+    static void _push(slab *&list, slab *s) noexcept
+    {
+        s->prev = nullptr;
+        s->next = list;
+        if(list) list->prev = s;
+        list = s;
+    }
+
+    static void _remove(slab *&list, slab *s) noexcept
+    {
+        if(s->prev) s->prev->next = s->next;
+        else list = s->next;
+        if(s->next) s->next->prev = s->prev;
+    }
+
+    // Maps a region of slab_size aligned to its size
+    void *_map(bool &huge) noexcept
+    {
+#ifdef MAP_HUGETLB
+        if(_use_hugetlb) {
+            void *p = ::mmap(nullptr, slab_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(p != MAP_FAILED) {
+                huge = true;
+                return p;
+            }
+        }
+#endif
+        huge = false;
+
+        // map twice the size and trim the ends to get the alignment
+        char *p = static_cast<char*>(::mmap(nullptr, 2 * slab_size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(p == MAP_FAILED)
+            return nullptr;
+
+        const std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(p);
+        char *aligned = p + ((slab_size - addr % slab_size) % slab_size);
+        if(aligned != p)
+            ::munmap(p, aligned - p);
+        if(aligned + slab_size != p + 2 * slab_size)
+            ::munmap(aligned + slab_size, p + 2 * slab_size - (aligned + slab_size));
+#ifdef MADV_HUGEPAGE
+        ::madvise(aligned, slab_size, MADV_HUGEPAGE);
+#endif
+        return aligned;
+    }
+
+    slab *_new_slab(std::size_t block)
+    {
+        bool huge;
+        void *p = _map(huge);
+        if(!p)
+            throw std::bad_alloc();
+        _slabs.fetch_add(1, std::memory_order_relaxed);
+        if(huge)
+            _huge_slabs.fetch_add(1, std::memory_order_relaxed);
+        return ::new(p) slab(block, huge);
+    }
+
+    void _unmap(slab *s) noexcept
+    {
+        _slabs.fetch_sub(1, std::memory_order_relaxed);
+        if(s->huge)
+            _huge_slabs.fetch_sub(1, std::memory_order_relaxed);
+        s->~slab();
+        ::munmap(static_cast<void*>(s), slab_size);
+    }
+
+    // Returns block size of the class serving @a bytes, or zero for upstream
+    static std::size_t _block_size(std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if(alignment > _cache_line)
+            return 0;
+        std::size_t size = (bytes + _granule - 1) / _granule * _granule;
+        if(alignment > _granule)
+            size = (size + alignment - 1) / alignment * alignment;
+        if(!size) size = _granule;
+        return size <= max_block ? size : 0;
+    }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        const std::size_t block = _block_size(bytes, alignment);
+        if(!block)
+            return _upstream->allocate(bytes, alignment);
+
+        size_class &c = _sizes[block / _granule - 1];
+        std::lock_guard<spinlock> lk(c.lock);
+        slab *s = c.partial;
+        if(!s) {
+            _push(c.partial, s = _new_slab(block));
+            ++c.slabs;
+        }
+
+        void *p;
+        if(s->free) {
+            p = s->free;
+            s->free = s->free->next;
+        } else
+            p = s->data() + s->carved++ * block;
+
+        if(++s->used == s->capacity) {
+            _remove(c.partial, s);
+            _push(c.full, s);
+        }
+        return p;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        const std::size_t block = _block_size(bytes, alignment);
+        if(!block)
+            return _upstream->deallocate(p, bytes, alignment);
+
+        slab *s = reinterpret_cast<slab*>(
+            reinterpret_cast<std::uintptr_t>(p) & ~(slab_size - 1));
+        size_class &c = _sizes[block / _granule - 1];
+        {
+            std::lock_guard<spinlock> lk(c.lock);
+            s->free = ::new(p) free_block { s->free };
+            if(s->used-- == s->capacity) {
+                _remove(c.full, s);
+                _push(c.partial, s);
+            }
+            if(s->used || c.slabs == 1)
+                return;
+            _remove(c.partial, s);
+            --c.slabs;
+        }
+        _unmap(s);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    { return this == &other; }
+
+public:
+    /**
+     * @brief Creates the resource
+     * @param hugetlb Try MAP_HUGETLB first, otherwise use
+     * transparent huge pages only.
+     * @param upstream Resource serving big and overaligned blocks.
+     */
+    explicit slab_resource(bool hugetlb = true,
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : _upstream(upstream), _use_hugetlb(hugetlb) { }
+
+    /**
+     * @brief Destroys the resource unmapping all slabs
+     * @note Blocks given out before become invalid.
+     */
+    ~slab_resource()
+    {
+        for(size_class &c : _sizes)
+            for(slab *list : { c.partial, c.full })
+                while(list) {
+                    slab *s = list;
+                    list = s->next;
+                    _unmap(s);
+                }
+    }
+
+#ifndef DOXYGEN
+    slab_resource(const slab_resource&) = delete;
+    slab_resource &operator=(const slab_resource&) = delete;
+#endif
+
+    /// Returns resource serving big and overaligned blocks
+    std::pmr::memory_resource *upstream_resource() const noexcept
+    { return _upstream; }
+
+    /// Returns the number of mapped slabs
+    std::size_t slabs() const noexcept
+    { return _slabs.load(std::memory_order_relaxed); }
+
+    /// Returns the number of slabs mapped with MAP_HUGETLB
+    std::size_t huge_slabs() const noexcept
+    { return _huge_slabs.load(std::memory_order_relaxed); }
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_SLAB_RESOURCE_H
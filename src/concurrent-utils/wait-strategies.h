@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#ifndef CONCURRENT_UTILS_WAIT_STRATEGIES_H
+#define CONCURRENT_UTILS_WAIT_STRATEGIES_H
+
+#include <chrono>
+#include <thread>
+
+namespace concurrent_utils {
+
+namespace details {
+
+// Hints the processor that the thread is spinning
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace details
+
+/**
+ * @brief Wait strategy parking waiting consumers on the condition
+ * variable at once
+ *
+ * Default strategy of concurrent_queue. Costs nothing while idle,
+ * but waking a parked thread takes microseconds.
+ *
+ * A wait strategy tells by @a spins whether consumers release
+ * the lock and spin until a push or close() is signalled, and by
+ * @a parks whether they park on the condition variable. Spinning
+ * strategies provide static @a spin(signalled), which returns true
+ * once @a signalled() is true, or false to park.
+ */
+struct park_wait
+{
+    enum { spins = false, parks = true };
+};
+
+/**
+ * @brief Wait strategy busy-spinning until signalled
+ *
+ * Gives the lowest wake-up latency for the price of a core
+ * per waiting consumer. Producers never notify.
+ */
+struct spin_wait
+{
+    enum { spins = true, parks = false };
+
+  template <typename Signalled>
+    static bool spin(Signalled signalled)
+    {
+        while(!signalled())
+            details::cpu_relax();
+        return true;
+    }
+};
+
+/**
+ * @brief Wait strategy spinning @a Spins times, then yielding
+ * the processor until signalled
+ *
+ * Lets other threads run on the core while the queue is idle,
+ * never parks. Producers never notify.
+ */
+template <unsigned Spins = 100>
+struct yield_wait
+{
+    enum { spins = true, parks = false };
+
+  template <typename Signalled>
+    static bool spin(Signalled signalled)
+    {
+        for(unsigned i = 0; !signalled(); ++i) {
+            if(i < Spins)
+                details::cpu_relax();
+            else
+                std::this_thread::yield();
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Wait strategy spinning for @a Usecs microseconds,
+ * then parking on the condition variable
+ *
+ * Short gaps between items are served with spinning latency,
+ * long ones cost nothing.
+ */
+template <unsigned Usecs = 50>
+struct spin_park_wait
+{
+    enum { spins = true, parks = true };
+
+  template <typename Signalled>
+    static bool spin(Signalled signalled)
+    {
+        const auto end = std::chrono::steady_clock::now()
+            + std::chrono::microseconds(Usecs);
+        for(unsigned i = 1; !signalled(); ++i) {
+            // the clock is much slower than the check
+            if(!(i % 64) && std::chrono::steady_clock::now() >= end)
+                return false;
+            details::cpu_relax();
+        }
+        return true;
+    }
+};
+
+} // namespace concurrent_utils
+
+#endif // CONCURRENT_UTILS_WAIT_STRATEGIES_H
@@ -1,8 +1,17 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <omp.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 #include "benchmark.h"
 
 namespace details {
@@ -54,6 +63,131 @@ double benchmark_omp_timer::elapsed()
 }
 
 
+#ifdef __linux__
+static int perf_event_open(perf_event_attr &attr)
+{
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static bool perf_event_config(benchmark_perf_counters::counter c,
+                              perf_event_attr &attr)
+{
+    auto &type = attr.type;
+    auto &config = attr.config;
+    switch(c) {
+    case benchmark_perf_counters::cycles:
+        type = PERF_TYPE_HARDWARE;
+        config = PERF_COUNT_HW_CPU_CYCLES;
+        return true;
+    case benchmark_perf_counters::instructions:
+        type = PERF_TYPE_HARDWARE;
+        config = PERF_COUNT_HW_INSTRUCTIONS;
+        return true;
+    case benchmark_perf_counters::llc_misses:
+        type = PERF_TYPE_HW_CACHE;
+        config = PERF_COUNT_HW_CACHE_LL
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        return true;
+    case benchmark_perf_counters::context_switches:
+        type = PERF_TYPE_SOFTWARE;
+        config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+        return true;
+    case benchmark_perf_counters::cache_transfers:
+        if(const char *raw = getenv("BENCHMARK_PERF_TRANSFERS")) {
+            type = PERF_TYPE_RAW;
+            config = strtoull(raw, nullptr, 0);
+            return config != 0;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+#endif
+
+benchmark_perf_counters::benchmark_perf_counters()
+{
+    int error = 0;
+    for(int c = 0; c < counters_count; ++c) {
+        fds[c] = -1;
+        values[c] = 0;
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        if(!perf_event_config(counter(c), attr))
+            continue;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[c] = perf_event_open(attr);
+        if(fds[c] == -1 && (errno == EACCES || errno == EPERM)) {
+            // unprivileged users may count only the user space
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[c] = perf_event_open(attr);
+        }
+        if(fds[c] == -1)
+            error = errno;
+#endif
+    }
+    if(error)
+        fprintf(stderr, "benchmark_perf_counters: some counters are"
+                " unavailable: %s\n", strerror(error));
+}
+
+benchmark_perf_counters::~benchmark_perf_counters()
+{
+    for(int fd : fds)
+        if(fd != -1)
+            close(fd);
+}
+
+void benchmark_perf_counters::start()
+{
+#ifdef __linux__
+    for(int fd : fds)
+        if(fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+}
+
+void benchmark_perf_counters::stop()
+{
+#ifdef __linux__
+    for(int c = 0; c < counters_count; ++c) {
+        if(fds[c] == -1)
+            continue;
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled and time running
+        std::uint64_t data[3];
+        if(read(fds[c], data, sizeof(data)) != sizeof(data)) {
+            perror("benchmark_perf_counters: read");
+            continue;
+        }
+        // scales the value, if the counter has been multiplexed
+        values[c] = data[2] && data[2] < data[1]
+            ? std::uint64_t(double(data[0]) * data[1] / data[2]) : data[0];
+    }
+#endif
+}
+
+const char *benchmark_perf_counters::name(counter c)
+{
+    static const char *const names[counters_count] = {
+        "cycles", "instructions", "llc misses",
+        "context switches", "cache-line transfers"
+    };
+    return names[c];
+}
+
+
 benchmark_controller::benchmark_controller(
         const char *aname, std::uint32_t aiterations)
     : name(aname), iteration(0), iterations(aiterations)
@@ -64,20 +198,34 @@ benchmark_controller::benchmark_controller(
             name, iterations);
     omp_timer.start();
     cpu_timer.start();
+    perf_counters.start();
 }
 
 benchmark_controller::~benchmark_controller()
 {
+    perf_counters.stop();
     const auto omp_elapsed = omp_timer.elapsed();
     const auto cpu_elapsed = cpu_timer.elapsed();
     fprintf(stderr,
         "finish benchmark \"%s\" for %u iterations\n"
         "cpu  time %0.9f (%0.9f per iteration)\n"
-        "full time %0.9f (%0.9f per iteration)\n"
-        "*************************************\n",
+        "full time %0.9f (%0.9f per iteration)\n",
         name, iterations,
         cpu_elapsed, cpu_elapsed / iterations,
         omp_elapsed, omp_elapsed / iterations);
+
+    for(int c = 0; c < benchmark_perf_counters::counters_count; ++c) {
+        const auto counter = benchmark_perf_counters::counter(c);
+        if(!perf_counters.available(counter)) {
+            fprintf(stderr, "%-20s n/a\n", benchmark_perf_counters::name(counter));
+            continue;
+        }
+        const auto value = perf_counters.value(counter);
+        fprintf(stderr, "%-20s %llu (%0.1f per iteration)\n",
+                benchmark_perf_counters::name(counter),
+                static_cast<unsigned long long>(value), double(value) / iterations);
+    }
+    fprintf(stderr, "*************************************\n");
 }
 
 bool benchmark_controller::is_done()
@@ -29,12 +29,11 @@
 #define CONCURRENT_UTILS_BENCHMARK_H
 
 #include <cstdint>
-
-namespace details {
-
 #include <stdlib.h>
 #include <time.h>
 
+namespace details {
+
 class benchmark_cpuclock_timer
 {
     clockid_t clockid;
@@ -58,11 +57,46 @@ public:
 };
 
 
+/**
+ * @brief Hardware and software counters of perf_event_open
+ *
+ * Counts the calling thread and threads it creates after the
+ * construction. Counters the kernel refuses, or all of them off
+ * Linux, are reported as unavailable. Cache-line transfers have no
+ * generic event; a raw event code counting them, such as HITM loads,
+ * is taken from BENCHMARK_PERF_TRANSFERS (e.g. "0x4d2").
+ */
+class benchmark_perf_counters
+{
+public:
+    enum counter {
+        cycles, instructions, llc_misses, context_switches,
+        cache_transfers, counters_count
+    };
+
+private:
+    int fds[counters_count];
+    std::uint64_t values[counters_count];
+
+public:
+    benchmark_perf_counters();
+    ~benchmark_perf_counters();
+    benchmark_perf_counters(const benchmark_perf_counters&) = delete;
+    benchmark_perf_counters &operator=(const benchmark_perf_counters&) = delete;
+    void start();
+    void stop();
+    bool available(counter c) const { return fds[c] != -1; }
+    std::uint64_t value(counter c) const { return values[c]; }
+    static const char *name(counter c);
+};
+
+
 class benchmark_controller
 {
     const char *name;
     std::uint32_t iteration;
     const std::uint32_t iterations;
+    benchmark_perf_counters perf_counters;
     benchmark_cpuclock_timer cpu_timer;
     benchmark_omp_timer omp_timer;
 
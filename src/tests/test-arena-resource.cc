@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/arena-resource.h"
+#include "../concurrent-utils/concurrent-queue.h"
+
+#include <future>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace concurrent_utils;
+
+template <typename Tp>
+using pmr_queue = concurrent_queue<Tp, std::mutex, std::pmr::polymorphic_allocator<Tp>>;
+
+TEST(ArenaResource, Allocate)
+{
+    arena_resource arena(1024);
+    EXPECT_EQ(1024u, arena.chunk_size());
+    EXPECT_EQ(std::pmr::get_default_resource(), arena.upstream_resource());
+    EXPECT_EQ(0u, arena.reserved());
+
+    void *p1 = arena.allocate(10, 1);
+    void *p2 = arena.allocate(16, 16);
+    void *p3 = arena.allocate(8, 64);
+    EXPECT_NE(p1, p2);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p2) % 16);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p3) % 64);
+    EXPECT_GE(static_cast<char *>(p2), static_cast<char *>(p1) + 10);
+    EXPECT_GT(arena.reserved(), 1024u);
+
+    const std::size_t reserved = arena.reserved();
+    arena.deallocate(p1, 10, 1); // no-op
+    EXPECT_EQ(reserved, arena.reserved());
+
+    // too big for regular chunks
+    void *big = arena.allocate(4096, 4096);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(big) % 4096);
+    EXPECT_GT(arena.reserved(), reserved + 4096);
+
+    EXPECT_TRUE(arena.is_equal(arena));
+    arena_resource other;
+    EXPECT_FALSE(arena.is_equal(other));
+
+    arena.release();
+    EXPECT_EQ(0u, arena.reserved());
+    EXPECT_NE(nullptr, arena.allocate(10, 1));
+}
+
+TEST(ArenaResource, Concurrent)
+{
+    arena_resource arena(4096);
+    const int count = 10000;
+
+    auto fn = [&] {
+        std::vector<void *> v;
+        for(int i = 0; i < count; ++i)
+            v.push_back(arena.allocate(24, 8));
+        return v;
+    };
+
+    auto f1 = std::async(std::launch::async, fn);
+    auto f2 = std::async(std::launch::async, fn);
+    auto f3 = std::async(std::launch::async, fn);
+
+    std::set<void *> all;
+    for(auto *f : { &f1, &f2, &f3 })
+        for(void *p : f->get()) {
+            EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p) % 8);
+            all.insert(p);
+        }
+
+    EXPECT_EQ(3u * count, all.size());
+}
+
+TEST(ArenaResource, QueueNodes)
+{
+    arena_resource arena(pmr_queue<int>::node_size * 100);
+    pmr_queue<int> queue(&arena);
+    EXPECT_EQ(&arena, queue.get_allocator().resource());
+
+    for(int i = 0; i < 100; ++i)
+        queue.push(i);
+
+    // all nodes fit in one chunk
+    const std::size_t reserved = arena.reserved();
+    EXPECT_GE(reserved, pmr_queue<int>::node_size * 100);
+    EXPECT_LT(reserved, pmr_queue<int>::node_size * 200);
+
+    int val;
+    for(int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(queue.pull(val));
+        EXPECT_EQ(i, val);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+static std::vector<std::string> drain(pmr_queue<std::string> &queue)
+{
+    std::vector<std::string> v;
+    std::string val;
+    while(queue.pull(val))
+        v.push_back(val);
+    return v;
+}
+
+TEST(ArenaResource, QueuePropagation)
+{
+    using strings = std::vector<std::string>;
+    arena_resource arena1, arena2;
+    pmr_queue<std::string> queue1(&arena1), queue2(&arena2);
+    queue1.push("a");
+    queue1.push("b");
+    queue2.push("c");
+
+    // allocators do not propagate, items move between arenas
+    queue1.swap(queue2);
+    EXPECT_EQ(&arena1, queue1.get_allocator().resource());
+    EXPECT_EQ(&arena2, queue2.get_allocator().resource());
+
+    queue1.append(std::move(queue2));
+    EXPECT_EQ(&arena1, queue1.get_allocator().resource());
+    EXPECT_TRUE(queue2.empty());
+
+    queue2.push("d");
+    queue1.append(queue2);
+    EXPECT_EQ(strings { "d" }, drain(queue2));
+
+    // copy gets the default resource
+    pmr_queue<std::string> copy(queue1);
+    EXPECT_EQ(std::pmr::get_default_resource(), copy.get_allocator().resource());
+
+    // nodes of arena2 must not be used by other queues
+    arena2.release();
+
+    // move keeps own resource of the target
+    pmr_queue<std::string> moved(&arena2);
+    moved = std::move(copy);
+    EXPECT_EQ(&arena2, moved.get_allocator().resource());
+
+    EXPECT_EQ((strings { "c", "a", "b", "d" }), drain(queue1));
+    EXPECT_EQ((strings { "c", "a", "b", "d" }), drain(moved));
+}
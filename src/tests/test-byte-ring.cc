@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/byte-ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+namespace {
+
+template <typename Ring>
+bool push(Ring &ring, const std::string &message)
+{
+    auto span = ring.reserve(message.size());
+    if(!span)
+        return false;
+    std::memcpy(span.data(), message.data(), message.size());
+    ring.commit(span);
+    return true;
+}
+
+template <typename Ring>
+std::string pull(Ring &ring)
+{
+    auto span = ring.try_pull();
+    std::string message(span.data(), span.size());
+    if(span)
+        ring.release(span);
+    return message;
+}
+
+} // namespace
+
+TEST(ByteRing, Framing)
+{
+    byte_ring<> ring(100);
+    EXPECT_EQ(128u, ring.capacity());
+    EXPECT_EQ(48u, ring.max_message());
+    EXPECT_TRUE(ring.empty());
+    EXPECT_THROW(ring.try_reserve(49), std::length_error);
+
+    EXPECT_TRUE(push(ring, "first"));
+    EXPECT_TRUE(push(ring, ""));
+    EXPECT_TRUE(push(ring, "third message"));
+    EXPECT_FALSE(ring.empty());
+
+    EXPECT_EQ("first", pull(ring));
+    EXPECT_EQ("", pull(ring));
+    EXPECT_EQ("third message", pull(ring));
+    EXPECT_TRUE(ring.empty());
+    EXPECT_FALSE(ring.try_pull());
+}
+
+TEST(ByteRing, CommitInOrder)
+{
+    byte_ring<> ring(128);
+    auto first = ring.try_reserve(8);
+    auto second = ring.try_reserve(4);
+    ASSERT_TRUE(first);
+    ASSERT_TRUE(second);
+
+    std::memcpy(second.data(), "next", 4);
+    ring.commit(second);
+    EXPECT_FALSE(ring.try_pull());
+
+    std::memcpy(first.data(), "partial", 7);
+    ring.commit(first, 7);
+    EXPECT_FALSE(first);
+    EXPECT_EQ("partial", pull(ring));
+    EXPECT_EQ("next", pull(ring));
+}
+
+TEST(ByteRing, Wraparound)
+{
+    byte_ring<> ring(128);
+    const std::string message(40, 'x');
+
+    // frames of 48 and 64 bytes, so every other one is padded
+    for(int i = 0; i < 20; ++i) {
+        const std::string m = message.substr(0, i % 2 ? 40 : 20);
+        ASSERT_TRUE(push(ring, m));
+        ASSERT_EQ(m, pull(ring));
+    }
+
+    // 16 bytes of padding, 64 and 48 bytes of messages
+    auto span = ring.try_reserve(40);
+    ASSERT_TRUE(span);
+    ring.commit(span);
+    span = ring.try_reserve(20);
+    ASSERT_TRUE(span);
+    ring.commit(span);
+    EXPECT_FALSE(ring.try_reserve(1));
+
+    EXPECT_EQ(40u, pull(ring).size());
+    EXPECT_TRUE(ring.try_reserve(20));
+}
+
+TEST(ByteRing, OutOfOrderRelease)
+{
+    byte_ring<> ring(128);
+    ASSERT_TRUE(push(ring, std::string(40, 'a')));
+    ASSERT_TRUE(push(ring, std::string(40, 'b')));
+
+    auto a = ring.try_pull();
+    auto b = ring.try_pull();
+    ASSERT_TRUE(a && b);
+    EXPECT_EQ('b', b.data()[39]);
+
+    ring.release(b);
+    EXPECT_FALSE(ring.try_reserve(1));
+    ring.release(a);
+    EXPECT_TRUE(ring.try_reserve(40));
+}
+
+TEST(ByteRing, Close)
+{
+    byte_ring<> ring(128);
+    ASSERT_TRUE(push(ring, "left"));
+
+    auto span = ring.reserve(48);
+    EXPECT_TRUE(span);
+    std::thread waiter([&]() { EXPECT_FALSE(ring.reserve(48)); });
+    ring.close();
+    waiter.join();
+
+    EXPECT_TRUE(ring.closed());
+    EXPECT_FALSE(ring.try_reserve(1));
+    auto left = ring.wait_pull();
+    EXPECT_EQ("left", std::string(left.data(), left.size()));
+    ring.release(left);
+    EXPECT_FALSE(ring.wait_pull());
+}
+
+TEST(ByteRing, Threads)
+{
+    constexpr int producers = 4, consumers = 4, count = 20000;
+    byte_ring<> ring(4096);
+    std::atomic<int> received { 0 }, corrupted { 0 };
+
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+        threads.emplace_back([&, p]() {
+            for(int i = 0; i < count; ++i) {
+                const std::string message(i % 200, char('a' + p));
+                ASSERT_TRUE(push(ring, message + std::to_string(i)));
+            }
+        });
+    for(int c = 0; c < consumers; ++c)
+        threads.emplace_back([&]() {
+            while(auto span = ring.wait_pull()) {
+                const std::string message(span.data(), span.size());
+                ring.release(span);
+
+                const std::size_t digits = message.find_first_of("0123456789");
+                const int i = std::stoi(message.substr(digits));
+                if(digits != std::size_t(i % 200)
+                        || std::count(message.begin(), message.begin() + digits,
+                            message[0]) != std::ptrdiff_t(digits))
+                    ++corrupted;
+                ++received;
+            }
+        });
+
+    for(int p = 0; p < producers; ++p)
+        threads[p].join();
+    ring.close();
+    for(int c = 0; c < consumers; ++c)
+        threads[producers + c].join();
+
+    EXPECT_EQ(producers * count, received);
+    EXPECT_EQ(0, corrupted);
+}
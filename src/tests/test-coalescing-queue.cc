@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/coalescing-queue.h"
+
+#include <future>
+#include <map>
+#include <string>
+
+using namespace concurrent_utils;
+
+TEST(CoalescingQueue, Coalesce)
+{
+    coalescing_queue<std::string, int, std::mutex, std::hash<std::string>,
+        std::equal_to<std::string>, std::allocator<std::pair<std::string, int>>,
+        queue_metrics> queue;
+    std::pair<std::string, int> item;
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pull(item));
+
+    ASSERT_TRUE(queue.push("a", 1));
+    ASSERT_TRUE(queue.push("b", 2));
+    ASSERT_TRUE(queue.push("a", 3));
+    ASSERT_TRUE(queue.push("c", 4));
+    ASSERT_TRUE(queue.push("b", 5));
+    EXPECT_EQ(3u, queue.size());
+    EXPECT_EQ(2u, queue.coalesced());
+
+    // keys keep their first positions
+    ASSERT_TRUE(queue.pull(item));
+    EXPECT_EQ(std::make_pair(std::string("a"), 3), item);
+
+    // pulled key is new again
+    ASSERT_TRUE(queue.push("a", 6));
+    ASSERT_TRUE(queue.pull(item));
+    EXPECT_EQ(std::make_pair(std::string("b"), 5), item);
+    ASSERT_TRUE(queue.pull(item));
+    EXPECT_EQ(std::make_pair(std::string("c"), 4), item);
+    ASSERT_TRUE(queue.pull(item));
+    EXPECT_EQ(std::make_pair(std::string("a"), 6), item);
+    EXPECT_FALSE(queue.pull(item));
+
+    const auto stats = queue.stats();
+    EXPECT_EQ(4u, stats.pushes);
+    EXPECT_EQ(4u, stats.pulls);
+    EXPECT_EQ(0u, stats.depth);
+
+    queue.close();
+    EXPECT_FALSE(queue.push("d", 7));
+    EXPECT_FALSE(queue.wait_pull(item));
+}
+
+TEST(CoalescingQueue, ManyKeys)
+{
+    coalescing_queue<int, int, std::mutex> queue;
+    constexpr int num_keys = 10000;
+    queue.reserve(num_keys / 2);
+
+    // grows the table and reuses slots
+    for(int round = 0; round < 3; ++round) {
+        for(int i = 0; i < num_keys; ++i)
+            ASSERT_TRUE(queue.push(i, i + round));
+        for(int i = 0; i < num_keys; i += 2)
+            ASSERT_TRUE(queue.push(i, -i));
+        EXPECT_EQ(std::size_t(num_keys), queue.size());
+
+        std::pair<int, int> item;
+        for(int i = 0; i < num_keys; ++i) {
+            ASSERT_TRUE(queue.pull(item));
+            EXPECT_EQ(i, item.first);
+            EXPECT_EQ(i % 2 ? i + round : -i, item.second);
+
+            // erased keys leave no holes breaking the lookup,
+            // so the following key is coalesced
+            const int next = i + 1;
+            if(i % 3 == 0 && next < num_keys) {
+                ASSERT_TRUE(queue.push(next, next % 2 ? next + round : -next));
+            }
+        }
+        EXPECT_TRUE(queue.empty());
+    }
+}
+
+TEST(CoalescingQueue, Concurrent)
+{
+    coalescing_queue<int, int, std::mutex> queue;
+    constexpr int num_keys = 64, num_updates = 100000;
+
+    auto producer = std::async(std::launch::async, [&] {
+        for(int i = 0; i < num_updates; ++i)
+            queue.push(i % num_keys, i);
+        queue.close();
+    });
+
+    std::map<int, int> latest;
+    std::pair<int, int> item;
+    while(queue.wait_pull(item)) {
+        // values of a key only grow
+        EXPECT_LT(latest[item.first], item.second + 1);
+        latest[item.first] = item.second;
+    }
+    while(queue.pull(item))
+        latest[item.first] = item.second;
+    producer.get();
+
+    ASSERT_EQ(std::size_t(num_keys), latest.size());
+    for(int k = 0; k < num_keys; ++k)
+        EXPECT_EQ((num_updates - 1 - k) / num_keys * num_keys + k, latest[k]);
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/concurrent-hash-map.h"
+
+#include <atomic>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+TEST(ConcurrentHashMap, InsertFindErase)
+{
+    concurrent_hash_map<std::string, int> map(4);
+    EXPECT_EQ(4u, map.stripes());
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains("1"));
+
+    EXPECT_TRUE(map.emplace("1", 1));
+    EXPECT_FALSE(map.emplace("1", 2));
+    EXPECT_TRUE(map.insert({ "2", 2 }));
+    EXPECT_EQ(2u, map.size());
+
+    int val = 0;
+    EXPECT_TRUE(map.find("1", val));
+    EXPECT_EQ(1, val);
+    EXPECT_FALSE(map.find("3", val));
+    EXPECT_EQ(2, map.find("2").value());
+    EXPECT_FALSE(map.find("3"));
+
+    EXPECT_FALSE(map.insert_or_assign("1", 10));
+    EXPECT_TRUE(map.insert_or_assign("3", 3));
+    EXPECT_EQ(10, map.find("1").value());
+
+    EXPECT_FALSE(map.upsert("1", [](int &v) { ++v; }, 0));
+    EXPECT_TRUE(map.upsert("4", [](int &v) { ++v; }, 4));
+    EXPECT_EQ(11, map.find("1").value());
+    EXPECT_EQ(4, map.find("4").value());
+
+    EXPECT_TRUE(map.visit("2", [](int &v) { v *= 10; }));
+    EXPECT_FALSE(map.visit("5", [](int&) { }));
+    EXPECT_EQ(20, map.find("2").value());
+
+    EXPECT_TRUE(map.erase("1"));
+    EXPECT_FALSE(map.erase("1"));
+    EXPECT_FALSE(map.contains("1"));
+    EXPECT_EQ(3u, map.size());
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains("2"));
+}
+
+TEST(ConcurrentHashMap, Growth)
+{
+    concurrent_hash_map<int, std::string> map(2);
+    const std::size_t buckets = map.bucket_count();
+
+    for(int i = 0; i < 10000; ++i)
+        ASSERT_TRUE(map.emplace(i, std::to_string(i)));
+    EXPECT_EQ(10000u, map.size());
+    EXPECT_LT(buckets, map.bucket_count());
+
+    // moves of groups interleave with erasures and lookups
+    for(int i = 0; i < 10000; i += 2)
+        ASSERT_TRUE(map.erase(i));
+    for(int i = 0; i < 10000; ++i)
+        ASSERT_EQ(i % 2 != 0, map.contains(i));
+
+    std::map<int, std::string> copy;
+    map.for_each([&](const std::pair<const int, std::string> &p) {
+        copy.insert(p);
+    });
+    ASSERT_EQ(5000u, copy.size());
+    for(auto &p : copy)
+        EXPECT_EQ(std::to_string(p.first), p.second);
+
+    map.reserve(100000);
+    EXPECT_LE(100000u, map.bucket_count() * 7 * 3 / 4);
+    EXPECT_EQ(5000u, map.size());
+    EXPECT_EQ("9999", map.find(9999).value());
+}
+
+TEST(ConcurrentHashMap, EqualHashes)
+{
+    struct same_hash
+    {
+        std::size_t operator()(int) const noexcept { return 42; }
+    };
+
+    concurrent_hash_map<int, int, same_hash> map(2);
+    for(int i = 0; i < 28; ++i)
+        ASSERT_TRUE(map.emplace(i, i));
+    const std::size_t buckets = map.bucket_count();
+
+    // no resize can separate these keys
+    EXPECT_THROW(map.emplace(28, 28), std::length_error);
+    EXPECT_EQ(buckets, map.bucket_count());
+    EXPECT_EQ(28u, map.size());
+    EXPECT_FALSE(map.contains(28));
+
+    // present keys are still updated
+    EXPECT_FALSE(map.insert_or_assign(27, 0));
+    EXPECT_EQ(0, map.find(27).value());
+    ASSERT_TRUE(map.erase(0));
+    EXPECT_TRUE(map.emplace(28, 28));
+}
+
+namespace {
+
+// Counts bytes held by its users
+struct counting_resource : std::pmr::memory_resource
+{
+    std::size_t bytes = 0;
+
+    void *do_allocate(std::size_t n, std::size_t align) override
+    {
+        void *p = std::pmr::new_delete_resource()->allocate(n, align);
+        bytes += n;
+        return p;
+    }
+
+    void do_deallocate(void *p, std::size_t n, std::size_t align) override
+    {
+        bytes -= n;
+        std::pmr::new_delete_resource()->deallocate(p, n, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    { return this == &other; }
+};
+
+} // namespace
+
+TEST(ConcurrentHashMap, ThrowingCallback)
+{
+    using map_type = concurrent_hash_map<int, int, std::hash<int>, spinlock,
+        std::equal_to<int>, std::pmr::polymorphic_allocator<std::pair<const int, int>>>;
+    counting_resource res1, res2;
+    map_type map1(2, {}, {}, &res1), map2(2, {}, {}, &res2);
+
+    // stops right after the table doubles
+    int n = 0;
+    for(const std::size_t buckets = map1.bucket_count();
+        buckets == map1.bucket_count(); ++n) {
+        ASSERT_TRUE(map1.emplace(n, n));
+        ASSERT_TRUE(map2.emplace(n, n));
+    }
+
+    // the old table is freed by the lookup moving its last group,
+    // even if the callback throws
+    for(int i = 0; i < n; ++i) {
+        EXPECT_TRUE(map1.visit(i, [](int &) { }));
+        EXPECT_ANY_THROW(map2.visit(i, [](int &) { throw 1; }));
+    }
+    EXPECT_EQ(res1.bytes, res2.bytes);
+    EXPECT_ANY_THROW(map2.upsert(0, [](int &) { throw 1; }, 0));
+    EXPECT_EQ(0, map2.find(0).value());
+}
+
+TEST(ConcurrentHashMap, VisitPair)
+{
+    concurrent_hash_map<int, int> map(8);
+    for(int i = 0; i < 100; ++i)
+        map.emplace(i, 100);
+
+    EXPECT_FALSE(map.visit_pair(1, 1000, [](int&, int&) { }));
+    EXPECT_TRUE(map.visit_pair(5, 5, [](int &a, int &b) {
+        EXPECT_EQ(&a, &b);
+    }));
+
+    // transfers between random accounts keep the total
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t)
+        threads.emplace_back([&map, t]() {
+            unsigned seed = t;
+            for(int i = 0; i < 10000; ++i) {
+                seed = seed * 1103515245 + 12345;
+                const int from = (seed >> 8) % 100, to = (seed >> 16) % 100;
+                map.visit_pair(from, to, [](int &a, int &b) {
+                    if(&a != &b && a) { --a; ++b; }
+                });
+            }
+        });
+    for(auto &th : threads)
+        th.join();
+
+    int total = 0;
+    map.for_each([&](const std::pair<const int, int> &p) { total += p.second; });
+    EXPECT_EQ(10000, total);
+}
+
+template <typename Lock>
+static void concurrent_inserts()
+{
+    concurrent_hash_map<int, int, std::hash<int>, Lock> map(4);
+    std::atomic<int> inserted { 0 }, erased { 0 };
+
+    // overlapping ranges race for the same keys while the table grows
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t)
+        threads.emplace_back([&map, &inserted, &erased, t]() {
+            for(int i = t * 5000; i < t * 5000 + 10000; ++i) {
+                if(map.emplace(i, i))
+                    ++inserted;
+                if(map.upsert(i, [](int &v) { ++v; }, i + 1))
+                    ++inserted;
+                if(i % 3 == 0 && map.erase(i - 1000))
+                    ++erased;
+            }
+        });
+    for(auto &th : threads)
+        th.join();
+
+    EXPECT_LE(25000, inserted);
+    std::size_t count = 0;
+    map.for_each([&](const std::pair<const int, int>&) { ++count; });
+    EXPECT_EQ(std::size_t(inserted - erased), count);
+    EXPECT_EQ(count, map.size());
+    for(int i = 24000; i < 25000; ++i)
+        EXPECT_EQ(i + 1, map.find(i).value_or(-1));
+}
+
+TEST(ConcurrentHashMap, ConcurrentInserts)
+{
+    concurrent_inserts<spinlock>();
+    concurrent_inserts<std::mutex>();
+}
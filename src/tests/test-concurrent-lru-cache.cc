@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/concurrent-lru-cache.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+TEST(ConcurrentLruCache, FindInsertErase)
+{
+    concurrent_lru_cache<std::string, int> cache(100, 3);
+    EXPECT_EQ(4u, cache.shards());
+    EXPECT_EQ(100u, cache.capacity());
+    EXPECT_TRUE(cache.empty());
+
+    int val = 0;
+    EXPECT_FALSE(cache.find("1", val));
+    EXPECT_TRUE(cache.emplace("1", 1));
+    EXPECT_FALSE(cache.emplace("1", 2));
+    EXPECT_TRUE(cache.find("1", val));
+    EXPECT_EQ(1, val);
+
+    EXPECT_TRUE(cache.insert_or_assign("1", 10));
+    EXPECT_TRUE(cache.insert_or_assign("2", 2));
+    EXPECT_EQ(10, cache.find("1").value());
+    EXPECT_FALSE(cache.find("3"));
+    EXPECT_TRUE(cache.contains("2"));
+    EXPECT_EQ(2u, cache.size());
+
+    EXPECT_TRUE(cache.erase("1"));
+    EXPECT_FALSE(cache.erase("1"));
+    EXPECT_EQ(1u, cache.size());
+
+    cache_stats st = cache.stats();
+    EXPECT_EQ(2u, st.hits);
+    EXPECT_EQ(2u, st.misses);
+    EXPECT_EQ(2u, st.inserts);
+    EXPECT_EQ(0u, st.evictions);
+    EXPECT_EQ(1u, st.size);
+    EXPECT_EQ(1u, st.weight);
+    EXPECT_DOUBLE_EQ(0.5, st.hit_ratio());
+
+    cache.clear();
+    EXPECT_TRUE(cache.empty());
+    EXPECT_FALSE(cache.contains("2"));
+}
+
+TEST(ConcurrentLruCache, Clock)
+{
+    concurrent_lru_cache<int, int> cache(4, 1);
+    for(int i = 0; i < 4; ++i)
+        cache.emplace(i, i);
+
+    // referenced entries get a second chance
+    EXPECT_TRUE(cache.find(0));
+    EXPECT_TRUE(cache.find(2));
+    EXPECT_TRUE(cache.emplace(4, 4));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_TRUE(cache.emplace(5, 5));
+    EXPECT_FALSE(cache.contains(3));
+    EXPECT_TRUE(cache.contains(0));
+    EXPECT_TRUE(cache.contains(2));
+
+    // bits have been cleared by the hand
+    EXPECT_TRUE(cache.emplace(6, 6));
+    EXPECT_FALSE(cache.contains(0));
+    EXPECT_EQ(4u, cache.size());
+    EXPECT_EQ(3u, cache.stats().evictions);
+}
+
+namespace {
+
+struct length_weigher
+{
+    std::size_t operator()(int, const std::string &s) const noexcept
+    { return s.size(); }
+};
+
+} // namespace
+
+TEST(ConcurrentLruCache, Weight)
+{
+    concurrent_lru_cache<int, std::string, std::hash<int>, std::mutex,
+                         length_weigher> cache(10, 1);
+
+    EXPECT_TRUE(cache.emplace(1, "aaaa"));
+    EXPECT_TRUE(cache.emplace(2, "bbbb"));
+    EXPECT_EQ(8u, cache.weight());
+    EXPECT_FALSE(cache.emplace(3, "ccccccccccc"));
+    EXPECT_FALSE(cache.contains(3));
+
+    EXPECT_TRUE(cache.emplace(3, "cccc"));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(8u, cache.weight());
+
+    EXPECT_TRUE(cache.insert_or_assign(2, "bbbbbbbb"));
+    EXPECT_FALSE(cache.contains(3));
+    EXPECT_EQ(8u, cache.weight());
+    EXPECT_EQ(1u, cache.size());
+
+    EXPECT_FALSE(cache.insert_or_assign(2, "bbbbbbbbbbbb"));
+    EXPECT_TRUE(cache.empty());
+    EXPECT_EQ(0u, cache.weight());
+}
+
+TEST(ConcurrentLruCache, Concurrent)
+{
+    concurrent_lru_cache<int, int> cache(256, 8);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t)
+        threads.emplace_back([&cache, t]() {
+            unsigned seed = t;
+            for(int i = 0; i < 20000; ++i) {
+                seed = seed * 1103515245 + 12345;
+                const int key = (seed >> 8) % 1024;
+                if(auto v = cache.find(key))
+                    ASSERT_EQ(key * 2, *v);
+                else if(i % 5)
+                    cache.emplace(key, key * 2);
+                else
+                    cache.erase(key);
+            }
+        });
+    for(auto &th : threads)
+        th.join();
+
+    cache_stats st = cache.stats();
+    EXPECT_EQ(80000u, st.hits + st.misses);
+    EXPECT_LE(st.size, 256u);
+    EXPECT_EQ(st.size, st.weight);
+    EXPECT_EQ(st.size, cache.size());
+}
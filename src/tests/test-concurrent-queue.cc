@@ -30,6 +30,10 @@
 #include "../concurrent-utils/concurrent-queue.h"
 #include "mock-types.h"
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 using namespace concurrent_utils;
 
 TEST(ConcurrentQueue, CtorAndDtor)
@@ -1203,3 +1207,466 @@ TEST(ConcurrentQueue, WaitPullRelaTime)
         EXPECT_EQ(idx, res);
     }
 }
+
+template <typename Lock>
+void try_push_pull_until_test()
+{
+    using namespace std::chrono;
+    concurrent_queue<std::size_t, Lock> queue;
+    std::size_t res = 0;
+
+    EXPECT_TRUE(queue.try_push_for(milliseconds(10), 1));
+    EXPECT_TRUE(queue.try_pull_until(steady_clock::now() + milliseconds(10), res));
+    EXPECT_EQ(1u, res);
+
+    // empty queue: waits for data until the deadline
+    auto start = steady_clock::now();
+    EXPECT_FALSE(queue.try_pull_for(milliseconds(20), res));
+    EXPECT_GE(steady_clock::now() - start, milliseconds(20));
+    EXPECT_FALSE(queue.try_pull_for(milliseconds(1)));
+
+    // busy lock: the deadline bounds the acquisition
+    queue.underlying_lock().lock();
+    std::thread([&]() {
+        auto start = steady_clock::now();
+        EXPECT_FALSE(queue.try_push_for(milliseconds(20), 2));
+        EXPECT_FALSE(queue.try_pull_until(system_clock::now() + milliseconds(20), res));
+        EXPECT_GE(steady_clock::now() - start, milliseconds(40));
+    }).join();
+    queue.underlying_lock().unlock();
+    EXPECT_TRUE(queue.empty());
+
+    EXPECT_TRUE(queue.try_push_until(steady_clock::now() + milliseconds(10), 3));
+    EXPECT_EQ(3u, queue.try_pull_for(milliseconds(10)).value_or(0));
+
+    queue.close();
+    EXPECT_FALSE(queue.try_push_for(milliseconds(10), 4));
+    EXPECT_FALSE(queue.try_pull_for(milliseconds(10), res));
+}
+
+TEST(ConcurrentQueue, TryPushPullUntil)
+{
+    static_assert(is_timed_lockable<spinlock>::value, "");
+    static_assert(is_timed_lockable<std::timed_mutex>::value, "");
+    static_assert(!is_timed_lockable<std::mutex>::value, "");
+    static_assert(!is_timed_lockable<dummy_mutex>::value, "");
+
+    try_push_pull_until_test<spinlock>();
+    try_push_pull_until_test<std::timed_mutex>();
+    try_push_pull_until_test<std::mutex>(); // polls try_lock()
+
+    concurrent_queue<std::size_t, spinlock, std::allocator<std::size_t>,
+        queue_metrics> queue;
+    EXPECT_TRUE(queue.try_push_for(std::chrono::milliseconds(10), 1));
+    EXPECT_EQ(1u, queue.try_pull_for(std::chrono::milliseconds(10)).value_or(0));
+    EXPECT_EQ(1u, queue.stats().pushes);
+    EXPECT_EQ(1u, queue.stats().pulls);
+}
+
+TEST(ConcurrentQueue, TryPullUntilWakeup)
+{
+    concurrent_queue<std::size_t, spinlock> queue;
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.push(5);
+    });
+
+    std::size_t res = 0;
+    EXPECT_TRUE(queue.try_pull_for(std::chrono::seconds(5), res));
+    EXPECT_EQ(5u, res);
+    producer.join();
+}
+
+TEST(ConcurrentQueue, Metrics)
+{
+    concurrent_queue<std::size_t, std::mutex, std::allocator<std::size_t>,
+        queue_metrics> queue, queue2;
+
+    queue_stats stats = queue.stats();
+    EXPECT_EQ(0u, stats.pushes);
+    EXPECT_EQ(0u, stats.pulls);
+    EXPECT_EQ(0u, stats.depth);
+
+    std::size_t res = 0;
+    for(std::size_t i = 0; i < 3; ++i)
+        ASSERT_TRUE(queue.push(i));
+    ASSERT_TRUE(queue.pull(res));
+
+    stats = queue.stats();
+    EXPECT_EQ(3u, stats.pushes);
+    EXPECT_EQ(1u, stats.pulls);
+    EXPECT_EQ(2u, stats.depth);
+    EXPECT_EQ(3u, stats.peak_depth);
+
+    queue.swap(queue2);
+    EXPECT_EQ(0u, queue.stats().depth);
+    EXPECT_EQ(2u, queue2.stats().depth);
+    EXPECT_EQ(2u, queue2.stats().peak_depth);
+
+    EXPECT_FALSE(queue.wait_pull(std::chrono::milliseconds(10), res));
+    stats = queue.stats();
+    EXPECT_EQ(1u, stats.waits);
+    EXPECT_LE(std::chrono::milliseconds(10), stats.wait_time);
+    EXPECT_EQ(stats.wait_time, stats.max_wait_time);
+
+    // ready items are taken without blocking
+    ASSERT_TRUE(queue2.wait_pull(std::chrono::milliseconds(10), res));
+    ASSERT_TRUE(queue2.wait_pull(res));
+    EXPECT_EQ(0u, queue2.stats().waits);
+
+    queue.close();
+    EXPECT_FALSE(queue.push(1));
+    EXPECT_EQ(1u, queue.stats().closed_pushes);
+}
+
+TEST(ConcurrentQueue, PullWith)
+{
+    concurrent_queue<copyable_but_not_movable_t, std::mutex> queue;
+
+    bool visited = false;
+    EXPECT_FALSE(queue.pull_with([&](copyable_but_not_movable_t &) {
+        visited = true; }));
+    EXPECT_FALSE(visited);
+
+    for(int i = 0; i < 3; ++i)
+        ASSERT_TRUE(queue.push(i));
+
+    for(int i = 0; i < 3; ++i)
+        ASSERT_TRUE(queue.pull_with([&](copyable_but_not_movable_t &item) {
+            EXPECT_EQ(i, item.get());
+            // item is consumed in place
+            EXPECT_FALSE(item.was_copied());
+            EXPECT_FALSE(item.was_moved());
+        }));
+
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ConcurrentQueue, OptionalPull)
+{
+    concurrent_queue<not_copyable_but_movable_t, std::mutex> q1;
+    concurrent_queue<copyable_but_not_movable_t, std::mutex> q2;
+
+    EXPECT_FALSE(q1.try_pull());
+    EXPECT_FALSE(q2.try_pull());
+    EXPECT_FALSE(q1.wait_pull(std::chrono::milliseconds(1)));
+    EXPECT_FALSE(q2.wait_pull(std::chrono::steady_clock::now()));
+
+    for(int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q1.push(i));
+        ASSERT_TRUE(q2.push(i));
+    }
+
+    auto r1 = q1.try_pull();
+    ASSERT_TRUE(r1);
+    EXPECT_EQ(0, r1->get());
+    EXPECT_TRUE(r1->was_moved());
+
+    auto r2 = q2.try_pull();
+    ASSERT_TRUE(r2);
+    EXPECT_EQ(0, r2->get());
+    EXPECT_TRUE(r2->was_copied());
+
+    r1 = q1.wait_pull();
+    ASSERT_TRUE(r1);
+    EXPECT_EQ(1, r1->get());
+
+    r1 = q1.wait_pull(std::chrono::milliseconds(1));
+    ASSERT_TRUE(r1);
+    EXPECT_EQ(2, r1->get());
+
+    r1 = q1.wait_pull(std::chrono::steady_clock::now());
+    ASSERT_TRUE(r1);
+    EXPECT_EQ(3, r1->get());
+
+    q2.close();
+    EXPECT_FALSE(q2.wait_pull());
+    EXPECT_TRUE(q2.try_pull());
+}
+
+TEST(ConcurrentQueue, PullAll)
+{
+    concurrent_queue<std::size_t, std::mutex, std::allocator<std::size_t>,
+        queue_metrics> queue;
+    constexpr std::size_t num_tests = 10000;
+
+    auto batch = queue.pull_all();
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(batch.begin(), batch.end());
+
+    for(std::size_t i = 0; i < num_tests; ++i)
+        ASSERT_TRUE(queue.push(i));
+
+    batch = queue.pull_all();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(batch.empty());
+    EXPECT_EQ(num_tests, batch.size());
+
+    std::size_t expected = 0;
+    for(std::size_t item : batch)
+        EXPECT_EQ(expected++, item);
+    EXPECT_EQ(num_tests, expected);
+
+    const auto stats = queue.stats();
+    EXPECT_EQ(num_tests, stats.pulls);
+    EXPECT_EQ(0u, stats.depth);
+
+    decltype(batch) batch2(std::move(batch));
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(num_tests, batch2.size());
+
+    const auto &cbatch = batch2;
+    auto it = cbatch.begin();
+    EXPECT_EQ(0u, *it++);
+    EXPECT_EQ(1u, *it);
+
+    // Queue is still usable after drain
+    ASSERT_TRUE(queue.push(1));
+    std::size_t res = 0;
+    ASSERT_TRUE(queue.pull(res));
+    EXPECT_EQ(1u, res);
+}
+
+TEST(ConcurrentQueue, ForEach)
+{
+    using strings = std::vector<std::string>;
+    concurrent_queue<std::string, std::mutex> queue;
+    strings seen;
+
+    queue.for_each([&](const std::string &s) { seen.push_back(s); });
+    EXPECT_TRUE(seen.empty());
+
+    for(const char *s : { "a", "b", "c", "d" })
+        queue.push(s);
+
+    // queue can be changed during the walk
+    std::string str;
+    queue.for_each([&](const std::string &s) {
+        seen.push_back(s);
+        if(s == "b") {
+            queue.push("e");
+            ASSERT_TRUE(queue.pull(str));
+            EXPECT_EQ("a", str);
+            ASSERT_TRUE(queue.pull(str));
+            EXPECT_EQ("b", str);
+            ASSERT_TRUE(queue.pull(str));
+            EXPECT_EQ("c", str);
+
+            // walks can nest
+            strings inner;
+            queue.for_each([&](const std::string &s) { inner.push_back(s); });
+            EXPECT_EQ((strings { "d", "e" }), inner);
+        }
+    });
+
+    // pulled items are skipped, pushed ones are not visited
+    EXPECT_EQ((strings { "a", "b", "d" }), seen);
+
+    seen.clear();
+    auto batch = queue.snapshot();
+    for(const std::string &s : batch)
+        seen.push_back(s);
+    EXPECT_EQ((strings { "d", "e" }), seen);
+
+    // taking all items finishes the walk
+    seen.clear();
+    queue.for_each([&](const std::string &s) {
+        seen.push_back(s);
+        auto batch = queue.pull_all();
+        EXPECT_EQ(2u, batch.size());
+        queue.push("f");
+    });
+    EXPECT_EQ((strings { "d" }), seen);
+    ASSERT_TRUE(queue.pull(str));
+    EXPECT_EQ("f", str);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ConcurrentQueue, ForEachBulk)
+{
+    using strings = std::vector<std::string>;
+    concurrent_queue<std::string, std::mutex> queue1, queue2;
+    for(const char *s : { "a", "b", "c" })
+        queue1.push(s);
+    queue2.push("x");
+
+    strings seen;
+    queue1.for_each([&](const std::string &s) {
+        if(s == "a") {
+            queue1.swap(queue2);
+            queue2.append(std::move(queue1));
+            queue1 = queue2;
+            queue2.clear();
+        }
+        seen.push_back(s);
+    });
+
+    // items moved away are not visited
+    EXPECT_EQ((strings { "a" }), seen);
+
+    seen.clear();
+    queue1.for_each([&](const std::string &s) { seen.push_back(s); });
+    EXPECT_EQ((strings { "a", "b", "c", "x" }), seen);
+    EXPECT_TRUE(queue2.empty());
+}
+
+TEST(ConcurrentQueue, ForEachThrowingCopy)
+{
+    using queue_type = concurrent_queue<throw_from_copying_t, std::mutex>;
+    queue_type queue1, queue2;
+    static_assert(noexcept(queue1.swap(queue2)), "walks do not affect swap");
+    static_assert(noexcept(queue1.clear()), "walks do not affect clear");
+    static_assert(std::is_nothrow_move_constructible<queue_type>::value,
+                  "walks do not affect moving");
+
+    queue1.push(1);
+    queue1.push(2);
+
+    // the walk is left, if an item can not be copied
+    EXPECT_ANY_THROW(queue1.for_each([](const throw_from_copying_t &) { }));
+    queue1.swap(queue2);
+    EXPECT_TRUE(queue1.empty());
+    EXPECT_TRUE(queue2.pull_with([](throw_from_copying_t &) { }));
+    EXPECT_TRUE(queue2.pull_with([](throw_from_copying_t &) { }));
+    EXPECT_TRUE(queue2.empty());
+}
+
+TEST(ConcurrentQueue, ForEachPullWithoutCopying)
+{
+    using item_type = copyable_movable_t<>;
+    concurrent_queue<item_type, std::mutex> queue;
+    static_assert(noexcept(queue.clear()), "walks do not affect clear");
+    static_assert(std::is_nothrow_move_constructible<
+                  concurrent_queue<std::string, std::mutex>>::value,
+                  "walks do not affect moving");
+
+    for(int i = 1; i <= 4; ++i)
+        queue.push(i);
+
+    std::vector<int> seen;
+    queue.for_each([&](const item_type &t) {
+        EXPECT_TRUE(t.was_copied()); // the walk reads a copy
+        seen.push_back(t.get());
+        if(t.get() != 1)
+            return;
+
+        // consumers take the items themselves
+        EXPECT_TRUE(queue.pull_with([](item_type &t) {
+            EXPECT_EQ(1, t.get());
+            EXPECT_FALSE(t.was_copied());
+        }));
+        EXPECT_TRUE(queue.pull_with([](item_type &t) {
+            EXPECT_EQ(2, t.get());
+            EXPECT_FALSE(t.was_copied());
+        }));
+        auto batch = queue.pull_all();
+        ASSERT_EQ(2u, batch.size());
+        for(item_type &t : batch)
+            EXPECT_FALSE(t.was_copied());
+    });
+    EXPECT_EQ((std::vector<int> { 1 }), seen);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ConcurrentQueue, ForEachConcurrent)
+{
+    concurrent_queue<std::string, std::mutex> queue;
+    constexpr int num_items = 20000;
+    std::atomic_bool done { false };
+
+    auto producer = std::async(std::launch::async, [&] {
+        for(int i = 0; i < num_items; ++i)
+            queue.push(std::to_string(i));
+        queue.close();
+    });
+
+    auto consumer = std::async(std::launch::async, [&] {
+        int expected = 0;
+        std::string str;
+        while(queue.wait_pull(str))
+            EXPECT_EQ(std::to_string(expected++), str);
+        while(queue.pull(str))
+            EXPECT_EQ(std::to_string(expected++), str);
+        done = true;
+        return expected;
+    });
+
+    // each walk sees items in order, skipping ones pulled meanwhile
+    while(!done) {
+        int prev = -1;
+        queue.for_each([&](const std::string &s) {
+            const int cur = std::stoi(s);
+            EXPECT_LT(prev, cur);
+            prev = cur;
+        });
+
+        concurrent_queue<std::string, dummy_mutex> copy(queue);
+        std::string str;
+        prev = -1;
+        while(copy.pull(str)) {
+            const int cur = std::stoi(str);
+            EXPECT_LT(prev, cur);
+            prev = cur;
+        }
+    }
+
+    producer.get();
+    EXPECT_EQ(num_items, consumer.get());
+}
+
+template <typename Wait>
+class ConcurrentQueueWait : public ::testing::Test { };
+
+using wait_strategies = ::testing::Types<park_wait, spin_wait,
+    yield_wait<>, spin_park_wait<>, spin_park_wait<1>>;
+TYPED_TEST_SUITE(ConcurrentQueueWait, wait_strategies);
+
+TYPED_TEST(ConcurrentQueueWait, PushPull)
+{
+    using queue_type = concurrent_queue<int, std::mutex, std::allocator<int>,
+        no_queue_metrics, TypeParam>;
+    queue_type queue;
+    constexpr int num_items = 20000;
+
+    auto consumer = std::async(std::launch::async, [&] {
+        long sum = 0;
+        int val;
+        while(queue.wait_pull(val))
+            sum += val;
+        while(queue.pull(val))
+            sum += val;
+        return sum;
+    });
+
+    for(int i = 0; i < num_items; ++i) {
+        ASSERT_TRUE(queue.push(i));
+        if(i % 1000 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    queue.close();
+    EXPECT_EQ(long(num_items) * (num_items - 1) / 2, consumer.get());
+}
+
+TYPED_TEST(ConcurrentQueueWait, Timeouts)
+{
+    using queue_type = concurrent_queue<int, std::mutex, std::allocator<int>,
+        no_queue_metrics, TypeParam>;
+    queue_type queue;
+    int val = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.wait_pull(std::chrono::milliseconds(10), val));
+    EXPECT_FALSE(queue.wait_pull(std::chrono::system_clock::now()
+                                 + std::chrono::milliseconds(10), val));
+    EXPECT_LE(start + std::chrono::milliseconds(20), std::chrono::steady_clock::now());
+
+    auto waiter = std::async(std::launch::async, [&] {
+        return queue.wait_pull(std::chrono::seconds(10), val);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    start = std::chrono::steady_clock::now();
+    queue.close();
+    EXPECT_FALSE(waiter.get());
+    EXPECT_GT(start + std::chrono::seconds(5), std::chrono::steady_clock::now());
+    EXPECT_FALSE(queue.wait_pull());
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/concurrent-stack.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+TEST(ConcurrentStack, PushPull)
+{
+    concurrent_stack<std::string> stack;
+    EXPECT_TRUE(stack.empty());
+    EXPECT_FALSE(stack.closed());
+
+    std::string str;
+    EXPECT_FALSE(stack.pull(str));
+
+    EXPECT_TRUE(stack.push("1"));
+    EXPECT_TRUE(stack.push(std::string("2")));
+    EXPECT_TRUE(stack.push(3, '3'));
+    EXPECT_FALSE(stack.empty());
+
+    EXPECT_TRUE(stack.pull(str));
+    EXPECT_EQ("333", str);
+    EXPECT_EQ("2", stack.try_pull().value_or(""));
+    EXPECT_TRUE(stack.wait_pull(str));
+    EXPECT_EQ("1", str);
+    EXPECT_FALSE(stack.try_pull());
+    EXPECT_TRUE(stack.empty());
+}
+
+TEST(ConcurrentStack, MoveOnly)
+{
+    concurrent_stack<std::unique_ptr<int>> stack;
+    stack.reserve(4);
+    for(int i = 0; i < 8; ++i)
+        EXPECT_TRUE(stack.push(std::make_unique<int>(i)));
+
+    std::unique_ptr<int> p;
+    for(int i = 7; i >= 0; --i) {
+        ASSERT_TRUE(stack.pull(p));
+        EXPECT_EQ(i, *p);
+    }
+
+    // remaining items are freed by the destructor
+    stack.push(std::make_unique<int>(8));
+}
+
+TEST(ConcurrentStack, Close)
+{
+    concurrent_stack<int> stack;
+    EXPECT_TRUE(stack.push(1));
+
+    std::thread waiter([&]() {
+        int val;
+        EXPECT_TRUE(stack.wait_pull(val));
+        EXPECT_EQ(1, val);
+        EXPECT_FALSE(stack.wait_pull(val));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stack.close();
+    waiter.join();
+
+    EXPECT_TRUE(stack.closed());
+    EXPECT_FALSE(stack.push(2));
+    EXPECT_FALSE(stack.wait_pull());
+}
+
+TEST(ConcurrentStack, WaitPullTime)
+{
+    concurrent_stack<int> stack;
+    int val = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(stack.wait_pull(std::chrono::milliseconds(20), val));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        stack.push(5);
+    });
+    EXPECT_TRUE(stack.wait_pull(std::chrono::steady_clock::now()
+                                + std::chrono::seconds(5), val));
+    EXPECT_EQ(5, val);
+    producer.join();
+}
+
+TEST(ConcurrentStack, Multithreaded)
+{
+    const std::size_t threads = 4, per_thread = 50000;
+    concurrent_stack<std::size_t> stack;
+    std::atomic<std::size_t> sum { 0 }, producers_left { threads };
+    std::vector<std::thread> workers;
+
+    for(std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for(std::size_t i = 1; i <= per_thread; ++i)
+                stack.push(t * per_thread + i);
+            if(--producers_left == 0)
+                stack.close();
+        });
+        workers.emplace_back([&]() {
+            std::size_t val, local = 0;
+            while(stack.wait_pull(val))
+                local += val;
+            while(stack.pull(val))
+                local += val;
+            sum += local;
+        });
+    }
+    for(auto &w : workers)
+        w.join();
+
+    const std::size_t n = threads * per_thread;
+    EXPECT_EQ(n * (n + 1) / 2, sum.load());
+    EXPECT_TRUE(stack.empty());
+}
+
+TEST(ConcurrentStack, PushPullPairs)
+{
+    // pairs of operations on a contended stack meet in the elimination array
+    const std::size_t threads = 4, per_thread = 50000;
+    concurrent_stack<std::size_t> stack;
+    std::atomic<std::size_t> sum { 0 };
+    std::vector<std::thread> workers;
+
+    for(std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]() {
+            std::size_t val, local = 0;
+            for(std::size_t i = 1; i <= per_thread; ++i) {
+                stack.push(t * per_thread + i);
+                if(stack.pull(val)) local += val;
+            }
+            sum += local;
+        });
+    for(auto &w : workers)
+        w.join();
+
+    std::size_t val;
+    while(stack.pull(val))
+        sum += val;
+    const std::size_t n = threads * per_thread;
+    EXPECT_EQ(n * (n + 1) / 2, sum.load());
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/delay-queue.h"
+
+#include <future>
+#include <random>
+#include <string>
+
+using namespace concurrent_utils;
+using namespace std::chrono_literals;
+
+TEST(DelayQueue, Order)
+{
+    delay_queue<std::string, std::mutex> queue;
+    const auto now = std::chrono::steady_clock::now();
+    std::string str;
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.next_due());
+    EXPECT_FALSE(queue.pull(str));
+
+    ASSERT_TRUE(queue.push_at(now - 1ms, "b"));
+    ASSERT_TRUE(queue.push_at(now - 2ms, "a"));
+    ASSERT_TRUE(queue.push_at(now - 1ms, 1, 'c'));
+    ASSERT_TRUE(queue.push_after(1h, "later"));
+    EXPECT_EQ(4u, queue.size());
+    EXPECT_EQ(now - 2ms, *queue.next_due());
+
+    for(const char *s : { "a", "b", "c" }) {
+        ASSERT_TRUE(queue.pull(str));
+        EXPECT_EQ(s, str);
+    }
+
+    // not due yet
+    EXPECT_FALSE(queue.pull(str));
+    EXPECT_FALSE(queue.wait_pull(1ms, str));
+    EXPECT_EQ("c", str);
+    EXPECT_EQ(1u, queue.size());
+
+    queue.close();
+    EXPECT_TRUE(queue.closed());
+    EXPECT_FALSE(queue.push_after(0s, "d"));
+    EXPECT_FALSE(queue.wait_pull(str));
+}
+
+TEST(DelayQueue, Many)
+{
+    delay_queue<int, std::mutex> queue;
+    const auto now = std::chrono::steady_clock::now();
+    constexpr int num_items = 100000;
+    queue.reserve(num_items);
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<int> dist(1, 1000000);
+    for(int i = 0; i < num_items; ++i)
+        ASSERT_TRUE(queue.push_at(now - std::chrono::microseconds(dist(gen)), i));
+
+    auto prev = std::chrono::steady_clock::time_point::min();
+    int val;
+    for(int i = 0; i < num_items; ++i) {
+        const auto due = *queue.next_due();
+        EXPECT_LE(prev, due);
+        prev = due;
+        ASSERT_TRUE(queue.pull(val));
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(DelayQueue, WaitPull)
+{
+    delay_queue<int, std::mutex> queue;
+    int val = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(queue.push_after(20ms, 1));
+    ASSERT_TRUE(queue.wait_pull(val));
+    EXPECT_EQ(1, val);
+    EXPECT_LE(start + 20ms, std::chrono::steady_clock::now());
+
+    // timed waits stop at their deadlines
+    ASSERT_TRUE(queue.push_after(1h, 2));
+    start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.wait_pull(10ms, val));
+    EXPECT_FALSE(queue.wait_pull(std::chrono::system_clock::now() + 10ms, val));
+    EXPECT_LE(start + 20ms, std::chrono::steady_clock::now());
+    EXPECT_EQ(1, val);
+
+    // earlier item reschedules the waiting consumer
+    auto consumer = std::async(std::launch::async, [&] {
+        int res = 0;
+        EXPECT_TRUE(queue.wait_pull(res));
+        return res;
+    });
+    std::this_thread::sleep_for(10ms);
+    start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(queue.push_after(10ms, 3));
+    EXPECT_EQ(3, consumer.get());
+    EXPECT_GT(start + 1s, std::chrono::steady_clock::now());
+
+    // closing wakes waiters
+    auto waiter = std::async(std::launch::async, [&] {
+        int res = 0;
+        return queue.wait_pull(res);
+    });
+    std::this_thread::sleep_for(10ms);
+    queue.close();
+    EXPECT_FALSE(waiter.get());
+}
+
+TEST(DelayQueue, WaitStats)
+{
+    delay_queue<int, std::mutex, std::chrono::steady_clock,
+                std::allocator<int>, queue_metrics> queue;
+    int val = 0;
+
+    // due items are taken without blocking
+    ASSERT_TRUE(queue.push_after(0ms, 1));
+    ASSERT_TRUE(queue.wait_pull(val));
+    ASSERT_TRUE(queue.push_after(0ms, 2));
+    ASSERT_TRUE(queue.wait_pull(10ms, val));
+    EXPECT_EQ(2, val);
+    EXPECT_EQ(0u, queue.stats().waits);
+
+    // expired deadline is not a wait
+    ASSERT_TRUE(queue.push_after(1h, 3));
+    EXPECT_FALSE(queue.wait_pull(std::chrono::steady_clock::now() - 1ms, val));
+    EXPECT_EQ(0u, queue.stats().waits);
+
+    EXPECT_FALSE(queue.wait_pull(10ms, val));
+    auto stats = queue.stats();
+    EXPECT_EQ(1u, stats.waits);
+    EXPECT_LE(10ms, stats.wait_time);
+
+    queue.close();
+    EXPECT_FALSE(queue.wait_pull(val));
+    EXPECT_EQ(1u, queue.stats().waits);
+}
+
+TEST(DelayQueue, Concurrent)
+{
+    delay_queue<int, std::mutex> queue;
+    constexpr int num_items = 1000;
+
+    auto consume = [&] {
+        int count = 0, val;
+        while(queue.wait_pull(val)) {
+            if(val < 0)
+                break;
+            ++count;
+        }
+        return count;
+    };
+    auto c1 = std::async(std::launch::async, consume);
+    auto c2 = std::async(std::launch::async, consume);
+
+    for(int i = 0; i < num_items; ++i)
+        ASSERT_TRUE(queue.push_after(std::chrono::microseconds(i % 100), i));
+    ASSERT_TRUE(queue.push_after(5ms, -1));
+    ASSERT_TRUE(queue.push_after(5ms, -1));
+
+    EXPECT_EQ(num_items, c1.get() + c2.get());
+    EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/intrusive-queue.h"
+
+#include <future>
+#include <vector>
+
+using namespace concurrent_utils;
+
+namespace {
+
+struct message
+{
+    message *next = (message *) 0x1;
+    std::size_t value;
+
+    explicit message(std::size_t v = 0) : value(v) { }
+};
+
+using queue_type = intrusive_concurrent_queue<message, &message::next, std::mutex>;
+
+} // anonymous namespace
+
+TEST(IntrusiveQueue, PushPull)
+{
+    queue_type queue;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.closed());
+
+    message m1(1), m2(2), m3(3);
+    message *ret = nullptr;
+    EXPECT_FALSE(queue.pull(ret));
+    EXPECT_EQ(nullptr, ret);
+
+    ASSERT_TRUE(queue.push(&m1));
+    ASSERT_TRUE(queue.push(&m2));
+    ASSERT_TRUE(queue.push(&m3));
+    EXPECT_FALSE(queue.empty());
+
+    ASSERT_TRUE(queue.pull(ret));
+    EXPECT_EQ(&m1, ret);
+    EXPECT_EQ(nullptr, m1.next);
+
+    ASSERT_TRUE(queue.wait_pull(ret));
+    EXPECT_EQ(&m2, ret);
+
+    ASSERT_TRUE(queue.wait_pull(std::chrono::milliseconds(1), ret));
+    EXPECT_EQ(&m3, ret);
+    EXPECT_TRUE(queue.empty());
+
+    EXPECT_FALSE(queue.wait_pull(std::chrono::milliseconds(1), ret));
+    EXPECT_FALSE(queue.wait_pull(std::chrono::steady_clock::now(), ret));
+    EXPECT_EQ(&m3, ret);
+
+    // Objects can be linked again after unlinking
+    ASSERT_TRUE(queue.push(&m3));
+    ASSERT_TRUE(queue.push(&m1));
+    message *first = queue.pull_all();
+    EXPECT_TRUE(queue.empty());
+    ASSERT_EQ(&m3, first);
+    EXPECT_EQ(&m1, first->next);
+    EXPECT_EQ(nullptr, m1.next);
+
+    queue.close();
+    EXPECT_TRUE(queue.closed());
+    EXPECT_FALSE(queue.push(&m2));
+    EXPECT_FALSE(queue.wait_pull(ret));
+}
+
+TEST(IntrusiveQueue, Multithreaded)
+{
+    intrusive_concurrent_queue<message, &message::next, spinlock,
+        queue_metrics> queue;
+    constexpr std::size_t num_tests = 100000;
+    std::vector<message> pool(num_tests);
+
+    auto consumer_task = [&]() {
+        std::size_t sum = 0;
+        message *ret = nullptr;
+        while(queue.wait_pull(ret))
+            sum += ret->value;
+        while(queue.pull(ret))
+            sum += ret->value;
+        return sum;
+    };
+
+    auto future = std::async(std::launch::async, consumer_task);
+    for(std::size_t i = 0; i < num_tests; ++i) {
+        pool[i].value = i;
+        ASSERT_TRUE(queue.push(&pool[i]));
+    }
+    queue.close();
+
+    EXPECT_EQ(num_tests * (num_tests - 1) / 2, future.get());
+    EXPECT_EQ(num_tests, queue.stats().pushes);
+    EXPECT_EQ(num_tests, queue.stats().pulls);
+}
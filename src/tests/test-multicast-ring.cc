@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/multicast-ring.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace concurrent_utils;
+
+TEST(MulticastRing, Process)
+{
+    multicast_ring<std::string> ring(3);
+    EXPECT_EQ(4u, ring.capacity());
+    EXPECT_EQ(-1, ring.published());
+
+    auto &journal = ring.add_consumer();
+    auto &logic = ring.add_consumer({ &journal });
+    std::vector<std::string> seen;
+    auto collect = [&](const std::string &s) { seen.push_back(s); };
+
+    EXPECT_EQ(0u, journal.process(collect));
+    ASSERT_TRUE(ring.push("a"));
+    ASSERT_TRUE(ring.push(2, 'b'));
+    ASSERT_TRUE(ring.publish_with([](std::string &slot) { slot = "c"; }));
+    EXPECT_EQ(2, ring.published());
+
+    // logic depends on journal
+    EXPECT_EQ(0u, logic.process(collect));
+    EXPECT_EQ(3u, journal.process(collect));
+    EXPECT_EQ(2, journal.sequence());
+    EXPECT_EQ(3u, logic.process(collect));
+    EXPECT_EQ(2, logic.sequence());
+    EXPECT_EQ((std::vector<std::string> { "a", "bb", "c", "a", "bb", "c" }), seen);
+
+    ring.close();
+    EXPECT_TRUE(ring.closed());
+    EXPECT_FALSE(ring.push("d"));
+    EXPECT_EQ(0u, journal.wait_process(collect));
+    EXPECT_EQ(0u, logic.wait_process(collect));
+}
+
+TEST(MulticastRing, Concurrent)
+{
+    multicast_ring<std::int64_t> ring(64);
+    constexpr std::int64_t num_producers = 4, num_items = 20000;
+    constexpr std::int64_t total = num_producers * num_items;
+
+    auto &journal = ring.add_consumer();
+    auto &audit = ring.add_consumer();
+    auto &logic = ring.add_consumer({ &journal, &audit });
+
+    auto consume = [&](multicast_ring<std::int64_t>::consumer &c, bool check_deps) {
+        return std::async(std::launch::async, [&c, &journal, &audit, check_deps] {
+            std::int64_t sum = 0, count = 0;
+            while(c.wait_process([&](std::int64_t v) {
+                if(check_deps) {
+                    EXPECT_LE(count, journal.sequence());
+                    EXPECT_LE(count, audit.sequence());
+                }
+                sum += v;
+                ++count;
+            }));
+            EXPECT_EQ(count - 1, c.sequence());
+            return sum;
+        });
+    };
+
+    auto f1 = consume(journal, false);
+    auto f2 = consume(audit, false);
+    auto f3 = consume(logic, true);
+
+    std::vector<std::future<void>> producers;
+    for(std::int64_t p = 0; p < num_producers; ++p)
+        producers.push_back(std::async(std::launch::async, [&ring, p] {
+            for(std::int64_t i = 0; i < num_items; ++i)
+                ASSERT_TRUE(ring.push(p * num_items + i));
+        }));
+    for(auto &f : producers)
+        f.get();
+
+    EXPECT_EQ(total - 1, ring.published());
+    ring.close();
+
+    const std::int64_t expected = total * (total - 1) / 2;
+    EXPECT_EQ(expected, f1.get());
+    EXPECT_EQ(expected, f2.get());
+    EXPECT_EQ(expected, f3.get());
+}
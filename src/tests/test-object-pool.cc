@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/object-pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+namespace {
+
+struct counted
+{
+    static std::atomic<int> alive;
+    std::string data;
+
+    counted() { ++alive; }
+    ~counted() { --alive; }
+};
+
+std::atomic<int> counted::alive { 0 };
+
+struct buffer_hooks
+{
+    int *created;
+
+    void construct(void *place)
+    {
+        ++*created;
+        ::new(place) counted();
+        static_cast<counted*>(place)->data.reserve(64);
+    }
+
+    void reset(counted &obj) noexcept { obj.data.clear(); }
+};
+
+} // namespace
+
+TEST(ObjectPool, AcquireRelease)
+{
+    int created = 0;
+    {
+        object_pool<counted, buffer_hooks> pool(8, 4, buffer_hooks { &created });
+        EXPECT_EQ(4u, pool.magazine_size());
+        EXPECT_EQ(8u, pool.max_size());
+
+        counted *p = pool.acquire();
+        EXPECT_EQ(1, created);
+        EXPECT_LE(64u, p->data.capacity());
+        p->data = "used";
+        pool.release(p);
+
+        // the object comes back reset from the thread's cache
+        counted *q = pool.acquire();
+        EXPECT_EQ(p, q);
+        EXPECT_TRUE(q->data.empty());
+        EXPECT_EQ(1, created);
+        pool.release(q);
+    }
+    EXPECT_EQ(0, counted::alive);
+}
+
+TEST(ObjectPool, Depot)
+{
+    int created = 0;
+    {
+        object_pool<counted, buffer_hooks> pool(8, 4, buffer_hooks { &created });
+
+        // two magazines of the thread, two in the depot and the rest destroyed
+        std::vector<counted*> objs;
+        for(int i = 0; i < 20; ++i)
+            objs.push_back(pool.acquire());
+        EXPECT_EQ(20, created);
+        for(counted *p : objs)
+            pool.release(p);
+        EXPECT_EQ(16, counted::alive);
+
+        std::thread([&]() {
+            std::set<counted*> got;
+            for(int i = 0; i < 8; ++i)
+                got.insert(pool.acquire());
+            EXPECT_EQ(8u, got.size());
+            for(counted *p : got)
+                EXPECT_NE(objs.end(), std::find(objs.begin(), objs.end(), p));
+            EXPECT_EQ(20, created);
+            for(counted *p : got)
+                pool.release(p);
+        }).join();
+    }
+    EXPECT_EQ(0, counted::alive);
+}
+
+TEST(ObjectPool, Reserve)
+{
+    int created = 0;
+    {
+        object_pool<counted, buffer_hooks> pool(10, 4, buffer_hooks { &created });
+        pool.reserve(100);
+        EXPECT_EQ(8, created);
+
+        std::vector<counted*> objs;
+        for(int i = 0; i < 9; ++i)
+            objs.push_back(pool.acquire());
+        EXPECT_EQ(9, created);
+        for(counted *p : objs)
+            pool.release(p);
+    }
+    EXPECT_EQ(0, counted::alive);
+}
+
+TEST(ObjectPool, Concurrent)
+{
+    object_pool<std::vector<int>> pool(256, 16);
+    pool.reserve(256);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t)
+        threads.emplace_back([&pool, t]() {
+            std::vector<std::vector<int>*> held;
+            for(int i = 0; i < 20000; ++i) {
+                if(held.size() < 40 && (i % 7) != 3) {
+                    held.push_back(pool.acquire());
+                    held.back()->assign(4, t);
+                } else {
+                    for(int v : *held.back())
+                        ASSERT_EQ(t, v);
+                    pool.release(held.back());
+                    held.pop_back();
+                }
+            }
+            for(auto *p : held)
+                pool.release(p);
+        });
+    for(auto &th : threads)
+        th.join();
+}
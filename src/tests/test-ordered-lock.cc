@@ -27,6 +27,8 @@
  */
 #include <gmock/gmock.h>
 
+#include <thread>
+
 #include "../concurrent-utils/locks.h"
 
 using testing::InSequence;
@@ -228,3 +230,28 @@ TEST(OrderedLock, Swap)
     EXPECT_TRUE(lock2.owns_lock());
     EXPECT_TRUE(!!lock2);
 }
+
+TEST(Spinlock, TryLockUntil)
+{
+    using namespace std::chrono;
+    spinlock lock;
+
+    EXPECT_TRUE(lock.try_lock_for(milliseconds(10)));
+    std::thread([&]() {
+        auto start = steady_clock::now();
+        EXPECT_FALSE(lock.try_lock_for(milliseconds(20)));
+        EXPECT_FALSE(lock.try_lock_until(steady_clock::now() + milliseconds(20)));
+        EXPECT_FALSE(lock.try_lock_until(system_clock::now() + milliseconds(20)));
+        EXPECT_GE(steady_clock::now() - start, milliseconds(60));
+        EXPECT_FALSE(try_lock_until(lock, steady_clock::now()));
+    }).join();
+    lock.unlock();
+
+    EXPECT_TRUE(try_lock_until(lock, steady_clock::now()));
+    lock.unlock();
+
+    // not try-lockable: acquired without a bound
+    testing::StrictMock<mock_mutex> mtx;
+    EXPECT_CALL(mtx, lock()).Times(1);
+    EXPECT_TRUE(try_lock_until(mtx, steady_clock::now()));
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/persistent-queue.h"
+
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace concurrent_utils;
+
+namespace {
+
+// Temporary directory removed with its files
+class temp_dir
+{
+    std::string _path;
+
+    static std::vector<std::string> _list(const std::string &dir)
+    {
+        std::vector<std::string> names;
+        if(DIR *d = ::opendir(dir.c_str())) {
+            while(const dirent *e = ::readdir(d))
+                if(e->d_name[0] != '.')
+                    names.push_back(e->d_name);
+            ::closedir(d);
+        }
+        return names;
+    }
+
+public:
+    temp_dir()
+    {
+        char tmpl[] = "/tmp/persistent-queue-XXXXXX";
+        _path = ::mkdtemp(tmpl);
+    }
+
+    ~temp_dir()
+    {
+        for(auto &name : _list(_path))
+            ::unlink((_path + '/' + name).c_str());
+        ::rmdir(_path.c_str());
+    }
+
+    const std::string &path() const { return _path; }
+
+    std::size_t count(const std::string &ext) const
+    {
+        std::size_t n = 0;
+        for(auto &name : _list(_path))
+            n += name.size() > ext.size()
+                && !name.compare(name.size() - ext.size(), ext.size(), ext);
+        return n;
+    }
+};
+
+std::string pull_string(persistent_queue<> &queue)
+{
+    std::string str;
+    queue.consume([&](const void *data, std::size_t size) {
+        str.assign(static_cast<const char*>(data), size);
+    });
+    return str;
+}
+
+persistent_queue_options small_segments()
+{
+    persistent_queue_options options;
+    options.segment_size = 4096;
+    options.spare_segments = 1;
+    return options;
+}
+
+} // namespace
+
+TEST(PersistentQueue, PushPull)
+{
+    temp_dir dir;
+    persistent_queue<> queue(dir.path());
+    EXPECT_EQ(dir.path(), queue.directory());
+    EXPECT_TRUE(queue.empty());
+
+    queue.push(42);
+    queue.push("abc", 3);
+    queue.push_with(5, [](void *p) { std::memcpy(p, "hello", 5); });
+    EXPECT_FALSE(queue.empty());
+
+    int val = 0;
+    EXPECT_TRUE(queue.pull(val));
+    EXPECT_EQ(42, val);
+
+    // wrong size leaves the record in place
+    EXPECT_THROW(queue.pull(val), std::length_error);
+    EXPECT_EQ("abc", pull_string(queue));
+    EXPECT_EQ("hello", pull_string(queue));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pull(val));
+
+    EXPECT_THROW(queue.push(nullptr, 0), std::length_error);
+}
+
+TEST(PersistentQueue, Recover)
+{
+    temp_dir dir;
+    persistent_queue_options options;
+    options.sync_every = 1;
+    {
+        persistent_queue<> queue(dir.path(), options);
+        for(int i = 0; i < 10; ++i)
+            queue.push(i);
+        int val;
+        for(int i = 0; i < 4; ++i)
+            queue.pull(val);
+    }
+    {
+        persistent_queue<> queue(dir.path(), options);
+        int val;
+        ASSERT_TRUE(queue.pull(val));
+        EXPECT_EQ(4, val);
+        queue.push(10);
+    }
+
+    persistent_queue<> queue(dir.path());
+    int val, expected = 5;
+    while(queue.pull(val))
+        EXPECT_EQ(expected++, val);
+    EXPECT_EQ(11, expected);
+}
+
+TEST(PersistentQueue, TornRecord)
+{
+    temp_dir dir;
+    {
+        persistent_queue<> queue(dir.path(), small_segments());
+        queue.push(std::string(100, 'a').c_str(), 100);
+        queue.push(std::string(100, 'b').c_str(), 100);
+    }
+
+    // damage the second record as if written partially
+    const std::string seg = dir.path() + "/0000000000000001.seg";
+    FILE *f = std::fopen(seg.c_str(), "r+b");
+    ASSERT_NE(nullptr, f);
+    std::fseek(f, 16 + 104 + 16 + 50, SEEK_SET);
+    std::fputc('x', f);
+    std::fclose(f);
+
+    persistent_queue<> queue(dir.path(), small_segments());
+    EXPECT_EQ(std::string(100, 'a'), pull_string(queue));
+    EXPECT_TRUE(queue.empty());
+
+    // new records take the place of the lost one
+    queue.push("c", 1);
+    EXPECT_EQ("c", pull_string(queue));
+}
+
+TEST(PersistentQueue, LostRecordsTail)
+{
+    temp_dir dir;
+    {
+        persistent_queue<> queue(dir.path(), small_segments());
+        queue.push(std::string(100, 'a').c_str(), 100);
+        queue.push(std::string(100, 'b').c_str(), 100);
+        queue.push(std::string(100, 'c').c_str(), 100);
+    }
+
+    // the second record is lost, the third one is intact
+    const std::string seg = dir.path() + "/0000000000000001.seg";
+    FILE *f = std::fopen(seg.c_str(), "r+b");
+    ASSERT_NE(nullptr, f);
+    std::fseek(f, 16 + 104 + 16 + 50, SEEK_SET);
+    std::fputc('x', f);
+    std::fclose(f);
+
+    {
+        persistent_queue<> queue(dir.path(), small_segments());
+        EXPECT_EQ(std::string(100, 'a'), pull_string(queue));
+        queue.push(std::string(100, 'd').c_str(), 100);
+    }
+
+    // records after the lost one do not come back
+    persistent_queue<> queue(dir.path(), small_segments());
+    EXPECT_EQ(std::string(100, 'd'), pull_string(queue));
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(PersistentQueue, SingleOwner)
+{
+    temp_dir dir;
+    {
+        persistent_queue<> queue(dir.path());
+        EXPECT_THROW(persistent_queue<>(dir.path()), std::system_error);
+        queue.push(1);
+    }
+
+    persistent_queue<> queue(dir.path());
+    int val = 0;
+    ASSERT_TRUE(queue.pull(val));
+    EXPECT_EQ(1, val);
+}
+
+TEST(PersistentQueue, Segments)
+{
+    temp_dir dir;
+    persistent_queue<> queue(dir.path(), small_segments());
+    EXPECT_THROW(queue.push(std::string(5000, 'x').c_str(), 5000), std::length_error);
+
+    // each segment holds three records of 1200 bytes
+    const std::string record(1200, 'r');
+    for(int i = 0; i < 10; ++i)
+        queue.push(record.c_str(), record.size());
+    EXPECT_EQ(4u, dir.count(".seg"));
+
+    for(int i = 0; i < 7; ++i)
+        EXPECT_EQ(record, pull_string(queue));
+    EXPECT_EQ(2u, dir.count(".seg"));
+    EXPECT_EQ(1u, dir.count(".spare"));
+
+    // spares become new segments
+    for(int i = 0; i < 5; ++i)
+        queue.push(record.c_str(), record.size());
+    EXPECT_EQ(0u, dir.count(".spare"));
+    EXPECT_EQ(3u, dir.count(".seg"));
+
+    int n = 0;
+    while(!pull_string(queue).empty())
+        ++n;
+    EXPECT_EQ(8, n);
+}
+
+TEST(PersistentQueue, Concurrent)
+{
+    temp_dir dir;
+    persistent_queue<std::mutex> queue(dir.path(), small_segments());
+
+    std::vector<std::thread> producers;
+    for(int t = 0; t < 2; ++t)
+        producers.emplace_back([&queue, t]() {
+            for(int i = 0; i < 5000; ++i)
+                queue.push(t * 5000 + i);
+        });
+
+    std::set<int> items;
+    std::vector<int> last(2, -1);
+    std::thread consumer([&]() {
+        int val;
+        while(items.size() < 10000)
+            if(queue.pull(val)) {
+                // items of a producer come in order
+                EXPECT_LT(last[val / 5000], val);
+                last[val / 5000] = val;
+                items.insert(val);
+            }
+    });
+
+    for(auto &th : producers)
+        th.join();
+    consumer.join();
+    EXPECT_EQ(10000u, items.size());
+    EXPECT_TRUE(queue.empty());
+}
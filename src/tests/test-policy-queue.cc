@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/policy-queue.h"
+
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace concurrent_utils;
+
+static_assert(std::is_same<make_queue<int>,
+    details::locked_queue<int, park_wait, std::allocator<int>>>::value, "");
+static_assert(std::is_same<make_queue<int, consumers::single>,
+    details::mpsc_list_queue<int, park_wait, std::allocator<int>>>::value, "");
+static_assert(std::is_same<make_queue<int, producers::single, consumers::single,
+                                      bounded<1000>, wait::spin>,
+    details::spsc_ring_queue<int, 1000, spin_wait, std::allocator<int>>>::value, "");
+static_assert(std::is_same<make_queue<int, wait::yield, bounded<8>, producers::single>,
+    details::ring_queue<int, 8, false, true, yield_wait<>, std::allocator<int>>>::value, "");
+static_assert(std::is_same<make_queue<int, bounded<8>, unbounded>, make_queue<int>>::value, "");
+static_assert(make_queue<int, bounded<1000>, consumers::single>::capacity() == 1024, "");
+
+template <typename Queue, int Producers, int Consumers>
+struct queue_kind
+{
+    using queue_type = Queue;
+    static constexpr int producers = Producers, consumers = Consumers;
+};
+
+template <typename Kind>
+class PolicyQueue : public ::testing::Test { };
+
+using queue_kinds = ::testing::Types<
+    queue_kind<make_queue<std::string, producers::single, consumers::single, bounded<64>>, 1, 1>,
+    queue_kind<make_queue<std::string, consumers::single, bounded<64>, wait::yield>, 4, 1>,
+    queue_kind<make_queue<std::string, producers::single, bounded<64>, wait::spin_park>, 1, 4>,
+    queue_kind<make_queue<std::string, bounded<64>>, 4, 4>,
+    queue_kind<make_queue<std::string, consumers::single, wait::spin>, 4, 1>,
+    queue_kind<make_queue<std::string>, 4, 4>
+>;
+TYPED_TEST_SUITE(PolicyQueue, queue_kinds);
+
+TYPED_TEST(PolicyQueue, Basic)
+{
+    typename TypeParam::queue_type queue;
+    std::string val;
+
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pull(val));
+    EXPECT_FALSE(queue.try_pull());
+
+    EXPECT_TRUE(queue.push("first"));
+    EXPECT_TRUE(queue.try_push(3u, 'x'));
+    EXPECT_FALSE(queue.empty());
+
+    EXPECT_TRUE(queue.pull(val));
+    EXPECT_EQ("first", val);
+    EXPECT_EQ("xxx", queue.wait_pull().value());
+    EXPECT_TRUE(queue.empty());
+
+    EXPECT_TRUE(queue.push("left"));
+    queue.close();
+    EXPECT_TRUE(queue.closed());
+    EXPECT_FALSE(queue.push("late"));
+    EXPECT_TRUE(queue.wait_pull(val));
+    EXPECT_EQ("left", val);
+    EXPECT_FALSE(queue.wait_pull(val));
+}
+
+TYPED_TEST(PolicyQueue, Full)
+{
+    typename TypeParam::queue_type queue;
+    if(!queue.bounded)
+        return;
+
+    for(std::size_t i = 0; i < queue.capacity(); ++i)
+        ASSERT_TRUE(queue.try_push(std::to_string(i)));
+    EXPECT_FALSE(queue.try_push("over"));
+
+    std::thread producer([&]() { EXPECT_TRUE(queue.push("waited")); });
+    std::string val;
+    EXPECT_TRUE(queue.wait_pull(val));
+    EXPECT_EQ("0", val);
+    producer.join();
+
+    for(std::size_t i = 1; i < queue.capacity(); ++i)
+        ASSERT_TRUE(queue.pull(val));
+    EXPECT_TRUE(queue.pull(val));
+    EXPECT_EQ("waited", val);
+}
+
+TYPED_TEST(PolicyQueue, Threads)
+{
+    constexpr int producers = TypeParam::producers;
+    constexpr int consumers = TypeParam::consumers;
+    constexpr int count = 20000;
+
+    typename TypeParam::queue_type queue;
+    std::vector<std::vector<int>> last(consumers, std::vector<int>(producers, -1));
+    std::atomic<int> received { 0 }, unordered { 0 };
+
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+        threads.emplace_back([&, p]() {
+            for(int i = 0; i < count; ++i)
+                ASSERT_TRUE(queue.push(std::to_string(p) + ':' + std::to_string(i)));
+        });
+    for(int c = 0; c < consumers; ++c)
+        threads.emplace_back([&, c]() {
+            std::string val;
+            while(queue.wait_pull(val)) {
+                const std::size_t colon = val.find(':');
+                const int p = std::stoi(val.substr(0, colon));
+                const int i = std::stoi(val.substr(colon + 1));
+                // items of a producer come in order to each consumer
+                if(i <= last[c][p])
+                    ++unordered;
+                last[c][p] = i;
+                ++received;
+            }
+        });
+
+    for(int p = 0; p < producers; ++p)
+        threads[p].join();
+    queue.close();
+    for(int c = 0; c < consumers; ++c)
+        threads[producers + c].join();
+
+    EXPECT_EQ(producers * count, received);
+    EXPECT_EQ(0, unordered);
+}
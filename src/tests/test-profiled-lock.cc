@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/concurrent-queue.h"
+#include "../concurrent-utils/profiled-lock.h"
+#include "mock-types.h"
+
+#include <future>
+
+using namespace concurrent_utils;
+
+TEST(ProfiledLock, LockUnlock)
+{
+    profiled_lock<std::mutex> lock;
+
+    lock_profile p = lock.profile();
+    EXPECT_EQ(0u, p.acquisitions);
+    EXPECT_EQ(0u, p.contended);
+
+    lock.lock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    lock.unlock();
+
+    ASSERT_TRUE(lock.try_lock());
+    lock.unlock();
+
+    p = lock.profile();
+    EXPECT_EQ(2u, p.acquisitions);
+    EXPECT_EQ(0u, p.contended);
+    EXPECT_LE(std::chrono::milliseconds(5), p.hold_time);
+    EXPECT_LE(std::chrono::milliseconds(5), p.max_hold_time);
+
+    std::uint64_t waits = 0, holds = 0;
+    for(std::size_t i = 0; i < p.wait_histogram.size(); ++i) {
+        waits += p.wait_histogram[i];
+        holds += p.hold_histogram[i];
+    }
+    EXPECT_EQ(2u, waits);
+    EXPECT_EQ(2u, holds);
+
+    // 5ms is between 2^22 and 2^23 nanoseconds
+    EXPECT_EQ(1u, p.hold_histogram[22]);
+
+    lock.reset();
+    EXPECT_EQ(0u, lock.profile().acquisitions);
+}
+
+TEST(ProfiledLock, Contended)
+{
+    profiled_lock<spinlock> lock;
+    lock.lock();
+
+    auto future = std::async(std::launch::async, [&]() {
+        lock.lock();
+        lock.unlock();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    lock.unlock();
+    future.get();
+
+    const lock_profile p = lock.profile();
+    EXPECT_EQ(2u, p.acquisitions);
+    EXPECT_EQ(1u, p.contended);
+    EXPECT_LE(std::chrono::milliseconds(5), p.max_wait_time);
+
+    // Locks without try_lock() never report contention
+    profiled_lock<dummy_mutex> dummy;
+    dummy.lock();
+    EXPECT_TRUE(dummy.underlying_lock().locked);
+    dummy.unlock();
+    EXPECT_EQ(1u, dummy.profile().acquisitions);
+    EXPECT_EQ(0u, dummy.profile().contended);
+}
+
+TEST(ProfiledLock, InQueue)
+{
+    concurrent_queue<std::size_t, profiled_lock<std::mutex>> queue;
+
+    std::size_t res = 0;
+    ASSERT_TRUE(queue.push(1));
+    ASSERT_TRUE(queue.pull(res));
+    EXPECT_EQ(1u, res);
+
+    EXPECT_EQ(2u, queue.underlying_lock().profile().acquisitions);
+}
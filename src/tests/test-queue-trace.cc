@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/concurrent-queue.h"
+#include "../concurrent-utils/queue-trace.h"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace concurrent_utils;
+
+namespace {
+
+using traced_string_queue = traced_queue<concurrent_queue<std::string, std::mutex>>;
+
+std::string temp_path()
+{
+    return "/tmp/test-queue-trace-" + std::to_string(::getpid()) + ".trace";
+}
+
+} // namespace
+
+TEST(QueueTrace, OffByDefault)
+{
+    trace_recorder recorder;
+    traced_string_queue queue;
+    queue.trace(&recorder);
+
+    EXPECT_FALSE(recorder.recording());
+    EXPECT_TRUE(queue.push("untraced"));
+    EXPECT_TRUE(queue.try_pull());
+    EXPECT_TRUE(recorder.events().empty());
+
+    recorder.start();
+    EXPECT_TRUE(queue.push(5u, 'x'));
+    recorder.stop();
+    EXPECT_TRUE(queue.wait_pull());
+
+    const auto events = recorder.events();
+    ASSERT_EQ(1u, events.size());
+    EXPECT_EQ(trace_op::push, events[0].op);
+    EXPECT_EQ(5u, events[0].size);
+    EXPECT_EQ(0u, events[0].thread);
+}
+
+TEST(QueueTrace, Threads)
+{
+    constexpr int producers = 3, count = 10000;
+    trace_recorder recorder;
+    traced_string_queue queue;
+    queue.trace(&recorder);
+    recorder.start();
+
+    std::vector<std::thread> threads;
+    for(int p = 0; p < producers; ++p)
+        threads.emplace_back([&, p]() {
+            for(int i = 0; i < count; ++i)
+                queue.push(std::size_t(p + 1), 'x');
+        });
+    threads.emplace_back([&]() {
+        std::string item;
+        for(int i = 0; i < producers * count; ++i)
+            EXPECT_TRUE(queue.wait_pull(item));
+        EXPECT_FALSE(queue.pull(item));
+    });
+    for(auto &t : threads)
+        t.join();
+
+    EXPECT_EQ(std::size_t(producers + 1), recorder.threads());
+    const auto events = recorder.events();
+    ASSERT_EQ(std::size_t(2 * producers * count), events.size());
+
+    std::vector<std::size_t> pushes(producers + 1, 0), pulls(producers + 1, 0);
+    for(std::size_t i = 0; i < events.size(); ++i) {
+        if(i) {
+            EXPECT_LE(events[i - 1].time_ns, events[i].time_ns);
+        }
+        ASSERT_LE(events[i].thread, producers);
+        auto &counter = events[i].op == trace_op::push ? pushes : pulls;
+        ++counter[events[i].thread];
+    }
+
+    // every thread either pushed or pulled all of its items
+    std::sort(pushes.begin(), pushes.end());
+    std::sort(pulls.begin(), pulls.end());
+    EXPECT_EQ(std::vector<std::size_t>({ 0, count, count, count }), pushes);
+    EXPECT_EQ(std::vector<std::size_t>({ 0, 0, 0, producers * count }), pulls);
+}
+
+TEST(QueueTrace, ReusedRecords)
+{
+    trace_recorder recorder;
+    recorder.start();
+
+    // the second thread takes over the record of the first one
+    for(int i = 0; i < 2; ++i)
+        std::thread([&]() { recorder.record(trace_op::push, 1); }).join();
+    recorder.record(trace_op::pull, 1);
+
+    EXPECT_EQ(3u, recorder.threads());
+    const auto events = recorder.events();
+    ASSERT_EQ(3u, events.size());
+    EXPECT_EQ(0u, events[0].thread);
+    EXPECT_EQ(1u, events[1].thread);
+    EXPECT_EQ(2u, events[2].thread);
+    EXPECT_EQ(0u, recorder.dropped());
+}
+
+TEST(QueueTrace, SaveLoad)
+{
+    trace_recorder recorder;
+    recorder.start();
+    recorder.record(trace_op::push, 100);
+    recorder.record(trace_op::pull, 100);
+    recorder.record(trace_op::push, std::size_t(1) << 40);
+
+    const std::string path = temp_path();
+    recorder.save(path);
+    const auto loaded = trace_recorder::load(path);
+    const auto events = recorder.events();
+    ASSERT_EQ(3u, loaded.size());
+    for(std::size_t i = 0; i < loaded.size(); ++i) {
+        EXPECT_EQ(events[i].time_ns, loaded[i].time_ns);
+        EXPECT_EQ(events[i].size, loaded[i].size);
+        EXPECT_EQ(events[i].op, loaded[i].op);
+    }
+    EXPECT_EQ(UINT32_MAX, loaded[2].size);
+
+    // the number of events must match the size of the file
+    std::FILE *f = std::fopen(path.c_str(), "r+b");
+    const std::uint64_t huge = UINT64_MAX / sizeof(trace_event);
+    std::fseek(f, 16, SEEK_SET);
+    std::fwrite(&huge, sizeof(huge), 1, f);
+    std::fclose(f);
+    EXPECT_THROW(trace_recorder::load(path), std::runtime_error);
+
+    f = std::fopen(path.c_str(), "wb");
+    std::fputs("not a trace", f);
+    std::fclose(f);
+    EXPECT_THROW(trace_recorder::load(path), std::runtime_error);
+    std::remove(path.c_str());
+    EXPECT_THROW(trace_recorder::load(path), std::system_error);
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/reclamation.h"
+
+#include <thread>
+#include <vector>
+
+using namespace concurrent_utils;
+
+namespace {
+
+std::atomic<int> alive_nodes { 0 };
+
+struct counted_node : reclaimable
+{
+    std::size_t value;
+    std::atomic<counted_node*> next { nullptr };
+
+    explicit counted_node(std::size_t v = 0) : value(v) { ++alive_nodes; }
+    ~counted_node() { --alive_nodes; }
+};
+
+// Treiber stack over a reclamation domain, used by the stress tests
+template <typename Domain, typename Guard>
+struct stack
+{
+    Domain &domain;
+    std::atomic<counted_node*> head { nullptr };
+
+    void push(std::size_t v)
+    {
+        auto *n = new counted_node(v);
+        counted_node *top = head.load(std::memory_order_relaxed);
+        do n->next.store(top, std::memory_order_relaxed);
+        while(!head.compare_exchange_weak(top, n, std::memory_order_release,
+                                          std::memory_order_relaxed));
+    }
+
+    bool pop(std::size_t &v);
+
+    ~stack() { std::size_t v; while(pop(v)); }
+};
+
+template <>
+bool stack<hazard_domain<>, hazard_pointer<hazard_domain<>>>::pop(std::size_t &v)
+{
+    hazard_pointer<hazard_domain<>> hp(domain);
+    counted_node *top = hp.protect(head);
+    while(top) {
+        counted_node *next = top->next.load(std::memory_order_relaxed);
+        if(head.compare_exchange_weak(top, next, std::memory_order_acquire,
+                                      std::memory_order_relaxed)) {
+            v = top->value;
+            hp.reset();
+            domain.retire(top);
+            return true;
+        }
+        top = hp.protect(head);
+    }
+    return false;
+}
+
+template <>
+bool stack<epoch_domain<>, epoch_guard<epoch_domain<>>>::pop(std::size_t &v)
+{
+    epoch_guard<epoch_domain<>> guard(domain);
+    counted_node *top = head.load(std::memory_order_acquire);
+    while(top) {
+        counted_node *next = top->next.load(std::memory_order_relaxed);
+        if(head.compare_exchange_weak(top, next, std::memory_order_acquire,
+                                      std::memory_order_acquire)) {
+            v = top->value;
+            domain.retire(top);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Domain, typename Guard>
+void stress(Domain &domain)
+{
+    const std::size_t threads = 4, per_thread = 20000;
+    std::atomic<std::size_t> sum { 0 };
+    {
+        stack<Domain, Guard> s { domain };
+        std::vector<std::thread> workers;
+        for(std::size_t t = 0; t < threads; ++t)
+            workers.emplace_back([&, t]() {
+                std::size_t v, local = 0;
+                for(std::size_t i = 1; i <= per_thread; ++i) {
+                    s.push(t * per_thread + i);
+                    if(s.pop(v)) local += v;
+                }
+                sum += local;
+            });
+        for(auto &w : workers)
+            w.join();
+        std::size_t v;
+        while(s.pop(v)) sum += v;
+    }
+
+    const std::size_t n = threads * per_thread;
+    EXPECT_EQ(n * (n + 1) / 2, sum.load());
+}
+
+} // anonymous namespace
+
+TEST(HazardPointers, ProtectedIsNotReclaimed)
+{
+    {
+        hazard_domain<> domain(1);
+        std::atomic<counted_node*> shared { new counted_node(1) };
+
+        hazard_pointer<hazard_domain<>> hp(domain);
+        counted_node *p = hp.protect(shared);
+        EXPECT_EQ(1u, p->value);
+
+        shared.store(new counted_node(2));
+        std::thread([&]() {
+            domain.retire(p);
+            EXPECT_EQ(0u, domain.reclaim());
+        }).join();
+        EXPECT_EQ(2, alive_nodes.load());
+
+        // the list of the exited thread is adopted
+        hp.reset();
+        EXPECT_EQ(1u, domain.reclaim());
+        EXPECT_EQ(1, alive_nodes.load());
+
+        domain.retire(shared.exchange(nullptr));
+        EXPECT_EQ(1u, domain.reclaim());
+        EXPECT_EQ(0, alive_nodes.load());
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(HazardPointers, Slots)
+{
+    hazard_domain<2> domain;
+    std::atomic<counted_node*> shared { nullptr };
+    {
+        hazard_pointer<hazard_domain<2>> hp1(domain), hp2(domain);
+        EXPECT_THROW(hazard_pointer<hazard_domain<2>> hp3(domain), std::length_error);
+        EXPECT_EQ(nullptr, hp1.protect(shared));
+    }
+    hazard_pointer<hazard_domain<2>> hp1(domain), hp2(domain);
+}
+
+TEST(HazardPointers, DomainReclaimsAll)
+{
+    {
+        hazard_domain<> domain(1000);
+        for(int i = 0; i < 100; ++i)
+            domain.retire(new counted_node);
+        std::thread([&]() { domain.retire(new counted_node); }).join();
+        EXPECT_EQ(101, alive_nodes.load());
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(HazardPointers, Stress)
+{
+    {
+        hazard_domain<> domain;
+        stress<hazard_domain<>, hazard_pointer<hazard_domain<>>>(domain);
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(EpochReclamation, GuardedIsNotReclaimed)
+{
+    {
+        epoch_domain<> domain(1);
+        auto *node = new counted_node;
+
+        std::atomic<bool> entered { false }, leave { false };
+        std::thread reader([&]() {
+            epoch_guard<epoch_domain<>> guard(domain);
+            entered = true;
+            while(!leave) std::this_thread::yield();
+        });
+        while(!entered) std::this_thread::yield();
+
+        domain.retire(node);
+        for(int i = 0; i < 10; ++i)
+            EXPECT_EQ(0u, domain.reclaim());
+        EXPECT_EQ(1, alive_nodes.load());
+
+        leave = true;
+        reader.join();
+        std::size_t reclaimed = 0;
+        for(int i = 0; i < 3; ++i)
+            reclaimed += domain.reclaim();
+        EXPECT_EQ(1u, reclaimed);
+        EXPECT_EQ(0, alive_nodes.load());
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(EpochReclamation, NestedGuards)
+{
+    epoch_domain<> domain(1000);
+    const auto epoch = domain.epoch();
+    {
+        epoch_guard<epoch_domain<>> outer(domain);
+        {
+            epoch_guard<epoch_domain<>> inner(domain);
+        }
+        domain.retire(new counted_node);
+        domain.reclaim();
+        domain.reclaim();
+        // the outer section still holds the epoch
+        EXPECT_EQ(epoch + 1, domain.epoch());
+        EXPECT_EQ(1, alive_nodes.load());
+    }
+    domain.reclaim();
+    domain.reclaim();
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(EpochReclamation, AllocatorDelete)
+{
+    using alloc_type = std::allocator<counted_node>;
+    using traits = std::allocator_traits<alloc_type>;
+    {
+        epoch_domain<> domain(1000);
+        alloc_type alloc;
+        counted_node *p = traits::allocate(alloc, 1);
+        traits::construct(alloc, p, 7);
+        domain.retire(p, allocator_delete<alloc_type>());
+        EXPECT_EQ(1, alive_nodes.load());
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
+
+TEST(EpochReclamation, Stress)
+{
+    {
+        epoch_domain<> domain;
+        stress<epoch_domain<>, epoch_guard<epoch_domain<>>>(domain);
+    }
+    EXPECT_EQ(0, alive_nodes.load());
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/shm-queue.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace concurrent_utils;
+
+namespace {
+
+// Unique name of a shared memory object, removed at the end
+struct shm_name
+{
+    std::string name;
+
+    explicit shm_name(const char *test)
+        : name(std::string("/concurrent-utils-") + test + '-' + std::to_string(::getpid()))
+    { shm_queue<int>::unlink(name); }
+
+    ~shm_name() { shm_queue<int>::unlink(name); }
+};
+
+} // namespace
+
+TEST(ShmQueue, PushPull)
+{
+    shm_name shm("push-pull");
+    shm_queue<int, shm_mode::spsc> queue(shm.name, 4);
+    EXPECT_EQ(shm.name, queue.name());
+    EXPECT_EQ(4u, queue.capacity());
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.closed());
+
+    int val;
+    EXPECT_FALSE(queue.pull(val));
+    for(int i = 0; i < 4; ++i)
+        EXPECT_TRUE(queue.push(i));
+    EXPECT_FALSE(queue.try_push(4));
+    EXPECT_EQ(4u, queue.size());
+
+    // another mapping of the same queue
+    shm_queue<int, shm_mode::spsc> other(shm.name);
+    EXPECT_TRUE(other.pull(val));
+    EXPECT_EQ(0, val);
+    EXPECT_TRUE(queue.try_push(4));
+
+    EXPECT_THROW((shm_queue<int, shm_mode::mpmc>(shm.name)), std::invalid_argument);
+    EXPECT_THROW((shm_queue<long, shm_mode::spsc>(shm.name)), std::invalid_argument);
+
+    queue.close();
+    EXPECT_TRUE(other.closed());
+    EXPECT_FALSE(queue.push(5));
+    for(int i = 1; i < 5; ++i) {
+        EXPECT_TRUE(other.wait_pull(val));
+        EXPECT_EQ(i, val);
+    }
+    EXPECT_FALSE(other.wait_pull(val));
+}
+
+TEST(ShmQueue, WaitPull)
+{
+    shm_name shm("wait-pull");
+    shm_queue<int> queue(shm.name, 16);
+
+    int val;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.wait_pull(std::chrono::milliseconds(20), val));
+    EXPECT_LE(std::chrono::milliseconds(20), std::chrono::steady_clock::now() - start);
+
+    std::thread producer([&shm]() {
+        shm_queue<int> q(shm.name);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        q.push(42);
+    });
+    EXPECT_TRUE(queue.wait_pull(std::chrono::seconds(5), val));
+    EXPECT_EQ(42, val);
+    producer.join();
+
+    // the only producer has unregistered
+    EXPECT_FALSE(queue.wait_pull(val));
+}
+
+TEST(ShmQueue, Mpmc)
+{
+    shm_name shm("mpmc");
+    shm_queue<long> queue(shm.name, 64);
+
+    std::atomic<long> sum { 0 };
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 2; ++t)
+        threads.emplace_back([&shm]() {
+            shm_queue<long> q(shm.name);
+            for(long i = 1; i <= 10000; ++i)
+                ASSERT_TRUE(q.push(i));
+        });
+    for(int t = 0; t < 2; ++t)
+        threads.emplace_back([&shm, &sum]() {
+            shm_queue<long> q(shm.name);
+            long val;
+            for(int i = 0; i < 10000; ++i) {
+                ASSERT_TRUE(q.wait_pull(val));
+                sum += val;
+            }
+        });
+    for(auto &th : threads)
+        th.join();
+    EXPECT_EQ(2 * 10000L * 10001 / 2, sum);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(ShmQueue, Processes)
+{
+    shm_name shm("processes");
+    shm_queue<int, shm_mode::spsc> queue(shm.name, 128);
+
+    const pid_t child = ::fork();
+    ASSERT_LE(0, child);
+    if(!child) {
+        shm_queue<int, shm_mode::spsc> q(shm.name);
+        for(int i = 0; i < 100000; ++i)
+            q.push(i);
+        ::_exit(0);  // exits without unregistering
+    }
+
+    int val, expected = 0;
+    while(queue.wait_pull(val))
+        ASSERT_EQ(expected++, val);
+    EXPECT_EQ(100000, expected);
+    ::waitpid(child, nullptr, 0);
+}
+
+TEST(ShmQueue, DeadOwner)
+{
+    shm_name shm("dead-owner");
+    shm_queue<int> queue(shm.name, 8);
+
+    const pid_t child = ::fork();
+    ASSERT_LE(0, child);
+    if(!child) {
+        shm_queue<int> q(shm.name);
+        int val;
+        for(;;) {
+            q.try_push(1);
+            q.pull(val);
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ::kill(child, SIGKILL);
+    ::waitpid(child, nullptr, 0);
+
+    // the mutex might have been held by the child
+    int val;
+    while(queue.pull(val))
+        EXPECT_EQ(1, val);
+    for(int i = 0; i < 8; ++i)
+        EXPECT_TRUE(queue.try_push(i));
+    EXPECT_FALSE(queue.try_push(8));
+    for(int i = 0; i < 8; ++i) {
+        EXPECT_TRUE(queue.pull(val));
+        EXPECT_EQ(i, val);
+    }
+}
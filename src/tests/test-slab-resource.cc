@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2014-2015 Max Plutonium <plutonium.max@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE ABOVE LISTED COPYRIGHT HOLDER(S) BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name(s) of the above copyright
+ * holders shall not be used in advertising or otherwise to promote the
+ * sale, use or other dealings in this Software without prior written
+ * authorization.
+ */
+#include <gtest/gtest.h>
+
+#include "../concurrent-utils/slab-resource.h"
+#include "../concurrent-utils/concurrent-queue.h"
+
+#include <future>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace concurrent_utils;
+
+template <typename Tp>
+using pmr_queue = concurrent_queue<Tp, spinlock, std::pmr::polymorphic_allocator<Tp>>;
+
+TEST(SlabResource, Allocate)
+{
+    slab_resource slabs;
+    EXPECT_EQ(std::pmr::get_default_resource(), slabs.upstream_resource());
+    EXPECT_EQ(0u, slabs.slabs());
+
+    void *p1 = slabs.allocate(10, 1);
+    void *p2 = slabs.allocate(16, 16);
+    void *p3 = slabs.allocate(40, 64);
+    EXPECT_NE(p1, p2);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p2) % 16);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(p3) % 64);
+    EXPECT_EQ(2u, slabs.slabs());
+    EXPECT_LE(slabs.huge_slabs(), slabs.slabs());
+
+    // freed blocks are reused first
+    slabs.deallocate(p1, 10, 1);
+    EXPECT_EQ(p1, slabs.allocate(12, 4));
+
+    // too big or overaligned for slabs
+    void *big = slabs.allocate(4096, 8);
+    void *aligned = slabs.allocate(8, 4096);
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(aligned) % 4096);
+    EXPECT_EQ(2u, slabs.slabs());
+    slabs.deallocate(big, 4096, 8);
+    slabs.deallocate(aligned, 8, 4096);
+
+    EXPECT_TRUE(slabs.is_equal(slabs));
+    slab_resource other(false);
+    EXPECT_FALSE(slabs.is_equal(other));
+
+    slabs.deallocate(p1, 12, 4);
+    slabs.deallocate(p2, 16, 16);
+    slabs.deallocate(p3, 40, 64);
+    EXPECT_EQ(2u, slabs.slabs());
+}
+
+TEST(SlabResource, ReturnSlabs)
+{
+    slab_resource slabs(false);
+    EXPECT_EQ(0u, slabs.huge_slabs());
+
+    const std::size_t per_slab = slab_resource::slab_size / 64;
+    std::vector<void*> blocks;
+    for(std::size_t i = 0; i < 3 * per_slab; ++i)
+        blocks.push_back(slabs.allocate(64, 8));
+    EXPECT_EQ(4u, slabs.slabs());
+
+    std::set<void*> unique(blocks.begin(), blocks.end());
+    EXPECT_EQ(blocks.size(), unique.size());
+
+    // empty slabs go back to the OS, except the last one
+    for(void *p : blocks)
+        slabs.deallocate(p, 64, 8);
+    EXPECT_EQ(1u, slabs.slabs());
+}
+
+TEST(SlabResource, Queue)
+{
+    slab_resource slabs;
+    pmr_queue<std::string> queue(&slabs);
+
+    auto producer = [&](int from) {
+        for(int i = from; i < from + 10000; ++i)
+            queue.push(std::to_string(i));
+    };
+    auto f1 = std::async(std::launch::async, producer, 0);
+    auto f2 = std::async(std::launch::async, producer, 10000);
+    f1.get();
+    f2.get();
+
+    EXPECT_EQ(1u, slabs.slabs());
+    std::set<std::string> items;
+    std::string str;
+    while(queue.pull(str))
+        items.insert(str);
+    EXPECT_EQ(20000u, items.size());
+    EXPECT_EQ(1u, slabs.slabs());
+}